@@ -27,6 +27,7 @@ void Talis5Memory::begin(String name)
         preferences.putBool("rst_flg", false);
     }
     _isActive = true;
+    _version++;
     printDefault();
     printUser();
     writeShadow();
@@ -171,6 +172,7 @@ void Talis5Memory::save()
         }
         preferences.end();
         resetWriteFlag();
+        _version++;
     }
 }
 
@@ -248,6 +250,7 @@ void Talis5Memory::clear()
         preferences.clear();
         preferences.end();
         _isActive = false;
+        _version++;
     }
 }
 
@@ -385,6 +388,17 @@ void Talis5Memory::printUser()
     preferences.end();
 }
 
+/**
+ * get version of the saved parameter, it changes every time the parameter in preference memory is written, reverted or
+ * cleared. Start from 1 after begin, not kept across restart
+ * 
+ * @return  version of the parameter
+*/
+uint32_t Talis5Memory::getVersion()
+{
+    return _version;
+}
+
 Talis5Memory::~Talis5Memory()
 {
 }
\ No newline at end of file
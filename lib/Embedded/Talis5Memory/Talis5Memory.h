@@ -32,6 +32,7 @@ private:
     bool _isIpSet = false;
     bool _isPortSet = false;
     bool _isSlaveSet = false;
+    uint32_t _version = 0;
     void copy();
     void createDefault();
     void writeShadow();
@@ -57,6 +58,7 @@ public:
     size_t setSlave(const uint8_t* value, size_t len);
     size_t getSlaveSize();
     size_t getSlave(uint8_t *buffer, size_t len);
+    uint32_t getVersion();
 
     ~Talis5Memory();
 };
@@ -1,8 +1,21 @@
 #include "TianBMS.h"
+#include "TianBMSRegister.h"
+
+static_assert(TianBMSRegister::GROUP_COUNT <= TianBMSChangeLog::GROUP_LIMIT, "register group exceed the change log group mask");
 
 TianBMS::TianBMS(TianBMSUtils::Endianess endianess)
 {
     _endianess = endianess;
+    _version.store(0);
+    for (size_t i = 0; i < _groupVersion.size(); i++)
+    {
+        _groupVersion[i].store(0);
+    }
+    for (size_t i = 0; i < _dataTimestamp.size(); i++)
+    {
+        _dataTimestamp[i].store(0);
+        _identityTimestamp[i].store(0);
+    }
     esp_log_level_set(_TAG, ESP_LOG_INFO);
 }
 
@@ -16,94 +29,206 @@ TianBMS::TianBMS(TianBMSUtils::Endianess endianess)
 */
 bool TianBMS::update(uint8_t id, uint32_t token, uint16_t* data, size_t dataSize)
 {
-    TokenInfo tokenInfo = parseToken(token);
-    uint8_t requestType = tokenInfo.requestType;
-    switch (requestType)
+    if (data == nullptr)
     {
-    case TianBMSUtils::RequestType::REQUEST_DATA :
-        /* code */
-        _bmsData[id].id = id;
-        if (updateData(id, data, dataSize))
+        return false;
+    }
+    TianBMSRegisterSource source(data, dataSize);
+    return updateFrom(id, token, source, millis());
+}
+
+/**
+ * Update the bms data, pcb barcode, sn1 code, or sn2 code straight from the modbus response payload (the register
+ * bytes after the byte count field, big endian). The length is checked once, then every field is decoded directly
+ * into the record without intermediate copy
+ * 
+ * @param[in]   id  the id of the slave
+ * @param[in]   token   token of the message, also act as identifier
+ * @param[in]   payload pointer to the register bytes
+ * @param[in]   payloadSize the length of the payload in bytes, must be even
+ * @param[in]   timestamp   millis() when the response was received
+ * @return      true if update, false if nothing is updated
+*/
+bool TianBMS::updateFromPayload(uint8_t id, uint32_t token, const uint8_t* payload, size_t payloadSize, uint32_t timestamp)
+{
+    TianBMSBlockPayload block;
+    block.token = token;
+    block.payload = payload;
+    block.payloadSize = payloadSize;
+    block.timestamp = timestamp;
+    return updateFromBlocks(id, &block, 1);
+}
+
+/**
+ * Update the record of the slave from the response of several register block read in the same poll. Every block is
+ * decoded inside one write section and published as one change, so reader never sees the record with only part of
+ * the blocks applied
+ * 
+ * @param[in]   id  the id of the slave
+ * @param[in]   blocks  response payload of each block, refer to TianBMSBlockPayload
+ * @param[in]   count   number of block
+ * @return      true if update, false if nothing is updated
+*/
+bool TianBMS::updateFromBlocks(uint8_t id, const TianBMSBlockPayload* blocks, size_t count)
+{
+    if (blocks == nullptr || count == 0)
+    {
+        return false;
+    }
+    bool isPresent = _bmsData.contains(id);
+    TianBMSData* record = _bmsData.beginWrite(id);
+    if (record == nullptr)
+    {
+        return false;
+    }
+    // new slave is reported with every group, its record has just been created
+    uint8_t changedGroups = isPresent ? 0 : TianBMSChangeLog::GROUP_ALL;
+    bool isUpdated = false;
+    bool isFresh = false;
+    bool isIdentity = false;
+    uint32_t timestamp = 0;
+    uint32_t identityTimestamp = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const TianBMSBlockPayload& block = blocks[i];
+        if (block.payload == nullptr || (block.payloadSize % 2) != 0)
         {
-            _bmsData[id].msgCount++;
-            return true;
+            continue;
         }
-        break;
-    case TianBMSUtils::RequestType::REQUEST_PCB_CODE :
-        _bmsData[id].id = id;
-        if (_endianess == TianBMSUtils::Endianess::ENDIAN_LITTLE)
+        TokenInfo tokenInfo = parseToken(block.token);
+        TianBMSPayloadSource source(block.payload, block.payloadSize / 2);
+        if (!updateRecord(record, tokenInfo, source, &changedGroups))
         {
-            if (updatePcbBarcode(id, data, dataSize, true))
-            {
-                _bmsData[id].msgCount++;
-                return true;
-            }
+            continue;
         }
-        else
+        isUpdated = true;
+        // only the fast block makes the data fresh, slow block is read far less often
+        if (tokenInfo.requestType == TianBMSUtils::RequestType::REQUEST_DATA && tokenInfo.block == 0)
         {
-            if (updatePcbBarcode(id, data, dataSize))
-            {
-                _bmsData[id].msgCount++;
-                return true;
-            }
+            isFresh = true;
+            timestamp = block.timestamp;
         }
-        break;
-    case TianBMSUtils::RequestType::REQUEST_SN1_CODE :
-        _bmsData[id].id = id;
-        if (_endianess == TianBMSUtils::Endianess::ENDIAN_LITTLE)
+        else if (tokenInfo.requestType != TianBMSUtils::RequestType::REQUEST_DATA &&
+            tokenInfo.requestType != TianBMSUtils::RequestType::REQUEST_SCAN)
         {
-            if (updateSnCode1(id, data, dataSize, true))
-            {
-                _bmsData[id].msgCount++;
-                return true;
-            }
+            isIdentity = true;
+            identityTimestamp = block.timestamp;
         }
-        else
+    }
+    _bmsData.endWrite(id);
+    if (isFresh)
+    {
+        _dataTimestamp[id].store(timestamp);
+    }
+    if (isIdentity)
+    {
+        _identityTimestamp[id].store(identityTimestamp | 0x01);
+    }
+    if (isUpdated || !isPresent)
+    {
+        commitChange(id, changedGroups);
+    }
+    return isUpdated;
+}
+
+/**
+ * Open the write section of the slave record and decode the incoming registers into it
+ * 
+ * @param[in]   id  the id of the slave
+ * @param[in]   token   token of the message, also act as identifier
+ * @param[in]   source  register source
+ * @param[in]   timestamp   millis() when the registers were read, kept as the data timestamp of the slave
+ * @return      true if update, false if nothing is updated
+*/
+template <typename Source>
+bool TianBMS::updateFrom(uint8_t id, uint32_t token, const Source& source, uint32_t timestamp)
+{
+    TokenInfo tokenInfo = parseToken(token);
+    bool isPresent = _bmsData.contains(id);
+    TianBMSData* record = _bmsData.beginWrite(id);
+    if (record == nullptr)
+    {
+        return false;
+    }
+    // new slave is reported with every group, its record has just been created
+    uint8_t changedGroups = isPresent ? 0 : TianBMSChangeLog::GROUP_ALL;
+    bool isUpdated = updateRecord(record, tokenInfo, source, &changedGroups);
+    _bmsData.endWrite(id);
+    // only the fast block makes the data fresh, slow block is read far less often
+    if (isUpdated && tokenInfo.requestType == TianBMSUtils::RequestType::REQUEST_DATA && tokenInfo.block == 0)
+    {
+        _dataTimestamp[id].store(timestamp);
+    }
+    if (isUpdated || !isPresent)
+    {
+        commitChange(id, changedGroups);
+    }
+    return isUpdated;
+}
+
+/**
+ * Publish new data version. The change is written into the change log and the group version before the version
+ * itself, so reader seeing the new version always find the change. Update without changed value (only msg_count
+ * moved) still change the version, but is not logged
+ * 
+ * @param[in]   id  the id of the slave
+ * @param[in]   groupMask   changed group of the record, refer to TianBMSChange
+*/
+void TianBMS::commitChange(uint8_t id, uint8_t groupMask)
+{
+    uint32_t version = _version.load() + 1;
+    if (groupMask != 0)
+    {
+        for (uint8_t group = 0; group < TianBMSChangeLog::GROUP_LIMIT; group++)
         {
-            if (updateSnCode1(id, data, dataSize))
+            if ((groupMask >> group) & 0x01)
             {
-                _bmsData[id].msgCount++;
-                return true;
+                _groupVersion[id * TianBMSChangeLog::GROUP_LIMIT + group].store(version);
             }
         }
-        
-        break;
+        _changeLog.append(version, id, groupMask);
+    }
+    _version.store(version);
+}
+
+/**
+ * Decode the incoming registers into the record based on request type, called inside the write section of the record
+ * 
+ * @param[in]   record  record of the slave
+ * @param[in]   tokenInfo   request type and register offset of the message
+ * @param[in]   source  register source
+ * @param[out]  changedGroups   bit of the group whose value changed is set, refer to TianBMSRegister::Group
+ * @return      true if update, false if nothing is updated
+*/
+template <typename Source>
+bool TianBMS::updateRecord(TianBMSData* record, const TokenInfo& tokenInfo, const Source& source, uint8_t* changedGroups)
+{
+    bool swap = (_endianess == TianBMSUtils::Endianess::ENDIAN_LITTLE);
+    bool isUpdated = false;
+    switch (tokenInfo.requestType)
+    {
+    case TianBMSUtils::RequestType::REQUEST_DATA :
+    case TianBMSUtils::RequestType::REQUEST_PCB_CODE :
+    case TianBMSUtils::RequestType::REQUEST_SN1_CODE :
     case TianBMSUtils::RequestType::REQUEST_SN2_CODE :
-        if (_endianess == TianBMSUtils::Endianess::ENDIAN_LITTLE)
-        {
-            if (updateSnCode2(id, data, dataSize, true))
-            {
-                _bmsData[id].msgCount++;
-                return true;
-            }
-        }
-        else
-        {
-            if (updateSnCode2(id, data, dataSize))
-            {
-                _bmsData[id].msgCount++;
-                return true;
-            }
-        }
+        isUpdated = updateData(record, tokenInfo, source, swap, changedGroups);
         break;
     case TianBMSUtils::RequestType::REQUEST_SCAN :
-        /* code */
-        _bmsData[id].id = id;
-        if (updateOnScan(id, data, dataSize))
-        {
-            _bmsData[id].msgCount++;
-            return true;
-        }
+        isUpdated = updateOnScan(record, source, changedGroups);
         break;
     default:
         break;
     }
-    
-    return false;
+
+    if (isUpdated)
+    {
+        record->msgCount++;
+    }
+    return isUpdated;
 }
 
 /**
- * Parse the token into id and request type
+ * Parse the token into id, request type, register offset and block
  * @param[in]   token   token of the incoming message
  * @return      TokenInfo data type
 */
@@ -111,7 +236,10 @@ TokenInfo TianBMS::parseToken(uint32_t token)
 {
     TokenInfo tokenInfo;
     tokenInfo.id = (token - _uniqueIdentifier) >> 24;
-    tokenInfo.requestType = (token - _uniqueIdentifier) & 0x00FFFFFF;
+    tokenInfo.requestType = (token - _uniqueIdentifier) & 0x000000FF;
+    tokenInfo.offset = ((token - _uniqueIdentifier) >> 8) & 0x000000FF;
+    tokenInfo.block = ((token - _uniqueIdentifier) >> 16) & 0x0000007F;
+    tokenInfo.isContinued = ((token - _uniqueIdentifier) >> 23) & 0x01;
     return tokenInfo;
 }
 
@@ -126,35 +254,97 @@ bool TianBMS::updateOnError(uint32_t token)
 {
     TokenInfo tokenInfo = parseToken(token);
     ESP_LOGI(_TAG, "Id : %d error\n", tokenInfo.id);
-    if (_bmsData.find(tokenInfo.id) != _bmsData.end())
+    // slow and session block is read again on the next poll, its failure does not count against the slave
+    if (tokenInfo.block != 0)
+    {
+        return false;
+    }
+    if (_bmsData.contains(tokenInfo.id))
     {
-        _bmsData[tokenInfo.id].errorCount++;
+        TianBMSData* record = _bmsData.beginWrite(tokenInfo.id);
+        record->errorCount++;
+        _bmsData.endWrite(tokenInfo.id);
         return true;
     }
     return false;
 }
 
+/**
+ * Write the identity string known from a previous read (persistent cache) into the record of the slave, so it is
+ * served before the slave is read again. The identity timestamp is left untouched, nothing has been read
+ * 
+ * @param[in]   id  the id of the slave, the slave must already be in the data table
+ * @param[in]   pcbBarcode  pcb barcode
+ * @param[in]   snCode1 sn code 1
+ * @param[in]   snCode2 sn code 2
+ * @return      true if restored, false if the slave is not in the data table
+*/
+bool TianBMS::restoreIdentity(uint8_t id, const char* pcbBarcode, const char* snCode1, const char* snCode2)
+{
+    if (!_bmsData.contains(id))
+    {
+        return false;
+    }
+    TianBMSData* record = _bmsData.beginWrite(id);
+    if (record == nullptr)
+    {
+        return false;
+    }
+    const char* source[3] = {pcbBarcode, snCode1, snCode2};
+    std::array<char, 33>* destination[3] = {&record->pcbBarcode, &record->snCode1, &record->snCode2};
+    bool isChanged = false;
+    for (size_t i = 0; i < 3; i++)
+    {
+        std::array<char, 33> value;
+        value.fill(0);
+        strncpy(value.data(), source[i] != nullptr ? source[i] : "", value.size() - 1);
+        isChanged |= value != *destination[i];
+        *destination[i] = value;
+    }
+    _bmsData.endWrite(id);
+    commitChange(id, isChanged ? 1 << TianBMSRegister::GROUP_IDENTITY : 0);
+    return true;
+}
+
+/**
+ * Start the message and error counter of the slave again, called when another pack answers on its id
+ * 
+ * @param[in]   id  the id of the slave
+ * @return      true if reset, false if the slave is not in the data table
+*/
+bool TianBMS::resetStatistics(uint8_t id)
+{
+    if (!_bmsData.contains(id))
+    {
+        return false;
+    }
+    TianBMSData* record = _bmsData.beginWrite(id);
+    if (record == nullptr)
+    {
+        return false;
+    }
+    record->msgCount = 0;
+    record->errorCount = 0;
+    _bmsData.endWrite(id);
+    commitChange(id, 0);
+    return true;
+}
+
 /**
  * Method to cleanup the data with too many errors. This detect the error count of each data, after reaching certain threshold
  * the data will be deleted and free up space for another data
 */
 void TianBMS::cleanUp()
 {
-    std::vector<int> obsoleteDataIndex;
-    obsoleteDataIndex.reserve(16);
-    std::map<int, TianBMSData>::iterator it;
-    for (it = _bmsData.begin(); it != _bmsData.end(); it++)
+    for (TianBMSSlotTable::iterator it = _bmsData.begin(); it != _bmsData.end(); it++)
     {
-        if ((*it).second.errorCount > _maxErrorCount)
+        if ((*it).errorCount > _maxErrorCount)
         {
-            obsoleteDataIndex.push_back((*it).first);
+            uint8_t id = (*it).id;
+            _bmsData.erase(id);
+            commitChange(id, TianBMSChangeLog::GROUP_REMOVED);
         }
     }
-
-    for (size_t i = 0; i < obsoleteDataIndex.size(); i++)
-    {
-        _bmsData.erase(obsoleteDataIndex.at(i));
-    }
 }
 
 /**
@@ -166,64 +356,42 @@ void TianBMS::setMaxErrorCount(uint8_t maxErrorCount)
 }
 
 /**
- * Update the bms data, it is expecting the data length to be >= 43 based on the required register to get all the data
+ * Update the bms data, pcb barcode, sn1 code, or sn2 code. Every enabled field in the register map (refer to
+ * TianBMSRegister::FIELDS) that is covered by the incoming registers is decoded. The registers start at the request
+ * address of the request type moved by the offset of the token, field outside the registers keep their value
  * 
- * @param[in]   id  the id of the slave
- * @param[in]   data    pointer to data array of uint16_t
- * @param[in]   dataSize    the length of data array
+ * @param[in]   record  record of the slave
+ * @param[in]   tokenInfo   request type and register offset of the message
+ * @param[in]   source  register source
+ * @param[in]   swap    swap the MSB and LSB of string register
+ * @param[out]  changedGroups   bit of the group whose value changed is set, refer to TianBMSRegister::Group
  * @return      true if updated, false if nothing is updated
 */
-bool TianBMS::updateData(uint8_t id, uint16_t* data, size_t dataSize)
+template <typename Source>
+bool TianBMS::updateData(TianBMSData* record, const TokenInfo& tokenInfo, const Source& source, bool swap, uint8_t* changedGroups)
 {    
-    if (dataSize >= 34)
-    {
-        _bmsData[id].packVoltage = *data++;
-        _bmsData[id].packCurrent = *data++;
-        _bmsData[id].remainingCapacity = *data++;
-        _bmsData[id].avgCellTemperature = *data++;
-        _bmsData[id].envTemperature = *data++;
-        _bmsData[id].warningFlag.value = *data++;
-        _bmsData[id].protectionFlag.value = *data++;
-        _bmsData[id].faultStatusFlag.value = *data++;
-        _bmsData[id].soc = *data++;
-        _bmsData[id].soh = *data++;
-        _bmsData[id].fullChargedCap = *data++;
-        _bmsData[id].cycleCount = *data++;
-        for (size_t i = 0; i < _bmsData[id].cellVoltage.size(); i++)
-        {
-            _bmsData[id].cellVoltage[i] = *data++;
-        }
-        // for (size_t i = 0; i < _bmsData[id].cellTemperature.size(); i++)
-        // {
-        //     _bmsData[id].cellTemperature[i] = *data++;
-        // }
-        _bmsData[id].balanceTemperature = *data++;
-        _bmsData[id].maxCellVoltage = *data++;
-        _bmsData[id].minCellVoltage = *data++;
-        _bmsData[id].cellVoltageDiff = *data++;
-        _bmsData[id].maxCellTemp = *data++;
-        _bmsData[id].minCellTemp = *data++;
-        _bmsData[id].fetTemp = *data++;
-        // _bmsData[id].remainChgTime = ((*data++) << 16) + *data++;
-        // _bmsData[id].remainDsgTime = ((*data++) << 16) + *data++;
-        return true;
-    }
-    return false;
+    uint16_t startAddress = TianBMSRegister::requestAddress(tokenInfo.requestType) + tokenInfo.offset;
+    return TianBMSRegister::decode(record, startAddress, source, swap, changedGroups) > 0;
 }
 
 /**
  * Update when scan is happening, expecting single data register of packVoltage
  * 
- * @param[in]   id  id of the slave
- * @param[in]   data    pointer to data array of uint16_t
- * @param[in]   dataSize    length of the data array
+ * @param[in]   record  record of the slave
+ * @param[in]   source  register source
+ * @param[out]  changedGroups   bit of the group whose value changed is set, refer to TianBMSRegister::Group
  * @return      true if updated, false if nothing is updated
 */
-bool TianBMS::updateOnScan(uint8_t id, uint16_t* data, size_t dataSize)
+template <typename Source>
+bool TianBMS::updateOnScan(TianBMSData* record, const Source& source, uint8_t* changedGroups)
 {    
-    if (dataSize == 1)
+    if (source.size() == 1)
     {
-        _bmsData[id].packVoltage = *data++;
+        if (record->packVoltage != source.at(0))
+        {
+            *changedGroups |= 1 << TianBMSRegister::GROUP_ELECTRICAL;
+        }
+        record->packVoltage = source.at(0);
         ESP_LOGI(_TAG, "Update on scan");
         return true;
     }
@@ -231,102 +399,179 @@ bool TianBMS::updateOnScan(uint8_t id, uint16_t* data, size_t dataSize)
 }
 
 /**
- * Update pcb barcode
+ * Get token identifier based on id, request type, register offset and block
  * 
  * @param[in]   id  id of the slave
- * @param[in]   data    pointer to data array of uint16_t
- * @param[in]   dataSize    length of the data array
- * @param[in]   swap    swap the MSB and LSB of the uint16_t
+ * @param[in]   requestType request type, refer to TianBMSUtils::RequestType
+ * @param[in]   offset  register offset of the request from the request address of the request type (refer to
+ *                      TianBMSRegister::requestAddress()), the response is decoded from there
+ * @param[in]   block   block index in the poll plan (0 - 127), only the response of block 0 (the fast block) refresh
+ *                      the data timestamp and only its failure counts as error of the slave
+ * @param[in]   isContinued another block of the same poll follows, refer to TianBMSResponseQueue::drain()
+ * 
+ * @return  token
+*/
+uint32_t TianBMS::getToken(uint8_t id, TianBMSUtils::RequestType requestType, uint8_t offset, uint8_t block, bool isContinued)
+{
+    uint32_t token = requestType + (offset << 8) + ((block & 0x7F) << 16) + ((isContinued ? 1 : 0) << 23) + _uniqueIdentifier + (id << 24);
+    return token;
+}
+
+/**
+ * Clear bms data
+*/
+void TianBMS::clearData()
+{
+    _bmsData.clear();
+    uint32_t version = _version.load() + 1;
+    _changeLog.reset(version);
+    _version.store(version);
+}
+
+/**
+ * get bms data object
+ * 
+ * @return bms data object
+*/
+TianBMSSlotTable& TianBMS::getTianBMSData()
+{
+    return _bmsData;
+}
+
+/**
+ * get clone of bms data object
  * 
- * @return  true if success update, false if failed
+ * @param[in]   buff    std::vector<TianBMSData> object, filled with the present slave ordered by id
 */
-bool TianBMS::updatePcbBarcode(uint8_t id, uint16_t* data, size_t dataSize, bool swap)
+void TianBMS::getCloneTianBMSData(std::vector<TianBMSData>& buff)
 {
-    if (Utilities::uint16ArrayToCharArray(data, dataSize, _bmsData[id].pcbBarcode.data(), _bmsData[id].pcbBarcode.size(), swap) > 0)
+    buff.clear();
+    buff.reserve(_bmsData.size());
+    TianBMSData record;
+    for (uint16_t id = TianBMSSlotTable::MIN_ID; id <= TianBMSSlotTable::MAX_ID; id++)
     {
-        return true;
+        if (_bmsData.read(id, record))
+        {
+            buff.push_back(record);
+        }
     }
-    return false;
 }
 
 /**
- * Update sn1 code
+ * get consistent copy of single slave data, safe to call from other task while the data is being updated
  * 
  * @param[in]   id  id of the slave
- * @param[in]   data    pointer to data array of uint16_t
- * @param[in]   dataSize    length of the data array
- * @param[in]   swap    swap the MSB and LSB of the uint16_t
+ * @param[out]  buff    TianBMSData object
+ * @param[out]  version optional, version of the record the copy was taken at, changes whenever the record is written
  * 
- * @return  true if success update, false if failed
+ * @return      true if success, false if the slave is not present
 */
-bool TianBMS::updateSnCode1(uint8_t id, uint16_t* data, size_t dataSize, bool swap)
+bool TianBMS::getSnapshot(uint8_t id, TianBMSData& buff, uint32_t* version) const
 {
-    if (Utilities::uint16ArrayToCharArray(data, dataSize, _bmsData[id].snCode1.data(), _bmsData[id].snCode1.size(), swap) > 0)
-    {
-        return true;
-    }
-    return false;
+    return _bmsData.read(id, buff, version);
+}
+
+/**
+ * get number of snapshot retried because of concurrent update
+ * 
+ * @return      retry count
+*/
+uint32_t TianBMS::getReadRetryCount() const
+{
+    return _bmsData.getReadRetryCount();
+}
+
+/**
+ * get number of snapshot given up because the record was written on every attempt
+ * 
+ * @return      starved count
+*/
+uint32_t TianBMS::getReadStarvedCount() const
+{
+    return _bmsData.getReadStarvedCount();
+}
+
+/**
+ * get version of the whole bms data, it changes whenever a record is updated, or a slave is added or removed. Error
+ * count alone does not change it
+ * 
+ * @return      data version
+*/
+uint32_t TianBMS::getVersion() const
+{
+    return _version.load();
 }
 
 /**
- * Update sn2 code
+ * get the data version the group of the slave last changed at
  * 
  * @param[in]   id  id of the slave
- * @param[in]   data    pointer to data array of uint16_t
- * @param[in]   dataSize    length of the data array
- * @param[in]   swap    swap the MSB and LSB of the uint16_t
+ * @param[in]   group   field group, refer to TianBMSRegister::Group
  * 
- * @return  true if success update, false if failed
+ * @return      data version, 0 if the group never changed
 */
-bool TianBMS::updateSnCode2(uint8_t id, uint16_t* data, size_t dataSize, bool swap)
+uint32_t TianBMS::getGroupVersion(uint8_t id, uint8_t group) const
 {
-    if (Utilities::uint16ArrayToCharArray(data, dataSize, _bmsData[id].snCode2.data(), _bmsData[id].snCode2.size(), swap) > 0)
+    if (id > TianBMSSlotTable::MAX_ID || group >= TianBMSChangeLog::GROUP_LIMIT)
     {
-        return true;
+        return 0;
     }
-    return false;
+    return _groupVersion[id * TianBMSChangeLog::GROUP_LIMIT + group].load();
 }
 
 /**
- * Get token identifier based on id and request type
+ * get the time the data registers (REQUEST_DATA) of the slave were last read, safe to call from other task
  * 
- * @param[in]   id  id of the slave
- * @param[in]   requestType request type, refer to TianBMSUtils::RequestType
+ * @param[in]   id  the id of the slave
  * 
- * @return  token
+ * @return      millis() of the last data response, 0 if never read
 */
-uint32_t TianBMS::getToken(uint8_t id, TianBMSUtils::RequestType requestType)
+uint32_t TianBMS::getDataTimestamp(uint8_t id) const
 {
-    uint32_t token = requestType + _uniqueIdentifier + (id << 24);
-    return token;
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return 0;
+    }
+    return _dataTimestamp[id].load();
 }
 
 /**
- * Clear bms data
+ * get the time the identity string (pcb barcode, sn code) of the slave was last read, safe to call from other task
+ * 
+ * @param[in]   id  the id of the slave
+ * 
+ * @return      millis() of the last identity response, 0 if never read
 */
-void TianBMS::clearData()
+uint32_t TianBMS::getIdentityTimestamp(uint8_t id) const
 {
-    _bmsData.clear();
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return 0;
+    }
+    return _identityTimestamp[id].load();
 }
 
 /**
- * get bms data object
+ * get the changed group of every slave between two data version, safe to call from other task
  * 
- * @return bms data object
+ * @param[in]   since   version already known by the caller (exclusive)
+ * @param[in]   until   last version to collect (inclusive), usually getVersion()
+ * @param[out]  groupMask   array indexed by slave id, refer to TianBMSChange for the bit meaning
+ * @param[in]   size    size of groupMask
+ * 
+ * @return      true if success, false if the changes are no longer known and full data has to be taken instead
 */
-std::map<int, TianBMSData>& TianBMS::getTianBMSData()
+bool TianBMS::getChanges(uint32_t since, uint32_t until, uint8_t* groupMask, size_t size) const
 {
-    return _bmsData;
+    return _changeLog.collect(since, until, groupMask, size);
 }
 
 /**
- * get clone of bms data object
- * 
- * @param[in]   buff    std::map<int, TianBMSDATA> object
+ * get the oldest version getChanges() can start from
 */
-void TianBMS::getCloneTianBMSData(std::map<int, TianBMSData>& buff)
+uint32_t TianBMS::getOldestChangeVersion() const
 {
-    buff = _bmsData;
+    return _changeLog.getOldestVersion();
 }
 
 /**
@@ -337,9 +582,10 @@ void TianBMS::getCloneTianBMSData(std::map<int, TianBMSData>& buff)
 */
 uint16_t TianBMS::getPackVoltage(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].packVoltage;
+        return record.packVoltage;
     }
     return 0;
 }
@@ -353,9 +599,10 @@ uint16_t TianBMS::getPackVoltage(uint8_t id)
 */
 uint16_t TianBMS::getPackCurrent(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].packCurrent;
+        return record.packCurrent;
     }
     return 0;
 }
@@ -369,9 +616,10 @@ uint16_t TianBMS::getPackCurrent(uint8_t id)
 */
 uint16_t TianBMS::getRemainingCapacity(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].remainingCapacity;
+        return record.remainingCapacity;
     }
     return 0;
 }
@@ -385,9 +633,10 @@ uint16_t TianBMS::getRemainingCapacity(uint8_t id)
 */
 int16_t TianBMS::getAvgCellTemperature(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].avgCellTemperature;
+        return record.avgCellTemperature;
     }
     return 0;
 }
@@ -401,9 +650,10 @@ int16_t TianBMS::getAvgCellTemperature(uint8_t id)
 */
 int16_t TianBMS::getEnvTemperature(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].envTemperature;
+        return record.envTemperature;
     }
     return 0;
 }
@@ -419,9 +669,10 @@ WarningFlag TianBMS::getWarningFlag(uint8_t id)
 {
     WarningFlag flag;
     flag.value = 0;
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].warningFlag;
+        return record.warningFlag;
     }
     return flag;
 }
@@ -437,9 +688,10 @@ ProtectionFlag TianBMS::getProtectionFlag(uint8_t id)
 {
     ProtectionFlag flag;
     flag.value = 0;
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].protectionFlag;
+        return record.protectionFlag;
     }
     return flag;
 }
@@ -455,9 +707,10 @@ FaultStatusFlag TianBMS::getFaultStatusFlag(uint8_t id)
 {
     FaultStatusFlag flag;
     flag.value = 0;
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].faultStatusFlag;
+        return record.faultStatusFlag;
     }
     return flag;
 }
@@ -471,9 +724,10 @@ FaultStatusFlag TianBMS::getFaultStatusFlag(uint8_t id)
 */
 uint16_t TianBMS::getSoc(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].soc;
+        return record.soc;
     }
     return 0;
 }
@@ -487,9 +741,10 @@ uint16_t TianBMS::getSoc(uint8_t id)
 */
 uint16_t TianBMS::getSoh(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].soh;
+        return record.soh;
     }
     return 0;
 }
@@ -503,9 +758,10 @@ uint16_t TianBMS::getSoh(uint8_t id)
 */
 uint16_t TianBMS::getFullChargedCap(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].fullChargedCap;
+        return record.fullChargedCap;
     }
     return 0;
 }
@@ -519,9 +775,10 @@ uint16_t TianBMS::getFullChargedCap(uint8_t id)
 */
 uint16_t TianBMS::getCycleCount(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].cycleCount;
+        return record.cycleCount;
     }
     return 0;
 }
@@ -534,11 +791,12 @@ uint16_t TianBMS::getCycleCount(uint8_t id)
 */
 void TianBMS::getCellVoltage(uint8_t id, std::array<uint16_t, 16> buffer)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
         for (size_t i = 0; i < buffer.size(); i++)
         {
-            buffer[i] = _bmsData[id].cellVoltage[i];
+            buffer[i] = record.cellVoltage[i];
         }
     }
     
@@ -552,11 +810,12 @@ void TianBMS::getCellVoltage(uint8_t id, std::array<uint16_t, 16> buffer)
 */
 void TianBMS::getCellTemperature(uint8_t id, std::array<uint16_t, 4> buffer)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
         for (size_t i = 0; i < buffer.size(); i++)
         {
-            buffer[i] = _bmsData[id].cellTemperature[i];
+            buffer[i] = record.cellTemperature[i];
         }
     }
 }
@@ -570,9 +829,10 @@ void TianBMS::getCellTemperature(uint8_t id, std::array<uint16_t, 4> buffer)
 */
 uint16_t TianBMS::getBalanceTemperature(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].balanceTemperature;
+        return record.balanceTemperature;
     }
     return 0;
 }
@@ -586,9 +846,10 @@ uint16_t TianBMS::getBalanceTemperature(uint8_t id)
 */
 uint16_t TianBMS::getMaxCellVoltage(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].maxCellVoltage;
+        return record.maxCellVoltage;
     }
     return 0;
 }
@@ -602,9 +863,10 @@ uint16_t TianBMS::getMaxCellVoltage(uint8_t id)
 */
 uint16_t TianBMS::getMinCellVoltage(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].minCellVoltage;
+        return record.minCellVoltage;
     }
     return 0;
 }
@@ -618,9 +880,10 @@ uint16_t TianBMS::getMinCellVoltage(uint8_t id)
 */
 uint16_t TianBMS::getCellVoltageDiff(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].cellVoltageDiff;
+        return record.cellVoltageDiff;
     }
     return 0;
 }
@@ -634,9 +897,10 @@ uint16_t TianBMS::getCellVoltageDiff(uint8_t id)
 */
 uint16_t TianBMS::getMaxCellTemp(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].maxCellTemp;
+        return record.maxCellTemp;
     }
     return 0;
 }
@@ -650,9 +914,10 @@ uint16_t TianBMS::getMaxCellTemp(uint8_t id)
 */
 uint16_t TianBMS::getMinCellTemp(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].minCellTemp;
+        return record.minCellTemp;
     }
     return 0;
 }
@@ -666,9 +931,10 @@ uint16_t TianBMS::getMinCellTemp(uint8_t id)
 */
 uint16_t TianBMS::getFetTemp(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].fetTemp;
+        return record.fetTemp;
     }
     return 0;
 }
@@ -682,9 +948,10 @@ uint16_t TianBMS::getFetTemp(uint8_t id)
 */
 uint32_t TianBMS::getRemainChgTime(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].remainChgTime;
+        return record.remainChgTime;
     }
     return 0;
 }
@@ -698,9 +965,10 @@ uint32_t TianBMS::getRemainChgTime(uint8_t id)
 */
 uint32_t TianBMS::getRemainDsgTime(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        return _bmsData[id].remainDsgTime;
+        return record.remainDsgTime;
     }
     return 0;
 }
@@ -714,12 +982,13 @@ uint32_t TianBMS::getRemainDsgTime(uint8_t id)
 */
 std::string TianBMS::getPcbBarcode(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        std::string result(_bmsData[id].pcbBarcode.data());
+        std::string result(record.pcbBarcode.data());
         return result;
     }
-    return 0;
+    return std::string();
 }
 
 /**
@@ -731,12 +1000,13 @@ std::string TianBMS::getPcbBarcode(uint8_t id)
 */
 std::string TianBMS::getSnCode1(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        std::string result(_bmsData[id].snCode1.data());
+        std::string result(record.snCode1.data());
         return result;
     }
-    return 0;
+    return std::string();
 }
 
 /**
@@ -748,12 +1018,13 @@ std::string TianBMS::getSnCode1(uint8_t id)
 */
 std::string TianBMS::getSnCode2(uint8_t id)
 {
-    if (_bmsData.find(id) != _bmsData.end())
+    TianBMSData record;
+    if (_bmsData.read(id, record))
     {
-        std::string result(_bmsData[id].snCode2.data());
+        std::string result(record.snCode2.data());
         return result;
     }
-    return 0;
+    return std::string();
 }
 
 TianBMS::~TianBMS()
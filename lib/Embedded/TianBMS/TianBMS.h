@@ -6,8 +6,9 @@
 #include <Utilities.h>
 #include <vector>
 #include <memory>
+#include <atomic>
 #include <ArduinoJson.h>
-#include <map>
+#include "TianBMSChangeLog.h"
 
 namespace TianBMSUtils {
     enum RequestType : uint8_t 
@@ -147,10 +148,110 @@ struct TianBMSData
 
 };
 
+/**
+ * Fixed capacity table of TianBMSData indexed directly by modbus unit id (1 - 247). All slots are allocated together
+ * with the table, so inserting or removing a slave never touches the heap. The presence of each slot is tracked by
+ * bitmap, iterator only hold slot index so it stays valid when slave is added or removed
+ * 
+ * Each slot is guarded by a sequence counter (seqlock). The single writer (modbus response path) wraps every change
+ * with beginWrite() / endWrite(), readers on other task (http handler, exporter) take a consistent copy with read()
+ * without blocking the writer. A reader retries at most MAX_READ_ATTEMPT time and never waits for the writer. Iterator
+ * and find() give direct access to the slot and are meant for the writer side
+*/
+class TianBMSSlotTable
+{
+public:
+    static const uint8_t MIN_ID = 1;
+    static const uint8_t MAX_ID = 247;
+    static const uint8_t MAX_READ_ATTEMPT = 16;
+
+    class iterator
+    {
+    private:
+        TianBMSSlotTable* _table;
+        uint16_t _index;
+    public:
+        iterator(TianBMSSlotTable* table = nullptr, uint16_t index = MAX_ID + 1);
+        TianBMSData& operator*() const;
+        TianBMSData* operator->() const;
+        iterator& operator++();
+        iterator operator++(int);
+        bool operator==(const iterator& other) const;
+        bool operator!=(const iterator& other) const;
+    };
+
+    TianBMSSlotTable();
+    TianBMSData* beginWrite(uint8_t id);
+    void endWrite(uint8_t id);
+    bool read(uint8_t id, TianBMSData& buff, uint32_t* version = nullptr) const;
+    uint32_t getReadRetryCount() const;
+    uint32_t getReadStarvedCount() const;
+    TianBMSData* find(uint8_t id);
+    const TianBMSData* find(uint8_t id) const;
+    bool contains(uint8_t id) const;
+    bool erase(uint8_t id);
+    void clear();
+    size_t size() const;
+    bool empty() const;
+    uint8_t next(uint8_t id) const;
+    iterator begin();
+    iterator end();
+
+private:
+    std::array<TianBMSData, MAX_ID + 1> _slots;
+    std::array<std::atomic<uint32_t>, MAX_ID + 1> _sequence;
+    std::array<std::atomic<uint32_t>, (MAX_ID + 32) / 32> _presence;
+    std::atomic<size_t> _size;
+    mutable std::atomic<uint32_t> _readRetryCount;
+    mutable std::atomic<uint32_t> _readStarvedCount;
+};
+
+/**
+ * Register source over array of uint16_t, already in host order
+*/
+class TianBMSRegisterSource
+{
+private:
+    const uint16_t* _data;
+    size_t _size;
+public:
+    TianBMSRegisterSource(const uint16_t* data, size_t size) : _data(data), _size(size) {}
+    size_t size() const { return _size; }
+    uint16_t at(size_t index) const { return _data[index]; }
+};
+
+/**
+ * Register source over modbus response payload, 2 bytes big endian per register
+*/
+class TianBMSPayloadSource
+{
+private:
+    const uint8_t* _payload;
+    size_t _size;
+public:
+    TianBMSPayloadSource(const uint8_t* payload, size_t size) : _payload(payload), _size(size) {}
+    size_t size() const { return _size; }
+    uint16_t at(size_t index) const { return (_payload[index * 2] << 8) | _payload[index * 2 + 1]; }
+};
+
 struct TokenInfo
 {
     uint8_t id = 0;
     uint8_t requestType = 0;
+    uint8_t offset = 0;     // register offset of the response from the request address of the request type
+    uint8_t block = 0;      // block index in the poll plan, block 0 is the fast block (refer to TianBMSPollPlan)
+    bool isContinued = false;   // another block of the same poll follows, both are applied as one update
+};
+
+/**
+ * Response payload of one register block, refer to TianBMS::updateFromBlocks()
+*/
+struct TianBMSBlockPayload
+{
+    uint32_t token = 0;
+    const uint8_t* payload = nullptr;   // register bytes, big endian
+    size_t payloadSize = 0;
+    uint32_t timestamp = 0;
 };
 
 class TianBMS
@@ -161,24 +262,42 @@ private:
     uint32_t _uniqueIdentifier = 12345;
     uint8_t _endianess;
     uint8_t _maxErrorCount = 3;
-    std::map<int, TianBMSData> _bmsData;
-    bool updateData(uint8_t id, uint16_t* data, size_t dataSize);
-    bool updateOnScan(uint8_t id, uint16_t* data, size_t dataSize);
-    bool updatePcbBarcode(uint8_t id, uint16_t* data, size_t dataSize, bool swap = false);
-    bool updateSnCode1(uint8_t id, uint16_t* data, size_t dataSize, bool swap = false);
-    bool updateSnCode2(uint8_t id, uint16_t* data, size_t dataSize, bool swap = false);
-    TokenInfo parseToken(uint32_t token);
+    TianBMSSlotTable _bmsData;
+    std::atomic<uint32_t> _version;
+    TianBMSChangeLog _changeLog;
+    std::array<std::atomic<uint32_t>, (TianBMSSlotTable::MAX_ID + 1) * TianBMSChangeLog::GROUP_LIMIT> _groupVersion;
+    std::array<std::atomic<uint32_t>, TianBMSSlotTable::MAX_ID + 1> _dataTimestamp;
+    std::array<std::atomic<uint32_t>, TianBMSSlotTable::MAX_ID + 1> _identityTimestamp;
+    template <typename Source> bool updateFrom(uint8_t id, uint32_t token, const Source& source, uint32_t timestamp);
+    template <typename Source> bool updateRecord(TianBMSData* record, const TokenInfo& tokenInfo, const Source& source, uint8_t* changedGroups);
+    template <typename Source> bool updateData(TianBMSData* record, const TokenInfo& tokenInfo, const Source& source, bool swap, uint8_t* changedGroups);
+    template <typename Source> bool updateOnScan(TianBMSData* record, const Source& source, uint8_t* changedGroups);
+    void commitChange(uint8_t id, uint8_t groupMask);
 public:
     TianBMS(TianBMSUtils::Endianess endianess = TianBMSUtils::Endianess::ENDIAN_LITTLE);
     ~TianBMS();
     bool update(uint8_t id, uint32_t token, uint16_t* data, size_t dataSize);
+    bool updateFromPayload(uint8_t id, uint32_t token, const uint8_t* payload, size_t payloadSize, uint32_t timestamp);
+    bool updateFromBlocks(uint8_t id, const TianBMSBlockPayload* blocks, size_t count);
     bool updateOnError(uint32_t token);
+    bool restoreIdentity(uint8_t id, const char* pcbBarcode, const char* snCode1, const char* snCode2);
+    bool resetStatistics(uint8_t id);
     void cleanUp();
     void setMaxErrorCount(uint8_t maxErrorCount);
-    uint32_t getToken(uint8_t id, TianBMSUtils::RequestType requestType);
-    std::map<int, TianBMSData>& getTianBMSData();
+    uint32_t getToken(uint8_t id, TianBMSUtils::RequestType requestType, uint8_t offset = 0, uint8_t block = 0, bool isContinued = false);
+    TokenInfo parseToken(uint32_t token);
+    TianBMSSlotTable& getTianBMSData();
+    bool getSnapshot(uint8_t id, TianBMSData& buff, uint32_t* version = nullptr) const;
+    uint32_t getReadRetryCount() const;
+    uint32_t getReadStarvedCount() const;
+    uint32_t getVersion() const;
+    uint32_t getGroupVersion(uint8_t id, uint8_t group) const;
+    uint32_t getDataTimestamp(uint8_t id) const;
+    uint32_t getIdentityTimestamp(uint8_t id) const;
+    bool getChanges(uint32_t since, uint32_t until, uint8_t* groupMask, size_t size) const;
+    uint32_t getOldestChangeVersion() const;
     void clearData();
-    void getCloneTianBMSData(std::map<int, TianBMSData>& buff);
+    void getCloneTianBMSData(std::vector<TianBMSData>& buff);
     uint16_t getPackVoltage(uint8_t id);
     uint16_t getPackCurrent(uint8_t id);
     uint16_t getRemainingCapacity(uint8_t id);
@@ -216,6 +335,7 @@ public:
     ~TianBMSJsonManager();
     String buildData(const TianBMSData &tianBMSData);
     String buildEmptyData();
+    String buildSchema();
 };
 
 
@@ -0,0 +1,287 @@
+#include "TianBMSBinaryWriter.h"
+#include <string.h>
+
+TianBMSBinaryWriter::TianBMSBinaryWriter(uint8_t* buffer, size_t capacity, Encoding encoding)
+{
+    _buffer = buffer;
+    _capacity = capacity;
+    _encoding = encoding;
+}
+
+/**
+ * Start map of size key / value pair
+*/
+void TianBMSBinaryWriter::beginMap(size_t size)
+{
+    if (_encoding == ENCODING_CBOR)
+    {
+        appendHead(5, size);
+    }
+    else if (size < 16)
+    {
+        put(0x80 | size);
+    }
+    else if (reserve(3))
+    {
+        put(0xDE);
+        putBigEndian(size, 2);
+    }
+}
+
+/**
+ * Start array of size element
+*/
+void TianBMSBinaryWriter::beginArray(size_t size)
+{
+    if (_encoding == ENCODING_CBOR)
+    {
+        appendHead(4, size);
+    }
+    else if (size < 16)
+    {
+        put(0x90 | size);
+    }
+    else if (reserve(3))
+    {
+        put(0xDC);
+        putBigEndian(size, 2);
+    }
+}
+
+/**
+ * Start array of unknown size, closed by endIndefinite(). CBOR only, MessagePack has no indefinite length
+*/
+void TianBMSBinaryWriter::beginIndefiniteArray()
+{
+    if (_encoding == ENCODING_CBOR)
+    {
+        put(0x9F);
+    }
+}
+
+/**
+ * Close the array started by beginIndefiniteArray()
+*/
+void TianBMSBinaryWriter::endIndefinite()
+{
+    if (_encoding == ENCODING_CBOR)
+    {
+        put(0xFF);
+    }
+}
+
+/**
+ * Append unsigned integer in the shortest form
+*/
+void TianBMSBinaryWriter::appendUInt(uint32_t value)
+{
+    if (_encoding == ENCODING_CBOR)
+    {
+        appendHead(0, value);
+    }
+    else if (value < 0x80)
+    {
+        put(value);
+    }
+    else if (value <= 0xFF && reserve(2))
+    {
+        put(0xCC);
+        put(value);
+    }
+    else if (value <= 0xFFFF && reserve(3))
+    {
+        put(0xCD);
+        putBigEndian(value, 2);
+    }
+    else if (value > 0xFFFF && reserve(5))
+    {
+        put(0xCE);
+        putBigEndian(value, 4);
+    }
+}
+
+/**
+ * Append signed integer in the shortest form
+*/
+void TianBMSBinaryWriter::appendInt(int32_t value)
+{
+    if (value >= 0)
+    {
+        appendUInt(value);
+    }
+    else if (_encoding == ENCODING_CBOR)
+    {
+        appendHead(1, (uint32_t)(-1 - value));
+    }
+    else if (value >= -32)
+    {
+        put((uint8_t)value);
+    }
+    else if (value >= -128 && reserve(2))
+    {
+        put(0xD0);
+        put((uint8_t)value);
+    }
+    else if (value >= -32768 && reserve(3))
+    {
+        put(0xD1);
+        putBigEndian((uint16_t)value, 2);
+    }
+    else if (value < -32768 && reserve(5))
+    {
+        put(0xD2);
+        putBigEndian((uint32_t)value, 4);
+    }
+}
+
+/**
+ * Append utf-8 text string
+ * 
+ * @param[in]   str the string
+ * @param[in]   maxLength   maximum number of character read from str, stop earlier on null terminator
+*/
+void TianBMSBinaryWriter::appendString(const char* str, size_t maxLength)
+{
+    size_t size = 0;
+    while (size < maxLength && str[size] != 0)
+    {
+        size++;
+    }
+    if (_encoding == ENCODING_CBOR)
+    {
+        appendHead(3, size);
+    }
+    else if (size < 32)
+    {
+        put(0xA0 | size);
+    }
+    else if (size <= 0xFF && reserve(2))
+    {
+        put(0xD9);
+        put(size);
+    }
+    else if (size > 0xFF && reserve(3))
+    {
+        put(0xDA);
+        putBigEndian(size, 2);
+    }
+    if (!reserve(size))
+    {
+        return;
+    }
+    memcpy(_buffer + _length, str, size);
+    _length += size;
+}
+
+/**
+ * Append array of uint16_t as single byte string, 2 bytes big endian per element
+*/
+void TianBMSBinaryWriter::appendUInt16Bytes(const uint16_t* values, size_t count)
+{
+    size_t size = count * 2;
+    if (_encoding == ENCODING_CBOR)
+    {
+        appendHead(2, size);
+    }
+    else if (size <= 0xFF && reserve(2))
+    {
+        put(0xC4);
+        put(size);
+    }
+    else if (size > 0xFF && reserve(3))
+    {
+        put(0xC5);
+        putBigEndian(size, 2);
+    }
+    if (!reserve(size))
+    {
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        putBigEndian(values[i], 2);
+    }
+}
+
+/**
+ * Append null (CBOR) or nil (MessagePack)
+*/
+void TianBMSBinaryWriter::appendNil()
+{
+    put(_encoding == ENCODING_CBOR ? 0xF6 : 0xC0);
+}
+
+/**
+ * Number of byte written
+*/
+size_t TianBMSBinaryWriter::length() const
+{
+    return _length;
+}
+
+/**
+ * Check if any write has been dropped because the buffer is full
+*/
+bool TianBMSBinaryWriter::isOverflow() const
+{
+    return _isOverflow;
+}
+
+/**
+ * Check if size more byte fit in the buffer, raise the overflow flag if not
+*/
+bool TianBMSBinaryWriter::reserve(size_t size)
+{
+    if (_length + size > _capacity)
+    {
+        _isOverflow = true;
+        return false;
+    }
+    return true;
+}
+
+void TianBMSBinaryWriter::put(uint8_t value)
+{
+    if (reserve(1))
+    {
+        _buffer[_length++] = value;
+    }
+}
+
+void TianBMSBinaryWriter::putBigEndian(uint32_t value, size_t size)
+{
+    for (size_t i = size; i > 0; i--)
+    {
+        put((value >> ((i - 1) * 8)) & 0xFF);
+    }
+}
+
+/**
+ * Append CBOR initial byte with its argument in the shortest form
+ * 
+ * @param[in]   majorType   CBOR major type (0 - 7)
+ * @param[in]   value   argument (integer value, length or size)
+*/
+void TianBMSBinaryWriter::appendHead(uint8_t majorType, uint32_t value)
+{
+    uint8_t initial = majorType << 5;
+    if (value < 24)
+    {
+        put(initial | value);
+    }
+    else if (value <= 0xFF && reserve(2))
+    {
+        put(initial | 24);
+        put(value);
+    }
+    else if (value <= 0xFFFF && reserve(3))
+    {
+        put(initial | 25);
+        putBigEndian(value, 2);
+    }
+    else if (value > 0xFFFF && reserve(5))
+    {
+        put(initial | 26);
+        putBigEndian(value, 4);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef TIANBMS_BINARY_WRITER_H
+#define TIANBMS_BINARY_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Append only CBOR (RFC 8949) or MessagePack writer over fixed size buffer, never allocate. Further write is ignored
+ * once the buffer is full and the overflow flag is raised, same as TianBMSJsonWriter
+*/
+class TianBMSBinaryWriter
+{
+public:
+    enum Encoding : uint8_t
+    {
+        ENCODING_CBOR = 0x00,
+        ENCODING_MSGPACK = 0x01
+    };
+
+    TianBMSBinaryWriter(uint8_t* buffer, size_t capacity, Encoding encoding);
+    void beginMap(size_t size);
+    void beginArray(size_t size);
+    void beginIndefiniteArray();
+    void endIndefinite();
+    void appendUInt(uint32_t value);
+    void appendInt(int32_t value);
+    void appendString(const char* str, size_t maxLength);
+    void appendUInt16Bytes(const uint16_t* values, size_t count);
+    void appendNil();
+    size_t length() const;
+    bool isOverflow() const;
+
+private:
+    uint8_t* _buffer;
+    size_t _capacity;
+    size_t _length = 0;
+    bool _isOverflow = false;
+    Encoding _encoding;
+    bool reserve(size_t size);
+    void put(uint8_t value);
+    void putBigEndian(uint32_t value, size_t size);
+    void appendHead(uint8_t majorType, uint32_t value);
+};
+
+#endif
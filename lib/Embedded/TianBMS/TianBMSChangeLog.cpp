@@ -0,0 +1,89 @@
+#include "TianBMSChangeLog.h"
+
+TianBMSChangeLog::TianBMSChangeLog()
+{
+    _head.store(0);
+    _oldestVersion.store(0);
+}
+
+/**
+ * Append a change, the oldest entry is overwritten when the ring is full
+ * 
+ * @param[in]   version data version the change was made at, must be greater than the previous one
+ * @param[in]   id  id of the slave
+ * @param[in]   groupMask   changed group of the record, refer to TianBMSChange
+*/
+void TianBMSChangeLog::append(uint32_t version, uint8_t id, uint8_t groupMask)
+{
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    TianBMSChange& entry = _entries[head % CAPACITY];
+    if (head >= CAPACITY && entry.version > _oldestVersion.load(std::memory_order_relaxed))
+    {
+        _oldestVersion.store(entry.version, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.version = version;
+    entry.id = id;
+    entry.groupMask = groupMask;
+    _head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * Forget every change up to the version, used when the whole data is replaced
+ * 
+ * @param[in]   version current data version
+*/
+void TianBMSChangeLog::reset(uint32_t version)
+{
+    _oldestVersion.store(version, std::memory_order_release);
+}
+
+/**
+ * Merge the changes made after since, up to until, into per slave group mask
+ * 
+ * @param[in]   since   version already known by the caller (exclusive)
+ * @param[in]   until   last version to collect (inclusive)
+ * @param[out]  groupMask   array indexed by slave id, the changed group are or-ed into it
+ * @param[in]   size    size of groupMask
+ * 
+ * @return      true if success, false if some change after since is no longer in the ring
+*/
+bool TianBMSChangeLog::collect(uint32_t since, uint32_t until, uint8_t* groupMask, size_t size) const
+{
+    if (since < _oldestVersion.load(std::memory_order_acquire) || since > until)
+    {
+        return false;
+    }
+    uint32_t head = _head.load(std::memory_order_acquire);
+    uint32_t start = head > CAPACITY ? head - CAPACITY : 0;
+    uint32_t index = head;
+    while (index > start)
+    {
+        const TianBMSChange& entry = _entries[(index - 1) % CAPACITY];
+        if (entry.version <= since)
+        {
+            break;
+        }
+        if (entry.version <= until && entry.id < size)
+        {
+            groupMask[entry.id] |= entry.groupMask;
+        }
+        index--;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // the writer may have overwritten the oldest entry read, or dropped a change not yet read
+    uint32_t last = _head.load(std::memory_order_relaxed);
+    if (last >= CAPACITY && last - CAPACITY >= (index > start ? index - 1 : index))
+    {
+        return false;
+    }
+    return since >= _oldestVersion.load(std::memory_order_acquire);
+}
+
+/**
+ * Oldest version the changes can be collected from
+*/
+uint32_t TianBMSChangeLog::getOldestVersion() const
+{
+    return _oldestVersion.load();
+}
@@ -0,0 +1,44 @@
+#ifndef TIANBMS_CHANGE_LOG_H
+#define TIANBMS_CHANGE_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <atomic>
+
+struct TianBMSChange
+{
+    uint32_t version = 0;
+    uint8_t id = 0;
+    uint8_t groupMask = 0; // bit n = TianBMSRegister::Group n changed, GROUP_REMOVED = slave removed
+};
+
+/**
+ * Ring of the last changes made to TianBMS, one entry per record change with the data version it was made at. Used to
+ * answer "what changed since version V" without keeping old copy of the record. Once the ring wrapped, the oldest
+ * changes are lost and the caller has to fall back to full snapshot
+ * 
+ * Single writer (the task updating TianBMS), any number of reader on other task. Reader never block the writer, entry
+ * overwritten in the middle of the read is detected and reported as lost
+*/
+class TianBMSChangeLog
+{
+public:
+    static const size_t CAPACITY = 256;
+    static const uint8_t GROUP_LIMIT = 7;
+    static const uint8_t GROUP_ALL = 0x7F;
+    static const uint8_t GROUP_REMOVED = 0x80;
+
+    TianBMSChangeLog();
+    void append(uint32_t version, uint8_t id, uint8_t groupMask);
+    void reset(uint32_t version);
+    bool collect(uint32_t since, uint32_t until, uint8_t* groupMask, size_t size) const;
+    uint32_t getOldestVersion() const;
+
+private:
+    std::array<TianBMSChange, CAPACITY> _entries;
+    std::atomic<uint32_t> _head;          // number of entry ever appended
+    std::atomic<uint32_t> _oldestVersion; // every change made after this version is still in the ring
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "TianBMSFilter.h"
+#include "TianBMSRegister.h"
+
+static_assert(TianBMSRegister::FIELD_COUNT <= 32, "field exceed the filter bitmask");
+
+TianBMSFilter::TianBMSFilter()
+{
+    _slaves.fill(0xFFFFFFFF);
+    _fields = 0xFFFFFFFF;
+}
+
+/**
+ * Select only the listed slave
+ * 
+ * @param[in]   list    comma separated slave id, e.g. "1,3,5"
+ * 
+ * @return      true if success, false if the list has invalid id, the selection is left unchanged
+*/
+bool TianBMSFilter::parseSlaves(const char* list)
+{
+    std::array<uint32_t, (TianBMSSlotTable::MAX_ID + 32) / 32> slaves;
+    slaves.fill(0);
+    const char* cursor = list;
+    while (*cursor != 0)
+    {
+        uint32_t id = 0;
+        size_t digit = 0;
+        while (*cursor >= '0' && *cursor <= '9' && digit < 4)
+        {
+            id = id * 10 + (*cursor - '0');
+            cursor++;
+            digit++;
+        }
+        if (digit == 0 || id < TianBMSSlotTable::MIN_ID || id > TianBMSSlotTable::MAX_ID || (*cursor != ',' && *cursor != 0))
+        {
+            return false;
+        }
+        slaves[id / 32] |= 1UL << (id % 32);
+        if (*cursor == ',')
+        {
+            cursor++;
+        }
+    }
+    _slaves = slaves;
+    _isAllSlaves = false;
+    return true;
+}
+
+/**
+ * Select only the listed field, msg_count and id are always written
+ * 
+ * @param[in]   list    comma separated json key of the field, refer to TianBMSRegister::FIELDS
+ * 
+ * @return      true if success, false if the list has unknown key, the selection is left unchanged
+*/
+bool TianBMSFilter::parseFields(const char* list)
+{
+    uint32_t fields = 0;
+    const char* cursor = list;
+    while (*cursor != 0)
+    {
+        const char* end = cursor;
+        while (*end != ',' && *end != 0)
+        {
+            end++;
+        }
+        size_t length = end - cursor;
+        bool isFound = false;
+        for (size_t i = 0; i < TianBMSRegister::FIELD_COUNT; i++)
+        {
+            const char* key = TianBMSRegister::FIELDS[i].key;
+            if (strncmp(key, cursor, length) == 0 && key[length] == 0)
+            {
+                fields |= 1UL << i;
+                isFound = true;
+                break;
+            }
+        }
+        if (!isFound)
+        {
+            return false;
+        }
+        cursor = *end == ',' ? end + 1 : end;
+    }
+    _fields = fields;
+    _isAllFields = false;
+    return true;
+}
+
+/**
+ * Check if the slave is selected
+*/
+bool TianBMSFilter::hasSlave(uint8_t id) const
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return false;
+    }
+    return (_slaves[id / 32] >> (id % 32)) & 0x01;
+}
+
+/**
+ * Check if the field is selected
+ * 
+ * @param[in]   index   position of the field in TianBMSRegister::FIELDS
+*/
+bool TianBMSFilter::hasField(size_t index) const
+{
+    return (_fields >> index) & 0x01;
+}
+
+/**
+ * Check if every slave is selected
+*/
+bool TianBMSFilter::isAllSlaves() const
+{
+    return _isAllSlaves;
+}
+
+/**
+ * Check if every field is selected
+*/
+bool TianBMSFilter::isAllFields() const
+{
+    return _isAllFields;
+}
+
+/**
+ * Next selected slave id, whether it is present or not
+ * 
+ * @param[in]   id  current slave, 0 to get the first one
+ * 
+ * @return      id of the next selected slave, 0 if there is no more
+*/
+uint8_t TianBMSFilter::nextSlave(uint8_t id) const
+{
+    for (uint16_t next = id + 1; next <= TianBMSSlotTable::MAX_ID; next++)
+    {
+        uint32_t word = _slaves[next / 32] >> (next % 32);
+        if (word == 0)
+        {
+            // nothing left in this word
+            next |= 31;
+            continue;
+        }
+        if (word & 0x01)
+        {
+            return next;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Hash of the selection, used to tell apart the ETag of filtered document. Whatever else the document depends on is
+ * given as seed and hashed first in the same chain, so it is never combined afterwards with the hash of the selection
+ * 
+ * @param[in]   seed    other variant of the document (format, encoding, ...)
+*/
+uint32_t TianBMSFilter::hash(uint32_t seed) const
+{
+    uint32_t hash = (2166136261UL ^ seed) * 16777619UL;
+    for (size_t i = 0; i < _slaves.size(); i++)
+    {
+        hash = (hash ^ _slaves[i]) * 16777619UL;
+    }
+    return (hash ^ _fields) * 16777619UL;
+}
@@ -0,0 +1,34 @@
+#ifndef TIANBMS_FILTER_H
+#define TIANBMS_FILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include "TianBMS.h"
+
+/**
+ * Selection of slave and field for the data document, parsed once from the query parameter (?id=1,3,5 and
+ * ?fields=soc,pack_current). Slave is kept as bitmap indexed by id, field as bitmask indexed by position in
+ * TianBMSRegister::FIELDS, so every lookup is direct. Default selection is every slave and every field
+*/
+class TianBMSFilter
+{
+public:
+    TianBMSFilter();
+    bool parseSlaves(const char* list);
+    bool parseFields(const char* list);
+    bool hasSlave(uint8_t id) const;
+    bool hasField(size_t index) const;
+    bool isAllSlaves() const;
+    bool isAllFields() const;
+    uint8_t nextSlave(uint8_t id) const;
+    uint32_t hash(uint32_t seed = 0) const;
+
+private:
+    std::array<uint32_t, (TianBMSSlotTable::MAX_ID + 32) / 32> _slaves;
+    uint32_t _fields;
+    bool _isAllSlaves = true;
+    bool _isAllFields = true;
+};
+
+#endif
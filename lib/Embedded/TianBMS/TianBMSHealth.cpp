@@ -0,0 +1,210 @@
+#include "TianBMSHealth.h"
+
+TianBMSHealth::TianBMSHealth()
+{
+}
+
+/**
+ * Check if the slave may be polled, healthy and suspect slave always, open slave once its probe is due
+ *
+ * @param[in]   id  slave id
+ * @param[in]   now current time, millis()
+*/
+bool TianBMSHealth::isPollable(uint8_t id, uint32_t now) const
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    const Slot& slot = _slots[id];
+    switch (slot.state)
+    {
+    case STATE_HEALTHY:
+    case STATE_SUSPECT:
+        return true;
+    case STATE_OPEN:
+        return isProbeDue(slot, now);
+    default:
+        return false;
+    }
+}
+
+/**
+ * Check if the slave answered its last request, only healthy slave gets the extra block and the identity read
+ *
+ * @param[in]   id  slave id
+*/
+bool TianBMSHealth::isHealthy(uint8_t id) const
+{
+    return getState(id) == STATE_HEALTHY;
+}
+
+/**
+ * Register request added to the modbus client queue, the request to an open slave is its probe
+ *
+ * @param[in]   id  slave id
+ * @param[in]   now current time, millis()
+*/
+void TianBMSHealth::onSend(uint8_t id, uint32_t now)
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    Slot& slot = _slots[id];
+    if (slot.state == STATE_OPEN && isProbeDue(slot, now))
+    {
+        slot.state = STATE_HALF_OPEN;
+        _lastProbe = now | 0x01;
+        _probeCount++;
+    }
+}
+
+/**
+ * Register answer of the slave (data or modbus exception), close the breaker and forget the backoff
+ *
+ * @param[in]   id  slave id
+*/
+void TianBMSHealth::onSuccess(uint8_t id)
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    Slot& slot = _slots[id];
+    if (slot.state == STATE_OPEN || slot.state == STATE_HALF_OPEN)
+    {
+        _recoveryCount++;
+    }
+    slot = Slot();
+}
+
+/**
+ * Register request the slave did not answer, timeout or gateway "target failed to respond"
+ *
+ * @param[in]   id  slave id
+ * @param[in]   now current time, millis()
+ *
+ * @return      true if the slave was already failing before this request, its timeout tells nothing about the load
+ *              of the gateway
+*/
+bool TianBMSHealth::onFailure(uint8_t id, uint32_t now)
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    Slot& slot = _slots[id];
+    bool isFailing = slot.state != STATE_HEALTHY;
+    if (slot.failures < UINT8_MAX)
+    {
+        slot.failures++;
+    }
+    if (slot.state == STATE_OPEN || slot.state == STATE_HALF_OPEN)
+    {
+        open(slot, now);
+    }
+    else if (slot.failures >= OPEN_THRESHOLD)
+    {
+        ESP_LOGI(_TAG, "Id : %d breaker open\n", id);
+        _tripCount++;
+        open(slot, now);
+    }
+    else
+    {
+        slot.state = STATE_SUSPECT;
+    }
+    return isFailing;
+}
+
+/**
+ * Close the breaker of every slave, called when the data table is cleared
+*/
+void TianBMSHealth::reset()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _slots.fill(Slot());
+    _lastProbe = 0;
+}
+
+/**
+ * Get the breaker state of the slave
+*/
+TianBMSHealth::State TianBMSHealth::getState(uint8_t id) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return id <= TianBMSSlotTable::MAX_ID ? _slots[id].state : STATE_HEALTHY;
+}
+
+/**
+ * Get number of slave of the data table in the state
+ *
+ * @param[in]   table   slot table
+ * @param[in]   state   breaker state
+*/
+size_t TianBMSHealth::getStateCount(const TianBMSSlotTable& table, State state) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t count = 0;
+    for (uint8_t id = table.next(0); id != 0; id = table.next(id))
+    {
+        count += _slots[id].state == state;
+    }
+    return count;
+}
+
+/**
+ * Get number of breaker opened from healthy or suspect since boot
+*/
+uint32_t TianBMSHealth::getTripCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _tripCount;
+}
+
+/**
+ * Get number of probe sent to open slave since boot
+*/
+uint32_t TianBMSHealth::getProbeCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _probeCount;
+}
+
+/**
+ * Get number of open slave that answered again since boot
+*/
+uint32_t TianBMSHealth::getRecoveryCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _recoveryCount;
+}
+
+/**
+ * Check if the probe of the open slave may be sent, its backoff is elapsed and no other probe has been started for
+ * PROBE_INTERVAL
+*/
+bool TianBMSHealth::isProbeDue(const Slot& slot, uint32_t now) const
+{
+    // bit 0 only marks a probe sent at time 0, the interval is measured from the send time
+    return (int32_t)(now - slot.retryAt) >= 0 && (_lastProbe == 0 || now - (_lastProbe & ~0x01UL) >= PROBE_INTERVAL);
+}
+
+/**
+ * Open the breaker of the slave, the backoff doubles on every opening in a row. The probe is due between half and the
+ * whole backoff from now
+*/
+void TianBMSHealth::open(Slot& slot, uint32_t now)
+{
+    slot.backoff = slot.backoff == 0 ? BASE_BACKOFF : slot.backoff * 2;
+    if (slot.backoff > MAX_BACKOFF)
+    {
+        slot.backoff = MAX_BACKOFF;
+    }
+    slot.retryAt = now + slot.backoff / 2 + (uint32_t)random(0, slot.backoff / 2 + 1);
+    slot.state = STATE_OPEN;
+}
@@ -0,0 +1,80 @@
+#ifndef TIANBMS_HEALTH_H
+#define TIANBMS_HEALTH_H
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <mutex>
+#include "TianBMS.h"
+
+/**
+ * Per slave circuit breaker of the poll. A slave that stops answering holds the modbus client for the whole timeout
+ * on every request and delays every other slave behind it, the breaker takes it out of the poll until it answers
+ * again :
+ *
+ *  - healthy   answered its last request, polled normally
+ *  - suspect   failed its last request (timeout, gateway "target failed to respond"), still polled at its normal
+ *              rate but without extra block, its timeout no longer shrinks the poll window
+ *  - open      failed OPEN_THRESHOLD request in a row, not polled. Once its backoff is elapsed it is polled once
+ *  - half open the single probe is in flight. Answer closes the breaker, failure opens it again with the backoff
+ *              doubled, from BASE_BACKOFF up to MAX_BACKOFF
+ *
+ * The delay before the probe is drawn between half and the whole backoff so slave lost together (gateway reboot,
+ * string switched off) are not probed together, and at most one probe is started every PROBE_INTERVAL so probes due
+ * at the same time do not hold the bus back to back. The slave stays in the data table the whole time, a recovered
+ * slave is polled again without rescan. Modbus exception is an answer, the slave is alive.
+ *
+ * isPollable() and onSend() are called from the poll task, onSuccess() and onFailure() from the modbus client task
+*/
+class TianBMSHealth
+{
+public:
+    enum State : uint8_t
+    {
+        STATE_HEALTHY = 0x00,
+        STATE_SUSPECT = 0x01,
+        STATE_OPEN = 0x02,
+        STATE_HALF_OPEN = 0x03
+    };
+
+    static const uint8_t STATE_COUNT = 4;
+    static const uint8_t OPEN_THRESHOLD = 3;        // failed request in a row opening the breaker
+    static const uint32_t BASE_BACKOFF = 5000;      // ms, backoff of the first opening
+    static const uint32_t MAX_BACKOFF = 300000;     // ms
+    static const uint32_t PROBE_INTERVAL = 10000;   // ms between two probe, every slave included
+
+    TianBMSHealth();
+    bool isPollable(uint8_t id, uint32_t now) const;
+    bool isHealthy(uint8_t id) const;
+    void onSend(uint8_t id, uint32_t now);
+    void onSuccess(uint8_t id);
+    bool onFailure(uint8_t id, uint32_t now);
+    void reset();
+    State getState(uint8_t id) const;
+    size_t getStateCount(const TianBMSSlotTable& table, State state) const;
+    uint32_t getTripCount() const;
+    uint32_t getProbeCount() const;
+    uint32_t getRecoveryCount() const;
+
+private:
+    struct Slot
+    {
+        uint32_t retryAt = 0;       // open slave is probed from this time
+        uint32_t backoff = 0;       // ms, backoff of the last opening, 0 = never opened
+        uint8_t failures = 0;       // failed request in a row
+        State state = STATE_HEALTHY;
+    };
+
+    const char* _TAG = "TIANBMS HEALTH";
+    mutable std::mutex _mutex;
+    std::array<Slot, TianBMSSlotTable::MAX_ID + 1> _slots;
+    uint32_t _lastProbe = 0;    // 0 = no probe yet
+    uint32_t _tripCount = 0;
+    uint32_t _probeCount = 0;
+    uint32_t _recoveryCount = 0;
+    bool isProbeDue(const Slot& slot, uint32_t now) const;
+    void open(Slot& slot, uint32_t now);
+};
+
+#endif
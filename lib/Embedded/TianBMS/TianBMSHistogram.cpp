@@ -0,0 +1,85 @@
+#include "TianBMSHistogram.h"
+
+const std::array<uint32_t, TianBMSHistogram::BOUND_COUNT> TianBMSHistogram::BOUNDS = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000
+};
+
+TianBMSHistogram::TianBMSHistogram()
+{
+    reset();
+}
+
+/**
+ * Add one value to the histogram
+ * 
+ * @param[in]   value   value in microsecond
+*/
+void TianBMSHistogram::record(uint32_t value)
+{
+    size_t index = 0;
+    while (index < BOUND_COUNT && value > BOUNDS[index])
+    {
+        index++;
+    }
+    _buckets[index].fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+    if (value > _max.load(std::memory_order_relaxed))
+    {
+        _max.store(value, std::memory_order_relaxed);
+    }
+    _count.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * Clear every bucket
+*/
+void TianBMSHistogram::reset()
+{
+    for (size_t i = 0; i < _buckets.size(); i++)
+    {
+        _buckets[i].store(0);
+    }
+    _count.store(0);
+    _sum.store(0);
+    _max.store(0);
+}
+
+/**
+ * Get number of value in the bucket (not cumulative)
+ * 
+ * @param[in]   index   bucket index, BOUND_COUNT is the bucket above every bound
+ * 
+ * @return      value count
+*/
+uint32_t TianBMSHistogram::getBucket(size_t index) const
+{
+    if (index >= _buckets.size())
+    {
+        return 0;
+    }
+    return _buckets[index].load(std::memory_order_relaxed);
+}
+
+/**
+ * Get number of recorded value
+*/
+uint32_t TianBMSHistogram::getCount() const
+{
+    return _count.load(std::memory_order_acquire);
+}
+
+/**
+ * Get sum of the recorded value in microsecond
+*/
+uint32_t TianBMSHistogram::getSum() const
+{
+    return _sum.load(std::memory_order_relaxed);
+}
+
+/**
+ * Get largest recorded value in microsecond
+*/
+uint32_t TianBMSHistogram::getMax() const
+{
+    return _max.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,38 @@
+#ifndef TIANBMS_HISTOGRAM_H
+#define TIANBMS_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <atomic>
+
+/**
+ * Fixed bucket histogram of duration in microsecond (scheduling jitter, round trip time, ...). Bucket n count the
+ * value up to BOUNDS[n], the last bucket count the value above every bound. Sum is kept in microsecond and wraps
+ * after 2^32 us, as a counter it is reported the same way as a restart
+ * 
+ * Single writer, any number of reader on other task
+*/
+class TianBMSHistogram
+{
+public:
+    static const size_t BOUND_COUNT = 10;
+    static const size_t BUCKET_COUNT = BOUND_COUNT + 1;
+    static const std::array<uint32_t, BOUND_COUNT> BOUNDS;
+
+    TianBMSHistogram();
+    void record(uint32_t value);
+    void reset();
+    uint32_t getBucket(size_t index) const;
+    uint32_t getCount() const;
+    uint32_t getSum() const;
+    uint32_t getMax() const;
+
+private:
+    std::array<std::atomic<uint32_t>, BUCKET_COUNT> _buckets;
+    std::atomic<uint32_t> _count;
+    std::atomic<uint32_t> _sum;
+    std::atomic<uint32_t> _max;
+};
+
+#endif
@@ -0,0 +1,341 @@
+#include "TianBMSIdentity.h"
+
+namespace
+{
+    const size_t IDENTITY_SIZE = 3 * 33;   // pcb barcode, sn code 1, sn code 2, null terminated
+}
+
+TianBMSIdentity::TianBMSIdentity()
+{
+}
+
+/**
+ * Set the preference namespace of the identity
+ *
+ * @param[in]   name    name for preference namespace
+*/
+void TianBMSIdentity::begin(const char* name)
+{
+    _name = name;
+}
+
+/**
+ * Follow the slave of the data table : restore the identity of new slave from NVS, handle the read identity (store,
+ * pack swap) and forget the slave that left the table. Called after the queued response has been applied
+ *
+ * @param[in]   tianBMS tianBMS object, the caller holds its write section
+ * @param[in]   now current time, millis()
+ * @param[out]  swapped id of the slave whose pack has been swapped
+ * @param[in]   size    capacity of swapped
+ *
+ * @return      number of swapped slave written
+*/
+size_t TianBMSIdentity::refresh(TianBMS& tianBMS, uint32_t now, uint8_t* swapped, size_t size)
+{
+    const TianBMSSlotTable& table = tianBMS.getTianBMSData();
+    size_t swapCount = 0;
+    for (uint8_t id = table.next(0); id != 0; id = table.next(id))
+    {
+        uint32_t readTimestamp = tianBMS.getIdentityTimestamp(id);
+        Slot slot;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            slot = _slots[id];
+        }
+        if (slot.discovered == 0)
+        {
+            // identity from the previous read is served until the slave is read again
+            bool isStored = load(id, _record);
+            if (isStored)
+            {
+                tianBMS.restoreIdentity(id, _record.pcbBarcode.data(), _record.snCode1.data(), _record.snCode2.data());
+                _restoreCount++;
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            Slot& target = _slots[id];
+            target.state = isStored && !target.isLoaded ? STATE_KNOWN : STATE_UNKNOWN;
+            target.serialHash = isStored ? hashSerial(_record) : target.serialHash;
+            target.isLoaded = true;
+            target.discovered = now | 0x01;
+            target.lastSend = 0;
+            target.pendingHash = 0;
+            continue;
+        }
+        if (readTimestamp == 0 || readTimestamp == slot.readTimestamp || !tianBMS.getSnapshot(id, _record))
+        {
+            continue;
+        }
+        // the identity address is not confirmed on every firmware, a read is only trusted once the same non empty
+        // identity has been read twice. Nothing is stored nor reset before
+        uint32_t identityHash = hashIdentity(_record);
+        if (identityHash == 0 || identityHash != slot.pendingHash)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            Slot& target = _slots[id];
+            target.readTimestamp = readTimestamp;
+            target.pendingHash = identityHash;
+            // empty identity is not read again, the slave does not report it
+            target.state = identityHash == 0 ? STATE_KNOWN : STATE_UNKNOWN;
+            continue;
+        }
+        uint32_t hash = hashSerial(_record);
+        bool isSwapped = slot.serialHash != 0 && hash != 0 && hash != slot.serialHash;
+        if (isSwapped)
+        {
+            ESP_LOGI(_TAG, "Id : %d pack swapped\n", id);
+            _swapCount++;
+            if (swapCount < size)
+            {
+                swapped[swapCount++] = id;
+            }
+        }
+        TianBMSData stored;
+        if (!load(id, stored) || stored.pcbBarcode != _record.pcbBarcode || stored.snCode1 != _record.snCode1 ||
+            stored.snCode2 != _record.snCode2)
+        {
+            store(id, _record);
+        }
+        _readCount++;
+        std::lock_guard<std::mutex> lock(_mutex);
+        Slot& target = _slots[id];
+        target.readTimestamp = readTimestamp;
+        target.serialHash = hash;
+        target.pendingHash = 0;
+        target.state = STATE_KNOWN;
+    }
+    // slave that left the table is read again once it is found again
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (uint8_t id = TianBMSSlotTable::MIN_ID; id <= TianBMSSlotTable::MAX_ID; id++)
+    {
+        if (_slots[id].discovered != 0 && !table.contains(id))
+        {
+            _slots[id].discovered = 0;
+            _slots[id].state = STATE_UNKNOWN;
+        }
+    }
+    return swapCount;
+}
+
+/**
+ * Get the slave whose identity has to be read
+ *
+ * @param[in]   table   slot table, only the slave in the table is read
+ * @param[in]   now current time, millis()
+ * @param[in]   isIdle  the bus has spare time, no slave is due for its poll
+ * @param[in]   health  circuit breaker, only healthy slave is read. nullptr = every slave
+ *
+ * @return      slave id, -1 if no identity has to be read now
+*/
+int16_t TianBMSIdentity::next(const TianBMSSlotTable& table, uint32_t now, bool isIdle, const TianBMSHealth* health) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (uint8_t id = table.next(0); id != 0; id = table.next(id))
+    {
+        const Slot& slot = _slots[id];
+        if (slot.discovered == 0 || slot.state == STATE_KNOWN || (health != nullptr && !health->isHealthy(id)))
+        {
+            continue;
+        }
+        // lost read (response never applied) is issued again like a failed one
+        if (slot.lastSend != 0 && now - slot.lastSend < RETRY_INTERVAL)
+        {
+            continue;
+        }
+        // discovered is set by the loop, it may be slightly ahead of the time of the poll task
+        if (isIdle || (int32_t)(now - slot.discovered) >= (int32_t)MAX_WAIT)
+        {
+            return id;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Register identity read added to the modbus client queue
+ *
+ * @param[in]   id  slave id
+ * @param[in]   now current time, millis()
+*/
+void TianBMSIdentity::onSend(uint8_t id, uint32_t now)
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _slots[id].state = STATE_PENDING;
+    _slots[id].lastSend = now | 0x01;
+}
+
+/**
+ * Register failed identity read, it is issued again after RETRY_INTERVAL
+ *
+ * @param[in]   id  slave id
+*/
+void TianBMSIdentity::onError(uint8_t id)
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_slots[id].state == STATE_PENDING)
+    {
+        _slots[id].state = STATE_UNKNOWN;
+    }
+}
+
+/**
+ * Forget the presence of every slave, called when the data table is cleared so every slave found again is read again.
+ * The known serial number is kept for the pack swap detection
+*/
+void TianBMSIdentity::reset()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t id = 0; id < _slots.size(); id++)
+    {
+        _slots[id].discovered = 0;
+        _slots[id].state = STATE_UNKNOWN;
+        _slots[id].pendingHash = 0;
+    }
+}
+
+/**
+ * Get number of slave in the data table whose identity is known
+*/
+size_t TianBMSIdentity::getKnownCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t count = 0;
+    for (size_t id = TianBMSSlotTable::MIN_ID; id <= TianBMSSlotTable::MAX_ID; id++)
+    {
+        count += _slots[id].discovered != 0 && _slots[id].state == STATE_KNOWN;
+    }
+    return count;
+}
+
+/**
+ * Get number of identity read from the slave since boot
+*/
+uint32_t TianBMSIdentity::getReadCount() const
+{
+    return _readCount;
+}
+
+/**
+ * Get number of identity restored from NVS since boot
+*/
+uint32_t TianBMSIdentity::getRestoreCount() const
+{
+    return _restoreCount;
+}
+
+/**
+ * Get number of pack swap detected since boot
+*/
+uint32_t TianBMSIdentity::getSwapCount() const
+{
+    return _swapCount;
+}
+
+/**
+ * Load the stored identity of the slave into the identity string of the record
+ *
+ * @return      true if the slave has stored identity
+*/
+bool TianBMSIdentity::load(uint8_t id, TianBMSData& record)
+{
+    if (_name.length() == 0)
+    {
+        return false;
+    }
+    char key[8];
+    snprintf(key, sizeof(key), "u%u", id);
+    std::array<char, IDENTITY_SIZE> buffer;
+    Preferences preferences;
+    preferences.begin(_name.c_str(), true);
+    size_t length = preferences.isKey(key) ? preferences.getBytes(key, buffer.data(), buffer.size()) : 0;
+    preferences.end();
+    if (length != buffer.size())
+    {
+        return false;
+    }
+    std::array<char, 33>* destination[3] = {&record.pcbBarcode, &record.snCode1, &record.snCode2};
+    for (size_t i = 0; i < 3; i++)
+    {
+        memcpy(destination[i]->data(), buffer.data() + i * 33, 33);
+        (*destination[i])[32] = 0;
+    }
+    return true;
+}
+
+/**
+ * Write the identity string of the record into NVS
+*/
+void TianBMSIdentity::store(uint8_t id, const TianBMSData& record)
+{
+    if (_name.length() == 0)
+    {
+        return;
+    }
+    char key[8];
+    snprintf(key, sizeof(key), "u%u", id);
+    std::array<char, IDENTITY_SIZE> buffer;
+    memcpy(buffer.data(), record.pcbBarcode.data(), 33);
+    memcpy(buffer.data() + 33, record.snCode1.data(), 33);
+    memcpy(buffer.data() + 66, record.snCode2.data(), 33);
+    Preferences preferences;
+    preferences.begin(_name.c_str());
+    if (preferences.putBytes(key, buffer.data(), buffer.size()) != buffer.size())
+    {
+        ESP_LOGI(_TAG, "Id : %d identity not stored\n", id);
+    }
+    preferences.end();
+}
+
+/**
+ * Hash of the serial number (sn code 1 and 2), FNV-1a
+ *
+ * @return      hash, 0 if the record has no serial number
+*/
+uint32_t TianBMSIdentity::hashSerial(const TianBMSData& record)
+{
+    const char* serial[2] = {record.snCode1.data(), record.snCode2.data()};
+    return hashStrings(serial, 2);
+}
+
+/**
+ * Hash of the whole identity (pcb barcode, sn code 1 and 2), FNV-1a, used to confirm a read with the next one
+ *
+ * @return      hash, 0 if the record has no identity
+*/
+uint32_t TianBMSIdentity::hashIdentity(const TianBMSData& record)
+{
+    const char* identity[3] = {record.pcbBarcode.data(), record.snCode1.data(), record.snCode2.data()};
+    return hashStrings(identity, 3);
+}
+
+/**
+ * Hash of the strings, FNV-1a with a separator after each string
+ *
+ * @return      hash, 0 if every string is empty
+*/
+uint32_t TianBMSIdentity::hashStrings(const char* const* strings, size_t count)
+{
+    bool isEmpty = true;
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < count; i++)
+    {
+        for (const char* c = strings[i]; *c != 0; c++)
+        {
+            hash = (hash ^ (uint8_t)*c) * 16777619UL;
+            isEmpty = false;
+        }
+        hash = (hash ^ 0xFF) * 16777619UL;
+    }
+    if (isEmpty)
+    {
+        return 0;
+    }
+    return hash != 0 ? hash : 1;
+}
@@ -0,0 +1,81 @@
+#ifndef TIANBMS_IDENTITY_H
+#define TIANBMS_IDENTITY_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <mutex>
+#include "TianBMS.h"
+#include "TianBMSHealth.h"
+
+/**
+ * Identity string (pcb barcode, sn code 1 and 2) of every slave, read once per slave and kept in NVS by unit id.
+ *
+ *  - slave appearing in the data table gets its identity from NVS straight away. On the first appearance since boot
+ *    it is trusted and never read, afterward (slave dropped and found again, rescan) it is read again to verify it
+ *  - the read is issued on spare bus time, when the slave to poll next is not due yet, or once the slave has waited
+ *    MAX_WAIT so a saturated bus still reads it. Slave that did not answer its last poll is not read (refer to
+ *    TianBMSHealth)
+ *  - read identity is only trusted once the same non empty identity has been read twice, RETRY_INTERVAL apart. The
+ *    confirmed identity is written to NVS only when it differs from the stored one. A serial number different from
+ *    the known one is a pack swap, the caller resets the statistic of the slave. Empty identity is not read again
+ *
+ * Only a hash of the serial number is kept in RAM, the string lives in the slave record and in NVS. refresh() is
+ * called from the loop inside the write section of TianBMS, next() and onSend() from the poll task, onError() from
+ * the modbus client task
+*/
+class TianBMSIdentity
+{
+public:
+    static const uint32_t RETRY_INTERVAL = 30000;   // ms, failed or lost read is issued again after this time
+    static const uint32_t MAX_WAIT = 60000;         // ms, read without waiting for spare bus time after this time
+
+    TianBMSIdentity();
+    void begin(const char* name);
+    size_t refresh(TianBMS& tianBMS, uint32_t now, uint8_t* swapped, size_t size);
+    int16_t next(const TianBMSSlotTable& table, uint32_t now, bool isIdle, const TianBMSHealth* health = nullptr) const;
+    void onSend(uint8_t id, uint32_t now);
+    void onError(uint8_t id);
+    void reset();
+    size_t getKnownCount() const;
+    uint32_t getReadCount() const;
+    uint32_t getRestoreCount() const;
+    uint32_t getSwapCount() const;
+
+private:
+    enum State : uint8_t
+    {
+        STATE_UNKNOWN = 0x00,   // read needed
+        STATE_PENDING = 0x01,   // read in flight
+        STATE_KNOWN = 0x02
+    };
+
+    struct Slot
+    {
+        uint32_t serialHash = 0;        // 0 = no serial number known
+        uint32_t pendingHash = 0;       // identity read once and waiting for confirmation, 0 = none
+        uint32_t readTimestamp = 0;     // identity timestamp of the last handled read
+        uint32_t discovered = 0;        // 0 = not in the data table
+        uint32_t lastSend = 0;
+        State state = STATE_UNKNOWN;
+        bool isLoaded = false;          // NVS looked up since boot
+    };
+
+    const char* _TAG = "TIANBMS IDENTITY";
+    mutable std::mutex _mutex;
+    std::array<Slot, TianBMSSlotTable::MAX_ID + 1> _slots;
+    String _name;
+    uint32_t _readCount = 0;
+    uint32_t _restoreCount = 0;
+    uint32_t _swapCount = 0;
+    TianBMSData _record;
+    bool load(uint8_t id, TianBMSData& record);
+    void store(uint8_t id, const TianBMSData& record);
+    static uint32_t hashSerial(const TianBMSData& record);
+    static uint32_t hashIdentity(const TianBMSData& record);
+    static uint32_t hashStrings(const char* const* strings, size_t count);
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "TianBMSInflightTable.h"
+#include <string.h>
+#include <chrono>
+
+TianBMSInflightTable::TianBMSInflightTable()
+{
+}
+
+/**
+ * Join the in flight request with the same key, or open new entry if there is none
+ *
+ * @param[in]   key request key
+ * @param[out]  isLeader    true if the caller opened the entry and has to forward the request
+ *
+ * @return      entry index, -1 if the table is full (the request is forwarded without coalescing)
+*/
+int16_t TianBMSInflightTable::join(const Key& key, bool& isLeader)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    int16_t freeEntry = -1;
+    for (size_t i = 0; i < _entries.size(); i++)
+    {
+        Entry& entry = _entries[i];
+        if (entry.state == STATE_PENDING && entry.key.id == key.id && entry.key.functionCode == key.functionCode &&
+            entry.key.address == key.address && entry.key.count == key.count)
+        {
+            entry.refCount++;
+            _coalescedCount++;
+            isLeader = false;
+            return i;
+        }
+        if (entry.state == STATE_FREE && freeEntry < 0)
+        {
+            freeEntry = i;
+        }
+    }
+    isLeader = true;
+    if (freeEntry < 0)
+    {
+        return -1;
+    }
+    Entry& entry = _entries[freeEntry];
+    entry.key = key;
+    entry.state = STATE_PENDING;
+    entry.refCount = 1;
+    entry.length = 0;
+    return freeEntry;
+}
+
+/**
+ * Store the response of the leader and wake up the follower
+ *
+ * @param[in]   entry   entry index
+ * @param[in]   message response message (unit id, function code, data), length 0 if the request failed
+ * @param[in]   length  message length, longer message is not shared
+*/
+void TianBMSInflightTable::complete(int16_t entry, const uint8_t* message, size_t length)
+{
+    if (entry < 0 || (size_t)entry >= _entries.size())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Entry& target = _entries[entry];
+        target.length = length <= MESSAGE_SIZE ? length : 0;
+        memcpy(target.message.data(), message, target.length);
+        target.state = STATE_DONE;
+    }
+    _done.notify_all();
+}
+
+/**
+ * Wait for the response of the leader
+ *
+ * @param[in]   entry   entry index
+ * @param[out]  message destination of the response message
+ * @param[in]   capacity    size of the destination
+ * @param[in]   timeout maximum wait in ms
+ *
+ * @return      message length, 0 on timeout or if the leader got no response
+*/
+size_t TianBMSInflightTable::wait(int16_t entry, uint8_t* message, size_t capacity, uint32_t timeout)
+{
+    if (entry < 0 || (size_t)entry >= _entries.size())
+    {
+        return 0;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    Entry& target = _entries[entry];
+    if (!_done.wait_for(lock, std::chrono::milliseconds(timeout), [&target] { return target.state == STATE_DONE; }))
+    {
+        return 0;
+    }
+    if (target.length > capacity)
+    {
+        return 0;
+    }
+    memcpy(message, target.message.data(), target.length);
+    return target.length;
+}
+
+/**
+ * Leave the entry, it is freed once every request left it
+ *
+ * @param[in]   entry   entry index
+*/
+void TianBMSInflightTable::leave(int16_t entry)
+{
+    if (entry < 0 || (size_t)entry >= _entries.size())
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    Entry& target = _entries[entry];
+    if (target.refCount > 0)
+    {
+        target.refCount--;
+    }
+    if (target.refCount == 0)
+    {
+        target.state = STATE_FREE;
+    }
+}
+
+/**
+ * Get number of request answered with the response of another request
+ *
+ * @return      coalesced count
+*/
+uint32_t TianBMSInflightTable::getCoalescedCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _coalescedCount;
+}
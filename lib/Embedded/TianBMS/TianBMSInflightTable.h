@@ -0,0 +1,64 @@
+#ifndef TIANBMS_INFLIGHT_TABLE_H
+#define TIANBMS_INFLIGHT_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * Table of the read request forwarded by the modbus proxy and not answered yet. Identical request (same unit id,
+ * function code, address and count) arriving while one is in flight join it instead of being sent again, and get the
+ * response of the first one (the leader).
+ *
+ * Leader : join() -> forward -> complete() -> leave()
+ * Follower : join() -> wait() -> leave()
+ *
+ * Entry is freed when the last request leave it. Used from every modbus proxy client task
+*/
+class TianBMSInflightTable
+{
+public:
+    static const size_t CAPACITY = 8;
+    static const size_t MESSAGE_SIZE = 256;
+
+    struct Key
+    {
+        uint8_t id;
+        uint8_t functionCode;
+        uint16_t address;
+        uint16_t count;
+    };
+
+    TianBMSInflightTable();
+    int16_t join(const Key& key, bool& isLeader);
+    void complete(int16_t entry, const uint8_t* message, size_t length);
+    size_t wait(int16_t entry, uint8_t* message, size_t capacity, uint32_t timeout);
+    void leave(int16_t entry);
+    uint32_t getCoalescedCount() const;
+
+private:
+    enum State : uint8_t
+    {
+        STATE_FREE = 0x00,
+        STATE_PENDING = 0x01,
+        STATE_DONE = 0x02
+    };
+
+    struct Entry
+    {
+        Key key = {0, 0, 0, 0};
+        State state = STATE_FREE;
+        uint8_t refCount = 0;
+        uint16_t length = 0;
+        std::array<uint8_t, MESSAGE_SIZE> message;
+    };
+
+    std::array<Entry, CAPACITY> _entries;
+    mutable std::mutex _mutex;
+    std::condition_variable _done;
+    uint32_t _coalescedCount = 0;
+};
+
+#endif
@@ -0,0 +1,1255 @@
+#include "TianBMSJsonStream.h"
+
+TianBMSJsonWriter::TianBMSJsonWriter(char* buffer, size_t capacity)
+{
+    _buffer = buffer;
+    _capacity = capacity;
+}
+
+/**
+ * Append single character
+*/
+void TianBMSJsonWriter::append(char c)
+{
+    if (_length >= _capacity)
+    {
+        _isOverflow = true;
+        return;
+    }
+    _buffer[_length++] = c;
+}
+
+/**
+ * Append null terminated string as is, without quote and escape
+*/
+void TianBMSJsonWriter::append(const char* str)
+{
+    while (*str != 0)
+    {
+        append(*str++);
+    }
+}
+
+/**
+ * Append unsigned integer as decimal
+*/
+void TianBMSJsonWriter::appendUInt(uint32_t value)
+{
+    if (_length + 10 > _capacity)
+    {
+        _isOverflow = true;
+        return;
+    }
+    _length += Utilities::uintToChar(value, _buffer + _length);
+}
+
+/**
+ * Append signed integer as decimal
+*/
+void TianBMSJsonWriter::appendInt(int32_t value)
+{
+    if (_length + 11 > _capacity)
+    {
+        _isOverflow = true;
+        return;
+    }
+    _length += Utilities::intToChar(value, _buffer + _length);
+}
+
+/**
+ * Append string as quoted json string, special and control character are escaped
+ * 
+ * @param[in]   str the string
+ * @param[in]   maxLength   maximum number of character read from str, stop earlier on null terminator
+*/
+void TianBMSJsonWriter::appendString(const char* str, size_t maxLength)
+{
+    static const char hex[] = "0123456789abcdef";
+    append('"');
+    for (size_t i = 0; i < maxLength && str[i] != 0; i++)
+    {
+        uint8_t c = str[i];
+        if (c == '"' || c == '\\')
+        {
+            append('\\');
+            append((char)c);
+        }
+        else if (c < 0x20)
+        {
+            append("\\u00");
+            append(hex[c >> 4]);
+            append(hex[c & 0x0F]);
+        }
+        else
+        {
+            append((char)c);
+        }
+    }
+    append('"');
+}
+
+/**
+ * Append quoted object key followed by colon
+*/
+void TianBMSJsonWriter::appendKey(const char* key)
+{
+    append('"');
+    append(key);
+    append("\":");
+}
+
+/**
+ * Number of character written
+*/
+size_t TianBMSJsonWriter::length() const
+{
+    return _length;
+}
+
+/**
+ * Check if any write has been dropped because the buffer is full
+*/
+bool TianBMSJsonWriter::isOverflow() const
+{
+    return _isOverflow;
+}
+
+TianBMSJsonStream::TianBMSJsonStream()
+{
+}
+
+/**
+ * Start new document, must be called before the first read
+ * 
+ * @param[in]   tianBMS TianBMS object as the data source
+ * @param[in]   format  record format
+ * @param[in]   encoding    document encoding
+*/
+void TianBMSJsonStream::begin(TianBMS& tianBMS, Format format, Encoding encoding)
+{
+    end();
+    _tianBMS = &tianBMS;
+    _format = format;
+    _encoding = encoding;
+    _recordCount = 0;
+    _recordLimit = tianBMS.getTianBMSData().size();
+    _fieldCount = TianBMSRegister::enabledCount();
+    _filter = TianBMSFilter();
+    _phase = PHASE_OPEN;
+    _id = 0;
+    _field = FIELD_HEADER;
+    _isFirst = true;
+    _source = nullptr;
+    _sourceLength = 0;
+    _sourcePosition = 0;
+    _isDelta = false;
+    _isFull = true;
+    _isFailed = false;
+}
+
+/**
+ * Start new delta document holding only what changed after since, must be called before the first read
+ * 
+ * @param[in]   tianBMS TianBMS object as the data source
+ * @param[in]   since   data version already known by the client, 0 to get the full data
+*/
+void TianBMSJsonStream::beginChanges(TianBMS& tianBMS, uint32_t since)
+{
+    begin(tianBMS);
+    _isDelta = true;
+    _since = since;
+    _until = tianBMS.getVersion();
+    _changed.fill(0);
+    _isFull = since == 0 || !tianBMS.getChanges(since, _until, _changed.data(), _changed.size());
+}
+
+/**
+ * Start new Prometheus text exposition document, must be called before the first read
+ * 
+ * @param[in]   tianBMS TianBMS object as the data source
+ * @param[in]   collector   optional, writer of the collector metric appended after the bms metric
+*/
+void TianBMSJsonStream::beginMetrics(TianBMS& tianBMS, MetricsCollector collector)
+{
+    begin(tianBMS, FORMAT_FULL, ENCODING_PROMETHEUS);
+    _metric = METRIC_MSG_COUNT;
+    _element = ELEMENT_HEADER;
+    _collector = collector;
+    _collectorIndex = 0;
+}
+
+/**
+ * Restrict the document to the slave and field selected by the filter, must be called after begin() and before the
+ * first read
+ * 
+ * @param[in]   filter  slave and field selection, copied into the stream
+*/
+void TianBMSJsonStream::setFilter(const TianBMSFilter& filter)
+{
+    _filter = filter;
+    if (!filter.isAllFields())
+    {
+        _fieldCount = 0;
+        for (size_t i = 0; i < TianBMSRegister::FIELD_COUNT; i++)
+        {
+            _fieldCount += isFieldSelected(i) ? 1 : 0;
+        }
+    }
+    if (!filter.isAllSlaves())
+    {
+        _recordLimit = 0;
+        for (uint8_t id = nextRecord(0); id != 0; id = nextRecord(id))
+        {
+            _recordLimit++;
+        }
+    }
+}
+
+/**
+ * Stop the document, it can not be read any further
+*/
+void TianBMSJsonStream::end()
+{
+    _field = FIELD_HEADER;
+    _phase = PHASE_DONE;
+    _sourceLength = 0;
+    _sourcePosition = 0;
+}
+
+/**
+ * Write the next part of the document into buffer
+ * 
+ * @param[in]   buffer  destination buffer
+ * @param[in]   maxLen  size of the destination buffer
+ * 
+ * @return      number of byte written, 0 when the document is finished
+*/
+size_t TianBMSJsonStream::read(uint8_t* buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (_sourcePosition < _sourceLength)
+        {
+            size_t length = _sourceLength - _sourcePosition;
+            if (length > maxLen - written)
+            {
+                length = maxLen - written;
+            }
+            memcpy(buffer + written, _source + _sourcePosition, length);
+            _sourcePosition += length;
+            written += length;
+            continue;
+        }
+        if (!fill())
+        {
+            break;
+        }
+    }
+    return written;
+}
+
+/**
+ * Check if the whole document has been written
+*/
+bool TianBMSJsonStream::isFinished() const
+{
+    return _phase == PHASE_DONE && _sourcePosition >= _sourceLength;
+}
+
+/**
+ * Check if the document has been stopped because a fragment did not fit in the scratch buffer, the bytes already
+ * read are not a complete document
+*/
+bool TianBMSJsonStream::isFailed() const
+{
+    return _isFailed;
+}
+
+/**
+ * Get number of document stopped by overflow of the scratch buffer since boot
+*/
+uint32_t TianBMSJsonStream::getFailCount() const
+{
+    return _failCount;
+}
+
+/**
+ * Render the next fragment of the document into the scratch buffer
+ * 
+ * @return      true if new fragment is available, false when the document is finished
+*/
+bool TianBMSJsonStream::fill()
+{
+    if (_encoding == ENCODING_PROMETHEUS)
+    {
+        return fillMetrics();
+    }
+    if (_encoding != ENCODING_JSON)
+    {
+        return fillBinary();
+    }
+    TianBMSJsonWriter writer(_scratch.data(), _scratch.size());
+    while (writer.length() == 0)
+    {
+        switch (_phase)
+        {
+        case PHASE_OPEN:
+            if (_isDelta)
+            {
+                writer.append("{\"version\":");
+                writer.appendUInt(_until);
+                writer.append(",\"since\":");
+                writer.appendUInt(_since);
+                writer.append(_isFull ? ",\"full\":true," : ",\"full\":false,");
+            }
+            else
+            {
+                writer.append('{');
+            }
+            writer.append("\"data\":[");
+            _id = nextRecord(0);
+            _phase = PHASE_RECORD;
+            break;
+        case PHASE_RECORD:
+            if (_field == FIELD_HEADER)
+            {
+                // take the snapshot of the next present slave, slave removed in the meantime is skipped
+                while (_id != 0 && !_tianBMS->getSnapshot(_id, _record))
+                {
+                    _id = nextRecord(_id);
+                }
+                if (_id == 0)
+                {
+                    if (_isDelta)
+                    {
+                        writer.append("],\"removed\":[");
+                        _isFirst = true;
+                        _id = nextRemoved(0);
+                        _phase = PHASE_REMOVED;
+                        break;
+                    }
+                    _phase = PHASE_CLOSE;
+                    break;
+                }
+                if (!_isFirst)
+                {
+                    writer.append(',');
+                }
+                _isFirst = false;
+                if (_format == FORMAT_COMPACT)
+                {
+                    writer.append('[');
+                    writer.appendUInt(_record.msgCount);
+                    writer.append(',');
+                    writer.appendUInt(_record.id);
+                }
+                else
+                {
+                    renderHeader(writer, _record);
+                }
+                _field = 0;
+                break;
+            }
+            while (_field < (int16_t)TianBMSRegister::FIELD_COUNT && !isFieldWritten(_field))
+            {
+                _field++;
+            }
+            if (_field < (int16_t)TianBMSRegister::FIELD_COUNT)
+            {
+                writer.append(',');
+                if (_format == FORMAT_COMPACT && !isFieldSelected(_field))
+                {
+                    writer.append("null");
+                }
+                else if (_format == FORMAT_COMPACT)
+                {
+                    renderCompactField(writer, _record, TianBMSRegister::FIELDS[_field]);
+                }
+                else
+                {
+                    renderField(writer, _record, TianBMSRegister::FIELDS[_field]);
+                }
+                _field++;
+            }
+            else
+            {
+                writer.append(_format == FORMAT_COMPACT ? ']' : '}');
+                _field = FIELD_HEADER;
+                _id = nextRecord(_id);
+            }
+            break;
+        case PHASE_REMOVED:
+            if (_id == 0)
+            {
+                _phase = PHASE_CLOSE;
+                break;
+            }
+            if (!_isFirst)
+            {
+                writer.append(',');
+            }
+            _isFirst = false;
+            writer.appendUInt(_id);
+            _id = nextRemoved(_id);
+            break;
+        case PHASE_CLOSE:
+            writer.append("]}");
+            _phase = PHASE_DONE;
+            break;
+        default:
+            return false;
+        }
+        if (writer.isOverflow())
+        {
+            return fail();
+        }
+    }
+    _source = _scratch.data();
+    _sourceLength = writer.length();
+    _sourcePosition = 0;
+    return true;
+}
+
+/**
+ * Render the next fragment of the CBOR or MessagePack document into the scratch buffer, {"data":[record,...]} with
+ * record as map (FORMAT_FULL) or array (FORMAT_COMPACT)
+ * 
+ * @return      true if new fragment is available, false when the document is finished
+*/
+bool TianBMSJsonStream::fillBinary()
+{
+    TianBMSBinaryWriter::Encoding encoding = _encoding == ENCODING_CBOR ?
+        TianBMSBinaryWriter::ENCODING_CBOR : TianBMSBinaryWriter::ENCODING_MSGPACK;
+    TianBMSBinaryWriter writer(reinterpret_cast<uint8_t*>(_scratch.data()), _scratch.size(), encoding);
+    while (writer.length() == 0)
+    {
+        switch (_phase)
+        {
+        case PHASE_OPEN:
+            writer.beginMap(1);
+            writer.appendString("data", 4);
+            if (_encoding == ENCODING_CBOR)
+            {
+                writer.beginIndefiniteArray();
+            }
+            else
+            {
+                writer.beginArray(_recordLimit);
+            }
+            _id = nextRecord(0);
+            _phase = PHASE_RECORD;
+            break;
+        case PHASE_RECORD:
+            if (_field == FIELD_HEADER)
+            {
+                while (_id != 0 && !_tianBMS->getSnapshot(_id, _record))
+                {
+                    _id = nextRecord(_id);
+                }
+                // slave added after begin does not fit in the sized array of MessagePack
+                if (_id == 0 || (_encoding == ENCODING_MSGPACK && _recordCount >= _recordLimit))
+                {
+                    _phase = PHASE_CLOSE;
+                    break;
+                }
+                _recordCount++;
+                if (_format == FORMAT_COMPACT)
+                {
+                    writer.beginArray(2 + TianBMSRegister::enabledCount());
+                    writer.appendUInt(_record.msgCount);
+                    writer.appendUInt(_record.id);
+                }
+                else
+                {
+                    writer.beginMap(2 + _fieldCount);
+                    writer.appendString("msg_count", 9);
+                    writer.appendUInt(_record.msgCount);
+                    writer.appendString("id", 2);
+                    writer.appendUInt(_record.id);
+                }
+                _field = 0;
+                break;
+            }
+            while (_field < (int16_t)TianBMSRegister::FIELD_COUNT && !isFieldWritten(_field))
+            {
+                _field++;
+            }
+            if (_field < (int16_t)TianBMSRegister::FIELD_COUNT)
+            {
+                if (isFieldSelected(_field))
+                {
+                    renderBinaryField(writer, _record, TianBMSRegister::FIELDS[_field], _format);
+                }
+                else
+                {
+                    writer.appendNil();
+                }
+                _field++;
+                break;
+            }
+            // record is sized, nothing to close
+            _field = FIELD_HEADER;
+            _id = nextRecord(_id);
+            break;
+        case PHASE_CLOSE:
+            if (_encoding == ENCODING_CBOR)
+            {
+                writer.endIndefinite();
+            }
+            while (_recordCount < _recordLimit && _encoding == ENCODING_MSGPACK)
+            {
+                writer.appendNil();
+                _recordCount++;
+            }
+            _phase = PHASE_DONE;
+            if (writer.length() == 0)
+            {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+        if (writer.isOverflow())
+        {
+            return fail();
+        }
+    }
+    _source = _scratch.data();
+    _sourceLength = writer.length();
+    _sourcePosition = 0;
+    return true;
+}
+
+/**
+ * Stop the document on overflow of the scratch buffer. The truncated fragment is dropped rather than sent, the client
+ * gets a document it can not parse instead of a silently corrupted one
+ * 
+ * @return      false, no fragment available
+*/
+bool TianBMSJsonStream::fail()
+{
+    _failCount++;
+    end();
+    _isFailed = true;
+    return false;
+}
+
+namespace {
+    /**
+     * Label text of each slave (slave="1") and cell (,cell="1"}), built once on the first scrape
+    */
+    struct MetricLabels
+    {
+        std::array<std::array<char, 12>, TianBMSSlotTable::MAX_ID + 1> slave;
+        std::array<std::array<char, 12>, 64> cell;
+
+        MetricLabels()
+        {
+            for (size_t id = 0; id < slave.size(); id++)
+            {
+                snprintf(slave[id].data(), slave[id].size(), "slave=\"%u\"", (unsigned int)id);
+            }
+            for (size_t n = 0; n < cell.size(); n++)
+            {
+                snprintf(cell[n].data(), cell[n].size(), ",cell=\"%u\"", (unsigned int)(n + 1));
+            }
+        }
+    };
+
+    const MetricLabels& metricLabels()
+    {
+        static MetricLabels labels;
+        return labels;
+    }
+
+    /**
+     * Append label value, backslash, quote and new line are escaped, other control character is dropped
+    */
+    void appendLabelValue(TianBMSJsonWriter& writer, const char* str, size_t maxLength)
+    {
+        for (size_t i = 0; i < maxLength && str[i] != 0; i++)
+        {
+            char c = str[i];
+            if (c == '\\' || c == '"')
+            {
+                writer.append('\\');
+                writer.append(c);
+            }
+            else if (c == '\n')
+            {
+                writer.append("\\n");
+            }
+            else if ((uint8_t)c >= 0x20)
+            {
+                writer.append(c);
+            }
+        }
+    }
+}
+
+/**
+ * Render the next line of the Prometheus document into the scratch buffer. The metric are written family by family,
+ * every slave of the family before the next one, as required by the exposition format. Snapshot of the slave is taken
+ * once per family, not per cell or flag bit
+ * 
+ * @return      true if new fragment is available, false when the document is finished
+*/
+bool TianBMSJsonStream::fillMetrics()
+{
+    TianBMSJsonWriter writer(_scratch.data(), _scratch.size());
+    const TianBMSSlotTable& table = _tianBMS->getTianBMSData();
+    while (writer.length() == 0)
+    {
+        switch (_phase)
+        {
+        case PHASE_OPEN:
+            _phase = PHASE_RECORD;
+            break;
+        case PHASE_RECORD:
+            if (_metric > METRIC_INFO)
+            {
+                _phase = PHASE_CLOSE;
+                break;
+            }
+            if (_metric >= 0 && _metric < METRIC_INFO &&
+                (!TianBMSRegister::FIELDS[_metric].enabled || TianBMSRegister::FIELDS[_metric].type == TianBMSRegister::TYPE_STRING))
+            {
+                _metric++;
+                break;
+            }
+            if (_element == ELEMENT_HEADER)
+            {
+                if (_metric == METRIC_MSG_COUNT)
+                {
+                    renderMetricHeader(writer, "messages_total", "Number of response applied to the slave record", "counter");
+                }
+                else if (_metric == METRIC_ERROR_COUNT)
+                {
+                    renderMetricHeader(writer, "error_count", "Consecutive failed request of the slave", "gauge");
+                }
+                else if (_metric == METRIC_INFO)
+                {
+                    renderMetricHeader(writer, "info", "Identity of the slave", "gauge");
+                }
+                else
+                {
+                    const TianBMSRegister::Descriptor& field = TianBMSRegister::FIELDS[_metric];
+                    renderMetricHeader(writer, field.key, "Slave field", "gauge", field.unit);
+                }
+                _id = table.next(0);
+                _element = 0;
+                break;
+            }
+            if (_id == 0)
+            {
+                _metric++;
+                _element = ELEMENT_HEADER;
+                break;
+            }
+            if (_element == 0 && !_tianBMS->getSnapshot(_id, _record))
+            {
+                _id = table.next(_id);
+                break;
+            }
+            renderMetricLine(writer);
+            break;
+        case PHASE_CLOSE:
+            if (_collector == nullptr || !_collector(writer, _collectorIndex))
+            {
+                _phase = PHASE_DONE;
+                return writer.length() > 0;
+            }
+            _collectorIndex++;
+            break;
+        default:
+            return false;
+        }
+        if (writer.isOverflow())
+        {
+            return fail();
+        }
+    }
+    _source = _scratch.data();
+    _sourceLength = writer.length();
+    _sourcePosition = 0;
+    return true;
+}
+
+/**
+ * Render the sample of the current metric, slave and element, then move to the next element or slave. Flag write one
+ * sample per named bit, array one sample per element
+*/
+void TianBMSJsonStream::renderMetricLine(TianBMSJsonWriter& writer)
+{
+    const MetricLabels& labels = metricLabels();
+    size_t elementCount = 1;
+    if (_metric == METRIC_MSG_COUNT || _metric == METRIC_ERROR_COUNT)
+    {
+        writer.append(_metric == METRIC_MSG_COUNT ? "tianbms_messages_total{" : "tianbms_error_count{");
+        writer.append(labels.slave[_id].data());
+        writer.append("} ");
+        writer.appendUInt(_metric == METRIC_MSG_COUNT ? _record.msgCount : _record.errorCount);
+        writer.append('\n');
+    }
+    else if (_metric == METRIC_INFO)
+    {
+        writer.append("tianbms_info{");
+        writer.append(labels.slave[_id].data());
+        for (size_t i = 0; i < TianBMSRegister::FIELD_COUNT; i++)
+        {
+            const TianBMSRegister::Descriptor& field = TianBMSRegister::FIELDS[i];
+            if (field.enabled && field.type == TianBMSRegister::TYPE_STRING)
+            {
+                writer.append(',');
+                writer.append(field.key);
+                writer.append("=\"");
+                appendLabelValue(writer, TianBMSRegister::fieldString(_record, field), field.count * 2);
+                writer.append('"');
+            }
+        }
+        writer.append("} 1\n");
+    }
+    else
+    {
+        const TianBMSRegister::Descriptor& field = TianBMSRegister::FIELDS[_metric];
+        if (field.type == TianBMSRegister::TYPE_FLAG)
+        {
+            elementCount = 16;
+            if (field.bitNames[_element] != nullptr)
+            {
+                writer.append("tianbms_");
+                writer.append(field.key);
+                writer.append('{');
+                writer.append(labels.slave[_id].data());
+                writer.append(",flag=\"");
+                writer.append(field.bitNames[_element]);
+                writer.append("\"} ");
+                writer.append(((TianBMSRegister::fieldValue(_record, field) >> _element) & 0x01) ? '1' : '0');
+                writer.append('\n');
+            }
+        }
+        else
+        {
+            bool isArray = field.type == TianBMSRegister::TYPE_UINT16_ARRAY;
+            elementCount = isArray ? field.count : 1;
+            writer.append("tianbms_");
+            writer.append(field.key);
+            writer.append('{');
+            writer.append(labels.slave[_id].data());
+            if (isArray && (size_t)_element < labels.cell.size())
+            {
+                writer.append(labels.cell[_element].data());
+            }
+            writer.append("} ");
+            int64_t value = TianBMSRegister::fieldValue(_record, field, _element);
+            if (field.type == TianBMSRegister::TYPE_UINT32)
+            {
+                writer.appendUInt(value);
+            }
+            else
+            {
+                renderScaled(writer, value, field.divider);
+            }
+            writer.append('\n');
+        }
+    }
+    _element++;
+    if ((size_t)_element >= elementCount)
+    {
+        _element = 0;
+        _id = _tianBMS->getTianBMSData().next(_id);
+    }
+}
+
+/**
+ * Render the HELP and TYPE line of a metric family, the name is prefixed with tianbms_
+ * 
+ * @param[in]   writer  destination writer
+ * @param[in]   name    name of the metric without prefix
+ * @param[in]   help    help text
+ * @param[in]   type    metric type, gauge or counter
+ * @param[in]   unit    optional, unit appended to the help text
+*/
+void TianBMSJsonStream::renderMetricHeader(TianBMSJsonWriter& writer, const char* name, const char* help, const char* type,
+    const char* unit)
+{
+    writer.append("# HELP tianbms_");
+    writer.append(name);
+    writer.append(' ');
+    writer.append(help);
+    if (unit != nullptr && strcmp(unit, "None") != 0)
+    {
+        writer.append(", unit ");
+        writer.append(unit);
+    }
+    writer.append("\n# TYPE tianbms_");
+    writer.append(name);
+    writer.append(' ');
+    writer.append(type);
+    writer.append('\n');
+}
+
+/**
+ * Render raw value divided by the divider as decimal number, 5820 with divider 100 is written as 58.20
+ * 
+ * @param[in]   writer  destination writer
+ * @param[in]   value   raw value
+ * @param[in]   divider power of 10
+*/
+void TianBMSJsonStream::renderScaled(TianBMSJsonWriter& writer, int32_t value, uint16_t divider)
+{
+    if (divider <= 1)
+    {
+        writer.appendInt(value);
+        return;
+    }
+    uint32_t magnitude = value < 0 ? -(int64_t)value : value;
+    if (value < 0)
+    {
+        writer.append('-');
+    }
+    writer.appendUInt(magnitude / divider);
+    writer.append('.');
+    uint32_t fraction = magnitude % divider;
+    for (uint32_t digit = divider / 10; digit > 0; digit /= 10)
+    {
+        writer.append('0' + (fraction / digit) % 10);
+    }
+}
+
+/**
+ * Next slave written into the data array, every present slave selected by the filter for get-data and full delta,
+ * otherwise only the slave changed after since. Selected slave is looked up directly by id
+ * 
+ * @param[in]   id  current slave, 0 to get the first one
+ * 
+ * @return      id of the next slave, 0 if there is no more
+*/
+uint8_t TianBMSJsonStream::nextRecord(uint8_t id) const
+{
+    const TianBMSSlotTable& table = _tianBMS->getTianBMSData();
+    do
+    {
+        id = _filter.isAllSlaves() ? table.next(id) : _filter.nextSlave(id);
+    } while (id != 0 && (!table.contains(id) ||
+        (_isDelta && !_isFull && (_changed[id] & TianBMSChangeLog::GROUP_ALL) == 0)));
+    return id;
+}
+
+/**
+ * Next slave removed after since and not found again
+ * 
+ * @param[in]   id  current slave, 0 to get the first one
+ * 
+ * @return      id of the next slave, 0 if there is no more
+*/
+uint8_t TianBMSJsonStream::nextRemoved(uint8_t id) const
+{
+    if (_isFull)
+    {
+        return 0;
+    }
+    for (uint16_t next = id + 1; next <= TianBMSSlotTable::MAX_ID; next++)
+    {
+        if ((_changed[next] & TianBMSChangeLog::GROUP_REMOVED) && !_tianBMS->getTianBMSData().contains(next))
+        {
+            return next;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Check if the value of the field is written for the current record. The field has to be enabled and selected by the
+ * filter. Delta document only write the field of the group changed after since, the group version is used so the field
+ * changed after the snapshot version is not missed
+ * 
+ * @param[in]   index   position of the field in TianBMSRegister::FIELDS
+ * 
+ * @return      true if the value is written
+*/
+bool TianBMSJsonStream::isFieldSelected(size_t index) const
+{
+    const TianBMSRegister::Descriptor& field = TianBMSRegister::FIELDS[index];
+    if (!field.enabled || !_filter.hasField(index))
+    {
+        return false;
+    }
+    if (!_isDelta || _isFull)
+    {
+        return true;
+    }
+    return _tianBMS->getGroupVersion(_record.id, field.group) > _since;
+}
+
+/**
+ * Check if the field takes a position in the current record, FORMAT_COMPACT keep the position of every enabled field
+ * 
+ * @param[in]   index   position of the field in TianBMSRegister::FIELDS
+*/
+bool TianBMSJsonStream::isFieldWritten(size_t index) const
+{
+    if (_format == FORMAT_COMPACT)
+    {
+        return TianBMSRegister::FIELDS[index].enabled;
+    }
+    return isFieldSelected(index);
+}
+
+/**
+ * Render the whole record object, in the same format as TianBMSJsonManager::buildData()
+ * 
+ * @param[in]   writer  destination writer
+ * @param[in]   record  source record
+*/
+void TianBMSJsonStream::renderRecord(TianBMSJsonWriter& writer, const TianBMSData& record)
+{
+    renderHeader(writer, record);
+    for (size_t i = 0; i < TianBMSRegister::FIELD_COUNT; i++)
+    {
+        if (TianBMSRegister::FIELDS[i].enabled)
+        {
+            writer.append(',');
+            renderField(writer, record, TianBMSRegister::FIELDS[i]);
+        }
+    }
+    writer.append('}');
+}
+
+/**
+ * Render the opening of the record object with its meta field, {"msg_count":1,"id":1
+ * 
+ * @param[in]   writer  destination writer
+ * @param[in]   record  source record
+*/
+void TianBMSJsonStream::renderHeader(TianBMSJsonWriter& writer, const TianBMSData& record)
+{
+    writer.append("{\"msg_count\":");
+    writer.appendUInt(record.msgCount);
+    writer.append(",\"id\":");
+    writer.appendUInt(record.id);
+}
+
+/**
+ * Render single field as "key":value, in the same format as TianBMSJsonManager::buildData()
+ * 
+ * @param[in]   writer  destination writer
+ * @param[in]   record  source record
+ * @param[in]   field   field descriptor
+*/
+void TianBMSJsonStream::renderField(TianBMSJsonWriter& writer, const TianBMSData& record, const TianBMSRegister::Descriptor& field)
+{
+    writer.appendKey(field.key);
+    if (field.type == TianBMSRegister::TYPE_STRING)
+    {
+        writer.appendString(TianBMSRegister::fieldString(record, field), field.count * 2);
+        return;
+    }
+
+    writer.append("{\"unit\":");
+    writer.appendString(field.unit, 16);
+    if (field.type == TianBMSRegister::TYPE_FLAG)
+    {
+        uint16_t value = TianBMSRegister::fieldValue(record, field);
+        writer.append(",\"value\":");
+        writer.appendUInt(value);
+        for (size_t bit = 0; bit < 16; bit++)
+        {
+            if (field.bitNames[bit] != nullptr)
+            {
+                writer.append(',');
+                writer.appendKey(field.bitNames[bit]);
+                writer.append(((value >> bit) & 0x01) ? '1' : '0');
+            }
+        }
+    }
+    else
+    {
+        writer.append(",\"divider\":");
+        writer.appendUInt(field.divider);
+        writer.append(",\"value\":");
+        if (field.type == TianBMSRegister::TYPE_UINT16_ARRAY)
+        {
+            writer.append('[');
+            for (size_t n = 0; n < field.count; n++)
+            {
+                if (n > 0)
+                {
+                    writer.append(',');
+                }
+                writer.appendUInt(TianBMSRegister::fieldValue(record, field, n));
+            }
+            writer.append(']');
+        }
+        else if (field.type == TianBMSRegister::TYPE_UINT32)
+        {
+            writer.appendUInt(TianBMSRegister::fieldValue(record, field));
+        }
+        else
+        {
+            writer.appendInt(TianBMSRegister::fieldValue(record, field));
+        }
+    }
+    writer.append('}');
+}
+
+/**
+ * Render the raw value of single field, the key, unit and divider are only given by the schema
+ * 
+ * @param[in]   writer  destination writer
+ * @param[in]   record  source record
+ * @param[in]   field   field descriptor
+*/
+void TianBMSJsonStream::renderCompactField(TianBMSJsonWriter& writer, const TianBMSData& record, const TianBMSRegister::Descriptor& field)
+{
+    switch (field.type)
+    {
+    case TianBMSRegister::TYPE_STRING:
+        writer.appendString(TianBMSRegister::fieldString(record, field), field.count * 2);
+        break;
+    case TianBMSRegister::TYPE_UINT16_ARRAY:
+        writer.append('[');
+        for (size_t n = 0; n < field.count; n++)
+        {
+            if (n > 0)
+            {
+                writer.append(',');
+            }
+            writer.appendUInt(TianBMSRegister::fieldValue(record, field, n));
+        }
+        writer.append(']');
+        break;
+    case TianBMSRegister::TYPE_UINT32:
+    case TianBMSRegister::TYPE_FLAG:
+        writer.appendUInt(TianBMSRegister::fieldValue(record, field));
+        break;
+    default:
+        writer.appendInt(TianBMSRegister::fieldValue(record, field));
+        break;
+    }
+}
+
+/**
+ * Render single field in binary. FORMAT_FULL write the key followed by the same value as the json document, FORMAT_COMPACT
+ * only write the raw value
+ * 
+ * @param[in]   writer  destination writer
+ * @param[in]   record  source record
+ * @param[in]   field   field descriptor
+ * @param[in]   format  record format
+*/
+void TianBMSJsonStream::renderBinaryField(TianBMSBinaryWriter& writer, const TianBMSData& record, const TianBMSRegister::Descriptor& field, Format format)
+{
+    bool isFull = format == FORMAT_FULL;
+    if (isFull)
+    {
+        writer.appendString(field.key, 64);
+    }
+    if (field.type == TianBMSRegister::TYPE_STRING)
+    {
+        writer.appendString(TianBMSRegister::fieldString(record, field), field.count * 2);
+        return;
+    }
+
+    uint16_t value = TianBMSRegister::fieldValue(record, field);
+    if (isFull)
+    {
+        size_t size = 3;
+        if (field.type == TianBMSRegister::TYPE_FLAG)
+        {
+            size = 2;
+            for (size_t bit = 0; bit < 16; bit++)
+            {
+                size += field.bitNames[bit] != nullptr ? 1 : 0;
+            }
+        }
+        writer.beginMap(size);
+        writer.appendString("unit", 4);
+        writer.appendString(field.unit, 16);
+        if (field.type != TianBMSRegister::TYPE_FLAG)
+        {
+            writer.appendString("divider", 7);
+            writer.appendUInt(field.divider);
+        }
+        writer.appendString("value", 5);
+    }
+    switch (field.type)
+    {
+    case TianBMSRegister::TYPE_UINT16_ARRAY:
+        writer.appendUInt16Bytes(reinterpret_cast<const uint16_t*>(reinterpret_cast<const uint8_t*>(&record) + field.dataOffset), field.count);
+        break;
+    case TianBMSRegister::TYPE_UINT32:
+        writer.appendUInt(TianBMSRegister::fieldValue(record, field));
+        break;
+    case TianBMSRegister::TYPE_FLAG:
+        writer.appendUInt(value);
+        for (size_t bit = 0; bit < 16 && isFull; bit++)
+        {
+            if (field.bitNames[bit] != nullptr)
+            {
+                writer.appendString(field.bitNames[bit], 32);
+                writer.appendUInt((value >> bit) & 0x01);
+            }
+        }
+        break;
+    case TianBMSRegister::TYPE_UINT16:
+        writer.appendUInt(value);
+        break;
+    default:
+        writer.appendInt(TianBMSRegister::fieldValue(record, field));
+        break;
+    }
+}
+
+TianBMSJsonStreamHandle::TianBMSJsonStreamHandle()
+{
+}
+
+TianBMSJsonStreamHandle::TianBMSJsonStreamHandle(TianBMSJsonStreamPool* pool, size_t index)
+{
+    _pool = pool;
+    _index = index;
+}
+
+TianBMSJsonStreamHandle::TianBMSJsonStreamHandle(const TianBMSJsonStreamHandle& other)
+{
+    _pool = other._pool;
+    _index = other._index;
+    if (_pool != nullptr)
+    {
+        _pool->retain(_index);
+    }
+}
+
+TianBMSJsonStreamHandle& TianBMSJsonStreamHandle::operator=(const TianBMSJsonStreamHandle& other)
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+    if (other._pool != nullptr)
+    {
+        other._pool->retain(other._index);
+    }
+    if (_pool != nullptr)
+    {
+        _pool->release(_index);
+    }
+    _pool = other._pool;
+    _index = other._index;
+    return *this;
+}
+
+TianBMSJsonStreamHandle::~TianBMSJsonStreamHandle()
+{
+    if (_pool != nullptr)
+    {
+        _pool->release(_index);
+    }
+}
+
+/**
+ * Pointer to the stream, nullptr if the handle is empty
+*/
+TianBMSJsonStream* TianBMSJsonStreamHandle::get() const
+{
+    if (_pool == nullptr)
+    {
+        return nullptr;
+    }
+    return &_pool->_streams[_index];
+}
+
+TianBMSJsonStream* TianBMSJsonStreamHandle::operator->() const
+{
+    return get();
+}
+
+/**
+ * Check if the handle hold a stream
+*/
+bool TianBMSJsonStreamHandle::isValid() const
+{
+    return _pool != nullptr;
+}
+
+TianBMSJsonStreamPool::TianBMSJsonStreamPool()
+{
+    for (size_t i = 0; i < _refCount.size(); i++)
+    {
+        _refCount[i].store(0);
+    }
+    _exhaustedCount.store(0);
+}
+
+/**
+ * Take a free stream from the pool
+ * 
+ * @return      handle of the stream, empty handle (isValid() == false) if all stream are in use
+*/
+TianBMSJsonStreamHandle TianBMSJsonStreamPool::acquire()
+{
+    for (size_t i = 0; i < _refCount.size(); i++)
+    {
+        uint8_t expected = 0;
+        if (_refCount[i].compare_exchange_strong(expected, 1))
+        {
+            return TianBMSJsonStreamHandle(this, i);
+        }
+    }
+    _exhaustedCount++;
+    return TianBMSJsonStreamHandle();
+}
+
+/**
+ * Number of free stream
+*/
+size_t TianBMSJsonStreamPool::available() const
+{
+    size_t count = 0;
+    for (size_t i = 0; i < _refCount.size(); i++)
+    {
+        if (_refCount[i].load() == 0)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Number of acquire rejected because all stream were in use
+*/
+uint32_t TianBMSJsonStreamPool::getExhaustedCount() const
+{
+    return _exhaustedCount.load();
+}
+
+/**
+ * Number of document stopped by overflow of the scratch buffer, every stream of the pool
+*/
+uint32_t TianBMSJsonStreamPool::getFailedCount() const
+{
+    uint32_t count = 0;
+    for (size_t i = 0; i < _streams.size(); i++)
+    {
+        count += _streams[i].getFailCount();
+    }
+    return count;
+}
+
+void TianBMSJsonStreamPool::retain(size_t index)
+{
+    _refCount[index]++;
+}
+
+void TianBMSJsonStreamPool::release(size_t index)
+{
+    if (_refCount[index].load() == 1)
+    {
+        _streams[index].end();
+    }
+    _refCount[index]--;
+}
@@ -0,0 +1,205 @@
+#ifndef TIANBMS_JSON_STREAM_H
+#define TIANBMS_JSON_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <atomic>
+#include "TianBMS.h"
+#include "TianBMSRegister.h"
+#include "TianBMSBinaryWriter.h"
+#include "TianBMSFilter.h"
+
+/**
+ * Append only json text writer over fixed size char buffer, never allocate. Further write is ignored once the buffer
+ * is full and the overflow flag is raised
+*/
+class TianBMSJsonWriter
+{
+private:
+    char* _buffer;
+    size_t _capacity;
+    size_t _length = 0;
+    bool _isOverflow = false;
+public:
+    TianBMSJsonWriter(char* buffer, size_t capacity);
+    void append(char c);
+    void append(const char* str);
+    void appendUInt(uint32_t value);
+    void appendInt(int32_t value);
+    void appendString(const char* str, size_t maxLength);
+    void appendKey(const char* key);
+    size_t length() const;
+    bool isOverflow() const;
+};
+
+/**
+ * Resumable json serializer for /api/get-data. It writes the same document as TianBMSJsonManager::buildData()
+ * wrapped into {"data":[...]}, directly into the window given by the caller. Only one field is rendered at a time into
+ * small scratch buffer, so the memory used is bounded whatever the number of slave
+ * 
+ * With FORMAT_COMPACT each record is written as positional array of raw value, [msg_count,id,value,...], described
+ * once by TianBMSJsonManager::buildSchema()
+ * 
+ * With ENCODING_CBOR or ENCODING_MSGPACK the same document is written in binary, TYPE_UINT16_ARRAY value is packed into
+ * single byte string (2 bytes big endian per element). The data array of MessagePack is sized when the stream begin,
+ * slave removed in the meantime is written as nil
+ * 
+ * Started with beginMetrics(), it writes Prometheus text exposition (format 0.0.4) instead, one gauge family per
+ * numeric field with slave, cell and flag label, followed by the collector metric given by the caller. One line is
+ * rendered at a time and the label text is precomputed, so the scrape of 247 slave use the same memory as of 1 slave
+ * 
+ * setFilter() restrict the document to the selected slave and field, excluded field is skipped without being rendered
+ * (written as null in FORMAT_COMPACT so the position still match the schema)
+ * 
+ * Started with beginChanges(), it writes the delta document of /api/changes instead :
+ * {"version":V,"since":S,"full":false,"data":[...],"removed":[...]}, data only hold the slave changed after S with the
+ * field of the changed group. When the changes after S are no longer known, full is true and data hold every field of
+ * every slave
+*/
+class TianBMSJsonStream
+{
+public:
+    enum Format : uint8_t
+    {
+        FORMAT_FULL = 0x00,
+        FORMAT_COMPACT = 0x01
+    };
+
+    enum Encoding : uint8_t
+    {
+        ENCODING_JSON = 0x00,
+        ENCODING_CBOR = 0x01,
+        ENCODING_MSGPACK = 0x02,
+        ENCODING_PROMETHEUS = 0x03
+    };
+
+    static const size_t RECORD_SIZE = 2560;     // largest record written by renderRecord(), every string escaped
+
+    /**
+     * Write the collector metric at index (HELP, TYPE and sample lines) into the writer, return false when index is
+     * past the last metric. Called from the web server task
+    */
+    typedef bool (*MetricsCollector)(TianBMSJsonWriter& writer, size_t index);
+
+    TianBMSJsonStream();
+    void begin(TianBMS& tianBMS, Format format = FORMAT_FULL, Encoding encoding = ENCODING_JSON);
+    void beginChanges(TianBMS& tianBMS, uint32_t since);
+    void beginMetrics(TianBMS& tianBMS, MetricsCollector collector = nullptr);
+    void setFilter(const TianBMSFilter& filter);
+    void end();
+    size_t read(uint8_t* buffer, size_t maxLen);
+    bool isFinished() const;
+    bool isFailed() const;
+    uint32_t getFailCount() const;
+
+    static void renderRecord(TianBMSJsonWriter& writer, const TianBMSData& record);
+    static void renderHeader(TianBMSJsonWriter& writer, const TianBMSData& record);
+    static void renderField(TianBMSJsonWriter& writer, const TianBMSData& record, const TianBMSRegister::Descriptor& field);
+    static void renderCompactField(TianBMSJsonWriter& writer, const TianBMSData& record, const TianBMSRegister::Descriptor& field);
+    static void renderBinaryField(TianBMSBinaryWriter& writer, const TianBMSData& record, const TianBMSRegister::Descriptor& field, Format format);
+    static void renderMetricHeader(TianBMSJsonWriter& writer, const char* name, const char* help, const char* type,
+        const char* unit = nullptr);
+    static void renderScaled(TianBMSJsonWriter& writer, int32_t value, uint16_t divider);
+
+private:
+    enum Phase : uint8_t
+    {
+        PHASE_OPEN = 0x00,
+        PHASE_RECORD = 0x01,
+        PHASE_REMOVED = 0x02,
+        PHASE_CLOSE = 0x03,
+        PHASE_DONE = 0x04
+    };
+    static const int16_t FIELD_HEADER = -1;
+    static const int16_t METRIC_MSG_COUNT = -2;
+    static const int16_t METRIC_ERROR_COUNT = -1;
+    static const int16_t METRIC_INFO = TianBMSRegister::FIELD_COUNT;
+    static const int16_t ELEMENT_HEADER = -1;
+
+    TianBMS* _tianBMS = nullptr;
+    Phase _phase = PHASE_DONE;
+    uint8_t _id = 0;
+    int16_t _field = FIELD_HEADER;
+    bool _isFirst = true;
+    TianBMSData _record;
+    std::array<char, 384> _scratch;
+    const char* _source = nullptr;
+    size_t _sourceLength = 0;
+    size_t _sourcePosition = 0;
+    Format _format = FORMAT_FULL;
+    Encoding _encoding = ENCODING_JSON;
+    size_t _recordCount = 0;
+    size_t _recordLimit = 0;
+    size_t _fieldCount = 0;
+    TianBMSFilter _filter;
+    int16_t _metric = METRIC_MSG_COUNT;
+    int16_t _element = ELEMENT_HEADER;
+    MetricsCollector _collector = nullptr;
+    size_t _collectorIndex = 0;
+    bool _isDelta = false;
+    bool _isFull = true;
+    bool _isFailed = false;
+    uint32_t _failCount = 0;
+    uint32_t _since = 0;
+    uint32_t _until = 0;
+    std::array<uint8_t, TianBMSSlotTable::MAX_ID + 1> _changed;
+    bool fill();
+    bool fillBinary();
+    bool fillMetrics();
+    bool fail();
+    void renderMetricLine(TianBMSJsonWriter& writer);
+    uint8_t nextRecord(uint8_t id) const;
+    uint8_t nextRemoved(uint8_t id) const;
+    bool isFieldSelected(size_t index) const;
+    bool isFieldWritten(size_t index) const;
+};
+
+class TianBMSJsonStreamPool;
+
+/**
+ * Reference counted handle of pooled TianBMSJsonStream. Copyable, so it can be captured by the chunked response
+ * callback. The stream goes back to the pool when the last copy is destroyed, also when the client disconnect before
+ * the document is finished
+*/
+class TianBMSJsonStreamHandle
+{
+private:
+    TianBMSJsonStreamPool* _pool = nullptr;
+    size_t _index = 0;
+public:
+    TianBMSJsonStreamHandle();
+    TianBMSJsonStreamHandle(TianBMSJsonStreamPool* pool, size_t index);
+    TianBMSJsonStreamHandle(const TianBMSJsonStreamHandle& other);
+    TianBMSJsonStreamHandle& operator=(const TianBMSJsonStreamHandle& other);
+    ~TianBMSJsonStreamHandle();
+    TianBMSJsonStream* get() const;
+    TianBMSJsonStream* operator->() const;
+    bool isValid() const;
+};
+
+/**
+ * Fixed pool of TianBMSJsonStream, one stream per in-flight response so concurrent clients never share the cursor.
+ * All streams are allocated together with the pool, acquire and release never touch the heap
+*/
+class TianBMSJsonStreamPool
+{
+public:
+    static const size_t CAPACITY = 4;
+
+    TianBMSJsonStreamPool();
+    TianBMSJsonStreamHandle acquire();
+    size_t available() const;
+    uint32_t getExhaustedCount() const;
+    uint32_t getFailedCount() const;
+
+private:
+    friend class TianBMSJsonStreamHandle;
+    std::array<TianBMSJsonStream, CAPACITY> _streams;
+    std::array<std::atomic<uint8_t>, CAPACITY> _refCount;
+    std::atomic<uint32_t> _exhaustedCount;
+    void retain(size_t index);
+    void release(size_t index);
+};
+
+#endif
@@ -0,0 +1,286 @@
+#include "TianBMSModbusMap.h"
+#include <algorithm>
+
+static_assert(TianBMSModbusMap::SLAVE_BASE >= TianBMSModbusMap::BANK_BASE + TianBMSModbusMap::BANK_SIZE, "bank block overlap the slave block");
+static_assert(TianBMSModbusMap::SLAVE_HEADER_SIZE + TianBMSModbusMap::NATIVE_SIZE <= TianBMSModbusMap::SLAVE_BLOCK_SIZE, "native register exceed the slave block");
+static_assert((uint32_t)TianBMSModbusMap::SLAVE_BASE + TianBMSSlotTable::MAX_ID * TianBMSModbusMap::SLAVE_BLOCK_SIZE <= 0x10000, "slave block exceed the register address");
+
+TianBMSModbusMap::TianBMSModbusMap(TianBMS& tianBMS) : _tianBMS(tianBMS)
+{
+    _bank.fill(0);
+    _nativeField.fill(-1);
+    for (size_t i = 0; i < TianBMSRegister::FIELD_COUNT; i++)
+    {
+        const TianBMSRegister::Descriptor& field = TianBMSRegister::FIELDS[i];
+        if (!field.enabled || field.type == TianBMSRegister::TYPE_STRING || field.address < NATIVE_BASE)
+        {
+            continue;
+        }
+        for (size_t n = 0; n < field.count; n++)
+        {
+            size_t offset = field.address - NATIVE_BASE + n;
+            if (offset < _nativeField.size())
+            {
+                _nativeField[offset] = i;
+            }
+        }
+    }
+}
+
+/**
+ * Read register from the map. Bank block is rebuilt only when the data version changed since the last read, slave
+ * block is read from the snapshot of the slave, taken once per request
+ *
+ * @param[in]   address first register address
+ * @param[in]   count   number of register
+ * @param[out]  registers   destination, must hold count register
+ *
+ * @return      true if success, false if any register is outside the map (illegal data address)
+*/
+bool TianBMSModbusMap::read(uint16_t address, uint16_t count, uint16_t* registers)
+{
+    uint32_t last = (uint32_t)address + count;
+    bool isBank = address >= BANK_BASE && last <= BANK_BASE + BANK_SIZE;
+    bool isSlave = address >= SLAVE_BASE && last <= SLAVE_BASE + (uint32_t)TianBMSSlotTable::MAX_ID * SLAVE_BLOCK_SIZE;
+    if (count == 0 || (!isBank && !isSlave))
+    {
+        return false;
+    }
+    _requestCount++;
+    _registerCount += count;
+    if (isBank)
+    {
+        updateBank();
+        for (size_t i = 0; i < count; i++)
+        {
+            registers[i] = _bank[address - BANK_BASE + i];
+        }
+        return true;
+    }
+    _isRecordValid = false;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint16_t offset = address - SLAVE_BASE + i;
+        registers[i] = readSlave(offset / SLAVE_BLOCK_SIZE + 1, offset % SLAVE_BLOCK_SIZE);
+    }
+    return true;
+}
+
+/**
+ * Get number of read request served from the map
+ *
+ * @return      request count
+*/
+uint32_t TianBMSModbusMap::getRequestCount() const
+{
+    return _requestCount;
+}
+
+/**
+ * Get number of register served from the map
+ *
+ * @return      register count
+*/
+uint32_t TianBMSModbusMap::getRegisterCount() const
+{
+    return _registerCount;
+}
+
+/**
+ * Rebuild the bank block from the snapshot of every active slave, skipped if nothing changed since the last build
+*/
+void TianBMSModbusMap::updateBank()
+{
+    uint32_t version = _tianBMS.getVersion();
+    if (_isBankValid && version == _bankVersion)
+    {
+        return;
+    }
+    uint16_t activeCount = 0;
+    int32_t totalCurrent = 0;
+    uint32_t totalVoltage = 0;
+    uint32_t totalSoc = 0;
+    uint16_t minSoc = 0xFFFF, maxSoc = 0, minSoh = 0xFFFF;
+    uint16_t maxCellVoltage = 0, minCellVoltage = 0xFFFF, maxCellTemp = 0, minCellTemp = 0xFFFF;
+    uint8_t maxCellVoltageId = 0, minCellVoltageId = 0, maxCellTempId = 0, minCellTempId = 0;
+    uint16_t warning = 0, protection = 0, fault = 0, alarmCount = 0;
+
+    const TianBMSSlotTable& table = _tianBMS.getTianBMSData();
+    for (uint8_t id = table.next(0); id != 0; id = table.next(id))
+    {
+        if (!_tianBMS.getSnapshot(id, _record))
+        {
+            continue;
+        }
+        activeCount++;
+        totalCurrent += _record.packCurrent;
+        totalVoltage += _record.packVoltage;
+        totalSoc += _record.soc;
+        minSoc = std::min(minSoc, _record.soc);
+        maxSoc = std::max(maxSoc, _record.soc);
+        minSoh = std::min(minSoh, _record.soh);
+        if (_record.maxCellVoltage > maxCellVoltage)
+        {
+            maxCellVoltage = _record.maxCellVoltage;
+            maxCellVoltageId = id;
+        }
+        if (_record.minCellVoltage < minCellVoltage)
+        {
+            minCellVoltage = _record.minCellVoltage;
+            minCellVoltageId = id;
+        }
+        if (_record.maxCellTemp > maxCellTemp)
+        {
+            maxCellTemp = _record.maxCellTemp;
+            maxCellTempId = id;
+        }
+        if (_record.minCellTemp < minCellTemp)
+        {
+            minCellTemp = _record.minCellTemp;
+            minCellTempId = id;
+        }
+        warning |= _record.warningFlag.value;
+        protection |= _record.protectionFlag.value;
+        fault |= _record.faultStatusFlag.value;
+        // byte 1 of the fault status is the mos and limit state, only byte 0 is a fault
+        if (_record.protectionFlag.value != 0 || (_record.faultStatusFlag.value & 0x00FF) != 0)
+        {
+            alarmCount++;
+        }
+    }
+
+    _bank.fill(0);
+    _bank[0] = MAP_VERSION;
+    _bank[1] = activeCount;
+    _bank[2] = version >> 16;
+    _bank[3] = version & 0xFFFF;
+    _bank[4] = (uint32_t)totalCurrent >> 16;
+    _bank[5] = (uint32_t)totalCurrent & 0xFFFF;
+    if (activeCount > 0)
+    {
+        _bank[6] = totalVoltage / activeCount;
+        _bank[7] = minSoc;
+        _bank[8] = maxSoc;
+        _bank[9] = totalSoc / activeCount;
+        _bank[10] = minSoh;
+        _bank[11] = maxCellVoltage;
+        _bank[12] = maxCellVoltageId;
+        _bank[13] = minCellVoltageId != 0 ? minCellVoltage : 0;
+        _bank[14] = minCellVoltageId;
+        _bank[15] = maxCellTemp;
+        _bank[16] = maxCellTempId;
+        _bank[17] = minCellTempId != 0 ? minCellTemp : 0;
+        _bank[18] = minCellTempId;
+    }
+    _bank[19] = warning;
+    _bank[20] = protection;
+    _bank[21] = fault;
+    _bank[22] = alarmCount;
+    _bankVersion = version;
+    _isBankValid = true;
+}
+
+/**
+ * Read one register of the slave block, the snapshot of the slave is kept for the following register of the same
+ * request
+ *
+ * @param[in]   id  slave id
+ * @param[in]   offset  register offset inside the slave block
+ *
+ * @return      register value, 0 if the slave is not active
+*/
+uint16_t TianBMSModbusMap::readSlave(uint8_t id, uint16_t offset)
+{
+    if (!_isRecordValid || _recordId != id)
+    {
+        _recordId = id;
+        _isRecordValid = true;
+        if (!_tianBMS.getSnapshot(id, _record))
+        {
+            _record.id = 0;
+        }
+    }
+    if (_record.id == 0)
+    {
+        return 0;
+    }
+    switch (offset)
+    {
+    case 0:
+        return _record.id;
+    case 1:
+        return _record.errorCount;
+    case 2:
+        return _record.msgCount >> 16;
+    case 3:
+        return _record.msgCount & 0xFFFF;
+    default:
+        break;
+    }
+    if (offset < SLAVE_HEADER_SIZE || offset >= SLAVE_HEADER_SIZE + NATIVE_SIZE)
+    {
+        return 0;
+    }
+    return readField(_record, offset - SLAVE_HEADER_SIZE);
+}
+
+/**
+ * Read bms input register of the slave as the bms itself would answer, only when every register of the range belong
+ * to an enabled field held by the record
+ *
+ * @param[in]   id  slave id
+ * @param[in]   address first bms register address
+ * @param[in]   count   number of register
+ * @param[out]  registers   destination, must hold count register
+ *
+ * @return      true if success, false if the slave is not active or any register is not held
+*/
+bool TianBMSModbusMap::readNative(uint8_t id, uint16_t address, uint16_t count, uint16_t* registers) const
+{
+    if (count == 0 || address < NATIVE_BASE || (uint32_t)address + count > NATIVE_BASE + NATIVE_SIZE)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        if (_nativeField[address - NATIVE_BASE + i] < 0)
+        {
+            return false;
+        }
+    }
+    TianBMSData record;
+    if (!_tianBMS.getSnapshot(id, record))
+    {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        registers[i] = readField(record, address - NATIVE_BASE + i);
+    }
+    return true;
+}
+
+/**
+ * Read one bms input register from the record
+ *
+ * @param[in]   record  source record
+ * @param[in]   nativeOffset    register address - NATIVE_BASE
+ *
+ * @return      register value, 0 if the register is not held by any enabled field
+*/
+uint16_t TianBMSModbusMap::readField(const TianBMSData& record, uint16_t nativeOffset) const
+{
+    int8_t index = _nativeField[nativeOffset];
+    if (index < 0)
+    {
+        return 0;
+    }
+    const TianBMSRegister::Descriptor& field = TianBMSRegister::FIELDS[index];
+    size_t element = NATIVE_BASE + nativeOffset - field.address;
+    if (field.type == TianBMSRegister::TYPE_UINT32)
+    {
+        uint32_t value = TianBMSRegister::fieldValue(record, field);
+        return element == 0 ? value >> 16 : value & 0xFFFF;
+    }
+    return TianBMSRegister::fieldValue(record, field, element);
+}
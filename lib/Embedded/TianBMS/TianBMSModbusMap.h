@@ -0,0 +1,85 @@
+#ifndef TIANBMS_MODBUS_MAP_H
+#define TIANBMS_MODBUS_MAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include "TianBMS.h"
+#include "TianBMSRegister.h"
+
+/**
+ * Register map of the collector modbus server, served from the latest snapshot so no request is sent to the slave.
+ * Holding (0x03) and input (0x04) register read the same map, every value is 16 bit unless noted, 32 bit value is
+ * written high word first
+ *
+ * Bank block, address 0 - 31 :
+ *  0       map version (1)
+ *  1       number of active slave
+ *  2 - 3   data version, incremented on every applied response (uint32)
+ *  4 - 5   total pack current, 0.01 A (int32)
+ *  6       average pack voltage, 0.01 V
+ *  7       minimum soc, 0.01 %
+ *  8       maximum soc, 0.01 %
+ *  9       average soc, 0.01 %
+ *  10      minimum soh, 0.01 %
+ *  11      maximum cell voltage, mV
+ *  12      slave id of the maximum cell voltage
+ *  13      minimum cell voltage, mV
+ *  14      slave id of the minimum cell voltage
+ *  15      maximum cell temperature, 0.1 Celcius
+ *  16      slave id of the maximum cell temperature
+ *  17      minimum cell temperature, 0.1 Celcius
+ *  18      slave id of the minimum cell temperature
+ *  19      warning flag of every slave or-ed together
+ *  20      protection flag of every slave or-ed together
+ *  21      fault status flag of every slave or-ed together
+ *  22      number of slave with protection or fault bit set
+ *  23 - 31 reserved, read as 0
+ *
+ * Slave block, address SLAVE_BASE + (id - 1) * SLAVE_BLOCK_SIZE, 64 register per slave id 1 - 247 :
+ *  0       slave id, 0 if the slave is not active (the rest of the block is 0)
+ *  1       consecutive error count
+ *  2 - 3   message count (uint32)
+ *  4 - 7   reserved, read as 0
+ *  8 - 59  same layout as the bms input register 4096 - 4147 (pack voltage, current, ..., cell voltage), disabled
+ *          field read as 0
+ *  60 - 63 reserved, read as 0
+ *
+ * readNative() serve the bms input register themselves (4096 - 4147) for the modbus proxy, it only use the snapshot
+ * it takes and can be called from any task. The rest is only used from the modbus server task (AsyncTCP)
+*/
+class TianBMSModbusMap
+{
+public:
+    static const uint16_t MAP_VERSION = 1;
+    static const uint16_t BANK_BASE = 0;
+    static const uint16_t BANK_SIZE = 32;
+    static const uint16_t SLAVE_BASE = 1000;
+    static const uint16_t SLAVE_BLOCK_SIZE = 64;
+    static const uint16_t SLAVE_HEADER_SIZE = 8;
+    static const uint16_t NATIVE_BASE = 4096;
+    static const uint16_t NATIVE_SIZE = 52;
+
+    TianBMSModbusMap(TianBMS& tianBMS);
+    bool read(uint16_t address, uint16_t count, uint16_t* registers);
+    bool readNative(uint8_t id, uint16_t address, uint16_t count, uint16_t* registers) const;
+    uint32_t getRequestCount() const;
+    uint32_t getRegisterCount() const;
+
+private:
+    TianBMS& _tianBMS;
+    std::array<uint16_t, BANK_SIZE> _bank;
+    uint32_t _bankVersion = 0;
+    bool _isBankValid = false;
+    std::array<int8_t, NATIVE_SIZE> _nativeField;
+    TianBMSData _record;
+    uint8_t _recordId = 0;
+    bool _isRecordValid = false;
+    uint32_t _requestCount = 0;
+    uint32_t _registerCount = 0;
+    void updateBank();
+    uint16_t readSlave(uint8_t id, uint16_t offset);
+    uint16_t readField(const TianBMSData& record, uint16_t nativeOffset) const;
+};
+
+#endif
@@ -0,0 +1,439 @@
+#include "TianBMSPollPlan.h"
+
+namespace
+{
+    const uint32_t CHARACTER_BITS = 11;         // modbus rtu character, start + 8 data + parity or second stop + stop
+    const uint32_t TRANSACTION_OVERHEAD = 20;   // character, request frame (8) + response header and crc (5) + 2 silent interval (3.5)
+}
+
+TianBMSPollPlan::TianBMSPollPlan(uint32_t slowPeriod, uint16_t bridgeLimit) : _slowPeriod(slowPeriod), _bridgeLimit(bridgeLimit)
+{
+    build();
+    reset();
+}
+
+/**
+ * Get the largest gap worth reading to save one transaction. Every register of the gap costs 2 character on the bus,
+ * one more transaction costs its frame overhead and the turnaround of the gateway and the slave
+ * 
+ * @param[in]   baudRate    baud rate of the rtu bus behind the gateway
+ * @param[in]   turnaround  ms from the end of the request to the start of the response, gateway included
+ * 
+ * @return      bridge limit in register
+*/
+uint16_t TianBMSPollPlan::getBridgeLimit(uint32_t baudRate, uint32_t turnaround)
+{
+    uint64_t turnaroundCharacter = (uint64_t)turnaround * baudRate / (CHARACTER_BITS * 1000);
+    return (TRANSACTION_OVERHEAD + turnaroundCharacter) / 2;
+}
+
+/**
+ * Get number of fast block, block 0 to the count - 1 are read on every poll
+*/
+size_t TianBMSPollPlan::getFastBlockCount() const
+{
+    return _fastCount;
+}
+
+/**
+ * Get the slow block that is due for the slave
+ * 
+ * @param[in]   id  slave id
+ * @param[in]   now current time, millis()
+ * 
+ * @return      block index, -1 if nothing is due
+*/
+int16_t TianBMSPollPlan::nextExtra(uint8_t id, uint32_t now) const
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t block = 0; block < _blockCount; block++)
+    {
+        uint32_t lastSend = _lastSend[id][block];
+        switch (_blocks[block].period)
+        {
+        case TianBMSRegister::PERIOD_SLOW:
+            if (lastSend == 0 || now - lastSend >= _slowPeriod)
+            {
+                uint8_t cursor = _splitCursor[id][block];
+                return cursor == 0 ? block : MAX_BLOCK + _splitFirst[block] + cursor - 1;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Register block request added to the modbus client queue. The split block is counted with its block, the block is
+ * done for the slow period once its last split block is sent
+ * 
+ * @param[in]   id  slave id
+ * @param[in]   block   block index or split block index
+ * @param[in]   now current time, millis()
+*/
+void TianBMSPollPlan::onSend(uint8_t id, uint8_t block, uint32_t now)
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (block >= MAX_BLOCK && block < MAX_BLOCK + _splitCount)
+    {
+        uint8_t parent = _splitParent[block - MAX_BLOCK];
+        _requestCount[parent]++;
+        _registerCount += _splitBlocks[block - MAX_BLOCK].count;
+        uint8_t& cursor = _splitCursor[id][parent];
+        if (_splitFirst[parent] + cursor >= _splitEnd[parent])
+        {
+            cursor = 1;
+            _lastSend[id][parent] = now | 0x01;
+        }
+        else
+        {
+            cursor++;
+        }
+        return;
+    }
+    if (block >= _blockCount)
+    {
+        return;
+    }
+    _lastSend[id][block] = now | 0x01;
+    _requestCount[block]++;
+    _registerCount += _blocks[block].count;
+}
+
+/**
+ * Register failed block request, the error is counted with its block as onSend() counts the request. Failed whole
+ * block is due again on the next poll, block rejected by the slave is read field by field from now on. Failed split
+ * block is not split again and not retried, onSend() already moved the cursor to the next field so the other field
+ * keep updating and the failed one is read again on the next slow period
+ * 
+ * @param[in]   id  slave id
+ * @param[in]   block   block index or split block index
+ * @param[in]   isRejected  the slave answered with modbus exception, the gateway and the slave are fine
+*/
+void TianBMSPollPlan::onError(uint8_t id, uint8_t block, bool isRejected)
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (block >= MAX_BLOCK && block < MAX_BLOCK + _splitCount)
+    {
+        uint8_t parent = _splitParent[block - MAX_BLOCK];
+        _errorCount[parent]++;
+        ESP_LOGD(_TAG, "Id : %d split block %d of block %d failed, next field on the next poll\n", id, block, parent);
+        return;
+    }
+    if (block >= _blockCount)
+    {
+        return;
+    }
+    _errorCount[block]++;
+    _lastSend[id][block] = 0;
+    if (isRejected && _splitCursor[id][block] == 0 && _splitFirst[block] < _splitEnd[block])
+    {
+        ESP_LOGI(_TAG, "Id : %d block %d rejected, read field by field\n", id, block);
+        _splitCursor[id][block] = 1;
+    }
+}
+
+/**
+ * Check if the block is read field by field for the slave
+ * 
+ * @param[in]   id  slave id
+ * @param[in]   block   block index
+*/
+bool TianBMSPollPlan::isSplit(uint8_t id, uint8_t block) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return id <= TianBMSSlotTable::MAX_ID && block < _blockCount && _splitCursor[id][block] != 0;
+}
+
+/**
+ * Make every slow block of the slave due, called when another pack answers on its id
+ * 
+ * @param[in]   id  slave id
+*/
+void TianBMSPollPlan::resetSlave(uint8_t id)
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t block = 0; block < _blockCount; block++)
+    {
+        if (_blocks[block].period == TianBMSRegister::PERIOD_SLOW)
+        {
+            _lastSend[id][block] = 0;
+        }
+    }
+    _splitCursor[id].fill(0);
+}
+
+/**
+ * Forget every slave, called when the data table is cleared
+*/
+void TianBMSPollPlan::reset()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t id = 0; id < _lastSend.size(); id++)
+    {
+        _lastSend[id].fill(0);
+        _splitCursor[id].fill(0);
+    }
+    _requestCount.fill(0);
+    _errorCount.fill(0);
+    _registerCount = 0;
+}
+
+/**
+ * Get number of block of the plan
+*/
+size_t TianBMSPollPlan::getBlockCount() const
+{
+    return _blockCount;
+}
+
+/**
+ * Get the block, the plan does not change after construction
+ * 
+ * @param[in]   block   block index or split block index, out of range index gives the fast block
+*/
+const TianBMSRegister::Block& TianBMSPollPlan::getBlock(uint8_t block) const
+{
+    if (block >= MAX_BLOCK && block < MAX_BLOCK + _splitCount)
+    {
+        return _splitBlocks[block - MAX_BLOCK];
+    }
+    return _blocks[block < _blockCount ? block : FAST_BLOCK];
+}
+
+/**
+ * Check if the register range lies inside the fast block, from the first fast register to the last one. Its value is
+ * then as fresh as the data timestamp, except the slow counter left between two fast block that holds its last slow
+ * read
+ * 
+ * @param[in]   address first register address
+ * @param[in]   count   number of register
+*/
+bool TianBMSPollPlan::isFastRange(uint16_t address, uint16_t count) const
+{
+    const TianBMSRegister::Block& first = _blocks[FAST_BLOCK];
+    const TianBMSRegister::Block& last = _blocks[_fastCount > 0 ? _fastCount - 1 : FAST_BLOCK];
+    return address >= first.address && (uint32_t)address + count <= (uint32_t)last.address + last.count;
+}
+
+/**
+ * Get the largest gap in register read to join two range into one block
+*/
+uint16_t TianBMSPollPlan::getBridgeLimit() const
+{
+    return _bridgeLimit;
+}
+
+/**
+ * Get number of request sent for the block
+ * 
+ * @param[in]   block   block index
+*/
+uint32_t TianBMSPollPlan::getRequestCount(uint8_t block) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return block < _blockCount ? _requestCount[block] : 0;
+}
+
+/**
+ * Get number of failed request of the block, its split block included
+ * 
+ * @param[in]   block   block index
+*/
+uint32_t TianBMSPollPlan::getErrorCount(uint8_t block) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return block < _blockCount ? _errorCount[block] : 0;
+}
+
+/**
+ * Get number of register requested by every block
+*/
+uint32_t TianBMSPollPlan::getRegisterCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _registerCount;
+}
+
+/**
+ * Build the block of the plan, fast block first then the slow and the session block
+*/
+void TianBMSPollPlan::build()
+{
+    using namespace TianBMSRegister;
+    _blockCount = 0;
+    _fastCount = 0;
+    for (uint8_t period = PERIOD_FAST; period <= PERIOD_SESSION; period++)
+    {
+        // field of the period not read yet by the block of a faster period, by address
+        std::array<uint8_t, FIELD_COUNT> order;
+        size_t orderCount = 0;
+        for (size_t i = 0; i < FIELD_COUNT; i++)
+        {
+            const Descriptor& field = FIELDS[i];
+            if (!field.enabled || field.period != period || isCovered(field.address, field.count))
+            {
+                continue;
+            }
+            size_t n = orderCount++;
+            for (; n > 0 && FIELDS[order[n - 1]].address > field.address; n--)
+            {
+                order[n] = order[n - 1];
+            }
+            order[n] = i;
+        }
+
+        Block block = {0, 0, 0, 0, (Period)period};
+        bool isOpen = false;
+        for (size_t n = 0; n < orderCount; n++)
+        {
+            const Descriptor& field = FIELDS[order[n]];
+            uint32_t end = field.address + field.count;
+            uint32_t blockEnd = block.address + block.count;
+            // once the table is down to its last entry every range goes into the open block
+            bool isBridged = (field.address <= blockEnd + _bridgeLimit && !isSlowerInGap(period, blockEnd,
+                field.address)) || _blockCount + 1 >= MAX_BLOCK;
+            if (isOpen && isBridged && end - block.address <= MAX_BLOCK_SIZE)
+            {
+                block.count = end > blockEnd ? end - block.address : block.count;
+                continue;
+            }
+            if (isOpen)
+            {
+                push(block);
+            }
+            block.request = field.request;
+            block.offset = field.address - requestAddress(field.request);
+            block.address = field.address;
+            block.count = field.count;
+            isOpen = true;
+        }
+        if (isOpen)
+        {
+            push(block);
+        }
+        if (period == PERIOD_FAST)
+        {
+            _fastCount = _blockCount;
+        }
+    }
+
+    for (uint8_t block = 0; block < _blockCount; block++)
+    {
+        split(block);
+    }
+}
+
+/**
+ * Add one split block per enabled field of the slow block, nothing when the block holds a single field or when the
+ * split table is full
+*/
+void TianBMSPollPlan::split(uint8_t block)
+{
+    using namespace TianBMSRegister;
+    const Block& whole = _blocks[block];
+    _splitFirst[block] = _splitCount;
+    _splitEnd[block] = _splitCount;
+    if (whole.period != PERIOD_SLOW)
+    {
+        return;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < FIELD_COUNT; i++)
+    {
+        const Descriptor& field = FIELDS[i];
+        if (field.enabled && field.address >= whole.address && field.address + field.count <= whole.address + whole.count)
+        {
+            count++;
+        }
+    }
+    if (count < 2 || _splitCount + count > MAX_SPLIT_BLOCK)
+    {
+        return;
+    }
+    for (size_t i = 0; i < FIELD_COUNT; i++)
+    {
+        const Descriptor& field = FIELDS[i];
+        if (field.enabled && field.address >= whole.address && field.address + field.count <= whole.address + whole.count)
+        {
+            Block& part = _splitBlocks[_splitCount];
+            part.request = field.request;
+            part.offset = field.address - requestAddress(field.request);
+            part.address = field.address;
+            part.count = field.count;
+            part.period = PERIOD_SLOW;
+            _splitParent[_splitCount] = block;
+            _splitCount++;
+        }
+    }
+    _splitEnd[block] = _splitCount;
+}
+
+/**
+ * Check if the register range is already read by a block of the plan
+*/
+bool TianBMSPollPlan::isCovered(uint16_t address, uint16_t count) const
+{
+    for (size_t i = 0; i < _blockCount; i++)
+    {
+        if (address >= _blocks[i].address && address + count <= _blocks[i].address + _blocks[i].count)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Check if an enabled field read less often than the period lies in the register gap, the block of the period does not
+ * read over it
+ * 
+ * @param[in]   period  period of the block
+ * @param[in]   address first register of the gap
+ * @param[in]   end register address after the gap
+*/
+bool TianBMSPollPlan::isSlowerInGap(uint8_t period, uint16_t address, uint16_t end) const
+{
+    for (size_t i = 0; i < TianBMSRegister::FIELD_COUNT; i++)
+    {
+        const TianBMSRegister::Descriptor& field = TianBMSRegister::FIELDS[i];
+        if (field.enabled && field.period > period && field.address < end && field.address + field.count > address)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Add the block to the plan
+ * 
+ * @return      false if the plan is full, MAX_BLOCK is sized for the register map
+*/
+bool TianBMSPollPlan::push(const TianBMSRegister::Block& block)
+{
+    if (_blockCount >= MAX_BLOCK)
+    {
+        return false;
+    }
+    _blocks[_blockCount++] = block;
+    return true;
+}
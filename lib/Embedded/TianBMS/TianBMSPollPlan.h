@@ -0,0 +1,84 @@
+#ifndef TIANBMS_POLL_PLAN_H
+#define TIANBMS_POLL_PLAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <mutex>
+#include "TianBMS.h"
+#include "TianBMSRegister.h"
+
+/**
+ * Register block plan and per slave state of the poll. The plan is built once from the period of every enabled field
+ * (refer to TianBMSRegister::FIELDS) :
+ *
+ *  - the field of each period, fast first then slow and session, is sorted by address and coalesced. Two range are
+ *    read as one block when the gap between them is at most the bridge limit, reading the unused register of the gap
+ *    costs less bus time than one more transaction. Block never exceed MAX_BLOCK_SIZE register (response payload
+ *    buffer)
+ *  - a fast block never bridges over a field of a slower period, the slow counter between two fast range (soh, full
+ *    charged capacity, cycle count) is left to its slow block instead of being read on every poll
+ *
+ * The fast block are the first getFastBlockCount() block, all of them are read on every poll of the slave and applied
+ * as one update. After them the slow block is read once per slow period. Failed block is due again on the next poll.
+ * The session block (identity string) is read on its own, refer to TianBMSIdentity.
+ *
+ * Slow block holding more than one field has a split block per field. Once the slave rejects the whole block with a
+ * modbus exception (a register of the block or of its gap does not exist on this firmware), the block is read field by
+ * field for this slave, one split block per poll, so a single unknown register does not stop the other field of the
+ * block from updating. The slave goes back to the whole block when it is reset.
+ *
+ * nextExtra() and onSend() are called from the poll task, onError() from the modbus client task
+*/
+class TianBMSPollPlan
+{
+public:
+    static const uint8_t FAST_BLOCK = 0;
+    static const uint8_t MAX_BLOCK = 8;
+    static const uint8_t MAX_BLOCK_SIZE = 64;       // register, refer to TianBMSResponse::payload
+    static const uint8_t MAX_SPLIT_BLOCK = 16;      // split block index follows the plan, from MAX_BLOCK
+
+    TianBMSPollPlan(uint32_t slowPeriod = 30000, uint16_t bridgeLimit = 14);
+    static uint16_t getBridgeLimit(uint32_t baudRate, uint32_t turnaround);
+    size_t getFastBlockCount() const;
+    int16_t nextExtra(uint8_t id, uint32_t now) const;
+    void onSend(uint8_t id, uint8_t block, uint32_t now);
+    void onError(uint8_t id, uint8_t block, bool isRejected = false);
+    void resetSlave(uint8_t id);
+    void reset();
+    size_t getBlockCount() const;
+    const TianBMSRegister::Block& getBlock(uint8_t block) const;
+    bool isFastRange(uint16_t address, uint16_t count) const;
+    uint16_t getBridgeLimit() const;
+    uint32_t getRequestCount(uint8_t block) const;
+    uint32_t getErrorCount(uint8_t block) const;
+    uint32_t getRegisterCount() const;
+    bool isSplit(uint8_t id, uint8_t block) const;
+
+private:
+    const char* _TAG = "TIANBMS POLL PLAN";
+    mutable std::mutex _mutex;
+    std::array<TianBMSRegister::Block, MAX_BLOCK> _blocks;
+    size_t _blockCount = 0;
+    size_t _fastCount = 0;
+    std::array<TianBMSRegister::Block, MAX_SPLIT_BLOCK> _splitBlocks;
+    std::array<uint8_t, MAX_SPLIT_BLOCK> _splitParent;
+    std::array<uint8_t, MAX_BLOCK> _splitFirst;     // first split block of the block
+    std::array<uint8_t, MAX_BLOCK> _splitEnd;       // first == end when the block is not split
+    size_t _splitCount = 0;
+    // per slave and block, 0 = the whole block is read, n = the block is split and its split block n - 1 is next
+    std::array<std::array<uint8_t, MAX_BLOCK>, TianBMSSlotTable::MAX_ID + 1> _splitCursor;
+    std::array<std::array<uint32_t, MAX_BLOCK>, TianBMSSlotTable::MAX_ID + 1> _lastSend;  // 0 = never
+    std::array<uint32_t, MAX_BLOCK> _requestCount;
+    std::array<uint32_t, MAX_BLOCK> _errorCount;
+    uint32_t _registerCount = 0;
+    uint32_t _slowPeriod;
+    uint16_t _bridgeLimit;
+    void build();
+    bool isCovered(uint16_t address, uint16_t count) const;
+    bool isSlowerInGap(uint8_t period, uint16_t address, uint16_t end) const;
+    bool push(const TianBMSRegister::Block& block);
+    void split(uint8_t block);
+};
+
+#endif
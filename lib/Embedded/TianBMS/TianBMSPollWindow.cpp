@@ -0,0 +1,255 @@
+#include "TianBMSPollWindow.h"
+
+TianBMSPollWindow::TianBMSPollWindow()
+{
+    reset();
+}
+
+/**
+ * Check if new request can be added to the modbus client queue
+ * 
+ * @param[in]   now current time, millis()
+ * 
+ * @return      true if the window has room and the gap since the last request is elapsed
+*/
+bool TianBMSPollWindow::canSend(uint32_t now) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _inFlight < (uint8_t)_window && now - _lastSend >= _gap;
+}
+
+/**
+ * Check if the request of the slave is still waiting for its response
+ * 
+ * @param[in]   id  slave id
+*/
+bool TianBMSPollWindow::isInFlight(uint8_t id) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return id <= TianBMSSlotTable::MAX_ID && _sendTime[id] != 0;
+}
+
+/**
+ * Register request added to the modbus client queue
+ * 
+ * @param[in]   id  slave id
+ * @param[in]   now current time, millis()
+*/
+void TianBMSPollWindow::onSend(uint8_t id, uint32_t now)
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_sendTime[id] == 0)
+    {
+        _inFlight++;
+    }
+    _sendTime[id] = now | 0x01;
+    _lastSend = now;
+}
+
+/**
+ * Register response (data or modbus exception, the gateway answered), adjust the window from the round trip time
+ * 
+ * @param[in]   id  slave id
+ * @param[in]   now current time, millis()
+*/
+void TianBMSPollWindow::onResponse(uint8_t id, uint32_t now)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t rtt = 0;
+    if (complete(id, now, rtt) == 0)
+    {
+        return;
+    }
+    _smoothedRtt = _smoothedRtt == 0 ? rtt : (_smoothedRtt * 7 + rtt) / 8;
+    if (_nextBaseRtt == 0 || rtt < _nextBaseRtt)
+    {
+        _nextBaseRtt = rtt;
+    }
+    if (_baseRtt == 0 || rtt < _baseRtt)
+    {
+        _baseRtt = rtt;
+    }
+    if (++_baseRttSamples >= BASE_RTT_SAMPLES)
+    {
+        // forget the old minimum, the path to the gateway may have become slower for good
+        _baseRtt = _nextBaseRtt;
+        _nextBaseRtt = 0;
+        _baseRttSamples = 0;
+    }
+    _timeoutRate -= _timeoutRate / 16;
+
+    // number of request waiting in the queue, estimated from the extra delay over the base round trip
+    float queued = _window * (1.0f - (float)_baseRtt / (float)(rtt > 0 ? rtt : 1));
+    if (queued < ALPHA && _window < MAX_WINDOW)
+    {
+        _window += _window < 2 ? 1.0f : 1.0f / _window;
+    }
+    else if (queued > BETA && _window > MIN_WINDOW)
+    {
+        // window below MIN_WINDOW would be truncated to 0 and stop the poll
+        _window -= 1.0f / _window;
+        if (_window < MIN_WINDOW)
+        {
+            _window = MIN_WINDOW;
+        }
+    }
+    _gap -= _gap / 4;
+    if (_gap < MIN_GAP)
+    {
+        // integer decrease stalls at 3 ms, small gap is dropped
+        _gap = 0;
+    }
+}
+
+/**
+ * Register request without response, halve the window and double the gap, once per round trip
+ * 
+ * @param[in]   id  slave id
+ * @param[in]   now current time, millis()
+*/
+void TianBMSPollWindow::onTimeout(uint8_t id, uint32_t now)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t rtt = 0;
+    if (complete(id, now, rtt) == 0)
+    {
+        return;
+    }
+    _timeoutCount++;
+    _timeoutRate += (1000 - _timeoutRate) / 16;
+    if (now - _lastDecrease < _smoothedRtt)
+    {
+        return;
+    }
+    _lastDecrease = now;
+    _window = _window / 2 < MIN_WINDOW ? MIN_WINDOW : _window / 2;
+    _gap = _gap == 0 ? _smoothedRtt : _gap * 2;
+    if (_gap > MAX_GAP)
+    {
+        _gap = MAX_GAP;
+    }
+}
+
+/**
+ * Register request without response from a slave already known to be failing, the request is closed and counted as
+ * timeout without backing off the window
+ * 
+ * @param[in]   id  slave id
+ * @param[in]   now current time, millis()
+*/
+void TianBMSPollWindow::onLost(uint8_t id, uint32_t now)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t rtt = 0;
+    if (complete(id, now, rtt) != 0)
+    {
+        _timeoutCount++;
+    }
+}
+
+/**
+ * Forget every request in flight and start again from the minimum window, e.g. after the data has been cleared
+*/
+void TianBMSPollWindow::reset()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _sendTime.fill(0);
+    _window = MIN_WINDOW;
+    _inFlight = 0;
+    _gap = 0;
+    _lastSend = 0;
+    _lastDecrease = 0;
+    _smoothedRtt = 0;
+    _baseRtt = 0;
+    _nextBaseRtt = 0;
+    _baseRttSamples = 0;
+    _timeoutRate = 0;
+}
+
+/**
+ * Close the request of the slave
+ * 
+ * @param[in]   id  slave id
+ * @param[in]   now current time, millis()
+ * @param[out]  rtt round trip time of the request in ms
+ * 
+ * @return      1 if the request was in flight, 0 otherwise
+*/
+uint8_t TianBMSPollWindow::complete(uint8_t id, uint32_t now, uint32_t& rtt)
+{
+    if (id > TianBMSSlotTable::MAX_ID || _sendTime[id] == 0)
+    {
+        return 0;
+    }
+    rtt = now - (_sendTime[id] & ~0x01UL);
+    _sendTime[id] = 0;
+    _inFlight--;
+    return 1;
+}
+
+/**
+ * Get number of request allowed in flight
+*/
+uint8_t TianBMSPollWindow::getWindow() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return (uint8_t)_window;
+}
+
+/**
+ * Get number of request in flight
+*/
+uint8_t TianBMSPollWindow::getInFlight() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _inFlight;
+}
+
+/**
+ * Get minimum gap between two request in ms
+*/
+uint32_t TianBMSPollWindow::getGap() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _gap;
+}
+
+/**
+ * Get smoothed round trip time in ms
+*/
+uint32_t TianBMSPollWindow::getSmoothedRtt() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _smoothedRtt;
+}
+
+/**
+ * Get lowest recent round trip time in ms
+*/
+uint32_t TianBMSPollWindow::getBaseRtt() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _baseRtt;
+}
+
+/**
+ * Get recent timeout rate, per 1000 request
+*/
+uint32_t TianBMSPollWindow::getTimeoutRate() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _timeoutRate;
+}
+
+/**
+ * Get number of timeout since boot
+*/
+uint32_t TianBMSPollWindow::getTimeoutCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _timeoutCount;
+}
@@ -0,0 +1,70 @@
+#ifndef TIANBMS_POLL_WINDOW_H
+#define TIANBMS_POLL_WINDOW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <mutex>
+#include "TianBMS.h"
+
+/**
+ * Adaptive in flight window of the poll engine, in the spirit of TCP congestion control. The modbus client handle one
+ * request at a time, so request added to its queue only wait there. The window keep enough request queued so the
+ * gateway never idles between two response, without letting the queue (and the data age) grow :
+ *
+ *  - round trip time is measured from addRequest to the response, the lowest recent value is the base round trip.
+ *    Queued request show up as round trip above the base, window grows by one while less than ALPHA request are
+ *    queued and shrinks by one above BETA (delay based, as TCP Vegas)
+ *  - timeout halves the window and doubles the gap between two request (at most once per round trip), success
+ *    shrinks the gap by a quarter until it is cleared below MIN_GAP. A gateway that starts to lose request is backed off quickly. Timeout of a slave already
+ *    failing (refer to TianBMSHealth) only closes its request, a dead pack says nothing about the gateway load
+ *
+ * Request is tracked by slave id, only one request per slave is in flight. onSend() is called from the poll task,
+ * onResponse(), onTimeout() and onLost() from the modbus client task
+*/
+class TianBMSPollWindow
+{
+public:
+    static const uint8_t MIN_WINDOW = 1;
+    static const uint8_t MAX_WINDOW = 8;
+    static const uint32_t MAX_GAP = 2000;       // ms
+    static const uint32_t MIN_GAP = 4;          // ms, shrinking gap below this is cleared
+    static const uint32_t BASE_RTT_SAMPLES = 64; // base round trip is measured again after this many response
+
+    TianBMSPollWindow();
+    bool canSend(uint32_t now) const;
+    bool isInFlight(uint8_t id) const;
+    void onSend(uint8_t id, uint32_t now);
+    void onResponse(uint8_t id, uint32_t now);
+    void onTimeout(uint8_t id, uint32_t now);
+    void onLost(uint8_t id, uint32_t now);
+    void reset();
+    uint8_t getWindow() const;
+    uint8_t getInFlight() const;
+    uint32_t getGap() const;
+    uint32_t getSmoothedRtt() const;
+    uint32_t getBaseRtt() const;
+    uint32_t getTimeoutRate() const;
+    uint32_t getTimeoutCount() const;
+
+private:
+    static constexpr float ALPHA = 0.5f;
+    static constexpr float BETA = 1.5f;
+
+    mutable std::mutex _mutex;
+    std::array<uint32_t, TianBMSSlotTable::MAX_ID + 1> _sendTime;   // 0 = not in flight
+    float _window = MIN_WINDOW;
+    uint8_t _inFlight = 0;
+    uint32_t _gap = 0;
+    uint32_t _lastSend = 0;
+    uint32_t _lastDecrease = 0;
+    uint32_t _smoothedRtt = 0;
+    uint32_t _baseRtt = 0;
+    uint32_t _nextBaseRtt = 0;
+    uint32_t _baseRttSamples = 0;
+    uint32_t _timeoutRate = 0;   // per 1000 request, exponential moving average
+    uint32_t _timeoutCount = 0;
+    uint8_t complete(uint8_t id, uint32_t now, uint32_t& rtt);
+};
+
+#endif
@@ -0,0 +1,330 @@
+#ifndef TIANBMS_REGISTER_H
+#define TIANBMS_REGISTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "TianBMS.h"
+
+/**
+ * Register map of Tian BMS. Every field is described once in FIELDS, the decoder, the json serializer and the modbus
+ * request plan are all generated from this table. To enable or disable a field, only the enabled flag need to be changed
+*/
+namespace TianBMSRegister {
+    enum FieldType : uint8_t
+    {
+        TYPE_UINT16 = 0x00,
+        TYPE_INT16 = 0x01,
+        TYPE_UINT32 = 0x02,        // 2 registers, high word first
+        TYPE_FLAG = 0x03,          // 1 register, serialized with each named bit
+        TYPE_UINT16_ARRAY = 0x04,  // 1 register per element
+        TYPE_STRING = 0x05         // 2 characters per register
+    };
+
+    enum Group : uint8_t
+    {
+        GROUP_IDENTITY = 0x00,
+        GROUP_ELECTRICAL = 0x01,
+        GROUP_CAPACITY = 0x02,
+        GROUP_TEMPERATURE = 0x03,
+        GROUP_STATUS = 0x04,
+        GROUP_CELL_VOLTAGE = 0x05,
+        GROUP_TIME = 0x06,
+        GROUP_COUNT = 0x07
+    };
+
+    enum Period : uint8_t
+    {
+        PERIOD_FAST = 0x00,         // every poll of the slave
+        PERIOD_SLOW = 0x01,         // once per slow period
+        PERIOD_SESSION = 0x02       // once after the slave is found
+    };
+
+    struct Descriptor
+    {
+        const char* key;            // json key
+        const char* unit;
+        uint16_t divider;
+        uint16_t address;           // first register address
+        uint8_t count;              // number of register
+        FieldType type;
+        Group group;
+        uint8_t request;            // TianBMSUtils::RequestType used to read this field
+        uint16_t dataOffset;        // offset of the member inside TianBMSData
+        const char* const* bitNames; // name of each bit (16 entries) for TYPE_FLAG, nullptr entry is unused bit
+        bool enabled;
+        Period period;              // how often the field need to be read, refer to TianBMSPollPlan
+    };
+
+    constexpr const char* WARNING_BITS[16] = {
+        "cell_ov_alm", "cell_uv_alm", "pack_ov_alm", "pack_uv_alm", "chg_oc_alm", "dchg_oc_alm", "bat_ot_alm", "bat_ut_alm",
+        "env_ot_alm", "env_ut_alm", "mos_ot_alm", "low_capacity", nullptr, nullptr, nullptr, nullptr
+    };
+
+    constexpr const char* PROTECTION_BITS[16] = {
+        "cell_ov_prot", "cell_uv_prot", "pack_ov_prot", "pack_uv_prot", "short_prot", "oc_prot", "chg_ot_prot", "chg_ut_prot",
+        "dchg_ot_prot", "dchg_ut_prot", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr
+    };
+
+    constexpr const char* FAULT_STATUS_BITS[16] = {
+        "comm_sampling_fault", "temp_sensor_break", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+        "soc", "sod", "chg_mos", "dchg_mos", "chg_limit_function", nullptr, nullptr, nullptr
+    };
+
+    /**
+     * The order of this table is the order of the json output. cell_temperature, balance_temperature,
+     * remaining_charge_time and remaining_discharge_time stay disabled until their address is confirmed on a pack, the
+     * baseline firmware never output them
+    */
+    constexpr Descriptor FIELDS[] = {
+        {"pcb_barcode", "None", 1, 4160, 16, TYPE_STRING, GROUP_IDENTITY, TianBMSUtils::REQUEST_PCB_CODE, offsetof(TianBMSData, pcbBarcode), nullptr, true, PERIOD_SESSION},
+        {"sn_code_1", "None", 1, 4176, 16, TYPE_STRING, GROUP_IDENTITY, TianBMSUtils::REQUEST_SN1_CODE, offsetof(TianBMSData, snCode1), nullptr, true, PERIOD_SESSION},
+        {"sn_code_2", "None", 1, 4192, 16, TYPE_STRING, GROUP_IDENTITY, TianBMSUtils::REQUEST_SN2_CODE, offsetof(TianBMSData, snCode2), nullptr, true, PERIOD_SESSION},
+        {"pack_voltage", "V", 100, 4096, 1, TYPE_UINT16, GROUP_ELECTRICAL, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, packVoltage), nullptr, true, PERIOD_FAST},
+        {"pack_current", "A", 100, 4097, 1, TYPE_INT16, GROUP_ELECTRICAL, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, packCurrent), nullptr, true, PERIOD_FAST},
+        {"remaining_capacity", "Ah", 1, 4098, 1, TYPE_UINT16, GROUP_CAPACITY, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, remainingCapacity), nullptr, true, PERIOD_FAST},
+        {"average_cell_temperature", "Celcius", 10, 4099, 1, TYPE_INT16, GROUP_TEMPERATURE, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, avgCellTemperature), nullptr, true, PERIOD_FAST},
+        {"env_temperature", "Celcius", 10, 4100, 1, TYPE_INT16, GROUP_TEMPERATURE, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, envTemperature), nullptr, true, PERIOD_FAST},
+        {"warning_flag", "None", 1, 4101, 1, TYPE_FLAG, GROUP_STATUS, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, warningFlag), WARNING_BITS, true, PERIOD_FAST},
+        {"protection_flag", "None", 1, 4102, 1, TYPE_FLAG, GROUP_STATUS, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, protectionFlag), PROTECTION_BITS, true, PERIOD_FAST},
+        {"fault_status_flag", "None", 1, 4103, 1, TYPE_FLAG, GROUP_STATUS, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, faultStatusFlag), FAULT_STATUS_BITS, true, PERIOD_FAST},
+        {"soc", "%", 100, 4104, 1, TYPE_UINT16, GROUP_CAPACITY, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, soc), nullptr, true, PERIOD_FAST},
+        {"soh", "%", 100, 4105, 1, TYPE_UINT16, GROUP_CAPACITY, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, soh), nullptr, true, PERIOD_SLOW},
+        {"full_charged_cap", "Ah", 1, 4106, 1, TYPE_UINT16, GROUP_CAPACITY, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, fullChargedCap), nullptr, true, PERIOD_SLOW},
+        {"cycle_count", "None", 1, 4107, 1, TYPE_UINT16, GROUP_CAPACITY, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, cycleCount), nullptr, true, PERIOD_SLOW},
+        {"cell_voltage", "mV", 1, 4108, 16, TYPE_UINT16_ARRAY, GROUP_CELL_VOLTAGE, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, cellVoltage), nullptr, true, PERIOD_FAST},
+        {"cell_temperature", "Celcius", 10, 4136, 4, TYPE_UINT16_ARRAY, GROUP_TEMPERATURE, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, cellTemperature), nullptr, false, PERIOD_SLOW},
+        {"balance_temperature", "Celcius", 10, 4124, 1, TYPE_UINT16, GROUP_TEMPERATURE, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, balanceTemperature), nullptr, false, PERIOD_SLOW},
+        {"max_cell_voltage", "mV", 1, 4125, 1, TYPE_UINT16, GROUP_CELL_VOLTAGE, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, maxCellVoltage), nullptr, true, PERIOD_FAST},
+        {"min_cell_voltage", "mV", 1, 4126, 1, TYPE_UINT16, GROUP_CELL_VOLTAGE, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, minCellVoltage), nullptr, true, PERIOD_FAST},
+        {"cell_voltage_diff", "mV", 1, 4127, 1, TYPE_UINT16, GROUP_CELL_VOLTAGE, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, cellVoltageDiff), nullptr, true, PERIOD_FAST},
+        {"max_cell_temperature", "Celcius", 10, 4128, 1, TYPE_UINT16, GROUP_TEMPERATURE, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, maxCellTemp), nullptr, true, PERIOD_FAST},
+        {"min_cell_temperature", "Celcius", 10, 4129, 1, TYPE_UINT16, GROUP_TEMPERATURE, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, minCellTemp), nullptr, true, PERIOD_FAST},
+        {"fet_temperature", "Celcius", 10, 4130, 1, TYPE_UINT16, GROUP_TEMPERATURE, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, fetTemp), nullptr, true, PERIOD_FAST},
+        {"remaining_charge_time", "Seconds", 1, 4144, 2, TYPE_UINT32, GROUP_TIME, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, remainChgTime), nullptr, false, PERIOD_SLOW},
+        {"remaining_discharge_time", "Seconds", 1, 4146, 2, TYPE_UINT32, GROUP_TIME, TianBMSUtils::REQUEST_DATA, offsetof(TianBMSData, remainDsgTime), nullptr, false, PERIOD_SLOW}
+    };
+
+    constexpr size_t FIELD_COUNT = sizeof(FIELDS) / sizeof(FIELDS[0]);
+
+    constexpr uint16_t minOf(uint16_t a, uint16_t b)
+    {
+        return a < b ? a : b;
+    }
+
+    constexpr uint16_t maxOf(uint16_t a, uint16_t b)
+    {
+        return a > b ? a : b;
+    }
+
+    /**
+     * First register address of the enabled fields read by the request type
+    */
+    constexpr uint16_t firstAddress(uint8_t request, size_t index = 0)
+    {
+        return index >= FIELD_COUNT ? 0xFFFF :
+            minOf((FIELDS[index].enabled && FIELDS[index].request == request) ? FIELDS[index].address : 0xFFFF, firstAddress(request, index + 1));
+    }
+
+    /**
+     * Register address after the last enabled fields read by the request type
+    */
+    constexpr uint16_t endAddress(uint8_t request, size_t index = 0)
+    {
+        return index >= FIELD_COUNT ? 0 :
+            maxOf((FIELDS[index].enabled && FIELDS[index].request == request) ? FIELDS[index].address + FIELDS[index].count : 0, endAddress(request, index + 1));
+    }
+
+    /**
+     * Register address of the modbus request for the request type
+    */
+    constexpr uint16_t requestAddress(uint8_t request)
+    {
+        return firstAddress(request);
+    }
+
+    /**
+     * Number of register of the modbus request for the request type, covering every enabled field
+    */
+    constexpr uint16_t requestCount(uint8_t request)
+    {
+        return endAddress(request) > firstAddress(request) ? endAddress(request) - firstAddress(request) : 0;
+    }
+
+    /**
+     * Number of enabled field
+    */
+    constexpr size_t enabledCount(size_t index = 0)
+    {
+        return index >= FIELD_COUNT ? 0 : (FIELDS[index].enabled ? 1 : 0) + enabledCount(index + 1);
+    }
+
+    /**
+     * First register address of the enabled fields read with the period
+    */
+    constexpr uint16_t periodFirstAddress(Period period, size_t index = 0)
+    {
+        return index >= FIELD_COUNT ? 0xFFFF :
+            minOf((FIELDS[index].enabled && FIELDS[index].period == period) ? FIELDS[index].address : 0xFFFF, periodFirstAddress(period, index + 1));
+    }
+
+    /**
+     * Register address after the last enabled fields read with the period
+    */
+    constexpr uint16_t periodEndAddress(Period period, size_t index = 0)
+    {
+        return index >= FIELD_COUNT ? 0 :
+            maxOf((FIELDS[index].enabled && FIELDS[index].period == period) ? FIELDS[index].address + FIELDS[index].count : 0, periodEndAddress(period, index + 1));
+    }
+
+    /**
+     * Register block read with one modbus request, built by the poll plan (refer to TianBMSPollPlan)
+    */
+    struct Block
+    {
+        uint8_t request;            // TianBMSUtils::RequestType of the first field in the block
+        uint8_t offset;             // address - requestAddress(request), carried by the token (refer to TianBMS::getToken)
+        uint16_t address;           // first register address
+        uint8_t count;              // number of register
+        Period period;
+    };
+
+    static_assert(requestCount(TianBMSUtils::REQUEST_DATA) <= 64, "data request exceed the response payload buffer");
+    static_assert(periodEndAddress(PERIOD_FAST) > periodFirstAddress(PERIOD_FAST) &&
+        periodEndAddress(PERIOD_FAST) - periodFirstAddress(PERIOD_FAST) <= 64, "fast fields must fit one response payload");
+    static_assert(requestCount(TianBMSUtils::REQUEST_PCB_CODE) * 2 < sizeof(TianBMSData::pcbBarcode), "pcb barcode exceed the buffer");
+
+    /**
+     * Number of byte used by the field inside TianBMSData, including the null terminator of TYPE_STRING
+    */
+    constexpr size_t fieldSize(const Descriptor& field)
+    {
+        return field.type == TYPE_UINT32 ? 4 :
+            field.type == TYPE_UINT16_ARRAY ? field.count * 2 :
+            field.type == TYPE_STRING ? field.count * 2 + 1 : 2;
+    }
+
+    /**
+     * Read the value of numeric field from the record
+     *
+     * @param[in]   record  source record
+     * @param[in]   field   field descriptor
+     * @param[in]   element element index for TYPE_UINT16_ARRAY
+     *
+     * @return      raw value (before divider), 0 for TYPE_STRING
+    */
+    inline int64_t fieldValue(const TianBMSData& record, const Descriptor& field, size_t element = 0)
+    {
+        const uint8_t* member = reinterpret_cast<const uint8_t*>(&record) + field.dataOffset;
+        switch (field.type)
+        {
+        case TYPE_UINT16:
+        case TYPE_FLAG:
+            return *reinterpret_cast<const uint16_t*>(member);
+        case TYPE_INT16:
+            return *reinterpret_cast<const int16_t*>(member);
+        case TYPE_UINT32:
+            return *reinterpret_cast<const uint32_t*>(member);
+        case TYPE_UINT16_ARRAY:
+            return reinterpret_cast<const uint16_t*>(member)[element];
+        default:
+            return 0;
+        }
+    }
+
+    /**
+     * Read the value of TYPE_STRING field from the record
+     *
+     * @param[in]   record  source record
+     * @param[in]   field   field descriptor
+     *
+     * @return      null terminated string, empty string for other type
+    */
+    inline const char* fieldString(const TianBMSData& record, const Descriptor& field)
+    {
+        if (field.type != TYPE_STRING)
+        {
+            return "";
+        }
+        return reinterpret_cast<const char*>(&record) + field.dataOffset;
+    }
+
+    /**
+     * Decode every enabled field covered by the register block into the record. Register address is unique across the
+     * request type, so a block may carry the field of several request type
+     *
+     * @param[in]   record  destination record
+     * @param[in]   startAddress    register address of the first register in source
+     * @param[in]   source  register source, refer to TianBMSRegisterSource or TianBMSPayloadSource
+     * @param[in]   swap    swap the MSB and LSB of string register
+     * @param[out]  changedGroups   optional, bit of the group (refer to Group) whose value changed is set
+     *
+     * @return      number of decoded field
+    */
+    template <typename Source>
+    size_t decode(TianBMSData* record, uint16_t startAddress, const Source& source, bool swap,
+        uint8_t* changedGroups = nullptr)
+    {
+        uint8_t previous[40];
+        size_t decoded = 0;
+        uint8_t* base = reinterpret_cast<uint8_t*>(record);
+        for (size_t i = 0; i < FIELD_COUNT; i++)
+        {
+            const Descriptor& field = FIELDS[i];
+            if (!field.enabled || field.address < startAddress ||
+                field.address + field.count > startAddress + source.size())
+            {
+                continue;
+            }
+            size_t index = field.address - startAddress;
+            uint8_t* member = base + field.dataOffset;
+            size_t size = fieldSize(field);
+            if (changedGroups != nullptr && size <= sizeof(previous))
+            {
+                memcpy(previous, member, size);
+            }
+            switch (field.type)
+            {
+            case TYPE_UINT16:
+            case TYPE_FLAG:
+                *reinterpret_cast<uint16_t*>(member) = source.at(index);
+                break;
+            case TYPE_INT16:
+                *reinterpret_cast<int16_t*>(member) = source.at(index);
+                break;
+            case TYPE_UINT32:
+                *reinterpret_cast<uint32_t*>(member) = ((uint32_t)source.at(index) << 16) + source.at(index + 1);
+                break;
+            case TYPE_UINT16_ARRAY:
+                for (size_t n = 0; n < field.count; n++)
+                {
+                    reinterpret_cast<uint16_t*>(member)[n] = source.at(index + n);
+                }
+                break;
+            case TYPE_STRING:
+                for (size_t n = 0; n < field.count; n++)
+                {
+                    uint16_t value = source.at(index + n);
+                    if (swap)
+                    {
+                        value = Utilities::swap16(value);
+                    }
+                    member[n * 2] = value >> 8;
+                    member[n * 2 + 1] = value & 0xFF;
+                }
+                member[field.count * 2] = 0;
+                break;
+            default:
+                break;
+            }
+            if (changedGroups != nullptr && (size > sizeof(previous) || memcmp(previous, member, size) != 0))
+            {
+                *changedGroups |= 1 << field.group;
+            }
+            decoded++;
+        }
+        return decoded;
+    }
+}
+
+#endif
@@ -0,0 +1,205 @@
+#include "TianBMSResponseQueue.h"
+
+TianBMSResponseQueue::TianBMSResponseQueue(uint32_t maxHold) : _maxHold(maxHold)
+{
+    _head.store(0);
+    _tail.store(0);
+    _enqueuedCount.store(0);
+    _appliedCount.store(0);
+    _overflowCount.store(0);
+    _invalidCount.store(0);
+    _mergedCount.store(0);
+}
+
+/**
+ * Reserve the next free slot for the producer. The slot is filled in place and only visible to the consumer after
+ * commit() is called. Producer side only
+ * 
+ * @return      pointer to the free slot, nullptr if the queue is full (counted as overflow)
+*/
+TianBMSResponse* TianBMSResponseQueue::reserve()
+{
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) >= CAPACITY)
+    {
+        _overflowCount++;
+        return nullptr;
+    }
+    TianBMSResponse* slot = &_slots[head & (CAPACITY - 1)];
+    slot->isError = false;
+    slot->errorCode = 0;
+    slot->payloadSize = 0;
+    return slot;
+}
+
+/**
+ * Publish the slot returned by the last reserve() to the consumer. Producer side only
+*/
+void TianBMSResponseQueue::commit()
+{
+    _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    _enqueuedCount++;
+}
+
+/**
+ * Enqueue error response. Producer side only
+ * 
+ * @param[in]   token   token of the request that failed
+ * @param[in]   errorCode   modbus error code
+ * @param[in]   timestamp   time when the error is received in ms
+ * 
+ * @return      true if enqueued, false if the queue is full
+*/
+bool TianBMSResponseQueue::pushError(uint32_t token, uint8_t errorCode, uint32_t timestamp)
+{
+    TianBMSResponse* slot = reserve();
+    if (slot == nullptr)
+    {
+        return false;
+    }
+    slot->token = token;
+    slot->timestamp = timestamp;
+    slot->isError = true;
+    slot->errorCode = errorCode;
+    commit();
+    return true;
+}
+
+/**
+ * Apply the queued response into TianBMS. Consumer side only, the caller is responsible to hold the lock of the
+ * TianBMS object if any
+ * 
+ * @param[in]   tianBMS TianBMS object as the destination
+ * @param[in]   maxBatch    maximum number of response applied in this call, the blocks of one merged update are
+ *                          always applied together
+ * @param[out]  oldestTimestamp optional, timestamp of the first response applied, left untouched if nothing is applied
+ * 
+ * @return      number of response applied
+*/
+size_t TianBMSResponseQueue::drain(TianBMS& tianBMS, size_t maxBatch, uint32_t* oldestTimestamp)
+{
+    size_t count = 0;
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    uint32_t head = _head.load(std::memory_order_acquire);
+    while (tail != head && count < maxBatch)
+    {
+        TianBMSResponse& slot = _slots[tail & (CAPACITY - 1)];
+        if (slot.isError)
+        {
+            if (count == 0 && oldestTimestamp != nullptr)
+            {
+                *oldestTimestamp = slot.timestamp;
+            }
+            tianBMS.updateOnError(slot.token);
+            tail++;
+            count++;
+            _tail.store(tail, std::memory_order_release);
+            _appliedCount++;
+            continue;
+        }
+        // collect the following block of the same poll, stop at the first block that is not continued
+        std::array<TianBMSBlockPayload, MAX_MERGE> blocks;
+        size_t blockCount = 0;
+        uint32_t next = tail;
+        bool isComplete = false;
+        while (next != head && blockCount < MAX_MERGE)
+        {
+            TianBMSResponse& block = _slots[next & (CAPACITY - 1)];
+            if (block.isError || block.id != slot.id)
+            {
+                isComplete = true;
+                break;
+            }
+            blocks[blockCount].token = block.token;
+            blocks[blockCount].payload = block.payload.data();
+            blocks[blockCount].payloadSize = block.payloadSize;
+            blocks[blockCount].timestamp = block.timestamp;
+            blockCount++;
+            next++;
+            if (!tianBMS.parseToken(block.token).isContinued)
+            {
+                isComplete = true;
+                break;
+            }
+        }
+        if (!isComplete && blockCount < MAX_MERGE && millis() - slot.timestamp < _maxHold)
+        {
+            break;
+        }
+        if (count == 0 && oldestTimestamp != nullptr)
+        {
+            *oldestTimestamp = slot.timestamp;
+        }
+        tianBMS.updateFromBlocks(slot.id, blocks.data(), blockCount);
+        tail = next;
+        count += blockCount;
+        _tail.store(tail, std::memory_order_release);
+        _appliedCount += blockCount;
+        _mergedCount += blockCount - 1;
+    }
+    return count;
+}
+
+/**
+ * Number of response waiting to be applied
+*/
+size_t TianBMSResponseQueue::size() const
+{
+    return _head.load() - _tail.load();
+}
+
+/**
+ * Count response the producer refused before reserving a slot (invalid length, ...), it is dropped. Producer side only
+*/
+void TianBMSResponseQueue::reject()
+{
+    _invalidCount++;
+}
+
+/**
+ * Number of response enqueued since boot
+*/
+uint32_t TianBMSResponseQueue::getEnqueuedCount() const
+{
+    return _enqueuedCount.load();
+}
+
+/**
+ * Number of response applied into TianBMS since boot
+*/
+uint32_t TianBMSResponseQueue::getAppliedCount() const
+{
+    return _appliedCount.load();
+}
+
+/**
+ * Number of response applied together with the response before it since boot
+*/
+uint32_t TianBMSResponseQueue::getMergedCount() const
+{
+    return _mergedCount.load();
+}
+
+/**
+ * Number of response rejected because the queue was full since boot
+*/
+uint32_t TianBMSResponseQueue::getOverflowCount() const
+{
+    return _overflowCount.load();
+}
+
+/**
+ * Number of response refused by the producer since boot
+*/
+uint32_t TianBMSResponseQueue::getInvalidCount() const
+{
+    return _invalidCount.load();
+}
+
+/**
+ * Number of response dropped since boot, overflowed or invalid
+*/
+uint32_t TianBMSResponseQueue::getDroppedCount() const
+{
+    return _overflowCount.load() + _invalidCount.load();
+}
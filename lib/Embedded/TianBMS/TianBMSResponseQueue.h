@@ -0,0 +1,64 @@
+#ifndef TIANBMS_RESPONSE_QUEUE_H
+#define TIANBMS_RESPONSE_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <atomic>
+#include "TianBMS.h"
+
+struct TianBMSResponse
+{
+    uint32_t token = 0;
+    uint32_t timestamp = 0;
+    uint8_t id = 0;
+    uint8_t errorCode = 0;
+    bool isError = false;
+    uint8_t payloadSize = 0;
+    std::array<uint8_t, 128> payload; // raw register bytes, big endian
+
+};
+
+/**
+ * Bounded lock free single producer / single consumer ring of preallocated response slots. The modbus client task
+ * (producer) only copy the raw payload of the response, the consumer decode it into TianBMS in batch. Nothing is dropped silently,
+ * every entry is counted as enqueued, applied, overflowed (queue full) or invalid (refused by the producer before
+ * reserve(), e.g. payload length not matching)
+ *
+ * Response whose token is continued (refer to TianBMS::getToken) is applied together with the response of the next
+ * block of the same slave as one update. It is held until that response or its error is in the queue, at most
+ * maxHold ms in case the next request never made it to the bus
+*/
+class TianBMSResponseQueue
+{
+public:
+    static const size_t CAPACITY = 32; // must be power of two
+    static const size_t MAX_MERGE = 4;  // block applied as one update
+
+    TianBMSResponseQueue(uint32_t maxHold = 3000);
+    TianBMSResponse* reserve();
+    void commit();
+    bool pushError(uint32_t token, uint8_t errorCode, uint32_t timestamp);
+    void reject();
+    size_t drain(TianBMS& tianBMS, size_t maxBatch, uint32_t* oldestTimestamp = nullptr);
+    size_t size() const;
+    uint32_t getEnqueuedCount() const;
+    uint32_t getAppliedCount() const;
+    uint32_t getMergedCount() const;
+    uint32_t getOverflowCount() const;
+    uint32_t getInvalidCount() const;
+    uint32_t getDroppedCount() const;
+
+private:
+    std::array<TianBMSResponse, CAPACITY> _slots;
+    std::atomic<uint32_t> _head; // written by producer
+    std::atomic<uint32_t> _tail; // written by consumer
+    std::atomic<uint32_t> _enqueuedCount;
+    std::atomic<uint32_t> _appliedCount;
+    std::atomic<uint32_t> _overflowCount;
+    std::atomic<uint32_t> _invalidCount;
+    std::atomic<uint32_t> _mergedCount;
+    uint32_t _maxHold;
+};
+
+#endif
@@ -0,0 +1,220 @@
+#include "TianBMSScanner.h"
+
+TianBMSScanner::TianBMSScanner()
+{
+    reset();
+}
+
+/**
+ * Start new scan
+ * 
+ * @param[in]   addresses   address to probe
+ * @param[in]   count   number of address
+ * @param[in]   parallel    maximum probe in flight during the first pass
+ * @param[in]   now current time, millis()
+*/
+void TianBMSScanner::begin(const uint8_t* addresses, size_t count, uint8_t parallel, uint32_t now)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _state.fill(STATE_NONE);
+    _tries.fill(0);
+    _remaining = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t id = addresses[i];
+        if (id >= TianBMSSlotTable::MIN_ID && id <= TianBMSSlotTable::MAX_ID && _state[id] == STATE_NONE)
+        {
+            _state[id] = STATE_UNKNOWN;
+            _remaining++;
+        }
+    }
+    _parallel = parallel > 0 ? parallel : 1;
+    _window = 1;
+    _inFlight = 0;
+    _isActive = true;
+    _startTime = now;
+    _duration = 0;
+    _probeCount = 0;
+    _retryCount = 0;
+}
+
+/**
+ * Stop the scan and clear the result
+*/
+void TianBMSScanner::reset()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _state.fill(STATE_NONE);
+    _tries.fill(0);
+    _inFlight = 0;
+    _remaining = 0;
+    _isActive = false;
+}
+
+/**
+ * Get the next address to probe, the caller must send the probe and report its result
+ * 
+ * @return      address, -1 if nothing can be probed now (window full or scan finished)
+*/
+int16_t TianBMSScanner::nextProbe()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_isActive || _remaining == 0)
+    {
+        return -1;
+    }
+    bool isFirstPass = false;
+    for (size_t id = TianBMSSlotTable::MIN_ID; id <= TianBMSSlotTable::MAX_ID && !isFirstPass; id++)
+    {
+        isFirstPass = _state[id] == STATE_UNKNOWN;
+    }
+    if (_inFlight >= (isFirstPass ? _window : 1))
+    {
+        return -1;
+    }
+    State wanted = isFirstPass ? STATE_UNKNOWN : STATE_AMBIGUOUS;
+    for (size_t id = TianBMSSlotTable::MIN_ID; id <= TianBMSSlotTable::MAX_ID; id++)
+    {
+        if (_state[id] == wanted)
+        {
+            if (!isFirstPass)
+            {
+                _retryCount++;
+            }
+            _state[id] = STATE_PENDING;
+            _tries[id]++;
+            _inFlight++;
+            _probeCount++;
+            return id;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Register answer of the probe, the address is present
+*/
+void TianBMSScanner::onResponse(uint8_t id, uint32_t now)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    settle(id, STATE_PRESENT, now);
+}
+
+/**
+ * Register gateway report of no answer from the address, the address is absent
+*/
+void TianBMSScanner::onAbsent(uint8_t id, uint32_t now)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    settle(id, STATE_ABSENT, now);
+}
+
+/**
+ * Register probe without any answer, probed again later unless it already used MAX_TRIES
+*/
+void TianBMSScanner::onTimeout(uint8_t id, uint32_t now)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (id > TianBMSSlotTable::MAX_ID || _state[id] != STATE_PENDING)
+    {
+        return;
+    }
+    if (_tries[id] >= MAX_TRIES)
+    {
+        settle(id, STATE_ABSENT, now);
+        return;
+    }
+    _state[id] = STATE_AMBIGUOUS;
+    _inFlight--;
+    _window = _window > 1 ? _window / 2 : 1;
+}
+
+/**
+ * Close the probe of the address with its final state
+*/
+void TianBMSScanner::settle(uint8_t id, State state, uint32_t now)
+{
+    if (id > TianBMSSlotTable::MAX_ID || _state[id] != STATE_PENDING)
+    {
+        return;
+    }
+    _state[id] = state;
+    _inFlight--;
+    _remaining--;
+    if (_window < _parallel)
+    {
+        _window++;
+    }
+    if (_remaining == 0)
+    {
+        _duration = now - _startTime;
+    }
+}
+
+/**
+ * Check if a scan has been started and not reset since
+*/
+bool TianBMSScanner::isActive() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _isActive;
+}
+
+/**
+ * Check if every address is known as present or absent
+*/
+bool TianBMSScanner::isFinished() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _isActive && _remaining == 0;
+}
+
+/**
+ * Check if the address answered the scan
+*/
+bool TianBMSScanner::isPresent(uint8_t id) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return id <= TianBMSSlotTable::MAX_ID && _state[id] == STATE_PRESENT;
+}
+
+/**
+ * Get number of present address
+*/
+size_t TianBMSScanner::getPresentCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t count = 0;
+    for (size_t id = TianBMSSlotTable::MIN_ID; id <= TianBMSSlotTable::MAX_ID; id++)
+    {
+        count += _state[id] == STATE_PRESENT;
+    }
+    return count;
+}
+
+/**
+ * Get number of probe sent by the current scan, retry included
+*/
+uint32_t TianBMSScanner::getProbeCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _probeCount;
+}
+
+/**
+ * Get number of probe sent again for ambiguous address
+*/
+uint32_t TianBMSScanner::getRetryCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _retryCount;
+}
+
+/**
+ * Get duration of the last finished scan in ms, 0 while the scan is running
+*/
+uint32_t TianBMSScanner::getDuration() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _duration;
+}
@@ -0,0 +1,72 @@
+#ifndef TIANBMS_SCANNER_H
+#define TIANBMS_SCANNER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <mutex>
+#include "TianBMS.h"
+
+/**
+ * Address scan state. Every listed address is probed once, with several probe queued in the modbus client so the next
+ * one is sent as soon as the previous is answered instead of on the next poll tick, the result fill the presence
+ * bitmap :
+ *
+ *  - response (data or modbus exception) : present
+ *  - gateway exception "target device failed to respond" : absent, the gateway itself timed out on the bus
+ *  - timeout : ambiguous, the gateway may have dropped the request or waited behind another client. Ambiguous
+ *    address is probed again one at a time once the first pass is done, up to MAX_TRIES probe in total, then taken as
+ *    absent
+ *
+ * Gateway that queue request itself can hold a probe past the client timeout, so the number of probe in flight starts
+ * at 1, grows by one on every answer up to `parallel` and is halved on timeout
+ *
+ * nextProbe() is called from the poll task, onResponse(), onAbsent() and onTimeout() from the modbus client task
+*/
+class TianBMSScanner
+{
+public:
+    static const uint8_t MAX_TRIES = 2;
+
+    TianBMSScanner();
+    void begin(const uint8_t* addresses, size_t count, uint8_t parallel, uint32_t now);
+    void reset();
+    int16_t nextProbe();
+    void onResponse(uint8_t id, uint32_t now);
+    void onAbsent(uint8_t id, uint32_t now);
+    void onTimeout(uint8_t id, uint32_t now);
+    bool isActive() const;
+    bool isFinished() const;
+    bool isPresent(uint8_t id) const;
+    size_t getPresentCount() const;
+    uint32_t getProbeCount() const;
+    uint32_t getRetryCount() const;
+    uint32_t getDuration() const;
+
+private:
+    enum State : uint8_t
+    {
+        STATE_NONE = 0x00,      // not in the address list
+        STATE_UNKNOWN = 0x01,
+        STATE_PENDING = 0x02,
+        STATE_AMBIGUOUS = 0x03,
+        STATE_PRESENT = 0x04,
+        STATE_ABSENT = 0x05
+    };
+
+    mutable std::mutex _mutex;
+    std::array<State, TianBMSSlotTable::MAX_ID + 1> _state;
+    std::array<uint8_t, TianBMSSlotTable::MAX_ID + 1> _tries;
+    uint8_t _parallel = 1;
+    uint8_t _window = 1;
+    uint8_t _inFlight = 0;
+    size_t _remaining = 0;      // address not yet present or absent
+    bool _isActive = false;
+    uint32_t _startTime = 0;
+    uint32_t _duration = 0;
+    uint32_t _probeCount = 0;
+    uint32_t _retryCount = 0;
+    void settle(uint8_t id, State state, uint32_t now);
+};
+
+#endif
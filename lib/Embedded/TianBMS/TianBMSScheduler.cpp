@@ -0,0 +1,294 @@
+#include "TianBMSScheduler.h"
+
+namespace
+{
+    // target age = normal age / divider, by level
+    const uint8_t AGE_DIVIDER[TianBMSScheduler::LEVEL_COUNT] = {1, 2, 2, 4};
+}
+
+TianBMSScheduler::TianBMSScheduler(uint32_t normalAge) : _normalAge(normalAge > 0 ? normalAge : 1)
+{
+    reset();
+}
+
+/**
+ * Take the data applied since the last call into account : classify the slave again from its new record and count
+ * the deadline miss, both of the data that arrived late and of the data that is still missing past its target age
+ *
+ * @param[in]   tianBMS tianBMS object
+ * @param[in]   now current time, millis()
+*/
+void TianBMSScheduler::refresh(TianBMS& tianBMS, uint32_t now)
+{
+    const TianBMSSlotTable& table = tianBMS.getTianBMSData();
+    for (uint8_t id = table.next(0); id != 0; id = table.next(id))
+    {
+        uint32_t timestamp = tianBMS.getDataTimestamp(id);
+        bool isUpdated = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            Slot& slot = _slots[id];
+            isUpdated = timestamp != 0 && timestamp != slot.lastUpdate;
+            if (!isUpdated && slot.lastUpdate != 0 && !slot.isMissed && now - slot.lastUpdate > getTargetAge(slot.level))
+            {
+                slot.isMissed = true;
+                slot.missCount++;
+                _totalMissCount++;
+            }
+        }
+        // snapshot is taken without the lock, the record only change on the next response
+        if (!isUpdated || !tianBMS.getSnapshot(id, _record))
+        {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        Slot& slot = _slots[id];
+        if (slot.lastUpdate != 0 && !slot.isMissed && timestamp - slot.lastUpdate > getTargetAge(slot.level))
+        {
+            slot.missCount++;
+            _totalMissCount++;
+        }
+        slot.level = classify(slot, _record, timestamp);
+        slot.lastUpdate = timestamp;
+        slot.isMissed = false;
+    }
+}
+
+/**
+ * Get the slave to poll next. Slave past its deadline is served by level, critical first, then by how overdue its
+ * request is relative to its target age. Slave never polled is served first, slave overdue STARVE_RATIO times its
+ * target age is served before any other so a bus full of critical pack does not stop the rest
+ *
+ * @param[in]   table   slot table, only the slave in the table is polled
+ * @param[in]   now current time, millis()
+ * @param[in]   lead    expected round trip in ms, the request is due this long before the deadline so the data
+ *                      arrives in time
+ * @param[in]   health  circuit breaker, slave that may not be polled is skipped. nullptr = every slave
+ *
+ * @return      slave id, -1 if every slave already has its request in flight or may not be polled
+*/
+int16_t TianBMSScheduler::next(const TianBMSSlotTable& table, uint32_t now, uint32_t lead, const TianBMSHealth* health) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    int16_t best = -1;
+    uint8_t bestBand = 0;
+    uint32_t bestElapsed = 0;
+    uint32_t bestAge = 1;
+    for (uint8_t id = table.next(0); id != 0; id = table.next(id))
+    {
+        const Slot& slot = _slots[id];
+        if (slot.isPending || (health != nullptr && !health->isPollable(id, now)))
+        {
+            continue;
+        }
+        if (slot.lastSend == 0)
+        {
+            return id;
+        }
+        uint32_t elapsed = now - slot.lastSend + lead;
+        uint32_t age = getTargetAge(slot.level);
+        uint8_t band = 0;
+        if ((uint64_t)elapsed >= (uint64_t)age * STARVE_RATIO)
+        {
+            band = LEVEL_COUNT + 1;
+        }
+        else if (elapsed >= age)
+        {
+            band = slot.level + 1;
+        }
+        // higher band first, then elapsed / age > bestElapsed / bestAge, without division
+        if (best < 0 || band > bestBand ||
+            (band == bestBand && (uint64_t)elapsed * bestAge > (uint64_t)bestElapsed * age))
+        {
+            best = id;
+            bestBand = band;
+            bestElapsed = elapsed;
+            bestAge = age;
+        }
+    }
+    return best;
+}
+
+/**
+ * Register request added to the modbus client queue
+ *
+ * @param[in]   id  slave id
+ * @param[in]   now current time, millis()
+*/
+void TianBMSScheduler::onSend(uint8_t id, uint32_t now)
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _slots[id].lastSend = now | 0x01;
+    _slots[id].isPending = true;
+}
+
+/**
+ * Register the end of the request of the slave, response or error
+ *
+ * @param[in]   id  slave id
+*/
+void TianBMSScheduler::onComplete(uint8_t id)
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _slots[id].isPending = false;
+}
+
+/**
+ * Check if the slave has reached its deadline, a request sent before it only spends spare bus time
+ *
+ * @param[in]   id  slave id
+ * @param[in]   now current time, millis()
+ * @param[in]   lead    expected round trip in ms, refer to next()
+*/
+bool TianBMSScheduler::isDue(uint8_t id, uint32_t now, uint32_t lead) const
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    const Slot& slot = _slots[id];
+    return slot.lastSend == 0 || now - slot.lastSend + lead >= getTargetAge(slot.level);
+}
+
+/**
+ * Forget the state learned from the record of the slave (level, soc rate, deadline miss), called when another pack
+ * answers on its id. Its request in flight is kept
+ *
+ * @param[in]   id  slave id
+*/
+void TianBMSScheduler::resetSlave(uint8_t id)
+{
+    if (id > TianBMSSlotTable::MAX_ID)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    Slot& slot = _slots[id];
+    _totalMissCount -= slot.missCount;
+    Slot fresh;
+    fresh.lastSend = slot.lastSend;
+    fresh.isPending = slot.isPending;
+    slot = fresh;
+}
+
+/**
+ * Forget every slave, called when the data table is cleared
+*/
+void TianBMSScheduler::reset()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _slots.fill(Slot());
+    _totalMissCount = 0;
+}
+
+/**
+ * Get target maximum data age of the level
+ *
+ * @param[in]   level   slave level
+ *
+ * @return      target age in ms
+*/
+uint32_t TianBMSScheduler::getTargetAge(Level level) const
+{
+    return _normalAge / AGE_DIVIDER[level < LEVEL_COUNT ? level : LEVEL_NORMAL];
+}
+
+/**
+ * Get the level of the slave, from its latest record
+*/
+TianBMSScheduler::Level TianBMSScheduler::getLevel(uint8_t id) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return id <= TianBMSSlotTable::MAX_ID ? _slots[id].level : LEVEL_NORMAL;
+}
+
+/**
+ * Get the age of the latest data of the slave as seen by the last refresh()
+ *
+ * @return      age in ms, 0 if the slave has no data yet
+*/
+uint32_t TianBMSScheduler::getDataAge(uint8_t id, uint32_t now) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (id > TianBMSSlotTable::MAX_ID || _slots[id].lastUpdate == 0)
+    {
+        return 0;
+    }
+    return now - _slots[id].lastUpdate;
+}
+
+/**
+ * Get number of deadline miss of the slave
+*/
+uint32_t TianBMSScheduler::getMissCount(uint8_t id) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return id <= TianBMSSlotTable::MAX_ID ? _slots[id].missCount : 0;
+}
+
+/**
+ * Get number of deadline miss of every slave
+*/
+uint32_t TianBMSScheduler::getTotalMissCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _totalMissCount;
+}
+
+/**
+ * Get number of slave at the level
+*/
+size_t TianBMSScheduler::getLevelCount(Level level) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t count = 0;
+    for (size_t id = TianBMSSlotTable::MIN_ID; id <= TianBMSSlotTable::MAX_ID; id++)
+    {
+        count += _slots[id].lastUpdate != 0 && _slots[id].level == level;
+    }
+    return count;
+}
+
+/**
+ * Get the level of the slave from its new record, soc rate is measured against the soc of at least SOC_WINDOW ago
+ * so the register resolution does not look like a fast change
+*/
+TianBMSScheduler::Level TianBMSScheduler::classify(Slot& slot, const TianBMSData& record, uint32_t timestamp)
+{
+    if (slot.socTime == 0)
+    {
+        slot.socTime = timestamp | 0x01;
+        slot.socReference = record.soc;
+    }
+    else if (timestamp - slot.socTime >= SOC_WINDOW)
+    {
+        uint32_t delta = record.soc > slot.socReference ? record.soc - slot.socReference : slot.socReference - record.soc;
+        slot.isFastSoc = (uint64_t)delta * 60000 >= (uint64_t)FAST_SOC_RATE * (timestamp - slot.socTime);
+        slot.socTime = timestamp | 0x01;
+        slot.socReference = record.soc;
+    }
+    // byte 1 of the fault status is the mos and limit state, only byte 0 is a fault
+    if (record.protectionFlag.value != 0 || (record.faultStatusFlag.value & 0x00FF) != 0)
+    {
+        return LEVEL_CRITICAL;
+    }
+    if (record.warningFlag.value != 0)
+    {
+        return LEVEL_WARNING;
+    }
+    int32_t current = record.packCurrent;
+    if (current >= HIGH_CURRENT || current <= -HIGH_CURRENT || slot.isFastSoc)
+    {
+        return LEVEL_ACTIVE;
+    }
+    return LEVEL_NORMAL;
+}
@@ -0,0 +1,86 @@
+#ifndef TIANBMS_SCHEDULER_H
+#define TIANBMS_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <mutex>
+#include "TianBMS.h"
+#include "TianBMSHealth.h"
+
+/**
+ * Deadline driven poll order. Every slave has a target maximum data age set by its state, its deadline is the last
+ * request + its target age. Slave past its deadline is served by level (critical first), and inside a level by how
+ * overdue it is relative to its own target age, (now - last request) / target age. Before any deadline is reached
+ * the same ratio gives the order, so spare bus time goes to the slave closest to its deadline. Plain earliest deadline
+ * first would let a critical pack wait behind every late normal pack on a saturated bus.
+ *
+ * State and target age, from the latest record :
+ *  - critical  protection bit or fault bit (byte 0 of the fault status) set    normal age / 4
+ *  - warning   warning bit set                                             normal age / 2
+ *  - active    |pack current| >= HIGH_CURRENT or soc moving >= FAST_SOC_RATE  normal age / 2
+ *  - normal    otherwise                                                   normal age
+ *
+ * Slave whose circuit breaker is open is left out until its probe is due (refer to TianBMSHealth).
+ *
+ * The order only decide which slave take the next request, the number of request is still set by the poll window
+ * (refer to TianBMSPollWindow), so critical pack gets fresher data without adding bus load. Deadline miss is counted
+ * once every time the data of the slave gets older than its target age.
+ *
+ * refresh(), next() and onSend() are called from the poll task, onComplete() from the modbus client task
+*/
+class TianBMSScheduler
+{
+public:
+    enum Level : uint8_t
+    {
+        LEVEL_NORMAL = 0x00,
+        LEVEL_ACTIVE = 0x01,
+        LEVEL_WARNING = 0x02,
+        LEVEL_CRITICAL = 0x03
+    };
+
+    static const uint8_t LEVEL_COUNT = 4;
+    static const int16_t HIGH_CURRENT = 5000;       // 0.01 A
+    static const uint16_t FAST_SOC_RATE = 100;      // 0.01 % per minute
+    static const uint32_t SOC_WINDOW = 30000;       // ms, soc rate is measured over this window
+    static const uint8_t STARVE_RATIO = 4;          // slave this many target age late is served first
+
+    TianBMSScheduler(uint32_t normalAge = 2000);
+    void refresh(TianBMS& tianBMS, uint32_t now);
+    int16_t next(const TianBMSSlotTable& table, uint32_t now, uint32_t lead = 0, const TianBMSHealth* health = nullptr) const;
+    void onSend(uint8_t id, uint32_t now);
+    void onComplete(uint8_t id);
+    bool isDue(uint8_t id, uint32_t now, uint32_t lead = 0) const;
+    void resetSlave(uint8_t id);
+    void reset();
+    uint32_t getTargetAge(Level level) const;
+    Level getLevel(uint8_t id) const;
+    uint32_t getDataAge(uint8_t id, uint32_t now) const;
+    uint32_t getMissCount(uint8_t id) const;
+    uint32_t getTotalMissCount() const;
+    size_t getLevelCount(Level level) const;
+
+private:
+    struct Slot
+    {
+        uint32_t lastSend = 0;
+        uint32_t lastUpdate = 0;    // timestamp of the latest applied data, 0 = none yet
+        uint32_t socTime = 0;
+        uint32_t missCount = 0;
+        uint16_t socReference = 0;
+        Level level = LEVEL_NORMAL;
+        bool isPending = false;
+        bool isFastSoc = false;
+        bool isMissed = false;      // miss of the current data already counted
+    };
+
+    mutable std::mutex _mutex;
+    std::array<Slot, TianBMSSlotTable::MAX_ID + 1> _slots;
+    uint32_t _normalAge;
+    uint32_t _totalMissCount = 0;
+    TianBMSData _record;
+    Level classify(Slot& slot, const TianBMSData& record, uint32_t timestamp);
+};
+
+#endif
@@ -0,0 +1,298 @@
+#include "TianBMS.h"
+
+TianBMSSlotTable::TianBMSSlotTable()
+{
+    for (size_t i = 0; i < _sequence.size(); i++)
+    {
+        _sequence[i].store(0);
+    }
+    for (size_t i = 0; i < _presence.size(); i++)
+    {
+        _presence[i].store(0);
+    }
+    _size.store(0);
+    _readRetryCount.store(0);
+    _readStarvedCount.store(0);
+}
+
+/**
+ * Open the write section of the slave slot, the slot is marked as present when it is not yet. The record storage is
+ * preallocated, no heap allocation happened here. Must be closed with endWrite() on the same id
+ * 
+ * @param[in]   id  id of the slave (1 - 247)
+ * 
+ * @return      pointer to the record, nullptr if id is out of range
+*/
+TianBMSData* TianBMSSlotTable::beginWrite(uint8_t id)
+{
+    if (id < MIN_ID || id > MAX_ID)
+    {
+        return nullptr;
+    }
+    uint32_t sequence = _sequence[id].load(std::memory_order_relaxed);
+    _sequence[id].store(sequence + 1, std::memory_order_relaxed); // odd sequence signal the reader that write is in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    if (!contains(id))
+    {
+        _slots[id] = TianBMSData();
+        _slots[id].id = id;
+        _presence[id / 32].fetch_or(1UL << (id % 32));
+        _size++;
+    }
+    return &_slots[id];
+}
+
+/**
+ * Close the write section of the slave slot and publish the record to the reader
+ * 
+ * @param[in]   id  id of the slave (1 - 247)
+*/
+void TianBMSSlotTable::endWrite(uint8_t id)
+{
+    if (id < MIN_ID || id > MAX_ID)
+    {
+        return;
+    }
+    uint32_t sequence = _sequence[id].load(std::memory_order_relaxed);
+    _sequence[id].store(sequence + 1, std::memory_order_release);
+}
+
+/**
+ * Take a consistent copy of the slave record. The copy is retried when the writer touched the slot in the middle of it,
+ * the writer is never blocked.
+ * 
+ * A write section only lasts one decode, so a retry almost always succeeds. The reader cannot wait for the writer
+ * though, when it preempted the writer in the middle of its write section on the same core the writer does not run
+ * again until the reader gives up. The copy is given up after MAX_READ_ATTEMPT and counted as starved, the caller
+ * handles it as a missing slave for this read (refer to getReadStarvedCount())
+ * 
+ * @param[in]   id  id of the slave
+ * @param[out]  buff    TianBMSData object to store the copy
+ * @param[out]  version optional, sequence of the slot the copy was taken at. It changes on every write and is never
+ *                      reset, also when the slave is removed and found again
+ * 
+ * @return      true if success, false if the slave is not present or the copy was starved
+*/
+bool TianBMSSlotTable::read(uint8_t id, TianBMSData& buff, uint32_t* version) const
+{
+    for (uint8_t attempt = 0; attempt < MAX_READ_ATTEMPT; attempt++)
+    {
+        if (!contains(id))
+        {
+            return false;
+        }
+        uint32_t before = _sequence[id].load(std::memory_order_acquire);
+        if ((before & 0x01) == 0)
+        {
+            buff = _slots[id];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_sequence[id].load(std::memory_order_relaxed) == before)
+            {
+                if (version != nullptr)
+                {
+                    *version = before;
+                }
+                return true;
+            }
+        }
+        _readRetryCount++;
+    }
+    _readStarvedCount++;
+    return false;
+}
+
+/**
+ * Number of read retried because of concurrent write (torn read detected)
+*/
+uint32_t TianBMSSlotTable::getReadRetryCount() const
+{
+    return _readRetryCount.load();
+}
+
+/**
+ * Number of read given up after MAX_READ_ATTEMPT because the slot was written on every attempt
+*/
+uint32_t TianBMSSlotTable::getReadStarvedCount() const
+{
+    return _readStarvedCount.load();
+}
+
+/**
+ * Find the record of the slave
+ * 
+ * @param[in]   id  id of the slave
+ * 
+ * @return      pointer to the record, nullptr if the slave is not present
+*/
+TianBMSData* TianBMSSlotTable::find(uint8_t id)
+{
+    if (!contains(id))
+    {
+        return nullptr;
+    }
+    return &_slots[id];
+}
+
+/**
+ * Find the record of the slave
+ * 
+ * @param[in]   id  id of the slave
+ * 
+ * @return      pointer to the record, nullptr if the slave is not present
+*/
+const TianBMSData* TianBMSSlotTable::find(uint8_t id) const
+{
+    if (!contains(id))
+    {
+        return nullptr;
+    }
+    return &_slots[id];
+}
+
+/**
+ * Check the presence of the slave
+ * 
+ * @param[in]   id  id of the slave
+ * 
+ * @return      true if present, false if not present or out of range
+*/
+bool TianBMSSlotTable::contains(uint8_t id) const
+{
+    if (id < MIN_ID || id > MAX_ID)
+    {
+        return false;
+    }
+    return (_presence[id / 32].load(std::memory_order_acquire) >> (id % 32)) & 0x01;
+}
+
+/**
+ * Remove the slave from the table. The record storage is kept, so any iterator pointing into it stays valid
+ * 
+ * @param[in]   id  id of the slave
+ * 
+ * @return      true if removed, false if the slave is not present
+*/
+bool TianBMSSlotTable::erase(uint8_t id)
+{
+    if (!contains(id))
+    {
+        return false;
+    }
+    _presence[id / 32].fetch_and(~(1UL << (id % 32)));
+    _size--;
+    return true;
+}
+
+/**
+ * Remove all slave from the table
+*/
+void TianBMSSlotTable::clear()
+{
+    for (size_t i = 0; i < _presence.size(); i++)
+    {
+        _presence[i].store(0);
+    }
+    _size.store(0);
+}
+
+/**
+ * Number of present slave
+*/
+size_t TianBMSSlotTable::size() const
+{
+    return _size.load();
+}
+
+/**
+ * Check if there is no present slave
+*/
+bool TianBMSSlotTable::empty() const
+{
+    return _size.load() == 0;
+}
+
+/**
+ * Find the next present slave after the given id, use 0 to get the first present slave
+ * 
+ * @param[in]   id  id of the slave to start from (exclusive)
+ * 
+ * @return      id of the next present slave, 0 if there is no more present slave
+*/
+uint8_t TianBMSSlotTable::next(uint8_t id) const
+{
+    for (uint16_t i = id + 1; i <= MAX_ID; i++)
+    {
+        if (contains(i))
+        {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Iterator to the first present slave
+*/
+TianBMSSlotTable::iterator TianBMSSlotTable::begin()
+{
+    iterator it(this, 0);
+    return ++it;
+}
+
+/**
+ * Iterator past the last slot
+*/
+TianBMSSlotTable::iterator TianBMSSlotTable::end()
+{
+    return iterator(this, MAX_ID + 1);
+}
+
+TianBMSSlotTable::iterator::iterator(TianBMSSlotTable* table, uint16_t index)
+{
+    _table = table;
+    _index = index;
+}
+
+TianBMSData& TianBMSSlotTable::iterator::operator*() const
+{
+    return _table->_slots[_index];
+}
+
+TianBMSData* TianBMSSlotTable::iterator::operator->() const
+{
+    return &_table->_slots[_index];
+}
+
+/**
+ * Move to the next present slave, skipping empty slots
+*/
+TianBMSSlotTable::iterator& TianBMSSlotTable::iterator::operator++()
+{
+    if (_index > MAX_ID)
+    {
+        return *this;
+    }
+    _index++;
+    while (_index <= MAX_ID && !_table->contains(_index))
+    {
+        _index++;
+    }
+    return *this;
+}
+
+TianBMSSlotTable::iterator TianBMSSlotTable::iterator::operator++(int)
+{
+    iterator result = *this;
+    ++(*this);
+    return result;
+}
+
+bool TianBMSSlotTable::iterator::operator==(const iterator& other) const
+{
+    return _index == other._index;
+}
+
+bool TianBMSSlotTable::iterator::operator!=(const iterator& other) const
+{
+    return _index != other._index;
+}
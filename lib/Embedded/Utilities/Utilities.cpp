@@ -184,3 +184,63 @@ int Utilities::getBit(int pos, int data)
   return result;
 }
 
+
+/**
+ * Convert unsigned integer into decimal character, two digit at a time. The result is not null terminated
+ * 
+ * @param[in]   value   the value to be converted
+ * @param[in]   buff    pointer of char array, at least 10 char long
+ * @return  number of character written
+*/
+size_t Utilities::uintToChar(uint32_t value, char *buff)
+{
+    static const char digitPairs[201] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+    char temp[10];
+    size_t pos = sizeof(temp);
+    while (value >= 100)
+    {
+        uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        temp[--pos] = digitPairs[pair + 1];
+        temp[--pos] = digitPairs[pair];
+    }
+    if (value >= 10)
+    {
+        temp[--pos] = digitPairs[value * 2 + 1];
+        temp[--pos] = digitPairs[value * 2];
+    }
+    else
+    {
+        temp[--pos] = '0' + value;
+    }
+    size_t length = sizeof(temp) - pos;
+    memcpy(buff, temp + pos, length);
+    return length;
+}
+
+/**
+ * Convert signed integer into decimal character. The result is not null terminated
+ * 
+ * @param[in]   value   the value to be converted
+ * @param[in]   buff    pointer of char array, at least 11 char long
+ * @return  number of character written
+*/
+size_t Utilities::intToChar(int32_t value, char *buff)
+{
+    if (value < 0)
+    {
+        buff[0] = '-';
+        return 1 + uintToChar(0 - (uint32_t)value, buff + 1);
+    }
+    return uintToChar(value, buff);
+}
@@ -10,6 +10,8 @@ class Utilities {
         static uint16_t charConcat(const char &first, const char &second);
         static uint16_t swap16(uint16_t value);
         static int getBit(int pos, int data);
+        static size_t uintToChar(uint32_t value, char *buff);
+        static size_t intToChar(int32_t value, char *buff);
         template <typename T> static bool _getBit(int pos, T data);
         template <typename T> static void fillArray(T a[], size_t len, T value);
         template <typename T> static void fillArrayRandom(T a[], size_t len, T min, T max);
@@ -27,6 +27,7 @@ void WiFiSave::begin(String name)
         preferences.putBool("rst_flg", false);
     }
     _isActive = true;
+    _version++;
     printDefault();
     printUser();
     writeShadow();
@@ -179,6 +180,7 @@ void WiFiSave::save()
         preferences.putString("u_ssid", _shadowParameter.ssid);
         preferences.putString("u_pwd", _shadowParameter.password);
         preferences.end();
+        _version++;
     }
 }
 
@@ -246,6 +248,7 @@ void WiFiSave::clear()
         preferences.clear();
         preferences.end();
         _isActive = false;
+        _version++;
     }
 }
 
@@ -411,6 +414,17 @@ void WiFiSave::printUser()
     preferences.end();
 }
 
+/**
+ * Get version of the saved configuration, it changes every time the configuration in preference memory is written,
+ * reverted or cleared. Start from 1 after begin, not kept across restart
+ * 
+ * @return  version of the configuration
+*/
+uint32_t WiFiSave::getVersion()
+{
+    return _version;
+}
+
 WiFiSave::~WiFiSave()
 {
 }
\ No newline at end of file
@@ -25,6 +25,7 @@ private:
     WifiParameterData _shadowParameter;
     String _name;
     bool _isActive = false;
+    uint32_t _version = 0;
     void copy();
     void createDefault();
     void writeShadow();
@@ -57,6 +58,7 @@ public:
     String getSubnet();
     String getSsid();
     String getPassword();
+    uint32_t getVersion();
 
     ~WiFiSave();
 };
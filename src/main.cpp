@@ -7,10 +7,24 @@
 #include <ArduinoOTA.h>
 #include <ESP32httpUpdate.h>
 #include <ModbusServerTCPasync.h>
+#include <ModbusServerWiFi.h>
 #include <Preferences.h>
 #include <nvs_flash.h>
 #include <WiFiSetting.h>
 #include <TianBMS.h>
+#include <TianBMSResponseQueue.h>
+#include <TianBMSRegister.h>
+#include <TianBMSJsonStream.h>
+#include <TianBMSFilter.h>
+#include <TianBMSModbusMap.h>
+#include <TianBMSInflightTable.h>
+#include <TianBMSHistogram.h>
+#include <TianBMSPollWindow.h>
+#include <TianBMSScanner.h>
+#include <TianBMSScheduler.h>
+#include <TianBMSPollPlan.h>
+#include <TianBMSIdentity.h>
+#include <TianBMSHealth.h>
 #include <ModbusClientTCP.h>
 #include <WiFiSave.h>
 #include <Talis5Memory.h>
@@ -34,21 +48,41 @@ const char *TAG = "ESP32-Tian-BMS-Collector";
 
 SemaphoreHandle_t write_mutex = NULL;
 SemaphoreHandle_t read_mutex = NULL;
+SemaphoreHandle_t push_mutex = NULL;   // guards pushClients
+SemaphoreHandle_t poll_mutex = NULL;   // guards the poll state, refer to pollTask()
 
 WiFiClient theClient;                          // Set up a client
 
 FlashZhttp fz;
 AsyncWebServer server(80);
+AsyncWebSocket pushSocket("/api/ws");
 ModbusClientTCP MB(theClient);
+ModbusServerTCPasync MBserver;
+ModbusServerWiFi MBproxy;
 
 TianBMS reader;
+TianBMSResponseQueue responseQueue;
+TianBMSJsonStreamPool streamPool;
+TianBMSModbusMap modbusMap(reader);
+
+const uint8_t MODBUS_SERVER_ID = 1;         // unit id answered by the collector modbus server
+const uint16_t MODBUS_SERVER_PORT = 502;
+const uint8_t MODBUS_SERVER_CLIENTS = 4;
+const uint32_t MODBUS_SERVER_TIMEOUT = 20000; // idle connection is closed after this time
+
+#ifndef MODBUS_PROXY_TTL
+#define MODBUS_PROXY_TTL 5000   // maximum age (ms) of the cached data answered by the proxy
+#endif
+const uint16_t MODBUS_PROXY_PORT = 5020;
+const uint8_t MODBUS_PROXY_CLIENTS = 4;
+const uint32_t MODBUS_PROXY_WAIT = 4000;    // follower wait for the leader response, above the modbus client timeout
+TianBMSInflightTable proxyInflight;
 
 Talis5Memory talis5Memory;
 WiFiSave wifiSave;
 WiFiSetting wifiSetting;
 
 std::vector<uint8_t> slave;
-std::map<int, TianBMSData>::iterator globalIterator;
 
 unsigned long lastReconnectMillis;
 unsigned long lastRequest;
@@ -58,7 +92,46 @@ unsigned long lastRestartMillis;
 int reconnectInterval = 5000;
 int internalLed = 2;
 
-uint8_t slavePointer = 0;
+#ifndef POLL_TASK_CORE
+#define POLL_TASK_CORE 1        // AsyncTCP is pinned to core 0 (CONFIG_ASYNC_TCP_RUNNING_CORE)
+#endif
+// AsyncTCP 1.1.1 only enables its task watchdog when CONFIG_ASYNC_TCP_RUNNING_CORE is left undefined, the core is
+// given by platformio.ini so the watchdog has to be given there as well
+#if defined(CONFIG_ASYNC_TCP_RUNNING_CORE) && !defined(CONFIG_ASYNC_TCP_USE_WDT)
+#error "CONFIG_ASYNC_TCP_RUNNING_CORE is set without CONFIG_ASYNC_TCP_USE_WDT, the AsyncTCP watchdog would be disabled"
+#endif
+const uint32_t POLL_TICK = 10;              // ms between two wake up of the poll task
+const uint32_t POLL_TASK_STACK = 4096;
+const UBaseType_t POLL_TASK_PRIORITY = 2;
+TaskHandle_t pollTaskHandle = NULL;
+TianBMSHistogram pollJitter;                // actual request time - scheduled time, us
+TianBMSPollWindow pollWindow;
+#ifndef POLL_TARGET_AGE
+#define POLL_TARGET_AGE 2000    // ms, target maximum data age of a slave without alarm (refer to TianBMSScheduler)
+#endif
+TianBMSScheduler pollScheduler(POLL_TARGET_AGE);
+TianBMSHealth packHealth;
+#ifndef POLL_SLOW_PERIOD
+#define POLL_SLOW_PERIOD 30000  // ms between two read of the slow block of a slave (refer to TianBMSPollPlan)
+#endif
+#ifndef POLL_BUS_BAUD
+#define POLL_BUS_BAUD 9600      // baud rate of the rtu bus behind the gateway, sets the bridge limit of the poll plan
+#endif
+#ifndef POLL_BUS_TURNAROUND
+#define POLL_BUS_TURNAROUND 10  // ms from request to response on the rtu bus, gateway included
+#endif
+TianBMSPollPlan pollPlan(POLL_SLOW_PERIOD, TianBMSPollPlan::getBridgeLimit(POLL_BUS_BAUD, POLL_BUS_TURNAROUND));
+TianBMSIdentity packIdentity;
+
+#ifndef SCAN_TIMEOUT
+#define SCAN_TIMEOUT 300        // ms, modbus client timeout while scanning, must cover the gateway own bus timeout
+#endif
+#ifndef SCAN_PARALLEL
+#define SCAN_PARALLEL 2         // scan probe queued in the modbus client
+#endif
+const uint32_t POLL_TIMEOUT = 2000;
+const uint32_t POLL_INTERVAL = 2;          // ms the modbus client waits between two request, the window sets the rate
+TianBMSScanner scanner;
 
 bool isRestart = false;
 bool isCleanup = false;
@@ -67,6 +140,65 @@ bool isScan = false;
 uint8_t isScanFinished = false;
 uint8_t emptyCount = 0;
 uint8_t failCount = 0;
+uint32_t bootId = 0;
+
+/**
+ * Polling counter, errors is counted from the modbus client task
+*/
+struct PollStats
+{
+    uint32_t requests = 0;
+    uint32_t rejected = 0;          // request refused by the modbus client (queue full, ...)
+    uint32_t sweeps = 0;            // as many request as slave in the data table, open breaker excluded
+    uint32_t sweepDuration = 0;     // ms, last sweep
+    uint32_t sweepRequests = 0;
+    uint32_t sweepTransactions = 0; // modbus request of the last sweep, every block included
+    uint32_t transactions = 0;      // modbus request of the current sweep
+    unsigned long sweepStart = 0;
+    std::atomic<uint32_t> errors;   // error response, timeout included
+    PollStats() : errors(0) {}
+};
+
+/**
+ * Modbus proxy counter, updated from every proxy client task. Without the proxy every request would reach the bus,
+ * with it only forwarded does
+*/
+struct ProxyStats
+{
+    std::atomic<uint32_t> requests;
+    std::atomic<uint32_t> cacheHits;
+    std::atomic<uint32_t> forwarded;
+    std::atomic<uint32_t> token;
+    ProxyStats() : requests(0), cacheHits(0), forwarded(0), token(0) {}
+};
+
+/**
+ * Push channel state, only touched by the loop
+*/
+struct PushStats
+{
+    uint32_t frames = 0;
+    uint32_t dropped = 0;
+    uint32_t closed = 0;
+    uint32_t latencyLast = 0;
+    uint32_t latencyMax = 0;
+};
+
+struct PushClient
+{
+    uint32_t id = 0;            // 0 = free entry
+    AsyncWebSocketClient *client = nullptr;
+    unsigned long stalledSince = 0; // 0 = message queue not full
+};
+
+const unsigned long PUSH_STALL_TIMEOUT = 10000; // client whose queue stays full this long is closed
+uint32_t pushVersion = 0;
+PushStats pushStats;
+PollStats pollStats;
+ProxyStats proxyStats;
+std::array<uint8_t, TianBMSSlotTable::MAX_ID + 1> pushChanged;
+std::array<char, TianBMSJsonStream::RECORD_SIZE + 64> pushFrame;
+std::array<PushClient, DEFAULT_MAX_WS_CLIENTS> pushClients;
 
 // put function declarations here:
 
@@ -184,66 +316,1055 @@ void handleCompressedUpload(AsyncWebServerRequest *request, String filename, siz
     {
         ESP_LOGI(TAG, "%s:%s\n", request->getParam(i)->name().c_str(), request->getParam(i)->value().c_str());
     }
-    fz.file_upload(request, filename, index, data, len, final);
-}
-
-void setupLittleFs()
-{
-  if(!LittleFS.begin()){
-    Serial.println("An Error has occurred while mounting SPIFFS");
-    return;
-  }
-}
-
-// Define an onData handler function to receive the regular responses
-// Arguments are the message plus a user-supplied token to identify the causing request
-void handleData(ModbusMessage response, uint32_t token) 
-{
-    uint8_t functionCode = response.getFunctionCode();
-    uint8_t serverId = response.getServerID();
-    ESP_LOGI(TAG, "Server ID : %d\n", serverId);
-    
-    if (functionCode == READ_HOLD_REGISTER || functionCode == READ_INPUT_REGISTER)
+    fz.file_upload(request, filename, index, data, len, final);
+}
+
+void setupLittleFs()
+{
+  if(!LittleFS.begin()){
+    Serial.println("An Error has occurred while mounting SPIFFS");
+    return;
+  }
+}
+
+/**
+ * Check if the token is of a proxy request (refer to proxyModbusRead()). Its response belongs to the proxy client, it
+ * must not close the in flight request of the poll nor change the health of the slave
+*/
+bool isProxyToken(uint32_t token)
+{
+    return reader.parseToken(token).id == 0;
+}
+
+// Define an onData handler function to receive the regular responses
+// Arguments are the message plus a user-supplied token to identify the causing request
+// Runs on the modbus client task, the response is only enqueued and applied later by the loop. The poll state is
+// changed under poll_mutex
+void handleData(ModbusMessage response, uint32_t token) 
+{
+    if (isProxyToken(token))
+    {
+        return;
+    }
+    uint8_t functionCode = response.getFunctionCode();
+    uint8_t serverId = response.getServerID();
+    ESP_LOGI(TAG, "Server ID : %d\n", serverId);
+    
+    if (functionCode == READ_HOLD_REGISTER || functionCode == READ_INPUT_REGISTER)
+    {
+        TokenInfo info = reader.parseToken(token);
+        xSemaphoreTake(poll_mutex, portMAX_DELAY);
+        if (info.requestType == TianBMSUtils::REQUEST_SCAN)
+        {
+            scanner.onResponse(serverId, millis());
+        }
+        else if (info.requestType == TianBMSUtils::REQUEST_DATA && info.block == TianBMSPollPlan::FAST_BLOCK)
+        {
+            pollWindow.onResponse(serverId, millis());
+            pollScheduler.onComplete(serverId);
+            packHealth.onSuccess(serverId);
+        }
+        xSemaphoreGive(poll_mutex);
+        // length is checked before a slot is reserved, invalid response is counted and handed over as error so the
+        // block held in the queue for it is released
+        uint8_t byteCount = 0;
+        response.get(2, byteCount);
+        if (byteCount > sizeof(TianBMSResponse::payload) || response.size() < 3 + (size_t)byteCount)
+        {
+            ESP_LOGI(TAG, "invalid response length, id : %d\n", serverId);
+            responseQueue.reject();
+            responseQueue.pushError(token, (uint8_t)PACKET_LENGTH_ERROR, millis());
+            return;
+        }
+        TianBMSResponse* slot = responseQueue.reserve();
+        if (slot == nullptr)
+        {
+            // counted as overflow by the queue
+            ESP_LOGI(TAG, "response queue overflow, id : %d\n", serverId);
+            return;
+        }
+        memcpy(slot->payload.data(), response.data() + 3, byteCount);
+        slot->id = serverId;
+        slot->token = token;
+        slot->timestamp = millis();
+        slot->payloadSize = byteCount;
+        responseQueue.commit();
+    }
+    
+    // Serial.printf("Response: serverID=%d, FC=%d, Token=%08X, length=%d:\n", response.getServerID(), response.getFunctionCode(), token, response.size());
+    // for (auto& byte : response) {
+    //     Serial.printf("%02X ", byte);
+    // }
+    // Serial.println("");
+}
+
+// Define an onError handler function to receive error responses
+// Arguments are the error code returned and a user-supplied token to identify the causing request
+// Runs on the modbus client task, the poll state is changed under poll_mutex
+void handleError(Error error, uint32_t token) 
+{
+    if (isProxyToken(token))
+    {
+        return;
+    }
+    // ModbusError wraps the error code and provides a readable error message for it
+    ModbusError me(error);
+    Serial.printf("Error response: %02X - %s\n", (int)me, (const char *)me);
+    pollStats.errors.fetch_add(1, std::memory_order_relaxed);
+    // only a request the gateway did not answer at all means it is overloaded, modbus exception is still an answer
+    TokenInfo info = reader.parseToken(token);
+    uint8_t id = info.id;
+    xSemaphoreTake(poll_mutex, portMAX_DELAY);
+    if (info.requestType == TianBMSUtils::REQUEST_SCAN)
+    {
+        // the gateway answering "target failed to respond" is final, only a silent request is probed again
+        if (error == GATEWAY_TARGET_NO_RESPONSE)
+        {
+            scanner.onAbsent(id, millis());
+        }
+        else if (error == TIMEOUT)
+        {
+            scanner.onTimeout(id, millis());
+        }
+        else
+        {
+            scanner.onResponse(id, millis());
+        }
+    }
+    else if (info.block != TianBMSPollPlan::FAST_BLOCK)
+    {
+        // slow block is read again on the next poll, session block by the identity retry. The error still releases
+        // the block held in the response queue
+        pollPlan.onError(id, info.block, error >= ILLEGAL_FUNCTION && error <= MEMORY_PARITY_ERROR);
+        if (pollPlan.getBlock(info.block).period == TianBMSRegister::PERIOD_SESSION)
+        {
+            packIdentity.onError(id);
+        }
+    }
+    else if (error == TIMEOUT)
+    {
+        // timeout of a slave that already failed its previous request means the slave is gone, not that the gateway
+        // is overloaded
+        if (packHealth.onFailure(id, millis()))
+        {
+            pollWindow.onLost(id, millis());
+        }
+        else
+        {
+            pollWindow.onTimeout(id, millis());
+        }
+        pollScheduler.onComplete(id);
+    }
+    else
+    {
+        // gateway reporting that its target failed to respond is a failure of the slave, modbus exception from the
+        // slave itself is still an answer
+        if (error == GATEWAY_TARGET_NO_RESPONSE)
+        {
+            packHealth.onFailure(id, millis());
+        }
+        else if (error >= ILLEGAL_FUNCTION && error <= MEMORY_PARITY_ERROR)
+        {
+            packHealth.onSuccess(id);
+        }
+        pollWindow.onResponse(id, millis());
+        pollScheduler.onComplete(id);
+    }
+    xSemaphoreGive(poll_mutex);
+    if (!responseQueue.pushError(token, (uint8_t)error, millis()))
+    {
+        ESP_LOGI(TAG, "response queue overflow on error");
+    }
+}
+
+/**
+ * Build strong ETag from the version of the content. The boot id keep the tag unique across restart, since every
+ * version counter start again from zero
+ * 
+ * @param[in]   version version of the content
+ * @param[in]   variant anything else the body depends on (ip address, scan status, ...)
+ * 
+ * @return      quoted ETag value
+*/
+String buildETag(uint32_t version, uint32_t variant = 0)
+{
+    char etag[32];
+    snprintf(etag, sizeof(etag), "\"%08x-%x-%x\"", (unsigned int)bootId, (unsigned int)version, (unsigned int)variant);
+    return String(etag);
+}
+
+/**
+ * Hash of the content, FNV-1a, used as ETag variant of the content without version
+ * 
+ * @param[in]   data    content
+ * @param[in]   length  length of the content
+*/
+uint32_t hashContent(const char* data, size_t length)
+{
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ (uint8_t)data[i]) * 16777619UL;
+    }
+    return hash;
+}
+
+/**
+ * Answer 304 Not Modified when the client already hold the content tagged by etag, nothing is serialized
+ * 
+ * @param[in]   request the request
+ * @param[in]   etag    current ETag of the content
+ * 
+ * @return      true if the 304 response has been sent, false if the full response has to be sent
+*/
+bool sendNotModified(AsyncWebServerRequest *request, const String& etag)
+{
+    if (!request->hasHeader("If-None-Match"))
+    {
+        return false;
+    }
+    String tags = request->header("If-None-Match");
+    if (tags != "*" && tags.indexOf(etag) < 0)
+    {
+        return false;
+    }
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+    return true;
+}
+
+/**
+ * Send json body with its ETag, the client is asked to revalidate on every use
+*/
+void sendTagged(AsyncWebServerRequest *request, const String& etag, const String& output)
+{
+    AsyncWebServerResponse *response = request->beginResponse(200, "application/json", output);
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+}
+
+/**
+ * Serve read holding / input register of the collector modbus server from the latest snapshot, refer to
+ * TianBMSModbusMap for the register map. No request is sent to the slave
+ * 
+ * @param[in]   request modbus request
+ * 
+ * @return      modbus response
+*/
+ModbusMessage serveModbusRead(ModbusMessage request)
+{
+    ModbusMessage response;
+    uint16_t address = 0;
+    uint16_t words = 0;
+    request.get(2, address);
+    request.get(4, words);
+    if (words == 0 || words > 125)
+    {
+        response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_VALUE);
+        return response;
+    }
+    std::array<uint16_t, 125> registers;
+    if (!modbusMap.read(address, words, registers.data()))
+    {
+        response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_ADDRESS);
+        return response;
+    }
+    response.add(request.getServerID(), request.getFunctionCode(), (uint8_t)(words * 2));
+    for (size_t i = 0; i < words; i++)
+    {
+        response.add(registers[i]);
+    }
+    return response;
+}
+
+/**
+ * Transparent modbus proxy in front of the gateway, for any unit id. Read of bms input register covered by the data
+ * the collector already hold, not older than MODBUS_PROXY_TTL, is answered from the snapshot. Anything else is
+ * forwarded through the collector modbus client, identical request already in flight is not sent again but share its
+ * response. Runs on the proxy client task, blocking on the forwarded request is fine here
+ * 
+ * @param[in]   request modbus request
+ * 
+ * @return      modbus response
+*/
+ModbusMessage proxyModbusRead(ModbusMessage request)
+{
+    ModbusMessage response;
+    uint8_t id = request.getServerID();
+    uint8_t functionCode = request.getFunctionCode();
+    uint16_t address = 0;
+    uint16_t words = 0;
+    request.get(2, address);
+    request.get(4, words);
+    proxyStats.requests++;
+    if (words == 0 || words > 125)
+    {
+        response.setError(id, functionCode, ILLEGAL_DATA_VALUE);
+        return response;
+    }
+
+    std::array<uint16_t, 125> registers;
+    uint32_t timestamp = reader.getDataTimestamp(id);
+    if (functionCode == READ_INPUT_REGISTER && timestamp != 0 && millis() - timestamp <= MODBUS_PROXY_TTL &&
+        pollPlan.isFastRange(address, words) &&
+        modbusMap.readNative(id, address, words, registers.data()))
+    {
+        proxyStats.cacheHits++;
+        response.add(id, functionCode, (uint8_t)(words * 2));
+        for (size_t i = 0; i < words; i++)
+        {
+            response.add(registers[i]);
+        }
+        return response;
+    }
+
+    TianBMSInflightTable::Key key = {id, functionCode, address, words};
+    bool isLeader = true;
+    int16_t entry = proxyInflight.join(key, isLeader);
+    if (!isLeader)
+    {
+        std::array<uint8_t, TianBMSInflightTable::MESSAGE_SIZE> message;
+        size_t length = proxyInflight.wait(entry, message.data(), message.size(), MODBUS_PROXY_WAIT);
+        proxyInflight.leave(entry);
+        if (length == 0)
+        {
+            response.setError(id, functionCode, GATEWAY_TARGET_NO_RESPONSE);
+            return response;
+        }
+        response.add(message.data(), length);
+        return response;
+    }
+
+    // server id 0 is never polled by the collector, the proxy token carries it so it can not collide with the poll
+    // token and is told apart by isProxyToken()
+    proxyStats.forwarded++;
+    uint32_t sequence = proxyStats.token++;
+    uint32_t token = reader.getToken(0, TianBMSUtils::REQUEST_DATA, sequence & 0xFF, (sequence >> 8) & 0x7F);
+    response = MB.syncRequest(token, id, functionCode, address, words);
+    if (entry >= 0)
+    {
+        proxyInflight.complete(entry, response.data(), response.getError() == SUCCESS ? response.size() : 0);
+        proxyInflight.leave(entry);
+    }
+    return response;
+}
+
+/**
+ * Write microsecond value in second, 1500 is written as 0.001500
+*/
+void appendSeconds(TianBMSJsonWriter& writer, uint32_t micros)
+{
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%06u", (unsigned int)(micros / 1000000), (unsigned int)(micros % 1000000));
+    writer.append(text);
+}
+
+/**
+ * Write one line of Prometheus histogram, the cumulative bucket then the sum and the count. The HELP and TYPE line is
+ * written with the first bucket
+ * 
+ * @param[in]   writer  destination writer
+ * @param[in]   name    metric name without prefix
+ * @param[in]   help    help text
+ * @param[in]   histogram   source histogram, in microsecond
+ * @param[in]   line    line index
+ * 
+ * @return      false if line is past the last line
+*/
+bool renderHistogramMetric(TianBMSJsonWriter& writer, const char* name, const char* help, const TianBMSHistogram& histogram,
+    size_t line)
+{
+    if (line > TianBMSHistogram::BUCKET_COUNT + 1)
+    {
+        return false;
+    }
+    if (line == 0)
+    {
+        TianBMSJsonStream::renderMetricHeader(writer, name, help, "histogram");
+    }
+    writer.append("tianbms_");
+    writer.append(name);
+    if (line < TianBMSHistogram::BUCKET_COUNT)
+    {
+        uint32_t count = 0;
+        for (size_t i = 0; i <= line; i++)
+        {
+            count += histogram.getBucket(i);
+        }
+        writer.append("_bucket{le=\"");
+        if (line < TianBMSHistogram::BOUND_COUNT)
+        {
+            appendSeconds(writer, TianBMSHistogram::BOUNDS[line]);
+        }
+        else
+        {
+            writer.append("+Inf");
+        }
+        writer.append("\"} ");
+        writer.appendUInt(count);
+    }
+    else if (line == TianBMSHistogram::BUCKET_COUNT)
+    {
+        writer.append("_sum ");
+        appendSeconds(writer, histogram.getSum());
+    }
+    else
+    {
+        writer.append("_count ");
+        writer.appendUInt(histogram.getCount());
+    }
+    writer.append('\n');
+    return true;
+}
+
+/**
+ * Write one line of the per slave scheduler metric, the deadline miss then the target age of every slave of the data
+ * table. Line 0 of each metric is its header
+ * 
+ * @param[in]   writer  destination writer
+ * @param[in]   line    line index, slave id inside each metric
+ * 
+ * @return      false if line is past the last metric, true otherwise even if nothing is written (slave not in table)
+*/
+bool renderScheduleMetric(TianBMSJsonWriter& writer, size_t line)
+{
+    const size_t linesPerMetric = TianBMSSlotTable::MAX_ID + 1;
+    size_t metric = line / linesPerMetric;
+    uint8_t id = line % linesPerMetric;
+    const char* name = metric == 0 ? "poll_slave_deadline_miss_total" : "poll_slave_target_age_ms";
+    if (metric > 1)
+    {
+        return false;
+    }
+    if (id == 0)
+    {
+        if (metric == 0)
+        {
+            TianBMSJsonStream::renderMetricHeader(writer, name, "Data of the slave older than its target age", "counter");
+        }
+        else
+        {
+            TianBMSJsonStream::renderMetricHeader(writer, name, "Target maximum data age of the slave, from its state", "gauge");
+        }
+        return true;
+    }
+    if (!reader.getTianBMSData().contains(id))
+    {
+        return true;
+    }
+    writer.append("tianbms_");
+    writer.append(name);
+    writer.append("{slave=\"");
+    writer.appendUInt(id);
+    writer.append("\"} ");
+    if (metric == 0)
+    {
+        writer.appendUInt(pollScheduler.getMissCount(id));
+    }
+    else
+    {
+        writer.appendUInt(pollScheduler.getTargetAge(pollScheduler.getLevel(id)));
+    }
+    writer.append('\n');
+    return true;
+}
+
+/**
+ * Write the collector self metric at index into /metrics, after the bms metric. Counter is read without lock, the
+ * same way as /api/get-collector-stats
+ * 
+ * @param[in]   writer  destination writer
+ * @param[in]   index   index of the metric
+ * 
+ * @return      false if index is past the last metric
+*/
+bool renderCollectorMetric(TianBMSJsonWriter& writer, size_t index)
+{
+    struct Metric
+    {
+        const char* name;
+        const char* help;
+        const char* type;
+    };
+    static const Metric metrics[] = {
+        {"poll_requests_total", "Modbus request queued by the collector", "counter"},
+        {"poll_rejected_total", "Modbus request refused by the modbus client", "counter"},
+        {"poll_errors_total", "Modbus error response, timeout included", "counter"},
+        {"poll_sweeps_total", "Sweep of every slave of the data table", "counter"},
+        {"poll_sweep_duration_ms", "Duration of the last sweep", "gauge"},
+        {"poll_window", "Request allowed in flight by the adaptive window", "gauge"},
+        {"poll_rtt_ms", "Smoothed round trip time of the poll request", "gauge"},
+        {"poll_deadline_miss_total", "Slave data older than its target age, every slave", "counter"},
+        {"poll_registers_total", "Register requested by the poll plan", "counter"},
+        {"poll_sweep_transactions", "Modbus request of the last sweep, every block included", "gauge"},
+        {"poll_slave_open", "Slave left out of the poll by its open circuit breaker", "gauge"},
+        {"poll_breaker_trips_total", "Circuit breaker opened on a slave that stopped answering", "counter"},
+        {"scan_probes", "Probe sent by the last address scan, retry included", "gauge"},
+        {"scan_duration_ms", "Duration of the last address scan", "gauge"},
+        {"identity_swaps_total", "Pack swap detected from a changed serial number", "counter"},
+        {"response_enqueued_total", "Modbus response enqueued for the loop", "counter"},
+        {"response_applied_total", "Modbus response applied to the slave record", "counter"},
+        {"response_merged_total", "Modbus response applied together with the previous block of the same poll", "counter"},
+        {"response_overflow_total", "Modbus response dropped on full response queue", "counter"},
+        {"response_invalid_total", "Modbus response dropped on invalid payload length", "counter"},
+        {"snapshot_retry_total", "Snapshot read retried because of concurrent write", "counter"},
+        {"snapshot_starved_total", "Snapshot read given up because every attempt met a concurrent write", "counter"},
+        {"stream_pool_exhausted_total", "Request answered 503 because every stream was in use", "counter"},
+        {"push_clients", "Connected web socket client", "gauge"},
+        {"push_frames_total", "Frame broadcast to web socket client", "counter"},
+        {"push_dropped_total", "Frame dropped by slow web socket client", "counter"},
+        {"modbus_server_requests_total", "Read request served by the collector modbus server", "counter"},
+        {"modbus_proxy_requests_total", "Read request received by the modbus proxy", "counter"},
+        {"modbus_proxy_forwarded_total", "Proxy request forwarded to the gateway", "counter"},
+        {"active_slaves", "Slave currently in the data table", "gauge"},
+        {"free_heap_bytes", "Free heap", "gauge"},
+        {"min_free_heap_bytes", "Lowest free heap since boot", "gauge"},
+        {"uptime_seconds", "Time since boot", "gauge"}
+    };
+    const size_t metricCount = sizeof(metrics) / sizeof(metrics[0]);
+    const size_t histogramLines = TianBMSHistogram::BUCKET_COUNT + 2;
+    if (index >= metricCount + histogramLines)
+    {
+        return renderScheduleMetric(writer, index - metricCount - histogramLines);
+    }
+    if (index >= metricCount)
+    {
+        return renderHistogramMetric(writer, "poll_jitter_seconds", "Delay of the poll request after its scheduled time",
+            pollJitter, index - metricCount);
+    }
+    uint32_t value = 0;
+    switch (index)
+    {
+    case 0: value = pollStats.requests; break;
+    case 1: value = pollStats.rejected; break;
+    case 2: value = pollStats.errors.load(std::memory_order_relaxed); break;
+    case 3: value = pollStats.sweeps; break;
+    case 4: value = pollStats.sweepDuration; break;
+    case 5: value = pollWindow.getWindow(); break;
+    case 6: value = pollWindow.getSmoothedRtt(); break;
+    case 7: value = pollScheduler.getTotalMissCount(); break;
+    case 8: value = pollPlan.getRegisterCount(); break;
+    case 9: value = pollStats.sweepTransactions; break;
+    case 10:
+        value = packHealth.getStateCount(reader.getTianBMSData(), TianBMSHealth::STATE_OPEN) +
+            packHealth.getStateCount(reader.getTianBMSData(), TianBMSHealth::STATE_HALF_OPEN);
+        break;
+    case 11: value = packHealth.getTripCount(); break;
+    case 12: value = scanner.getProbeCount(); break;
+    case 13: value = scanner.getDuration(); break;
+    case 14: value = packIdentity.getSwapCount(); break;
+    case 15: value = responseQueue.getEnqueuedCount(); break;
+    case 16: value = responseQueue.getAppliedCount(); break;
+    case 17: value = responseQueue.getMergedCount(); break;
+    case 18: value = responseQueue.getOverflowCount(); break;
+    case 19: value = responseQueue.getInvalidCount(); break;
+    case 20: value = reader.getReadRetryCount(); break;
+    case 21: value = reader.getReadStarvedCount(); break;
+    case 22: value = streamPool.getExhaustedCount(); break;
+    case 23: value = pushSocket.count(); break;
+    case 24: value = pushStats.frames; break;
+    case 25: value = pushStats.dropped; break;
+    case 26: value = modbusMap.getRequestCount(); break;
+    case 27: value = proxyStats.requests.load(); break;
+    case 28: value = proxyStats.forwarded.load(); break;
+    case 29:
+        for (uint8_t id = reader.getTianBMSData().next(0); id != 0; id = reader.getTianBMSData().next(id))
+        {
+            value++;
+        }
+        break;
+    case 30: value = ESP.getFreeHeap(); break;
+    case 31: value = ESP.getMinFreeHeap(); break;
+    default: value = millis() / 1000; break;
+    }
+    TianBMSJsonStream::renderMetricHeader(writer, metrics[index].name, metrics[index].help, metrics[index].type);
+    writer.append("tianbms_");
+    writer.append(metrics[index].name);
+    writer.append(' ');
+    writer.appendUInt(value);
+    writer.append('\n');
+    return true;
+}
+
+/**
+ * Number of push client registered on connect, push_mutex must be held
+*/
+size_t pushClientCount()
+{
+    size_t count = 0;
+    for (const PushClient& entry : pushClients)
+    {
+        count += entry.client != nullptr;
+    }
+    return count;
+}
+
+/**
+ * Track the client whose message queue is full. Frame for such client is dropped by the web socket, once it has been
+ * full for PUSH_STALL_TIMEOUT the client is closed so it can not hold frames forever. Only the client registered in
+ * pushClients is walked, the disconnect event clears its entry under push_mutex before the client is deleted, so the
+ * pointer stays valid while push_mutex is held
+ * 
+ * @return      number of connected client that will drop the next frame
+*/
+size_t checkPushBackpressure()
+{
+    size_t stalled = 0;
+    for (PushClient& entry : pushClients)
+    {
+        AsyncWebSocketClient *client = entry.client;
+        if (client == nullptr)
+        {
+            continue;
+        }
+        if (!client->queueIsFull())
+        {
+            entry.stalledSince = 0;
+            continue;
+        }
+        stalled += !client->canSend();
+        if (entry.stalledSince == 0)
+        {
+            entry.stalledSince = millis() | 1;
+        }
+        else if (millis() - entry.stalledSince > PUSH_STALL_TIMEOUT)
+        {
+            ESP_LOGI(TAG, "close stalled push client : %d\n", entry.id);
+            pushStats.closed++;
+            entry.stalledSince = 0;
+            client->close();
+        }
+    }
+    return stalled;
+}
+
+/**
+ * Send the frame to every connected client with AsyncWebSocket::textAll(), the frame is copied once into a shared
+ * buffer and each client queue only hold a reference to it
+ * 
+ * @param[in]   clientCount number of registered client, all of them lose the frame when no buffer is available
+ * @param[in]   stalled     number of client whose queue is full, they drop the frame
+*/
+void broadcastFrame(const char* frame, size_t length, size_t clientCount, size_t stalled)
+{
+    AsyncWebSocketMessageBuffer *buffer = pushSocket.makeBuffer((uint8_t*)frame, length);
+    if (buffer == nullptr)
+    {
+        pushStats.dropped += clientCount;
+        return;
+    }
+    pushSocket.textAll(buffer);
+    pushStats.frames++;
+    pushStats.dropped += stalled;
+}
+
+/**
+ * Push the slave changed since the last call to the web socket client, one frame per slave :
+ * {"version":V,"data":{record as in /api/get-data}} or {"version":V,"removed":id}. Must be called from the task
+ * updating the data, right after the response is applied
+ * 
+ * @param[in]   responseTimestamp   time the oldest applied response was received in ms, used for the latency stats
+*/
+void pushUpdates(uint32_t responseTimestamp)
+{
+    uint32_t version = reader.getVersion();
+    if (version == pushVersion)
+    {
+        return;
+    }
+    // push_mutex only covers the client snapshot, the frames are rendered and queued without it
+    xSemaphoreTake(push_mutex, portMAX_DELAY);
+    size_t clientCount = pushClientCount();
+    size_t stalled = clientCount == 0 ? 0 : checkPushBackpressure();
+    xSemaphoreGive(push_mutex);
+    if (clientCount == 0)
+    {
+        pushVersion = version;
+        return;
+    }
+    pushChanged.fill(0);
+    if (!reader.getChanges(pushVersion, version, pushChanged.data(), pushChanged.size()))
+    {
+        // the changes are lost (data cleared), push every present slave
+        for (uint8_t id = reader.getTianBMSData().next(0); id != 0; id = reader.getTianBMSData().next(id))
+        {
+            pushChanged[id] = TianBMSChangeLog::GROUP_ALL;
+        }
+    }
+    pushVersion = version;
+    bool isSent = false;
+    TianBMSData record;
+    for (uint16_t id = TianBMSSlotTable::MIN_ID; id <= TianBMSSlotTable::MAX_ID; id++)
+    {
+        if (pushChanged[id] == 0)
+        {
+            continue;
+        }
+        TianBMSJsonWriter writer(pushFrame.data(), pushFrame.size());
+        writer.append("{\"version\":");
+        writer.appendUInt(version);
+        if (reader.getSnapshot(id, record))
+        {
+            writer.append(",\"data\":");
+            TianBMSJsonStream::renderRecord(writer, record);
+        }
+        else
+        {
+            writer.append(",\"removed\":");
+            writer.appendUInt(id);
+        }
+        writer.append('}');
+        if (writer.isOverflow())
+        {
+            pushStats.dropped += clientCount;
+            continue;
+        }
+        broadcastFrame(pushFrame.data(), writer.length(), clientCount, stalled);
+        isSent = true;
+    }
+    if (isSent)
+    {
+        pushStats.latencyLast = millis() - responseTimestamp;
+        if (pushStats.latencyLast > pushStats.latencyMax)
+        {
+            pushStats.latencyMax = pushStats.latencyLast;
+        }
+    }
+}
+
+/**
+ * Pick the encoding of the data document from the Accept header, json when nothing else is accepted
+*/
+TianBMSJsonStream::Encoding negotiateEncoding(AsyncWebServerRequest *request)
+{
+    if (!request->hasHeader("Accept"))
+    {
+        return TianBMSJsonStream::ENCODING_JSON;
+    }
+    String accept = request->header("Accept");
+    if (accept.indexOf("application/cbor") >= 0)
+    {
+        return TianBMSJsonStream::ENCODING_CBOR;
+    }
+    if (accept.indexOf("application/msgpack") >= 0 || accept.indexOf("application/x-msgpack") >= 0)
+    {
+        return TianBMSJsonStream::ENCODING_MSGPACK;
+    }
+    return TianBMSJsonStream::ENCODING_JSON;
+}
+
+/**
+ * Content type of the data document encoding
+*/
+const char* encodingContentType(TianBMSJsonStream::Encoding encoding)
+{
+    switch (encoding)
+    {
+    case TianBMSJsonStream::ENCODING_CBOR:
+        return "application/cbor";
+    case TianBMSJsonStream::ENCODING_MSGPACK:
+        return "application/msgpack";
+    default:
+        return "application/json";
+    }
+}
+
+/**
+ * Time elapsed since the scheduled time, 0 if it is not reached yet
+ * 
+ * @param[in]   targetMicros    scheduled time, micros()
+ * 
+ * @return      elapsed time in us
+*/
+uint32_t elapsedSince(uint32_t targetMicros)
+{
+    int32_t elapsed = (int32_t)(micros() - targetMicros);
+    return elapsed > 0 ? elapsed : 0;
+}
+
+/**
+ * Queue the read of every session block (identity string) of the slave, applied as one update. Called from the poll
+ * task
+ * 
+ * @param[in]   id  slave id
+*/
+void sendIdentity(uint8_t id)
+{
+    int16_t last = -1;
+    for (uint8_t block = 0; block < pollPlan.getBlockCount(); block++)
+    {
+        if (pollPlan.getBlock(block).period == TianBMSRegister::PERIOD_SESSION)
+        {
+            last = block;
+        }
+    }
+    if (last < 0)
+    {
+        return;
+    }
+    packIdentity.onSend(id, millis());
+    for (uint8_t block = 0; block <= last; block++)
+    {
+        const TianBMSRegister::Block& session = pollPlan.getBlock(block);
+        if (session.period != TianBMSRegister::PERIOD_SESSION)
+        {
+            continue;
+        }
+        Error err = MB.addRequest(reader.getToken(id, (TianBMSUtils::RequestType)session.request, session.offset, block, block != last),
+            id, READ_INPUT_REGISTER, session.address, session.count);
+        pollStats.requests++;
+        if (err != SUCCESS)
+        {
+            pollStats.rejected++;
+            packIdentity.onError(id);
+            return;
+        }
+        pollPlan.onSend(id, block, millis());
+    }
+}
+
+/**
+ * Apply the slave list change or the rescan request, once the modbus client queue has been empty for 3 s. Called from
+ * the poll task
+*/
+void handleRescan()
+{
+    if (isSlaveChanged || isScan)
+    {
+        if (MB.pendingRequests() == 0)
+        {
+            if (millis() - lastQueueCheck > 3000)
+            {
+                if (xSemaphoreTake(read_mutex, portMAX_DELAY))
+                {
+                    if (xSemaphoreTake(write_mutex, portMAX_DELAY))
+                    {
+                        // check if the signal is coming from slave changed flag, the new setting need to be written, if not it is coming from rescan flag
+                        if (isSlaveChanged) 
+                        {
+                            ESP_LOGI(TAG, "SAVE PARAMETER AND CLEAR");
+                            talis5Memory.save();
+                            slave.resize(talis5Memory.getSlaveSize());
+                            talis5Memory.getSlave(slave.data(), talis5Memory.getSlaveSize());
+                        }
+                        else
+                        {
+                            ESP_LOGI(TAG, "RESCAN");
+                        }
+                        isScanFinished = false;
+                        isSlaveChanged = false;
+                        isScan = false;
+                        reader.clearData();
+                        xSemaphoreTake(poll_mutex, portMAX_DELAY);
+                        pollWindow.reset();
+                        pollScheduler.reset();
+                        pollPlan.reset();
+                        packIdentity.reset();
+                        packHealth.reset();
+                        scanner.reset();
+                        xSemaphoreGive(poll_mutex);
+                        xSemaphoreGive(write_mutex);
+                    }
+                    xSemaphoreGive(read_mutex);
+                }
+                lastQueueCheck = millis();
+            }
+        }
+        else
+        {
+            lastQueueCheck = millis();
+        }
+    }
+}
+
+/**
+ * Send the request of the current tick. While polling, request is added as long as the adaptive window allows
+ * (refer to TianBMSPollWindow), to the slave picked by the deadline scheduler each time (refer to TianBMSScheduler). While scanning, probe is added as long as
+ * the scanner allows (refer to TianBMSScanner) with the modbus client timeout lowered to SCAN_TIMEOUT. Called from
+ * the poll task with poll_mutex held
+ * 
+ * @param[in]   targetMicros    scheduled time of the tick, the delay to the first request is recorded as jitter
+*/
+void pollNext(uint32_t targetMicros)
+{
+    if (isScanFinished)
+    {
+        /**
+         * This block will push the request to queue based on detected slave
+        */
+        // if (!isCleanup) // this flag is to detect if it's time to do cleanup, then pause the .addRequest
+        // { 
+        if (!isSlaveChanged && !isScan) // if it is not scan or not slave changed, do normal polling
+        {
+            bool isFirst = true;
+            pollScheduler.refresh(reader, millis());
+            while (pollWindow.canSend(millis()))
+            {
+                int16_t next = pollScheduler.next(reader.getTianBMSData(), millis(), pollWindow.getSmoothedRtt(), &packHealth);
+                if (next < 0)
+                {
+                    break;
+                }
+                uint8_t id = next;
+                // identity string is read on spare bus time, when the slave to poll next is not due yet
+                int16_t identityId = packIdentity.next(reader.getTianBMSData(), millis(),
+                    !pollScheduler.isDue(id, millis(), pollWindow.getSmoothedRtt()), &packHealth);
+                if (identityId >= 0)
+                {
+                    sendIdentity(identityId);
+                    lastRequest = millis();
+                    break;
+                }
+                // slave whose breaker is open is left out of the sweep
+                size_t sweepSize = reader.getTianBMSData().size();
+                size_t openCount = packHealth.getStateCount(reader.getTianBMSData(), TianBMSHealth::STATE_OPEN) +
+                    packHealth.getStateCount(reader.getTianBMSData(), TianBMSHealth::STATE_HALF_OPEN);
+                sweepSize = sweepSize > openCount ? sweepSize - openCount : 0;
+                if (pollStats.sweepRequests >= sweepSize)
+                {
+                    if (pollStats.sweepStart != 0)
+                    {
+                        pollStats.sweeps++;
+                        pollStats.sweepDuration = millis() - pollStats.sweepStart;
+                        pollStats.sweepTransactions = pollStats.transactions;
+                    }
+                    pollStats.sweepStart = millis();
+                    pollStats.sweepRequests = 0;
+                    pollStats.transactions = 0;
+                }
+                pollStats.sweepRequests++;
+                if (isFirst)
+                {
+                    pollJitter.record(elapsedSince(targetMicros));
+                    isFirst = false;
+                }
+                // slow block due for the slave follows its fast block, all of them are applied as one update. Slave that
+                // did not answer its last request only gets its fast block
+                int16_t extra = packHealth.isHealthy(id) ? pollPlan.nextExtra(id, millis()) : -1;
+                size_t fastCount = pollPlan.getFastBlockCount();
+                const TianBMSRegister::Block& fast = pollPlan.getBlock(TianBMSPollPlan::FAST_BLOCK);
+                Error err = MB.addRequest(reader.getToken(id, (TianBMSUtils::RequestType)fast.request, fast.offset, TianBMSPollPlan::FAST_BLOCK,
+                    fastCount > 1 || extra >= 0), id, READ_INPUT_REGISTER, fast.address, fast.count);
+                pollStats.requests++;
+                pollStats.transactions++;
+                if (err!=SUCCESS) {
+                    pollStats.rejected++;
+                    ModbusError e(err);
+                    Serial.printf("Error creating request: %02X - %s\n", (int)e, (const char *)e);
+                    break;
+                }
+                pollWindow.onSend(id, millis());
+                pollScheduler.onSend(id, millis());
+                packHealth.onSend(id, millis());
+                pollPlan.onSend(id, TianBMSPollPlan::FAST_BLOCK, millis());
+                lastRequest = millis();
+                // the other fast block and the extra block are sent outside the window
+                for (uint8_t block = TianBMSPollPlan::FAST_BLOCK + 1; block < fastCount; block++)
+                {
+                    const TianBMSRegister::Block& other = pollPlan.getBlock(block);
+                    err = MB.addRequest(reader.getToken(id, (TianBMSUtils::RequestType)other.request, other.offset, block,
+                        block + 1 < fastCount || extra >= 0), id, READ_INPUT_REGISTER, other.address, other.count);
+                    pollStats.requests++;
+                    pollStats.transactions++;
+                    if (err != SUCCESS)
+                    {
+                        pollStats.rejected++;
+                        break;
+                    }
+                    pollPlan.onSend(id, block, millis());
+                }
+                if (err != SUCCESS)
+                {
+                    break;
+                }
+                if (extra >= 0)
+                {
+                    const TianBMSRegister::Block& block = pollPlan.getBlock(extra);
+                    err = MB.addRequest(reader.getToken(id, (TianBMSUtils::RequestType)block.request, block.offset, extra), id, READ_INPUT_REGISTER,
+                        block.address, block.count);
+                    pollStats.requests++;
+                    pollStats.transactions++;
+                    if (err != SUCCESS)
+                    {
+                        pollStats.rejected++;
+                        break;
+                    }
+                    pollPlan.onSend(id, extra, millis());
+                }
+            }
+        }
+        // }
+    }
+    else
     {
-        uint8_t regCount;
-        uint16_t buffer[64];
-        uint8_t index = response.get(2, regCount);
-        regCount /= 2;
-        for (size_t i = 0; i < regCount; i++)
+        /**
+         * This block is to do address(slave) scan of every address of the slave list
+        */
+        if (isSlaveChanged || isScan)
         {
-            uint16_t content;
-            index = response.get(index, content);
-            buffer[i] = content;
+            return;
         }
-        if(xSemaphoreTake(write_mutex, 0))
+        if (!scanner.isActive())
         {
-            ESP_LOGI(TAG, "mutex on update");
-            ESP_LOGI(TAG, "write mutex taken");
-            reader.update(serverId, token, buffer, regCount);
-            ESP_LOGI(TAG, "write_mutex given");
-            xSemaphoreGive(write_mutex);
+            // every probe pays the client interval once, 247 probe with 200 ms of rest took 49 s on their own
+            MB.setTimeout(SCAN_TIMEOUT, POLL_INTERVAL);
+            scanner.begin(slave.data(), slave.size(), SCAN_PARALLEL, millis());
+        }
+        if (scanner.isFinished())
+        {
+            ESP_LOGI(TAG, "Scan finished, %d slave found in %d ms\n", scanner.getPresentCount(), scanner.getDuration());
+            MB.setTimeout(POLL_TIMEOUT, POLL_INTERVAL);
+            isScanFinished = 1;
+            return;
+        }
+        bool isFirst = true;
+        int16_t id;
+        while ((id = scanner.nextProbe()) >= 0)
+        {
+            if (isFirst)
+            {
+                pollJitter.record(elapsedSince(targetMicros));
+                isFirst = false;
+            }
+            ESP_LOGI(TAG, "Slave address : %d\n", id);
+            Error err = MB.addRequest(reader.getToken(id, TianBMSUtils::REQUEST_SCAN), id, READ_INPUT_REGISTER, 
+                TianBMSRegister::requestAddress(TianBMSUtils::REQUEST_DATA), 1);
+            if (err!=SUCCESS) {
+                ModbusError e(err);
+                Serial.printf("Error creating request: %02X - %s\n", (int)e, (const char *)e);
+                scanner.onTimeout(id, millis());
+                break;
+            }
+            lastRequest = millis();
         }
     }
-    
-    // Serial.printf("Response: serverID=%d, FC=%d, Token=%08X, length=%d:\n", response.getServerID(), response.getFunctionCode(), token, response.size());
-    // for (auto& byte : response) {
-    //     Serial.printf("%02X ", byte);
-    // }
-    // Serial.println("");
 }
 
-// Define an onError handler function to receive error responses
-// Arguments are the error code returned and a user-supplied token to identify the causing request
-void handleError(Error error, uint32_t token) 
+/**
+ * Poll task, wakes up every POLL_TICK (10 ms) with vTaskDelayUntil so the schedule does not drift with the time spent
+ * in the previous tick nor with the load of the other task. The rate of each slave is set by the scheduler and the poll
+ * window, POLL_INTERVAL only spaces the request sent by the modbus client
+ * 
+ * The poll state (pollWindow, pollScheduler, pollPlan, packHealth, packIdentity and scanner) is also changed by the
+ * response handlers on the modbus client task and by the loop, every change is made with poll_mutex held. The
+ * statistics read it without lock
+*/
+void pollTask(void *parameter)
 {
-    // ModbusError wraps the error code and provides a readable error message for it
-    ModbusError me(error);
-    Serial.printf("Error response: %02X - %s\n", (int)me, (const char *)me);
-    if(xSemaphoreTake(write_mutex, 0))
+    TickType_t lastWakeTime = xTaskGetTickCount();
+    TickType_t startTick = lastWakeTime;
+    uint32_t startMicros = micros();
+    for (;;)
     {
-        ESP_LOGI(TAG, "mutex on error update");
-        reader.updateOnError(token);
-        xSemaphoreGive(write_mutex);
+        vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(POLL_TICK));
+        uint32_t targetMicros = startMicros + (uint32_t)(lastWakeTime - startTick) * portTICK_PERIOD_MS * 1000;
+        handleRescan();
+        xSemaphoreTake(poll_mutex, portMAX_DELAY);
+        pollNext(targetMicros);
+        xSemaphoreGive(poll_mutex);
     }
 }
 
@@ -254,6 +1375,7 @@ void setup() {
     Serial.begin(115200); 
     Serial.setDebugOutput(true);
     esp_log_level_set(TAG, ESP_LOG_INFO);
+    bootId = esp_random();
 
     write_mutex = xSemaphoreCreateMutex();
     if(write_mutex != NULL )
@@ -265,6 +1387,16 @@ void setup() {
     {
         ESP_LOGI(TAG, "Successfully create read mutex");
     }
+    push_mutex = xSemaphoreCreateMutex();
+    if(push_mutex != NULL )
+    {
+        ESP_LOGI(TAG, "Successfully create push mutex");
+    }
+    poll_mutex = xSemaphoreCreateMutex();
+    if(poll_mutex != NULL )
+    {
+        ESP_LOGI(TAG, "Successfully create poll mutex");
+    }
 
     setupLittleFs();
     WiFi.onEvent(WiFiStationConnected, WiFiEvent_t::ARDUINO_EVENT_WIFI_STA_CONNECTED);
@@ -283,6 +1415,7 @@ void setup() {
     // wifiSave.save();
 
     talis5Memory.begin("talis5_param");
+    packIdentity.begin("tian_identity");
     // talis5Memory.setModbusTargetIp("192.168.2.113");
     // talis5Memory.setModbusPort(502);
     // uint8_t list[7] = {1,2,5,7,10,12,32};
@@ -371,7 +1504,7 @@ void setup() {
 
     MB.onDataHandler(&handleData);
     MB.onErrorHandler(&handleError);
-    MB.setTimeout(2000, 200);
+    MB.setTimeout(POLL_TIMEOUT, POLL_INTERVAL);
     MB.begin();
     IPAddress ip;
     if (ip.fromString(talis5Memory.getModbusTargetIp()))
@@ -380,6 +1513,14 @@ void setup() {
     }
     // MB.setTarget(IPAddress(192, 168, 2, 113), 502);
 
+    MBserver.registerWorker(MODBUS_SERVER_ID, READ_HOLD_REGISTER, &serveModbusRead);
+    MBserver.registerWorker(MODBUS_SERVER_ID, READ_INPUT_REGISTER, &serveModbusRead);
+    MBserver.start(MODBUS_SERVER_PORT, MODBUS_SERVER_CLIENTS, MODBUS_SERVER_TIMEOUT);
+
+    MBproxy.registerWorker(ANY_SERVER, READ_HOLD_REGISTER, &proxyModbusRead);
+    MBproxy.registerWorker(ANY_SERVER, READ_INPUT_REGISTER, &proxyModbusRead);
+    MBproxy.start(MODBUS_PROXY_PORT, MODBUS_PROXY_CLIENTS, MODBUS_SERVER_TIMEOUT);
+
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
 		request->send(LittleFS, "/index.html", "text/html");
 	});
@@ -422,103 +1563,134 @@ void setup() {
 
     server.on("/api/get-data", HTTP_GET, [](AsyncWebServerRequest *request)
     {
-        std::map<int, TianBMSData> bufferData;
-        reader.getCloneTianBMSData(bufferData);
-        ESP_LOGI(TAG, "buffer data size : %d\n", bufferData.size());
-        AsyncWebServerResponse *response = request->beginChunkedResponse("application/json", [bufferData](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        ESP_LOGI(TAG, "buffer data size : %d\n", reader.getTianBMSData().size());
+        // ?format=compact write each record as positional array of raw value, described by /api/schema
+        TianBMSJsonStream::Format format = TianBMSJsonStream::FORMAT_FULL;
+        if (request->hasParam("format") && request->getParam("format")->value() == "compact")
+        {
+            format = TianBMSJsonStream::FORMAT_COMPACT;
+        }
+        // Accept: application/cbor or application/msgpack get the same document in binary
+        TianBMSJsonStream::Encoding encoding = negotiateEncoding(request);
+        // ?id=1,3,5 and ?fields=soc,pack_current restrict the slave and field written
+        TianBMSFilter filter;
+        if ((request->hasParam("id") && !filter.parseSlaves(request->getParam("id")->value().c_str())) ||
+            (request->hasParam("fields") && !filter.parseFields(request->getParam("fields")->value().c_str())))
+        {
+            Talis5JsonHandler handler;
+            request->send(400, "application/json", handler.buildJsonResponse(400));
+            return;
+        }
+        // the version is taken before the stream start, record updated while streaming only make the tag older
+        String etag = buildETag(reader.getVersion(), filter.hash(format | (encoding << 8)));
+        if (sendNotModified(request, etag))
+        {
+            return;
+        }
+        // every response own its stream, it goes back to the pool when the response is destroyed
+        TianBMSJsonStreamHandle stream = streamPool.acquire();
+        if (!stream.isValid())
+        {
+            Talis5JsonHandler handler;
+            AsyncWebServerResponse *busyResponse = request->beginResponse(503, "application/json", handler.buildJsonResponse(503));
+            busyResponse->addHeader("Retry-After", "1");
+            request->send(busyResponse);
+            return;
+        }
+        stream->begin(reader, format, encoding);
+        stream->setFilter(filter);
+        AsyncWebServerResponse *response = request->beginChunkedResponse(encodingContentType(encoding), [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
             //Write up to "maxLen" bytes into "buffer" and return the amount written.
             //index equals the amount of bytes that have been already sent
             //You will be asked for more data until 0 is returned
             //Keep in mind that you can not delay or yield waiting for more data!
-            static auto it = bufferData.begin();
-            static bool isTerminated = false;
-            static bool isOverflow = false;
-            static String leftOverInput = "";
-            TianBMSJsonManager jman;
-            int len = 0;
-            // This block will execute when the buffer is not enough to store json
-            if (isOverflow)
-            {
-                if (leftOverInput.length() > maxLen)
-                {
-                    len = maxLen;
-                    memcpy(buffer, leftOverInput.begin(), len);
-                    leftOverInput = leftOverInput.substring(len);
-                }
-                else
-                {
-                    isOverflow = false;
-                    len = leftOverInput.length();
-                    memcpy(buffer, leftOverInput.begin(), len);
-                    leftOverInput = "";
-                }
-                return len;
-            }
-
-            // This block is crucial to terminate the browser request
-            if (isTerminated)
-            {
-                isTerminated = false;
-                it = reader.getTianBMSData().begin();
-                return len;
-            }
-
-            // This block will send the json formatted data
-            if (index == 0) // send the first open part of the json "{"data" : ["
-            {
-                it = bufferData.begin();
-                String startPart = "{\"data\":[";
-                for (size_t i = 0; i < startPart.length(); i++)
-                {
-                    buffer[i] = startPart.charAt(i);
-                    len++;
-                }
-                return len;
-            }
-            else
-            {
-                if (it == bufferData.end()) // send the last end part of the json "]}"
-                {
-                    String stopPart = "]}";
-                    String input = stopPart;
-                    isTerminated = true;
-                    for (size_t i = 0; i < input.length(); i++)
-                    {
-                        buffer[i] = input.charAt(i);
-                        len++;
-                    }
-                }
-                else // send the bms data as formatted json document
-                {
-                    String input = jman.buildData((*it).second);
-                    it++;
-                    if (it != bufferData.end())
-                    {
-                        input += ",";
-                    }
-                    if (input.length() < maxLen)
-                    {
-                        len = input.length();
-                    }
-                    else // detect if the converted json document size larger than buffer, this will set the overflow flag
-                    {
-                        len = maxLen;
-                        isOverflow = true;
-                        leftOverInput = input.substring(len);
-                    }
-                    memcpy(buffer, input.begin(), len); //copy the input into the buffer with length of len
-                }
-                return len;
-            }
+            return stream->read(buffer, maxLen);
         });
 
         response->addHeader("Server","ESP Async Web Server");
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", "no-cache");
+        response->addHeader("Vary", "Accept");
         request->send(response);
 
         });
 
+    server.on("/api/schema", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        // the schema only change with the firmware, it is built once and kept
+        static String schema;
+        if (schema.length() == 0)
+        {
+            TianBMSJsonManager manager;
+            schema = manager.buildSchema();
+        }
+        static uint32_t schemaHash = hashContent(schema.c_str(), schema.length());
+        String etag = buildETag(0, schemaHash);
+        if (sendNotModified(request, etag))
+        {
+            return;
+        }
+        AsyncWebServerResponse *response = request->beginResponse(200, "application/json", schema);
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", "max-age=3600");
+        request->send(response); });
+
+    server.on("/api/changes", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        // ?since=<version of the last response>&boot=<X-Boot-Id of the last response>, the version counter start
+        // again from zero on restart so the client of the previous boot always get the full data
+        uint32_t since = 0;
+        if (request->hasParam("since"))
+        {
+            since = strtoul(request->getParam("since")->value().c_str(), nullptr, 10);
+        }
+        if (request->hasParam("boot") && strtoul(request->getParam("boot")->value().c_str(), nullptr, 10) != bootId)
+        {
+            since = 0;
+        }
+        TianBMSJsonStreamHandle stream = streamPool.acquire();
+        if (!stream.isValid())
+        {
+            Talis5JsonHandler handler;
+            AsyncWebServerResponse *busyResponse = request->beginResponse(503, "application/json", handler.buildJsonResponse(503));
+            busyResponse->addHeader("Retry-After", "1");
+            request->send(busyResponse);
+            return;
+        }
+        stream->beginChanges(reader, since);
+        AsyncWebServerResponse *response = request->beginChunkedResponse("application/json", [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            return stream->read(buffer, maxLen);
+        });
+        response->addHeader("X-Boot-Id", String(bootId));
+        response->addHeader("Cache-Control", "no-store");
+        request->send(response); });
+
+    server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        // Prometheus text exposition, streamed line by line from the slot table
+        TianBMSJsonStreamHandle stream = streamPool.acquire();
+        if (!stream.isValid())
+        {
+            AsyncWebServerResponse *busyResponse = request->beginResponse(503, "text/plain", "busy\n");
+            busyResponse->addHeader("Retry-After", "1");
+            request->send(busyResponse);
+            return;
+        }
+        stream->beginMetrics(reader, renderCollectorMetric);
+        AsyncWebServerResponse *response = request->beginChunkedResponse("text/plain; version=0.0.4; charset=utf-8", [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            return stream->read(buffer, maxLen);
+        });
+        response->addHeader("Cache-Control", "no-store");
+        request->send(response); });
+
     server.on("/api/get-device-info", HTTP_GET, [](AsyncWebServerRequest *request)
     {
+        uint32_t deviceIp = wifiSave.getMode() == 1 ? (uint32_t)WiFi.softAPIP() : (uint32_t)WiFi.localIP();
+        String etag = buildETag(wifiSave.getVersion(), deviceIp);
+        if (sendNotModified(request, etag))
+        {
+            return;
+        }
         String output;
         StaticJsonDocument<256> doc;
         doc["firmware_version"] = FIRMWARE_VERSION;
@@ -562,10 +1734,15 @@ void setup() {
             doc["server_mode"] = "DHCP";
         }
         serializeJson(doc, output);
-        request->send(200, "application/json", output); });
+        sendTagged(request, etag, output); });
 
     server.on("/api/get-modbus-info", HTTP_GET, [](AsyncWebServerRequest *request)
     {
+        String etag = buildETag(talis5Memory.getVersion());
+        if (sendNotModified(request, etag))
+        {
+            return;
+        }
         StaticJsonDocument<768> doc;
         String output;
         doc["modbus_ip"] = talis5Memory.getModbusTargetIp();
@@ -581,22 +1758,140 @@ void setup() {
         }
 
         serializeJson(doc, output);
-        request->send(200, "application/json", output); });
+        sendTagged(request, etag, output); });
 
     server.on("/api/get-active-slave", HTTP_GET, [](AsyncWebServerRequest *request)
     {
+        String etag = buildETag(reader.getVersion(), isScanFinished);
+        if (sendNotModified(request, etag))
+        {
+            return;
+        }
         StaticJsonDocument<768> doc;
         String output;
         doc["address_status"] = isScanFinished;
         JsonArray slave_list = doc.createNestedArray("slave_list");
-        std::map<int, TianBMSData>::iterator it;
-        for (it = reader.getTianBMSData().begin(); it != reader.getTianBMSData().end(); it++)
+        for (uint8_t id = reader.getTianBMSData().next(0); id != 0; id = reader.getTianBMSData().next(id))
         {
-            slave_list.add((*it).first);
+            slave_list.add(id);
         }
 
         serializeJson(doc, output);
 
+        sendTagged(request, etag, output); });
+
+    server.on("/api/get-collector-stats", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        StaticJsonDocument<2560> doc;
+        String output;
+        JsonObject poll = doc.createNestedObject("poll");
+        poll["requests"] = pollStats.requests;
+        poll["rejected"] = pollStats.rejected;
+        poll["sweeps"] = pollStats.sweeps;
+        poll["sweep_ms"] = pollStats.sweepDuration;
+        JsonObject poll_window = poll.createNestedObject("window");
+        poll_window["size"] = pollWindow.getWindow();
+        poll_window["in_flight"] = pollWindow.getInFlight();
+        poll_window["gap_ms"] = pollWindow.getGap();
+        poll_window["rtt_ms"] = pollWindow.getSmoothedRtt();
+        poll_window["base_rtt_ms"] = pollWindow.getBaseRtt();
+        poll_window["timeout_rate"] = pollWindow.getTimeoutRate();
+        poll_window["timeouts"] = pollWindow.getTimeoutCount();
+        poll["errors"] = pollStats.errors.load(std::memory_order_relaxed);
+        JsonObject poll_jitter = poll.createNestedObject("jitter_us");
+        poll_jitter["count"] = pollJitter.getCount();
+        poll_jitter["sum"] = pollJitter.getSum();
+        poll_jitter["max"] = pollJitter.getMax();
+        JsonArray poll_jitter_bounds = poll_jitter.createNestedArray("bounds");
+        JsonArray poll_jitter_buckets = poll_jitter.createNestedArray("buckets");
+        for (size_t i = 0; i < TianBMSHistogram::BUCKET_COUNT; i++)
+        {
+            if (i < TianBMSHistogram::BOUND_COUNT)
+            {
+                poll_jitter_bounds.add(TianBMSHistogram::BOUNDS[i]);
+            }
+            poll_jitter_buckets.add(pollJitter.getBucket(i));
+        }
+        JsonObject schedule = poll.createNestedObject("schedule");
+        schedule["deadline_misses"] = pollScheduler.getTotalMissCount();
+        JsonArray schedule_levels = schedule.createNestedArray("levels");
+        static const char* const levelNames[TianBMSScheduler::LEVEL_COUNT] = {"normal", "active", "warning", "critical"};
+        for (uint8_t level = 0; level < TianBMSScheduler::LEVEL_COUNT; level++)
+        {
+            JsonObject entry = schedule_levels.createNestedObject();
+            entry["level"] = levelNames[level];
+            entry["target_ms"] = pollScheduler.getTargetAge((TianBMSScheduler::Level)level);
+            entry["slaves"] = pollScheduler.getLevelCount((TianBMSScheduler::Level)level);
+        }
+        JsonArray plan = poll.createNestedArray("plan");
+        static const char* const periodNames[] = {"fast", "slow", "session"};
+        for (uint8_t block = 0; block < pollPlan.getBlockCount(); block++)
+        {
+            const TianBMSRegister::Block& planBlock = pollPlan.getBlock(block);
+            JsonObject entry = plan.createNestedObject();
+            entry["address"] = planBlock.address;
+            entry["count"] = planBlock.count;
+            entry["period"] = periodNames[planBlock.period];
+            entry["requests"] = pollPlan.getRequestCount(block);
+            entry["errors"] = pollPlan.getErrorCount(block);
+        }
+        poll["bridge_limit"] = pollPlan.getBridgeLimit();
+        poll["registers"] = pollPlan.getRegisterCount();
+        poll["sweep_transactions"] = pollStats.sweepTransactions;
+        JsonObject health = poll.createNestedObject("health");
+        health["suspect"] = packHealth.getStateCount(reader.getTianBMSData(), TianBMSHealth::STATE_SUSPECT);
+        health["open"] = packHealth.getStateCount(reader.getTianBMSData(), TianBMSHealth::STATE_OPEN);
+        health["half_open"] = packHealth.getStateCount(reader.getTianBMSData(), TianBMSHealth::STATE_HALF_OPEN);
+        health["trips"] = packHealth.getTripCount();
+        health["probes"] = packHealth.getProbeCount();
+        health["recoveries"] = packHealth.getRecoveryCount();
+        JsonObject scan = doc.createNestedObject("scan");
+        scan["present"] = scanner.getPresentCount();
+        scan["probes"] = scanner.getProbeCount();
+        scan["retries"] = scanner.getRetryCount();
+        scan["duration_ms"] = scanner.getDuration();
+        JsonObject identity = doc.createNestedObject("identity");
+        identity["known"] = packIdentity.getKnownCount();
+        identity["reads"] = packIdentity.getReadCount();
+        identity["restored"] = packIdentity.getRestoreCount();
+        identity["swaps"] = packIdentity.getSwapCount();
+        JsonObject response_queue = doc.createNestedObject("response_queue");
+        response_queue["enqueued"] = responseQueue.getEnqueuedCount();
+        response_queue["applied"] = responseQueue.getAppliedCount();
+        response_queue["merged"] = responseQueue.getMergedCount();
+        response_queue["overflowed"] = responseQueue.getOverflowCount();
+        response_queue["invalid"] = responseQueue.getInvalidCount();
+        response_queue["dropped"] = responseQueue.getDroppedCount();
+        response_queue["pending"] = responseQueue.size();
+        doc["snapshot_retry"] = reader.getReadRetryCount();
+        doc["snapshot_starved"] = reader.getReadStarvedCount();
+        JsonObject stream_pool = doc.createNestedObject("stream_pool");
+        stream_pool["available"] = streamPool.available();
+        stream_pool["exhausted"] = streamPool.getExhaustedCount();
+        stream_pool["failed"] = streamPool.getFailedCount();
+        JsonObject change_log = doc.createNestedObject("change_log");
+        change_log["version"] = reader.getVersion();
+        change_log["oldest"] = reader.getOldestChangeVersion();
+        JsonObject modbus_server = doc.createNestedObject("modbus_server");
+        modbus_server["clients"] = MBserver.activeClients();
+        modbus_server["requests"] = modbusMap.getRequestCount();
+        modbus_server["registers"] = modbusMap.getRegisterCount();
+        JsonObject modbus_proxy = doc.createNestedObject("modbus_proxy");
+        modbus_proxy["requests"] = proxyStats.requests.load();
+        modbus_proxy["cache_hits"] = proxyStats.cacheHits.load();
+        modbus_proxy["forwarded"] = proxyStats.forwarded.load();
+        modbus_proxy["coalesced"] = proxyInflight.getCoalescedCount();
+        modbus_proxy["ttl_ms"] = MODBUS_PROXY_TTL;
+        JsonObject push = doc.createNestedObject("push");
+        push["clients"] = pushSocket.count();
+        push["frames"] = pushStats.frames;
+        push["dropped"] = pushStats.dropped;
+        push["closed"] = pushStats.closed;
+        push["latency_last_ms"] = pushStats.latencyLast;
+        push["latency_max_ms"] = pushStats.latencyMax;
+        doc["free_heap"] = ESP.getFreeHeap();
+
+        serializeJson(doc, output);
         request->send(200, "application/json", output); });
 
     server.on("/api/update-firmware", HTTP_POST, [](AsyncWebServerRequest *request){
@@ -747,6 +2042,52 @@ void setup() {
         request->send(status, "application/json", handler.buildJsonResponse(status));
     });
 
+    pushSocket.onEvent([](AsyncWebSocket *socket, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len)
+    {
+        // called from the AsyncTCP task, the disconnect event runs before the client is deleted
+        if (type == WS_EVT_CONNECT)
+        {
+            ESP_LOGI(TAG, "push client connected : %d\n", client->id());
+            xSemaphoreTake(push_mutex, portMAX_DELAY);
+            PushClient *slot = nullptr;
+            for (PushClient& entry : pushClients)
+            {
+                if (entry.client == nullptr)
+                {
+                    slot = &entry;
+                    break;
+                }
+            }
+            if (slot != nullptr)
+            {
+                slot->stalledSince = 0;
+                slot->id = client->id();
+                slot->client = client;
+            }
+            xSemaphoreGive(push_mutex);
+            if (slot == nullptr)
+            {
+                // replace AsyncWebSocket::cleanupClients(), the client over DEFAULT_MAX_WS_CLIENTS is refused
+                client->close();
+            }
+        }
+        else if (type == WS_EVT_DISCONNECT)
+        {
+            ESP_LOGI(TAG, "push client disconnected : %d\n", client->id());
+            xSemaphoreTake(push_mutex, portMAX_DELAY);
+            for (PushClient& entry : pushClients)
+            {
+                if (entry.client == client)
+                {
+                    entry.id = 0;
+                    entry.client = nullptr;
+                }
+            }
+            xSemaphoreGive(push_mutex);
+        }
+    });
+
+    server.addHandler(&pushSocket);
     server.addHandler(setNetwork);
     server.addHandler(setSlaveHandler);
     server.addHandler(setScanHandler);
@@ -761,9 +2102,10 @@ void setup() {
         }
     });
     server.begin();
-    globalIterator = reader.getTianBMSData().begin();
     lastRequest = millis();
     lastCleanup = millis();
+    lastQueueCheck = millis();
+    xTaskCreatePinnedToCore(pollTask, "poll", POLL_TASK_STACK, NULL, POLL_TASK_PRIORITY, &pollTaskHandle, POLL_TASK_CORE);
 }
 
 void loop() {
@@ -782,6 +2124,31 @@ void loop() {
 		}
 	}
 
+    /**
+     * Apply the modbus response enqueued by the modbus client task
+    */
+    if (responseQueue.size() > 0)
+    {
+        if (xSemaphoreTake(write_mutex, portMAX_DELAY))
+        {
+            uint32_t responseTimestamp = millis();
+            responseQueue.drain(reader, 8, &responseTimestamp);
+            // another pack answering on the id starts its statistic again
+            std::array<uint8_t, 8> swapped;
+            xSemaphoreTake(poll_mutex, portMAX_DELAY);
+            size_t swapCount = packIdentity.refresh(reader, millis(), swapped.data(), swapped.size());
+            for (size_t i = 0; i < swapCount; i++)
+            {
+                reader.resetStatistics(swapped[i]);
+                pollScheduler.resetSlave(swapped[i]);
+                pollPlan.resetSlave(swapped[i]);
+            }
+            xSemaphoreGive(poll_mutex);
+            xSemaphoreGive(write_mutex);
+            pushUpdates(responseTimestamp);
+        }
+    }
+
     /**
      * TO DO : This block is used to clean up obsolete data to free up space, but still causing crash
     */
@@ -795,8 +2162,7 @@ void loop() {
     //             reader.cleanUp(); // perform cleanup
     //             ESP_LOGI(TAG, "clean up");
     //             isCleanup = false;
-    //             std::map<int, TianBMSData>::iterator it = reader.getTianBMSData().begin();
-    //             if (it == reader.getTianBMSData().end()) // check if data is empty
+    //             if (reader.getTianBMSData().empty()) // check if data is empty
     //             {
     //                 emptyCount++;
     //                 if (emptyCount > 3) // if it is empty during > 3 times check, then perform address scan again
@@ -814,102 +2180,6 @@ void loop() {
     //     lastCleanup = millis();
     // }
 
-    if(isSlaveChanged || isScan)
-    {
-        if (MB.pendingRequests() == 0)
-        {
-            if (millis() - lastQueueCheck > 3000)
-            {
-                if (xSemaphoreTake(read_mutex, portMAX_DELAY))
-                {
-                    if (xSemaphoreTake(write_mutex, portMAX_DELAY))
-                    {
-                        // check if the signal is coming from slave changed flag, the new setting need to be written, if not it is coming from rescan flag
-                        if (isSlaveChanged) 
-                        {
-                            ESP_LOGI(TAG, "SAVE PARAMETER AND CLEAR");
-                            talis5Memory.save();
-                            slave.resize(talis5Memory.getSlaveSize());
-                            talis5Memory.getSlave(slave.data(), talis5Memory.getSlaveSize());
-                        }
-                        else
-                        {
-                            ESP_LOGI(TAG, "RESCAN");
-                        }
-                        isScanFinished = false;
-                        isSlaveChanged = false;
-                        isScan = false;
-                        reader.clearData();
-                        xSemaphoreGive(write_mutex);
-                    }
-                    xSemaphoreGive(read_mutex);
-                }
-                lastQueueCheck = millis();
-            }
-        }
-        else
-        {
-            lastQueueCheck = millis();
-        }
-    }
-
-    if (isScanFinished)
-    {
-        /**
-         * This block will push the request to queue based on detected slave
-        */
-        // if (!isCleanup) // this flag is to detect if it's time to do cleanup, then pause the .addRequest
-        // { 
-        if (!isSlaveChanged && !isScan) // if it is not scan or not slave changed, do normal polling
-        {
-            if (globalIterator != reader.getTianBMSData().end())
-            {
-                if (millis() - lastRequest > 500)
-                {
-                    Error err = MB.addRequest(reader.getToken((*globalIterator).first, TianBMSUtils::REQUEST_DATA), (*globalIterator).first, READ_INPUT_REGISTER, 4096, 34);
-                    if (err!=SUCCESS) {
-                        ModbusError e(err);
-                        Serial.printf("Error creating request: %02X - %s\n", (int)e, (const char *)e);
-                    }
-                    lastRequest = millis();
-                    globalIterator++; // increment the iterator to the next element
-                }
-            }
-            else
-            {
-                globalIterator = reader.getTianBMSData().begin(); // get the iterator of the first element of data
-            }
-        }
-        // }
-    }
-    else
-    {
-        /**
-         * This block is to do address(slave) scan, start from slave 1 to 16
-        */
-        if (millis() - lastRequest > 500)
-        {
-            ESP_LOGI(TAG, "Slave pointer : %d\n", slavePointer);
-            ESP_LOGI(TAG, "Slave address : %d\n", slave.at(slavePointer));
-            Error err = MB.addRequest(reader.getToken(slave.at(slavePointer), TianBMSUtils::REQUEST_SCAN), slave.at(slavePointer), READ_INPUT_REGISTER, 4096, 1);
-            if (err!=SUCCESS) {
-                ModbusError e(err);
-                Serial.printf("Error creating request: %02X - %s\n", (int)e, (const char *)e);
-            }
-            slavePointer++;
-            if (slavePointer >= slave.size())
-            {
-                slavePointer = 0;
-                isScanFinished = 1;
-                globalIterator = reader.getTianBMSData().begin();
-            }
-            lastRequest = millis();
-        }
-    }
-    
-    
-    
-
     // ESP_LOGI(TAG, "PCB Code : %s\n", tianBMS.getPcbBarcode().c_str());
 	// if (factoryReset)
 	// {
@@ -926,5 +2196,5 @@ void loop() {
 		delay(100);
 		ESP.restart();
 	}
-  
+    vTaskDelay(1); // polling has its own task, only yield here
 }
\ No newline at end of file
@@ -0,0 +1,93 @@
+#ifndef TEST_STUB_ARDUINO_H
+#define TEST_STUB_ARDUINO_H
+
+/**
+ * Minimal host replacement of the Arduino core for the native test environment, only what lib/Embedded/TianBMS and
+ * lib/Embedded/Utilities use. String keeps the Arduino interface (c_str(), length(), concat()) plus write() so
+ * ArduinoJson serializes into it, the log macro and Serial print nothing
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+class String
+{
+public:
+    String() {}
+    String(const char* str) : _value(str != nullptr ? str : "") {}
+    String(const std::string& str) : _value(str) {}
+    String(char c) : _value(1, c) {}
+    String(int value) : _value(std::to_string(value)) {}
+    String(unsigned int value) : _value(std::to_string(value)) {}
+    String(long value) : _value(std::to_string(value)) {}
+    String(unsigned long value) : _value(std::to_string(value)) {}
+
+    const char* c_str() const { return _value.c_str(); }
+    size_t length() const { return _value.length(); }
+    bool reserve(size_t size) { _value.reserve(size); return true; }
+    char charAt(size_t index) const { return index < _value.length() ? _value[index] : 0; }
+    char operator[](size_t index) const { return charAt(index); }
+    bool concat(const char* str) { _value += str; return true; }
+    bool concat(const String& str) { _value += str._value; return true; }
+    size_t write(uint8_t c) { _value += (char)c; return 1; }
+    size_t write(const uint8_t* data, size_t size) { _value.append((const char*)data, size); return size; }
+    String& operator+=(const String& str) { _value += str._value; return *this; }
+    bool operator==(const String& other) const { return _value == other._value; }
+    bool operator!=(const String& other) const { return _value != other._value; }
+    friend String operator+(const String& lhs, const String& rhs) { return String(lhs._value + rhs._value); }
+
+private:
+    std::string _value;
+};
+
+inline unsigned long millis()
+{
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return (unsigned long)duration_cast<milliseconds>(steady_clock::now() - start).count();
+}
+
+inline unsigned long micros()
+{
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return (unsigned long)duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+inline long random(long min, long max)
+{
+    return max > min ? min + rand() % (max - min) : min;
+}
+
+inline void vTaskDelay(uint32_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+#define ESP_LOG_INFO 3
+#define ESP_LOGE(tag, ...) do {} while (0)
+#define ESP_LOGW(tag, ...) do {} while (0)
+#define ESP_LOGI(tag, ...) do {} while (0)
+#define ESP_LOGD(tag, ...) do {} while (0)
+
+inline void esp_log_level_set(const char* tag, int level)
+{
+}
+
+class HardwareSerial
+{
+public:
+    template <typename T> void print(const T& value) {}
+    template <typename T> void println(const T& value) {}
+    void printf(const char* format, ...) {}
+};
+
+static HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef TEST_STUB_PREFERENCES_H
+#define TEST_STUB_PREFERENCES_H
+
+/**
+ * In memory replacement of the ESP32 NVS Preferences for the native test environment. Every instance shares one store
+ * keyed by "namespace/key", so a value written by one instance is read back by the next like after a reboot.
+ * clearStore() empties it between tests
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class Preferences
+{
+public:
+    bool begin(const char* name, bool readOnly = false)
+    {
+        _name = name;
+        return true;
+    }
+
+    void end()
+    {
+    }
+
+    bool isKey(const char* key)
+    {
+        return store().count(path(key)) > 0;
+    }
+
+    size_t getBytesLength(const char* key)
+    {
+        auto it = store().find(path(key));
+        return it == store().end() ? 0 : it->second.size();
+    }
+
+    size_t getBytes(const char* key, void* buff, size_t length)
+    {
+        auto it = store().find(path(key));
+        if (it == store().end() || it->second.size() > length)
+        {
+            return 0;
+        }
+        memcpy(buff, it->second.data(), it->second.size());
+        return it->second.size();
+    }
+
+    size_t putBytes(const char* key, const void* value, size_t length)
+    {
+        const uint8_t* bytes = (const uint8_t*)value;
+        store()[path(key)].assign(bytes, bytes + length);
+        writeCount()++;
+        return length;
+    }
+
+    bool remove(const char* key)
+    {
+        return store().erase(path(key)) > 0;
+    }
+
+    static size_t getWriteCount()
+    {
+        return writeCount();
+    }
+
+    static void clearStore()
+    {
+        store().clear();
+        writeCount() = 0;
+    }
+
+private:
+    std::string _name;
+
+    std::string path(const char* key) const
+    {
+        return _name + "/" + key;
+    }
+
+    static std::map<std::string, std::vector<uint8_t>>& store()
+    {
+        static std::map<std::string, std::vector<uint8_t>> values;
+        return values;
+    }
+
+    static size_t& writeCount()
+    {
+        static size_t count = 0;
+        return count;
+    }
+};
+
+#endif
@@ -0,0 +1,438 @@
+#include <unity.h>
+#include <TianBMS.h>
+#include <TianBMSJsonStream.h>
+#include <string>
+
+static TianBMS* tianBMS;
+static TianBMSJsonStream* stream;
+
+void setUp()
+{
+    tianBMS = new TianBMS();
+    stream = new TianBMSJsonStream();
+}
+
+void tearDown()
+{
+    delete stream;
+    delete tianBMS;
+}
+
+static void addSlave(uint8_t id)
+{
+    uint16_t registers[32] = {0};
+    registers[0] = 5321;
+    registers[1] = (uint16_t)-1250;
+    registers[2] = 87;
+    registers[3] = (uint16_t)-45;
+    registers[5] = 0x0801;
+    registers[8] = 9550;
+    for (uint16_t cell = 0; cell < 16; cell++)
+    {
+        registers[12 + cell] = 3300 + cell;
+    }
+    tianBMS->update(id, tianBMS->getToken(id, TianBMSUtils::REQUEST_DATA), registers, 32);
+    uint16_t barcode[16] = {0x4241, 0x0043};
+    tianBMS->update(id, tianBMS->getToken(id, TianBMSUtils::REQUEST_PCB_CODE), barcode, 16);
+}
+
+static std::string readAll(size_t chunkSize = 1436)
+{
+    std::string document;
+    uint8_t buffer[1436];
+    size_t length;
+    while ((length = stream->read(buffer, chunkSize)) > 0)
+    {
+        document.append(reinterpret_cast<const char*>(buffer), length);
+    }
+    return document;
+}
+
+/**
+ * Decoder of the CBOR and MessagePack subset written by TianBMSBinaryWriter, every item is printed as json like text
+ * (byte string as h'hex') so both encodings of the same document give the same text. Malformed input stops the
+ * decoding and leaves the position short of the end
+*/
+class BinaryDecoder
+{
+public:
+    BinaryDecoder(const std::string& data, bool isCbor) : _data(data), _isCbor(isCbor) {}
+
+    std::string decode()
+    {
+        std::string text;
+        _isValid = item(text) && _position == _data.size();
+        return text;
+    }
+
+    bool isValid() const
+    {
+        return _isValid;
+    }
+
+private:
+    const std::string& _data;
+    bool _isCbor;
+    size_t _position = 0;
+    bool _isValid = false;
+
+    bool readUInt(size_t size, uint64_t& value)
+    {
+        if (_position + size > _data.size())
+        {
+            return false;
+        }
+        value = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            value = (value << 8) | (uint8_t)_data[_position++];
+        }
+        return true;
+    }
+
+    bool bytes(size_t length, bool isText, std::string& text)
+    {
+        static const char hex[] = "0123456789abcdef";
+        if (_position + length > _data.size())
+        {
+            return false;
+        }
+        text += isText ? "\"" : "h'";
+        for (size_t i = 0; i < length; i++)
+        {
+            uint8_t c = _data[_position++];
+            if (isText)
+            {
+                text += (char)c;
+            }
+            else
+            {
+                text += hex[c >> 4];
+                text += hex[c & 0x0F];
+            }
+        }
+        text += isText ? "\"" : "'";
+        return true;
+    }
+
+    bool container(uint64_t count, bool isMap, bool isIndefinite, std::string& text)
+    {
+        text += isMap ? '{' : '[';
+        for (uint64_t i = 0; isIndefinite || i < count; i++)
+        {
+            if (isIndefinite && _position < _data.size() && (uint8_t)_data[_position] == 0xFF)
+            {
+                _position++;
+                break;
+            }
+            if (i > 0)
+            {
+                text += ',';
+            }
+            if (isMap)
+            {
+                if (!item(text))
+                {
+                    return false;
+                }
+                text += ':';
+            }
+            if (!item(text))
+            {
+                return false;
+            }
+        }
+        text += isMap ? '}' : ']';
+        return true;
+    }
+
+    bool item(std::string& text)
+    {
+        return _isCbor ? cborItem(text) : msgpackItem(text);
+    }
+
+    bool cborItem(std::string& text)
+    {
+        if (_position >= _data.size())
+        {
+            return false;
+        }
+        uint8_t initial = _data[_position++];
+        uint8_t major = initial >> 5;
+        uint8_t info = initial & 0x1F;
+        uint64_t argument = info;
+        bool isIndefinite = info == 31;
+        if (info >= 24 && info <= 27 && !readUInt(1 << (info - 24), argument))
+        {
+            return false;
+        }
+        if ((info > 27 && !isIndefinite) || (isIndefinite && major != 4 && major != 5))
+        {
+            return false;
+        }
+        switch (major)
+        {
+        case 0:
+            text += std::to_string(argument);
+            return true;
+        case 1:
+            text += std::to_string(-1 - (int64_t)argument);
+            return true;
+        case 2:
+        case 3:
+            return bytes(argument, major == 3, text);
+        case 4:
+        case 5:
+            return container(argument, major == 5, isIndefinite, text);
+        case 7:
+            if (info == 20 || info == 21)
+            {
+                text += info == 21 ? "true" : "false";
+                return true;
+            }
+            if (info == 22)
+            {
+                text += "null";
+                return true;
+            }
+            return false;
+        default:
+            return false;
+        }
+    }
+
+    bool msgpackItem(std::string& text)
+    {
+        if (_position >= _data.size())
+        {
+            return false;
+        }
+        uint8_t type = _data[_position++];
+        uint64_t value = 0;
+        if (type <= 0x7F)
+        {
+            text += std::to_string(type);
+            return true;
+        }
+        if (type >= 0xE0)
+        {
+            text += std::to_string((int8_t)type);
+            return true;
+        }
+        if (type >= 0x80 && type <= 0x9F)
+        {
+            return container(type & 0x0F, type < 0x90, false, text);
+        }
+        if (type >= 0xA0 && type <= 0xBF)
+        {
+            return bytes(type & 0x1F, true, text);
+        }
+        switch (type)
+        {
+        case 0xC0:
+            text += "null";
+            return true;
+        case 0xC2:
+        case 0xC3:
+            text += type == 0xC3 ? "true" : "false";
+            return true;
+        case 0xC4:
+        case 0xC5:
+            return readUInt(type == 0xC4 ? 1 : 2, value) && bytes(value, false, text);
+        case 0xD9:
+        case 0xDA:
+            return readUInt(type == 0xD9 ? 1 : 2, value) && bytes(value, true, text);
+        case 0xCC:
+        case 0xCD:
+        case 0xCE:
+        case 0xCF:
+            if (!readUInt(1 << (type - 0xCC), value))
+            {
+                return false;
+            }
+            text += std::to_string(value);
+            return true;
+        case 0xD0:
+        case 0xD1:
+        case 0xD2:
+        case 0xD3:
+        {
+            size_t size = 1 << (type - 0xD0);
+            if (!readUInt(size, value))
+            {
+                return false;
+            }
+            int64_t signedValue = size == 8 ? (int64_t)value : (int64_t)(value << (64 - size * 8)) >> (64 - size * 8);
+            text += std::to_string(signedValue);
+            return true;
+        }
+        case 0xDC:
+        case 0xDD:
+            return readUInt(type == 0xDC ? 2 : 4, value) && container(value, false, false, text);
+        case 0xDE:
+        case 0xDF:
+            return readUInt(type == 0xDE ? 2 : 4, value) && container(value, true, false, text);
+        default:
+            return false;
+        }
+    }
+};
+
+static std::string toHex(const std::string& data)
+{
+    static const char hex[] = "0123456789abcdef";
+    std::string text;
+    for (char c : data)
+    {
+        text += hex[(uint8_t)c >> 4];
+        text += hex[(uint8_t)c & 0x0F];
+    }
+    return text;
+}
+
+static std::string readDocument(TianBMSJsonStream::Format format, TianBMSJsonStream::Encoding encoding,
+    size_t chunkSize = 1436)
+{
+    stream->begin(*tianBMS, format, encoding);
+    return readAll(chunkSize);
+}
+
+/**
+ * Decode the document and check that it is well formed and ends with the last byte of the stream
+*/
+static std::string decode(const std::string& data, TianBMSJsonStream::Encoding encoding)
+{
+    BinaryDecoder decoder(data, encoding == TianBMSJsonStream::ENCODING_CBOR);
+    std::string text = decoder.decode();
+    TEST_ASSERT_TRUE_MESSAGE(decoder.isValid(), text.c_str());
+    return text;
+}
+
+static const char* CELLS = "h'0ce40ce50ce60ce70ce80ce90cea0ceb0cec0ced0cee0cef0cf00cf10cf20cf3'";
+
+void test_compact_bytes()
+{
+    addSlave(3);
+    // smallest form of every integer, cell voltage as big endian byte string
+    TEST_ASSERT_EQUAL_STRING("a164646174619f981802036341424360601914c93904e11857382c00190801000019254e0000005820"
+        "0ce40ce50ce60ce70ce80ce90cea0ceb0cec0ced0cee0cef0cf00cf10cf20cf3000000000000ff",
+        toHex(readDocument(TianBMSJsonStream::FORMAT_COMPACT, TianBMSJsonStream::ENCODING_CBOR)).c_str());
+    TEST_ASSERT_EQUAL_STRING("81a46461746191dc00180203a3414243a0a0cd14c9d1fb1e57d0d300cd08010000cd254e000000c420"
+        "0ce40ce50ce60ce70ce80ce90cea0ceb0cec0ced0cee0cef0cf00cf10cf20cf3000000000000",
+        toHex(readDocument(TianBMSJsonStream::FORMAT_COMPACT, TianBMSJsonStream::ENCODING_MSGPACK)).c_str());
+}
+
+void test_compact_record()
+{
+    addSlave(3);
+    std::string expected = std::string("{\"data\":[[2,3,\"ABC\",\"\",\"\",5321,-1250,87,-45,0,2049,0,0,9550,0,0,0,") +
+        CELLS + ",0,0,0,0,0,0]]}";
+    const TianBMSJsonStream::Encoding encodings[] = {
+        TianBMSJsonStream::ENCODING_CBOR, TianBMSJsonStream::ENCODING_MSGPACK
+    };
+    for (TianBMSJsonStream::Encoding encoding : encodings)
+    {
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), decode(readDocument(TianBMSJsonStream::FORMAT_COMPACT, encoding),
+            encoding).c_str());
+    }
+}
+
+void test_full_record_matches_json()
+{
+    addSlave(3);
+    std::string json = readDocument(TianBMSJsonStream::FORMAT_FULL, TianBMSJsonStream::ENCODING_JSON);
+    // same document as the json one, except the cell voltage written as byte string
+    size_t cells = json.find("[3300,");
+    json.replace(cells, json.find(']', cells) + 1 - cells, CELLS);
+    const TianBMSJsonStream::Encoding encodings[] = {
+        TianBMSJsonStream::ENCODING_CBOR, TianBMSJsonStream::ENCODING_MSGPACK
+    };
+    for (TianBMSJsonStream::Encoding encoding : encodings)
+    {
+        TEST_ASSERT_EQUAL_STRING(json.c_str(), decode(readDocument(TianBMSJsonStream::FORMAT_FULL, encoding),
+            encoding).c_str());
+    }
+}
+
+void test_document_does_not_depend_on_chunk_size()
+{
+    for (uint8_t id = 1; id <= 20; id++)
+    {
+        addSlave(id);
+    }
+    const TianBMSJsonStream::Encoding encodings[] = {
+        TianBMSJsonStream::ENCODING_CBOR, TianBMSJsonStream::ENCODING_MSGPACK
+    };
+    const TianBMSJsonStream::Format formats[] = {TianBMSJsonStream::FORMAT_FULL, TianBMSJsonStream::FORMAT_COMPACT};
+    const size_t chunkSizes[] = {1, 2, 7, 64, 383, 384, 385, 1000};
+    for (TianBMSJsonStream::Encoding encoding : encodings)
+    {
+        for (TianBMSJsonStream::Format format : formats)
+        {
+            std::string reference = readDocument(format, encoding);
+            decode(reference, encoding);
+            for (size_t chunkSize : chunkSizes)
+            {
+                TEST_ASSERT_TRUE(reference == readDocument(format, encoding, chunkSize));
+            }
+        }
+    }
+}
+
+static void removeSlave(uint8_t id)
+{
+    tianBMS->setMaxErrorCount(0);
+    tianBMS->updateOnError(tianBMS->getToken(id, TianBMSUtils::REQUEST_DATA));
+    tianBMS->cleanUp();
+}
+
+void test_slave_removed_while_streaming()
+{
+    addSlave(3);
+    addSlave(4);
+    addSlave(5);
+    // MessagePack array is sized at begin, the missing record is written as nil
+    stream->begin(*tianBMS, TianBMSJsonStream::FORMAT_COMPACT, TianBMSJsonStream::ENCODING_MSGPACK);
+    uint8_t buffer[8];
+    std::string data(reinterpret_cast<const char*>(buffer), stream->read(buffer, sizeof(buffer)));
+    removeSlave(4);
+    data += readAll();
+    std::string text = decode(data, TianBMSJsonStream::ENCODING_MSGPACK);
+    TEST_ASSERT_EQUAL_STRING("{\"data\":[[2,3,", text.substr(0, 14).c_str());
+    TEST_ASSERT_TRUE(text.find("[2,5,") != std::string::npos);
+    TEST_ASSERT_EQUAL_STRING(",null]}", text.substr(text.length() - 7).c_str());
+
+    // CBOR array is indefinite, the missing record is left out
+    addSlave(4);
+    stream->begin(*tianBMS, TianBMSJsonStream::FORMAT_COMPACT, TianBMSJsonStream::ENCODING_CBOR);
+    data.assign(reinterpret_cast<const char*>(buffer), stream->read(buffer, sizeof(buffer)));
+    removeSlave(4);
+    data += readAll();
+    text = decode(data, TianBMSJsonStream::ENCODING_CBOR);
+    TEST_ASSERT_TRUE(text.find("[2,4,") == std::string::npos);
+    TEST_ASSERT_TRUE(text.find("0],[2,5,") != std::string::npos);
+}
+
+void test_slave_added_while_streaming()
+{
+    addSlave(3);
+    stream->begin(*tianBMS, TianBMSJsonStream::FORMAT_COMPACT, TianBMSJsonStream::ENCODING_MSGPACK);
+    uint8_t buffer[8];
+    std::string data(reinterpret_cast<const char*>(buffer), stream->read(buffer, sizeof(buffer)));
+    addSlave(4);
+    data += readAll();
+    std::string text = decode(data, TianBMSJsonStream::ENCODING_MSGPACK);
+    TEST_ASSERT_TRUE(text.find("[2,4,") == std::string::npos);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_compact_bytes);
+    RUN_TEST(test_compact_record);
+    RUN_TEST(test_full_record_matches_json);
+    RUN_TEST(test_document_does_not_depend_on_chunk_size);
+    RUN_TEST(test_slave_removed_while_streaming);
+    RUN_TEST(test_slave_added_while_streaming);
+    return UNITY_END();
+}
@@ -0,0 +1,134 @@
+#include <unity.h>
+#include <TianBMS.h>
+#include <TianBMSJsonStream.h>
+#include <string>
+
+static TianBMS* tianBMS;
+static TianBMSJsonStream* stream;
+
+void setUp()
+{
+    tianBMS = new TianBMS();
+    stream = new TianBMSJsonStream();
+}
+
+void tearDown()
+{
+    delete stream;
+    delete tianBMS;
+}
+
+static void addSlave(uint8_t id)
+{
+    uint16_t registers[32] = {0};
+    registers[0] = 5321;
+    registers[1] = (uint16_t)-1250;
+    registers[2] = 87;
+    registers[3] = (uint16_t)-45;
+    registers[5] = 0x0801;
+    registers[8] = 9550;
+    for (uint16_t cell = 0; cell < 16; cell++)
+    {
+        registers[12 + cell] = 3300 + cell;
+    }
+    tianBMS->update(id, tianBMS->getToken(id, TianBMSUtils::REQUEST_DATA), registers, 32);
+    uint16_t barcode[16] = {0x4241, 0x0043};
+    tianBMS->update(id, tianBMS->getToken(id, TianBMSUtils::REQUEST_PCB_CODE), barcode, 16);
+}
+
+static std::string readAll(size_t chunkSize = 1436)
+{
+    std::string document;
+    uint8_t buffer[1436];
+    size_t length;
+    while ((length = stream->read(buffer, chunkSize)) > 0)
+    {
+        document.append(reinterpret_cast<const char*>(buffer), length);
+    }
+    return document;
+}
+
+/**
+ * Count the value of the top level array of the record, nested array (cell_voltage) is one value
+*/
+static size_t countPositions(const std::string& record)
+{
+    size_t count = 1;
+    int depth = 0;
+    bool isString = false;
+    for (size_t i = 0; i < record.length(); i++)
+    {
+        char c = record[i];
+        if (isString)
+        {
+            isString = !(c == '"' && record[i - 1] != '\\');
+            continue;
+        }
+        isString = c == '"';
+        depth += (c == '[') - (c == ']');
+        count += c == ',' && depth == 1;
+    }
+    return count;
+}
+
+void test_compact_record()
+{
+    addSlave(3);
+    stream->begin(*tianBMS, TianBMSJsonStream::FORMAT_COMPACT);
+    TEST_ASSERT_EQUAL_STRING("{\"data\":[[2,3,\"ABC\",\"\",\"\",5321,-1250,87,-45,0,2049,0,0,9550,0,0,0,"
+        "[3300,3301,3302,3303,3304,3305,3306,3307,3308,3309,3310,3311,3312,3313,3314,3315],0,0,0,0,0,0]]}",
+        readAll().c_str());
+}
+
+void test_positions_match_the_schema()
+{
+    addSlave(3);
+    addSlave(200);
+    stream->begin(*tianBMS, TianBMSJsonStream::FORMAT_COMPACT);
+    std::string document = readAll(5);
+    TEST_ASSERT_TRUE(document.find("],[") != std::string::npos);
+    size_t first = document.find("[[") + 1;
+    size_t second = document.find("],[") + 1;
+    // msg_count, id then every enabled field in the order of TianBMSRegister::FIELDS, as in /api/schema
+    TEST_ASSERT_EQUAL(2 + TianBMSRegister::enabledCount(), countPositions(document.substr(first, second - first)));
+    TEST_ASSERT_EQUAL(2 + TianBMSRegister::enabledCount(), countPositions(document.substr(second + 1)));
+}
+
+void test_filtered_field_keeps_its_position()
+{
+    addSlave(3);
+    addSlave(5);
+    TianBMSFilter filter;
+    TEST_ASSERT_TRUE(filter.parseFields("soc,pack_voltage"));
+    TEST_ASSERT_TRUE(filter.parseSlaves("5"));
+    stream->begin(*tianBMS, TianBMSJsonStream::FORMAT_COMPACT);
+    stream->setFilter(filter);
+    TEST_ASSERT_EQUAL_STRING("{\"data\":[[2,5,null,null,null,5321,null,null,null,null,null,null,null,9550,null,null,"
+        "null,null,null,null,null,null,null,null]]}", readAll().c_str());
+}
+
+void test_compact_is_smaller_than_full()
+{
+    for (uint8_t id = TianBMSSlotTable::MIN_ID; id <= TianBMSSlotTable::MAX_ID; id++)
+    {
+        addSlave(id);
+    }
+    stream->begin(*tianBMS);
+    size_t full = readAll().length();
+    stream->begin(*tianBMS, TianBMSJsonStream::FORMAT_COMPACT);
+    size_t compact = readAll().length();
+    TEST_ASSERT_LESS_THAN(full / 4, compact);
+    char message[64];
+    snprintf(message, sizeof(message), "247 slave : full %zu bytes, compact %zu bytes", full, compact);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_compact_record);
+    RUN_TEST(test_positions_match_the_schema);
+    RUN_TEST(test_filtered_field_keeps_its_position);
+    RUN_TEST(test_compact_is_smaller_than_full);
+    return UNITY_END();
+}
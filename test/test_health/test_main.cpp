@@ -0,0 +1,292 @@
+#include <unity.h>
+#include <TianBMS.h>
+#include <TianBMSHealth.h>
+#include <TianBMSScheduler.h>
+
+static TianBMSHealth* health;
+
+void setUp()
+{
+    health = new TianBMSHealth();
+}
+
+void tearDown()
+{
+    delete health;
+}
+
+static void fail(uint8_t id, uint32_t now, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        health->onSend(id, now);
+        health->onFailure(id, now);
+    }
+}
+
+/**
+ * First time the open slave may be probed, searched from now in 1 ms step
+*/
+static uint32_t probeTime(uint8_t id, uint32_t now, uint32_t limit)
+{
+    while (!health->isPollable(id, now) && limit > 0)
+    {
+        now++;
+        limit--;
+    }
+    return now;
+}
+
+void test_suspect_after_one_failure()
+{
+    health->onSend(3, 1000);
+    TEST_ASSERT_FALSE(health->onFailure(3, 1000));
+    TEST_ASSERT_EQUAL(TianBMSHealth::STATE_SUSPECT, health->getState(3));
+    TEST_ASSERT_TRUE(health->isPollable(3, 1000));
+    TEST_ASSERT_FALSE(health->isHealthy(3));
+    // second timeout in a row, already failing
+    TEST_ASSERT_TRUE(health->onFailure(3, 3000));
+
+    health->onSuccess(3);
+    TEST_ASSERT_TRUE(health->isHealthy(3));
+    TEST_ASSERT_EQUAL_UINT32(0, health->getRecoveryCount());
+    // failure count starts again
+    fail(3, 4000, TianBMSHealth::OPEN_THRESHOLD - 1);
+    TEST_ASSERT_EQUAL(TianBMSHealth::STATE_SUSPECT, health->getState(3));
+}
+
+void test_open_after_threshold()
+{
+    uint32_t now = 1000;
+    fail(3, now, TianBMSHealth::OPEN_THRESHOLD);
+    TEST_ASSERT_EQUAL(TianBMSHealth::STATE_OPEN, health->getState(3));
+    TEST_ASSERT_EQUAL_UINT32(1, health->getTripCount());
+    TEST_ASSERT_FALSE(health->isPollable(3, now));
+    uint32_t probe = probeTime(3, now, TianBMSHealth::BASE_BACKOFF + 1);
+    TEST_ASSERT_GREATER_OR_EQUAL(now + TianBMSHealth::BASE_BACKOFF / 2, probe);
+    TEST_ASSERT_LESS_OR_EQUAL(now + TianBMSHealth::BASE_BACKOFF, probe);
+}
+
+void test_probe_closes_or_reopens()
+{
+    uint32_t now = 1000;
+    fail(3, now, TianBMSHealth::OPEN_THRESHOLD);
+    now = probeTime(3, now, TianBMSHealth::BASE_BACKOFF + 1);
+    health->onSend(3, now);
+    TEST_ASSERT_EQUAL(TianBMSHealth::STATE_HALF_OPEN, health->getState(3));
+    TEST_ASSERT_EQUAL_UINT32(1, health->getProbeCount());
+    // single probe in flight
+    TEST_ASSERT_FALSE(health->isPollable(3, now + 100000));
+
+    // failed probe, backoff doubled, not counted as new trip
+    now += 2000;
+    TEST_ASSERT_TRUE(health->onFailure(3, now));
+    TEST_ASSERT_EQUAL(TianBMSHealth::STATE_OPEN, health->getState(3));
+    TEST_ASSERT_EQUAL_UINT32(1, health->getTripCount());
+    uint32_t probe = probeTime(3, now, TianBMSHealth::BASE_BACKOFF * 2 + 1);
+    TEST_ASSERT_GREATER_OR_EQUAL(now + TianBMSHealth::BASE_BACKOFF, probe);
+    TEST_ASSERT_LESS_OR_EQUAL(now + TianBMSHealth::BASE_BACKOFF * 2, probe);
+
+    health->onSend(3, probe);
+    health->onSuccess(3);
+    TEST_ASSERT_EQUAL(TianBMSHealth::STATE_HEALTHY, health->getState(3));
+    TEST_ASSERT_EQUAL_UINT32(1, health->getRecoveryCount());
+
+    // backoff forgotten, the next opening starts from BASE_BACKOFF
+    now = probe + TianBMSHealth::PROBE_INTERVAL;
+    fail(3, now, TianBMSHealth::OPEN_THRESHOLD);
+    TEST_ASSERT_LESS_OR_EQUAL(now + TianBMSHealth::BASE_BACKOFF, probeTime(3, now, TianBMSHealth::BASE_BACKOFF + 1));
+}
+
+void test_backoff_is_capped()
+{
+    uint32_t now = 1000;
+    fail(3, now, TianBMSHealth::OPEN_THRESHOLD);
+    for (int i = 0; i < 10; i++)
+    {
+        now = probeTime(3, now, TianBMSHealth::MAX_BACKOFF + 1);
+        health->onSend(3, now);
+        health->onFailure(3, now);
+    }
+    uint32_t probe = probeTime(3, now, TianBMSHealth::MAX_BACKOFF + 1);
+    TEST_ASSERT_GREATER_OR_EQUAL(now + TianBMSHealth::MAX_BACKOFF / 2, probe);
+    TEST_ASSERT_LESS_OR_EQUAL(now + TianBMSHealth::MAX_BACKOFF, probe);
+}
+
+void test_one_probe_per_interval()
+{
+    uint32_t now = 1000;
+    fail(3, now, TianBMSHealth::OPEN_THRESHOLD);
+    fail(4, now, TianBMSHealth::OPEN_THRESHOLD);
+    now += TianBMSHealth::BASE_BACKOFF;
+    TEST_ASSERT_TRUE(health->isPollable(3, now));
+    TEST_ASSERT_TRUE(health->isPollable(4, now));
+    health->onSend(3, now);
+    // the probe of slave 4 is also due but waits for the interval
+    TEST_ASSERT_FALSE(health->isPollable(4, now));
+    TEST_ASSERT_FALSE(health->isPollable(4, now + TianBMSHealth::PROBE_INTERVAL - 1));
+    TEST_ASSERT_TRUE(health->isPollable(4, now + TianBMSHealth::PROBE_INTERVAL));
+    // request to an open slave whose probe is not due is not a probe
+    health->onSend(4, now + 1);
+    TEST_ASSERT_EQUAL(TianBMSHealth::STATE_OPEN, health->getState(4));
+    TEST_ASSERT_EQUAL_UINT32(1, health->getProbeCount());
+}
+
+void test_state_count_and_reset()
+{
+    TianBMSSlotTable table;
+    for (uint8_t id = 1; id <= 5; id++)
+    {
+        table.beginWrite(id);
+        table.endWrite(id);
+    }
+    fail(2, 1000, 1);
+    fail(3, 1000, TianBMSHealth::OPEN_THRESHOLD);
+    fail(4, 1000, TianBMSHealth::OPEN_THRESHOLD);
+    // slave not in the table is not counted
+    fail(9, 1000, TianBMSHealth::OPEN_THRESHOLD);
+    TEST_ASSERT_EQUAL(2, health->getStateCount(table, TianBMSHealth::STATE_HEALTHY));
+    TEST_ASSERT_EQUAL(1, health->getStateCount(table, TianBMSHealth::STATE_SUSPECT));
+    TEST_ASSERT_EQUAL(2, health->getStateCount(table, TianBMSHealth::STATE_OPEN));
+
+    health->reset();
+    TEST_ASSERT_EQUAL(5, health->getStateCount(table, TianBMSHealth::STATE_HEALTHY));
+    TEST_ASSERT_TRUE(health->isPollable(3, 1001));
+    TEST_ASSERT_EQUAL_UINT32(3, health->getTripCount());
+
+    TEST_ASSERT_FALSE(health->isPollable(TianBMSSlotTable::MAX_ID + 1, 1000));
+    TEST_ASSERT_FALSE(health->onFailure(TianBMSSlotTable::MAX_ID + 1, 1000));
+}
+
+struct SweepResult
+{
+    double sweepTime;
+    uint32_t maxGap;
+    uint32_t timeoutCount;
+    uint32_t probeCount;
+    uint32_t recoveryCount;
+};
+
+/**
+ * Poll simulation on a bus serving one request at a time : a poll of an alive slave takes 95 ms, of a dead one the
+ * 2 s timeout. The first `deadCount` slave is dead until `recoverAt` (0 = for good), for 10 simulated minutes. The
+ * sweep time and the longest gap between two poll of an alive slave are measured after the first minute
+*/
+static SweepResult simulate(size_t slaveCount, size_t deadCount, bool isBreaker, uint32_t recoverAt = 0)
+{
+    const uint32_t aliveTime = 95;
+    const uint32_t timeout = 2000;
+    const uint32_t duration = 600000;
+    const uint32_t warmUp = 60000;
+    TianBMSSlotTable table;
+    for (uint8_t id = 1; id <= slaveCount; id++)
+    {
+        table.beginWrite(id);
+        table.endWrite(id);
+    }
+    TianBMSScheduler scheduler(2000);
+    TianBMSHealth breaker;
+    std::array<uint32_t, TianBMSSlotTable::MAX_ID + 1> lastPoll;
+    lastPoll.fill(0);
+    SweepResult result = {0, 0, 0, 0, 0};
+    uint32_t sweepCount = 0;
+    uint32_t sweepRequest = 0;
+    uint32_t sweepStart = 0;
+    double sweepSum = 0;
+    uint32_t now = 1;
+    while (now < duration)
+    {
+        int16_t next = scheduler.next(table, now, 0, isBreaker ? &breaker : nullptr);
+        if (next < 0)
+        {
+            now += 10;
+            continue;
+        }
+        uint8_t id = next;
+        // open slave is not part of the sweep
+        size_t sweepSize = slaveCount;
+        if (isBreaker)
+        {
+            sweepSize -= breaker.getStateCount(table, TianBMSHealth::STATE_OPEN) +
+                breaker.getStateCount(table, TianBMSHealth::STATE_HALF_OPEN);
+        }
+        if (sweepRequest >= sweepSize)
+        {
+            if (now > warmUp)
+            {
+                sweepSum += now - sweepStart;
+                sweepCount++;
+            }
+            sweepStart = now;
+            sweepRequest = 0;
+        }
+        sweepRequest++;
+        scheduler.onSend(id, now);
+        breaker.onSend(id, now);
+        bool isDead = id <= deadCount && (recoverAt == 0 || now < recoverAt);
+        now += isDead ? timeout : aliveTime;
+        scheduler.onComplete(id);
+        if (isDead)
+        {
+            result.timeoutCount++;
+            breaker.onFailure(id, now);
+            continue;
+        }
+        breaker.onSuccess(id);
+        if (id > deadCount && lastPoll[id] != 0 && now > warmUp && now - lastPoll[id] > result.maxGap)
+        {
+            result.maxGap = now - lastPoll[id];
+        }
+        lastPoll[id] = now;
+    }
+    result.sweepTime = sweepCount > 0 ? sweepSum / sweepCount : 0;
+    result.probeCount = breaker.getProbeCount();
+    result.recoveryCount = breaker.getRecoveryCount();
+    return result;
+}
+
+void test_measure_sweep_with_dead_slave()
+{
+    const size_t slaveCounts[] = {8, 16, 32};
+    for (size_t slaveCount : slaveCounts)
+    {
+        size_t deadCount = slaveCount / 4;
+        SweepResult alive = simulate(slaveCount, 0, false);
+        SweepResult before = simulate(slaveCount, deadCount, false);
+        SweepResult after = simulate(slaveCount, deadCount, true);
+        TEST_ASSERT_LESS_THAN(before.sweepTime / 2, after.sweepTime);
+        TEST_ASSERT_LESS_THAN(before.maxGap, after.maxGap);
+        TEST_ASSERT_LESS_THAN(before.timeoutCount / 3, after.timeoutCount);
+        char message[160];
+        snprintf(message, sizeof(message), "%2zu slave, %zu dead : all alive %4.0f ms, no breaker %5.0f ms "
+            "(gap %u ms, %u timeout), breaker %4.0f ms (gap %u ms, %u timeout, %u probe)", slaveCount, deadCount,
+            alive.sweepTime, before.sweepTime, before.maxGap, before.timeoutCount, after.sweepTime, after.maxGap,
+            after.timeoutCount, after.probeCount);
+        TEST_MESSAGE(message);
+    }
+}
+
+void test_dead_slave_recovers_without_rescan()
+{
+    const size_t deadCount = 4;
+    SweepResult result = simulate(16, deadCount, true, 300000);
+    TEST_ASSERT_EQUAL_UINT32(deadCount, result.recoveryCount);
+    char message[96];
+    snprintf(message, sizeof(message), "16 slave, 4 back at 300 s : %u probe, %u recovered", result.probeCount,
+        result.recoveryCount);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_suspect_after_one_failure);
+    RUN_TEST(test_open_after_threshold);
+    RUN_TEST(test_probe_closes_or_reopens);
+    RUN_TEST(test_backoff_is_capped);
+    RUN_TEST(test_one_probe_per_interval);
+    RUN_TEST(test_state_count_and_reset);
+    RUN_TEST(test_measure_sweep_with_dead_slave);
+    RUN_TEST(test_dead_slave_recovers_without_rescan);
+    return UNITY_END();
+}
@@ -0,0 +1,267 @@
+#include <unity.h>
+#include <TianBMS.h>
+#include <TianBMSJsonStream.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+
+static std::atomic<size_t> allocationCount(0);
+
+void* operator new(size_t size)
+{
+    allocationCount++;
+    void* pointer = malloc(size > 0 ? size : 1);
+    if (pointer == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t size) noexcept
+{
+    free(pointer);
+}
+
+static const uint8_t ID = 3;
+
+static TianBMS* tianBMS;
+static TianBMSJsonStream* stream;
+
+void setUp()
+{
+    tianBMS = new TianBMS();
+    stream = new TianBMSJsonStream();
+}
+
+void tearDown()
+{
+    delete stream;
+    delete tianBMS;
+}
+
+/**
+ * Put one slave with known value into the data table, the same record for every test
+*/
+static void addSlave(uint8_t id)
+{
+    uint16_t registers[32] = {0};
+    registers[0] = 5321;
+    registers[1] = (uint16_t)-1250;
+    registers[2] = 87;
+    registers[3] = (uint16_t)-45;
+    registers[5] = 0x0801;
+    registers[8] = 9550;
+    for (uint16_t cell = 0; cell < 16; cell++)
+    {
+        registers[12 + cell] = 3300 + cell;
+    }
+    tianBMS->update(id, tianBMS->getToken(id, TianBMSUtils::REQUEST_DATA), registers, 32);
+    uint16_t barcode[16] = {0x4241, 0x0043};
+    tianBMS->update(id, tianBMS->getToken(id, TianBMSUtils::REQUEST_PCB_CODE), barcode, 16);
+}
+
+static std::string readAll(size_t chunkSize)
+{
+    std::string document;
+    uint8_t buffer[1436];
+    size_t length;
+    while ((length = stream->read(buffer, chunkSize)) > 0)
+    {
+        document.append(reinterpret_cast<const char*>(buffer), length);
+    }
+    return document;
+}
+
+static const char* RECORD =
+    "{\"msg_count\":2,\"id\":3,\"pcb_barcode\":\"ABC\",\"sn_code_1\":\"\",\"sn_code_2\":\"\","
+    "\"pack_voltage\":{\"unit\":\"V\",\"divider\":100,\"value\":5321},"
+    "\"pack_current\":{\"unit\":\"A\",\"divider\":100,\"value\":-1250},"
+    "\"remaining_capacity\":{\"unit\":\"Ah\",\"divider\":1,\"value\":87},"
+    "\"average_cell_temperature\":{\"unit\":\"Celcius\",\"divider\":10,\"value\":-45},"
+    "\"env_temperature\":{\"unit\":\"Celcius\",\"divider\":10,\"value\":0},"
+    "\"warning_flag\":{\"unit\":\"None\",\"value\":2049,\"cell_ov_alm\":1,\"cell_uv_alm\":0,\"pack_ov_alm\":0,"
+    "\"pack_uv_alm\":0,\"chg_oc_alm\":0,\"dchg_oc_alm\":0,\"bat_ot_alm\":0,\"bat_ut_alm\":0,\"env_ot_alm\":0,"
+    "\"env_ut_alm\":0,\"mos_ot_alm\":0,\"low_capacity\":1},"
+    "\"protection_flag\":{\"unit\":\"None\",\"value\":0,\"cell_ov_prot\":0,\"cell_uv_prot\":0,\"pack_ov_prot\":0,"
+    "\"pack_uv_prot\":0,\"short_prot\":0,\"oc_prot\":0,\"chg_ot_prot\":0,\"chg_ut_prot\":0,\"dchg_ot_prot\":0,"
+    "\"dchg_ut_prot\":0},"
+    "\"fault_status_flag\":{\"unit\":\"None\",\"value\":0,\"comm_sampling_fault\":0,\"temp_sensor_break\":0,\"soc\":0,"
+    "\"sod\":0,\"chg_mos\":0,\"dchg_mos\":0,\"chg_limit_function\":0},"
+    "\"soc\":{\"unit\":\"%\",\"divider\":100,\"value\":9550},"
+    "\"soh\":{\"unit\":\"%\",\"divider\":100,\"value\":0},"
+    "\"full_charged_cap\":{\"unit\":\"Ah\",\"divider\":1,\"value\":0},"
+    "\"cycle_count\":{\"unit\":\"None\",\"divider\":1,\"value\":0},"
+    "\"cell_voltage\":{\"unit\":\"mV\",\"divider\":1,\"value\":[3300,3301,3302,3303,3304,3305,3306,3307,3308,3309,"
+    "3310,3311,3312,3313,3314,3315]},"
+    "\"max_cell_voltage\":{\"unit\":\"mV\",\"divider\":1,\"value\":0},"
+    "\"min_cell_voltage\":{\"unit\":\"mV\",\"divider\":1,\"value\":0},"
+    "\"cell_voltage_diff\":{\"unit\":\"mV\",\"divider\":1,\"value\":0},"
+    "\"max_cell_temperature\":{\"unit\":\"Celcius\",\"divider\":10,\"value\":0},"
+    "\"min_cell_temperature\":{\"unit\":\"Celcius\",\"divider\":10,\"value\":0},"
+    "\"fet_temperature\":{\"unit\":\"Celcius\",\"divider\":10,\"value\":0}}";
+
+void test_empty_document()
+{
+    stream->begin(*tianBMS);
+    TEST_ASSERT_EQUAL_STRING("{\"data\":[]}", readAll(1436).c_str());
+    TEST_ASSERT_TRUE(stream->isFinished());
+    TEST_ASSERT_FALSE(stream->isFailed());
+}
+
+void test_full_document()
+{
+    addSlave(ID);
+    stream->begin(*tianBMS);
+    std::string expected = std::string("{\"data\":[") + RECORD + "]}";
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), readAll(1436).c_str());
+    TEST_ASSERT_TRUE(stream->isFinished());
+}
+
+void test_render_record_matches_stream()
+{
+    addSlave(ID);
+    TianBMSData record;
+    tianBMS->getSnapshot(ID, record);
+    char buffer[TianBMSJsonStream::RECORD_SIZE];
+    TianBMSJsonWriter writer(buffer, sizeof(buffer) - 1);
+    TianBMSJsonStream::renderRecord(writer, record);
+    TEST_ASSERT_FALSE(writer.isOverflow());
+    buffer[writer.length()] = 0;
+    TEST_ASSERT_EQUAL_STRING(RECORD, buffer);
+}
+
+void test_document_does_not_depend_on_chunk_size()
+{
+    for (uint8_t id = 1; id <= 20; id++)
+    {
+        addSlave(id);
+    }
+    stream->begin(*tianBMS);
+    std::string reference = readAll(1436);
+    const size_t chunkSizes[] = {1, 2, 7, 64, 383, 384, 385, 1000};
+    for (size_t chunkSize : chunkSizes)
+    {
+        stream->begin(*tianBMS);
+        TEST_ASSERT_TRUE(reference == readAll(chunkSize));
+    }
+    TEST_ASSERT_EQUAL_STRING("{\"data\":[{", reference.substr(0, 10).c_str());
+    TEST_ASSERT_EQUAL_STRING("}]}", reference.substr(reference.length() - 3).c_str());
+}
+
+void test_writer_overflow()
+{
+    char buffer[16];
+    TianBMSJsonWriter writer(buffer, sizeof(buffer));
+    writer.append("{\"a\":");
+    writer.appendUInt(123);
+    writer.append(",\"b\":");
+    TEST_ASSERT_EQUAL(13, writer.length());
+    TEST_ASSERT_FALSE(writer.isOverflow());
+    // number is only written when its longest form fits
+    writer.appendInt(-1);
+    TEST_ASSERT_TRUE(writer.isOverflow());
+    TEST_ASSERT_EQUAL(13, writer.length());
+    writer.append("}}}}");
+    TEST_ASSERT_EQUAL(16, writer.length());
+}
+
+void test_writer_escape()
+{
+    char buffer[32];
+    TianBMSJsonWriter writer(buffer, sizeof(buffer) - 1);
+    writer.appendString("a\"b\\c", 16);
+    buffer[writer.length()] = 0;
+    TEST_ASSERT_EQUAL_STRING("\"a\\\"b\\\\c\"", buffer);
+}
+
+static bool writeLongMetric(TianBMSJsonWriter& writer, size_t index)
+{
+    if (index > 0)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < 500; i++)
+    {
+        writer.append('x');
+    }
+    return true;
+}
+
+void test_overflowed_unit_fails_the_stream()
+{
+    addSlave(ID);
+    TianBMSJsonStreamPool pool;
+    TianBMSJsonStreamHandle handle = pool.acquire();
+    handle->beginMetrics(*tianBMS, writeLongMetric);
+    uint8_t buffer[1436];
+    size_t total = 0;
+    size_t length;
+    while ((length = handle->read(buffer, sizeof(buffer))) > 0)
+    {
+        total += length;
+    }
+    TEST_ASSERT_GREATER_THAN(0, total);
+    TEST_ASSERT_TRUE(handle->isFailed());
+    TEST_ASSERT_EQUAL_UINT32(1, handle->getFailCount());
+    TEST_ASSERT_EQUAL_UINT32(1, pool.getFailedCount());
+
+    // next document starts clean
+    handle->begin(*tianBMS);
+    while (handle->read(buffer, sizeof(buffer)) > 0)
+    {
+    }
+    TEST_ASSERT_FALSE(handle->isFailed());
+    TEST_ASSERT_TRUE(handle->isFinished());
+}
+
+void test_stream_never_allocates()
+{
+    for (uint8_t id = TianBMSSlotTable::MIN_ID; id <= TianBMSSlotTable::MAX_ID; id++)
+    {
+        addSlave(id);
+    }
+    const int rounds = 20;
+    uint8_t buffer[1436];
+    size_t total = 0;
+    size_t before = allocationCount.load();
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        stream->begin(*tianBMS);
+        size_t length;
+        total = 0;
+        while ((length = stream->read(buffer, sizeof(buffer))) > 0)
+        {
+            total += length;
+        }
+    }
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    TEST_ASSERT_EQUAL(0, allocationCount.load() - before);
+    TEST_ASSERT_TRUE(stream->isFinished());
+
+    char message[96];
+    snprintf(message, sizeof(message), "247 slave : %zu bytes, %.0f bytes/ms on the host, 0 heap allocation", total,
+        total * rounds / elapsed);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_document);
+    RUN_TEST(test_full_document);
+    RUN_TEST(test_render_record_matches_stream);
+    RUN_TEST(test_document_does_not_depend_on_chunk_size);
+    RUN_TEST(test_writer_overflow);
+    RUN_TEST(test_writer_escape);
+    RUN_TEST(test_overflowed_unit_fails_the_stream);
+    RUN_TEST(test_stream_never_allocates);
+    return UNITY_END();
+}
@@ -0,0 +1,247 @@
+#include <unity.h>
+#include <TianBMS.h>
+#include <TianBMSJsonStream.h>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static TianBMS* tianBMS;
+static TianBMSJsonStream* stream;
+
+void setUp()
+{
+    tianBMS = new TianBMS();
+    stream = new TianBMSJsonStream();
+}
+
+void tearDown()
+{
+    delete stream;
+    delete tianBMS;
+}
+
+static void addSlave(uint8_t id, uint16_t* barcode)
+{
+    uint16_t registers[32] = {0};
+    registers[0] = 5321;
+    registers[1] = (uint16_t)-1250;
+    registers[2] = 87;
+    registers[3] = (uint16_t)-45;
+    registers[5] = 0x0801;
+    registers[8] = 9550;
+    for (uint16_t cell = 0; cell < 16; cell++)
+    {
+        registers[12 + cell] = 3300 + cell;
+    }
+    tianBMS->update(id, tianBMS->getToken(id, TianBMSUtils::REQUEST_DATA), registers, 32);
+    tianBMS->update(id, tianBMS->getToken(id, TianBMSUtils::REQUEST_PCB_CODE), barcode, 16);
+}
+
+static void addSlave(uint8_t id)
+{
+    uint16_t barcode[16] = {0x4241, 0x0043};
+    addSlave(id, barcode);
+}
+
+static std::vector<std::string> readLines(TianBMSJsonStream::MetricsCollector collector = nullptr)
+{
+    stream->beginMetrics(*tianBMS, collector);
+    std::string document;
+    uint8_t buffer[1436];
+    size_t length;
+    while ((length = stream->read(buffer, sizeof(buffer))) > 0)
+    {
+        document.append(reinterpret_cast<const char*>(buffer), length);
+    }
+    TEST_ASSERT_FALSE(stream->isFailed());
+    TEST_ASSERT_EQUAL('\n', document.back());
+    std::vector<std::string> lines;
+    std::istringstream input(document);
+    std::string line;
+    while (std::getline(input, line))
+    {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+static bool contains(const std::vector<std::string>& lines, const char* line)
+{
+    for (const std::string& value : lines)
+    {
+        if (value == line)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Name of the metric of a sample line, tianbms_soc{slave="1"} 95.50 -> tianbms_soc
+*/
+static std::string sampleName(const std::string& line)
+{
+    return line.substr(0, line.find('{'));
+}
+
+void test_sample_lines()
+{
+    addSlave(3);
+    std::vector<std::string> lines = readLines();
+    const char* expected[] = {
+        "# HELP tianbms_messages_total Number of response applied to the slave record",
+        "# TYPE tianbms_messages_total counter",
+        "tianbms_messages_total{slave=\"3\"} 2",
+        "tianbms_error_count{slave=\"3\"} 0",
+        "# HELP tianbms_pack_voltage Slave field, unit V",
+        "# TYPE tianbms_pack_voltage gauge",
+        "tianbms_pack_voltage{slave=\"3\"} 53.21",
+        "tianbms_pack_current{slave=\"3\"} -12.50",
+        "tianbms_remaining_capacity{slave=\"3\"} 87",
+        "tianbms_average_cell_temperature{slave=\"3\"} -4.5",
+        "tianbms_soc{slave=\"3\"} 95.50",
+        "# HELP tianbms_warning_flag Slave field",
+        "tianbms_warning_flag{slave=\"3\",flag=\"cell_ov_alm\"} 1",
+        "tianbms_warning_flag{slave=\"3\",flag=\"cell_uv_alm\"} 0",
+        "tianbms_warning_flag{slave=\"3\",flag=\"low_capacity\"} 1",
+        "tianbms_cell_voltage{slave=\"3\",cell=\"1\"} 3300",
+        "tianbms_cell_voltage{slave=\"3\",cell=\"16\"} 3315",
+        "# TYPE tianbms_info gauge",
+        "tianbms_info{slave=\"3\",pcb_barcode=\"ABC\",sn_code_1=\"\",sn_code_2=\"\"} 1"
+    };
+    for (const char* line : expected)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(contains(lines, line), line);
+    }
+    TEST_ASSERT_FALSE(contains(lines, "tianbms_cell_voltage{slave=\"3\",cell=\"17\"} 0"));
+}
+
+void test_families_are_grouped()
+{
+    addSlave(3);
+    addSlave(200);
+    addSlave(17);
+    std::vector<std::string> lines = readLines();
+    std::set<std::string> finished;
+    std::string family;
+    size_t sampleCount = 0;
+    for (const std::string& line : lines)
+    {
+        if (line.compare(0, 7, "# TYPE ") == 0)
+        {
+            finished.insert(family);
+            family = line.substr(7, line.find(' ', 7) - 7);
+            TEST_ASSERT_TRUE_MESSAGE(finished.count(family) == 0, line.c_str());
+            continue;
+        }
+        if (line[0] == '#')
+        {
+            continue;
+        }
+        // every sample follows the TYPE line of its family, slave in id order
+        TEST_ASSERT_EQUAL_STRING(family.c_str(), sampleName(line).c_str());
+        sampleCount++;
+    }
+    TEST_ASSERT_EQUAL(0, sampleCount % 3);
+    size_t first = 0;
+    while (lines[first][0] == '#')
+    {
+        first++;
+    }
+    TEST_ASSERT_EQUAL_STRING("tianbms_messages_total{slave=\"3\"} 2", lines[first].c_str());
+    TEST_ASSERT_EQUAL_STRING("tianbms_messages_total{slave=\"17\"} 2", lines[first + 1].c_str());
+    TEST_ASSERT_EQUAL_STRING("tianbms_messages_total{slave=\"200\"} 2", lines[first + 2].c_str());
+}
+
+void test_label_value_is_escaped()
+{
+    // a"b\ then new line, stored byte swapped as the slave send it
+    uint16_t barcode[16] = {0x2261, 0x5C62, 0x000A};
+    addSlave(3, barcode);
+    std::vector<std::string> lines = readLines();
+    TEST_ASSERT_TRUE(contains(lines,
+        "tianbms_info{slave=\"3\",pcb_barcode=\"a\\\"b\\\\\\n\",sn_code_1=\"\",sn_code_2=\"\"} 1"));
+}
+
+static std::vector<size_t> collectorCalls;
+
+static bool writeCollectorMetric(TianBMSJsonWriter& writer, size_t index)
+{
+    collectorCalls.push_back(index);
+    if (index >= 2)
+    {
+        return false;
+    }
+    if (index == 0)
+    {
+        TianBMSJsonStream::renderMetricHeader(writer, "uptime_seconds", "Time since boot", "gauge");
+    }
+    writer.append(index == 0 ? "tianbms_uptime_seconds 42\n" : "tianbms_heap_free_bytes 1000\n");
+    return true;
+}
+
+void test_collector_metric_is_last()
+{
+    addSlave(3);
+    collectorCalls.clear();
+    std::vector<std::string> lines = readLines(writeCollectorMetric);
+    TEST_ASSERT_EQUAL(3, collectorCalls.size());
+    for (size_t i = 0; i < collectorCalls.size(); i++)
+    {
+        TEST_ASSERT_EQUAL(i, collectorCalls[i]);
+    }
+    size_t count = lines.size();
+    TEST_ASSERT_EQUAL_STRING("# HELP tianbms_uptime_seconds Time since boot", lines[count - 4].c_str());
+    TEST_ASSERT_EQUAL_STRING("# TYPE tianbms_uptime_seconds gauge", lines[count - 3].c_str());
+    TEST_ASSERT_EQUAL_STRING("tianbms_uptime_seconds 42", lines[count - 2].c_str());
+    TEST_ASSERT_EQUAL_STRING("tianbms_heap_free_bytes 1000", lines[count - 1].c_str());
+}
+
+void test_empty_table_writes_headers_only()
+{
+    collectorCalls.clear();
+    std::vector<std::string> lines = readLines(writeCollectorMetric);
+    for (size_t i = 0; i + 2 < lines.size(); i++)
+    {
+        TEST_ASSERT_EQUAL('#', lines[i][0]);
+    }
+    TEST_ASSERT_EQUAL_STRING("tianbms_heap_free_bytes 1000", lines.back().c_str());
+}
+
+void test_every_slave_is_scraped()
+{
+    addSlave(3);
+    size_t linePerSlave = 0;
+    for (const std::string& line : readLines())
+    {
+        linePerSlave += line[0] != '#';
+    }
+    for (uint8_t id = TianBMSSlotTable::MIN_ID; id <= TianBMSSlotTable::MAX_ID; id++)
+    {
+        addSlave(id);
+    }
+    std::vector<std::string> lines = readLines();
+    size_t sampleCount = 0;
+    for (const std::string& line : lines)
+    {
+        sampleCount += line[0] != '#';
+    }
+    TEST_ASSERT_EQUAL(linePerSlave * TianBMSSlotTable::MAX_ID, sampleCount);
+    char message[64];
+    snprintf(message, sizeof(message), "247 slave : %zu sample line", sampleCount);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_sample_lines);
+    RUN_TEST(test_families_are_grouped);
+    RUN_TEST(test_label_value_is_escaped);
+    RUN_TEST(test_collector_metric_is_last);
+    RUN_TEST(test_empty_table_writes_headers_only);
+    RUN_TEST(test_every_slave_is_scraped);
+    return UNITY_END();
+}
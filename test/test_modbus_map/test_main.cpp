@@ -0,0 +1,233 @@
+#include <unity.h>
+#include <TianBMS.h>
+#include <TianBMSModbusMap.h>
+#include <chrono>
+
+static TianBMS* tianBMS;
+static TianBMSModbusMap* modbusMap;
+static uint16_t registers[125];
+
+void setUp()
+{
+    tianBMS = new TianBMS();
+    modbusMap = new TianBMSModbusMap(*tianBMS);
+}
+
+void tearDown()
+{
+    delete modbusMap;
+    delete tianBMS;
+}
+
+struct SlaveValue
+{
+    uint16_t packVoltage;
+    int16_t packCurrent;
+    uint16_t soc;
+    uint16_t soh;
+    uint16_t maxCellVoltage;
+    uint16_t minCellVoltage;
+    uint16_t maxCellTemp;
+    uint16_t minCellTemp;
+    uint16_t warning;
+    uint16_t protection;
+    uint16_t fault;
+};
+
+/**
+ * Apply register 4096 - 4127 then the later block 4128 - 4130 of the slave, the bms register i hold 1000 + i
+ * unless set from value
+*/
+static void updateSlave(uint8_t id, const SlaveValue& value)
+{
+    uint16_t fast[32];
+    for (size_t i = 0; i < 32; i++)
+    {
+        fast[i] = 1000 + i;
+    }
+    fast[0] = value.packVoltage;
+    fast[1] = (uint16_t)value.packCurrent;
+    fast[5] = value.warning;
+    fast[6] = value.protection;
+    fast[7] = value.fault;
+    fast[8] = value.soc;
+    fast[9] = value.soh;
+    fast[29] = value.maxCellVoltage;
+    fast[30] = value.minCellVoltage;
+    tianBMS->update(id, tianBMS->getToken(id, TianBMSUtils::REQUEST_DATA), fast, 32);
+    uint16_t slow[3] = {value.maxCellTemp, value.minCellTemp, 1130};
+    tianBMS->update(id, tianBMS->getToken(id, TianBMSUtils::REQUEST_DATA, 32, 1), slow, 3);
+}
+
+static const SlaveValue SLAVE_2 = {5300, -1250, 9000, 9800, 3400, 3300, 310, 250, 0x0001, 0x0000, 0x0100};
+static const SlaveValue SLAVE_7 = {5400, 500, 8000, 9500, 3450, 3320, 330, 240, 0x0800, 0x0004, 0x0000};
+static const SlaveValue SLAVE_9 = {5200, -300, 7000, 9900, 3410, 3280, 300, 260, 0x0000, 0x0000, 0x0001};
+
+void test_bank_block()
+{
+    updateSlave(2, SLAVE_2);
+    updateSlave(7, SLAVE_7);
+    updateSlave(9, SLAVE_9);
+    TEST_ASSERT_TRUE(modbusMap->read(TianBMSModbusMap::BANK_BASE, TianBMSModbusMap::BANK_SIZE, registers));
+    uint32_t version = tianBMS->getVersion();
+    const uint16_t expected[TianBMSModbusMap::BANK_SIZE] = {
+        TianBMSModbusMap::MAP_VERSION, 3, (uint16_t)(version >> 16), (uint16_t)version,
+        0xFFFF, (uint16_t)-1050,    // -1250 + 500 - 300
+        5300, 7000, 9000, 8000, 9500,
+        3450, 7, 3280, 9,
+        330, 7, 240, 7,
+        0x0801, 0x0004, 0x0101,
+        2                           // slave 7 protection, slave 9 fault, mos state of slave 2 is not a fault
+    };
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(expected, registers, TianBMSModbusMap::BANK_SIZE);
+}
+
+void test_bank_follows_the_data_version()
+{
+    updateSlave(2, SLAVE_2);
+    TEST_ASSERT_TRUE(modbusMap->read(1, 1, registers));
+    TEST_ASSERT_EQUAL_UINT16(1, registers[0]);
+    updateSlave(7, SLAVE_7);
+    TEST_ASSERT_TRUE(modbusMap->read(1, 1, registers));
+    TEST_ASSERT_EQUAL_UINT16(2, registers[0]);
+
+    tianBMS->setMaxErrorCount(0);
+    tianBMS->updateOnError(tianBMS->getToken(2, TianBMSUtils::REQUEST_DATA));
+    tianBMS->cleanUp();
+    TEST_ASSERT_TRUE(modbusMap->read(0, 10, registers));
+    TEST_ASSERT_EQUAL_UINT16(1, registers[1]);
+    TEST_ASSERT_EQUAL_UINT16(5400, registers[6]);
+
+    tianBMS->clearData();
+    TEST_ASSERT_TRUE(modbusMap->read(0, 23, registers));
+    TEST_ASSERT_EQUAL_UINT16(0, registers[1]);
+    for (size_t i = 4; i < 23; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT16(0, registers[i]);
+    }
+}
+
+void test_slave_block()
+{
+    updateSlave(7, SLAVE_7);
+    uint16_t base = TianBMSModbusMap::SLAVE_BASE + 6 * TianBMSModbusMap::SLAVE_BLOCK_SIZE;
+    TEST_ASSERT_TRUE(modbusMap->read(base, TianBMSModbusMap::SLAVE_BLOCK_SIZE, registers));
+    TEST_ASSERT_EQUAL_UINT16(7, registers[0]);
+    TEST_ASSERT_EQUAL_UINT16(0, registers[1]);
+    TEST_ASSERT_EQUAL_UINT16(0, registers[2]);
+    TEST_ASSERT_EQUAL_UINT16(2, registers[3]);
+    for (size_t i = 4; i < TianBMSModbusMap::SLAVE_HEADER_SIZE; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT16(0, registers[i]);
+    }
+    // bms register layout, balance temperature (4124), 4131 - 4143 and remaining time are not enabled
+    const uint16_t* native = registers + TianBMSModbusMap::SLAVE_HEADER_SIZE;
+    TEST_ASSERT_EQUAL_UINT16(5400, native[0]);
+    TEST_ASSERT_EQUAL_UINT16(500, native[1]);
+    TEST_ASSERT_EQUAL_UINT16(1002, native[2]);
+    TEST_ASSERT_EQUAL_UINT16(0x0800, native[5]);
+    TEST_ASSERT_EQUAL_UINT16(8000, native[8]);
+    for (size_t cell = 0; cell < 16; cell++)
+    {
+        TEST_ASSERT_EQUAL_UINT16(1012 + cell, native[12 + cell]);
+    }
+    TEST_ASSERT_EQUAL_UINT16(0, native[28]);
+    TEST_ASSERT_EQUAL_UINT16(3450, native[29]);
+    TEST_ASSERT_EQUAL_UINT16(330, native[32]);
+    TEST_ASSERT_EQUAL_UINT16(1130, native[34]);
+    for (size_t i = 35; i < TianBMSModbusMap::SLAVE_BLOCK_SIZE - TianBMSModbusMap::SLAVE_HEADER_SIZE; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT16(0, native[i]);
+    }
+}
+
+void test_inactive_slave_reads_zero()
+{
+    updateSlave(7, SLAVE_7);
+    // the end of slave 6 and the start of slave 7 in one request
+    uint16_t address = TianBMSModbusMap::SLAVE_BASE + 6 * TianBMSModbusMap::SLAVE_BLOCK_SIZE - 60;
+    TEST_ASSERT_TRUE(modbusMap->read(address, 64, registers));
+    for (size_t i = 0; i < 60; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT16(0, registers[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT16(7, registers[60]);
+    TEST_ASSERT_EQUAL_UINT16(2, registers[63]);
+}
+
+void test_illegal_address()
+{
+    uint16_t slaveEnd = TianBMSModbusMap::SLAVE_BASE + TianBMSSlotTable::MAX_ID * TianBMSModbusMap::SLAVE_BLOCK_SIZE;
+    TEST_ASSERT_FALSE(modbusMap->read(0, 0, registers));
+    TEST_ASSERT_FALSE(modbusMap->read(TianBMSModbusMap::BANK_SIZE - 2, 4, registers));
+    TEST_ASSERT_FALSE(modbusMap->read(TianBMSModbusMap::BANK_SIZE, 1, registers));
+    TEST_ASSERT_FALSE(modbusMap->read(TianBMSModbusMap::SLAVE_BASE - 1, 2, registers));
+    TEST_ASSERT_FALSE(modbusMap->read(slaveEnd - 1, 2, registers));
+    TEST_ASSERT_FALSE(modbusMap->read(0xFFFF, 2, registers));
+    TEST_ASSERT_TRUE(modbusMap->read(slaveEnd - 1, 1, registers));
+    TEST_ASSERT_EQUAL_UINT32(1, modbusMap->getRequestCount());
+    TEST_ASSERT_EQUAL_UINT32(1, modbusMap->getRegisterCount());
+}
+
+void test_read_native()
+{
+    updateSlave(7, SLAVE_7);
+    uint16_t base = TianBMSModbusMap::NATIVE_BASE;
+    TEST_ASSERT_TRUE(modbusMap->readNative(7, base, 28, registers));
+    TEST_ASSERT_EQUAL_UINT16(5400, registers[0]);
+    TEST_ASSERT_EQUAL_UINT16(1027, registers[27]);
+    TEST_ASSERT_TRUE(modbusMap->readNative(7, base + 29, 6, registers));
+    TEST_ASSERT_EQUAL_UINT16(3450, registers[0]);
+    TEST_ASSERT_EQUAL_UINT16(1130, registers[5]);
+    // register not held by an enabled field, the proxy forward the request to the slave
+    TEST_ASSERT_FALSE(modbusMap->readNative(7, base, 32, registers));
+    TEST_ASSERT_FALSE(modbusMap->readNative(7, base + 34, 2, registers));
+    TEST_ASSERT_FALSE(modbusMap->readNative(7, base - 1, 2, registers));
+    TEST_ASSERT_FALSE(modbusMap->readNative(7, base, 0, registers));
+    TEST_ASSERT_FALSE(modbusMap->readNative(8, base, 1, registers));
+    TEST_ASSERT_EQUAL_UINT32(0, modbusMap->getRequestCount());
+}
+
+void test_measure_read()
+{
+    SlaveValue value = SLAVE_2;
+    for (uint8_t id = TianBMSSlotTable::MIN_ID; id <= TianBMSSlotTable::MAX_ID; id++)
+    {
+        value.packVoltage = 5000 + id;
+        updateSlave(id, value);
+    }
+    const int rounds = 200000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+    {
+        uint16_t offset = (i % TianBMSSlotTable::MAX_ID) * TianBMSModbusMap::SLAVE_BLOCK_SIZE;
+        modbusMap->read(TianBMSModbusMap::SLAVE_BASE + offset + TianBMSModbusMap::SLAVE_HEADER_SIZE,
+            TianBMSModbusMap::NATIVE_SIZE, registers);
+    }
+    double slaveRate = rounds / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+    {
+        modbusMap->read(TianBMSModbusMap::BANK_BASE, 23, registers);
+    }
+    double bankRate = rounds / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    TEST_ASSERT_EQUAL_UINT32(rounds * 2, modbusMap->getRequestCount());
+
+    char message[96];
+    snprintf(message, sizeof(message), "247 slave : %.0f slave block read/s, %.0f bank read/s on the host", slaveRate,
+        bankRate);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_bank_block);
+    RUN_TEST(test_bank_follows_the_data_version);
+    RUN_TEST(test_slave_block);
+    RUN_TEST(test_inactive_slave_reads_zero);
+    RUN_TEST(test_illegal_address);
+    RUN_TEST(test_read_native);
+    RUN_TEST(test_measure_read);
+    return UNITY_END();
+}
@@ -0,0 +1,316 @@
+#include <unity.h>
+#include <TianBMS.h>
+#include <TianBMSPollPlan.h>
+
+static const uint32_t SLOW_PERIOD = 30000;
+static const uint8_t SLOW_BLOCK = 2;           // soh, full charged capacity and cycle count
+
+static TianBMSPollPlan* plan;
+
+void setUp()
+{
+    plan = new TianBMSPollPlan(SLOW_PERIOD, TianBMSPollPlan::getBridgeLimit(9600, 10));
+}
+
+void tearDown()
+{
+    delete plan;
+}
+
+void test_bridge_limit()
+{
+    // 20 character of frame overhead plus the turnaround in character, 2 character per register
+    TEST_ASSERT_EQUAL_UINT16(14, TianBMSPollPlan::getBridgeLimit(9600, 10));
+    TEST_ASSERT_EQUAL_UINT16(10, TianBMSPollPlan::getBridgeLimit(9600, 0));
+    TEST_ASSERT_EQUAL_UINT16(62, TianBMSPollPlan::getBridgeLimit(115200, 10));
+    TEST_ASSERT_EQUAL_UINT16(14, plan->getBridgeLimit());
+}
+
+void test_block_plan()
+{
+    TEST_ASSERT_EQUAL(4, plan->getBlockCount());
+    TEST_ASSERT_EQUAL(2, plan->getFastBlockCount());
+    // the fast read stops before the slow counter 4105 - 4107 and starts again after it
+    const TianBMSRegister::Block& fast = plan->getBlock(TianBMSPollPlan::FAST_BLOCK);
+    TEST_ASSERT_EQUAL_UINT16(4096, fast.address);
+    TEST_ASSERT_EQUAL_UINT16(9, fast.count);
+    TEST_ASSERT_EQUAL_UINT8(TianBMSUtils::REQUEST_DATA, fast.request);
+    TEST_ASSERT_EQUAL_UINT8(0, fast.offset);
+    TEST_ASSERT_EQUAL(TianBMSRegister::PERIOD_FAST, fast.period);
+
+    // cell voltage to fet temperature, over the disabled balance temperature
+    const TianBMSRegister::Block& fastEnd = plan->getBlock(1);
+    TEST_ASSERT_EQUAL_UINT16(4108, fastEnd.address);
+    TEST_ASSERT_EQUAL_UINT16(23, fastEnd.count);
+    TEST_ASSERT_EQUAL_UINT8(12, fastEnd.offset);
+    TEST_ASSERT_EQUAL(TianBMSRegister::PERIOD_FAST, fastEnd.period);
+
+    // soh, full charged capacity and cycle count
+    const TianBMSRegister::Block& slow = plan->getBlock(2);
+    TEST_ASSERT_EQUAL_UINT16(4105, slow.address);
+    TEST_ASSERT_EQUAL_UINT16(3, slow.count);
+    TEST_ASSERT_EQUAL_UINT8(TianBMSUtils::REQUEST_DATA, slow.request);
+    TEST_ASSERT_EQUAL_UINT8(9, slow.offset);
+    TEST_ASSERT_EQUAL(TianBMSRegister::PERIOD_SLOW, slow.period);
+
+    // the three identity string, no gap
+    const TianBMSRegister::Block& session = plan->getBlock(3);
+    TEST_ASSERT_EQUAL_UINT16(4160, session.address);
+    TEST_ASSERT_EQUAL_UINT16(48, session.count);
+    TEST_ASSERT_EQUAL(TianBMSRegister::PERIOD_SESSION, session.period);
+
+    // out of range index gives the fast block
+    TEST_ASSERT_TRUE(&plan->getBlock(7) == &fast);
+}
+
+void test_every_enabled_field_is_read()
+{
+    for (size_t i = 0; i < TianBMSRegister::FIELD_COUNT; i++)
+    {
+        const TianBMSRegister::Descriptor& field = TianBMSRegister::FIELDS[i];
+        if (!field.enabled)
+        {
+            continue;
+        }
+        size_t readCount = 0;
+        for (uint8_t n = 0; n < plan->getBlockCount(); n++)
+        {
+            const TianBMSRegister::Block& block = plan->getBlock(n);
+            TEST_ASSERT_LESS_OR_EQUAL(TianBMSPollPlan::MAX_BLOCK_SIZE, block.count);
+            if (field.address >= block.address && field.address + field.count <= block.address + block.count)
+            {
+                // as often as the field period asks, or more often
+                TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(field.period, block.period, field.key);
+                readCount++;
+            }
+        }
+        TEST_ASSERT_EQUAL_MESSAGE(1, readCount, field.key);
+    }
+}
+
+void test_fast_range()
+{
+    TEST_ASSERT_TRUE(plan->isFastRange(4096, 35));
+    TEST_ASSERT_TRUE(plan->isFastRange(4108, 16));
+    TEST_ASSERT_TRUE(plan->isFastRange(4128, 3));
+    TEST_ASSERT_FALSE(plan->isFastRange(4096, 36));
+    TEST_ASSERT_FALSE(plan->isFastRange(4095, 2));
+}
+
+void test_slow_block_once_per_period()
+{
+    uint32_t now = 1001;  // send time is kept odd, 0 is never sent
+    TEST_ASSERT_EQUAL(SLOW_BLOCK, plan->nextExtra(3, now));
+    plan->onSend(3, SLOW_BLOCK, now);
+    TEST_ASSERT_EQUAL(-1, plan->nextExtra(3, now + SLOW_PERIOD - 1));
+    TEST_ASSERT_EQUAL(SLOW_BLOCK, plan->nextExtra(3, now + SLOW_PERIOD));
+    // other slave keeps its own period
+    TEST_ASSERT_EQUAL(SLOW_BLOCK, plan->nextExtra(4, now));
+
+    // timeout, due again on the next poll, the block is not split
+    plan->onError(3, SLOW_BLOCK);
+    TEST_ASSERT_EQUAL(SLOW_BLOCK, plan->nextExtra(3, now + 1));
+    TEST_ASSERT_FALSE(plan->isSplit(3, SLOW_BLOCK));
+
+    plan->onSend(3, SLOW_BLOCK, now);
+    plan->onSend(3, TianBMSPollPlan::FAST_BLOCK, now);
+    plan->onSend(3, TianBMSPollPlan::FAST_BLOCK + 1, now);
+    TEST_ASSERT_EQUAL_UINT32(2, plan->getRequestCount(SLOW_BLOCK));
+    TEST_ASSERT_EQUAL_UINT32(1, plan->getRequestCount(TianBMSPollPlan::FAST_BLOCK));
+    TEST_ASSERT_EQUAL_UINT32(3 + 3 + 9 + 23, plan->getRegisterCount());
+}
+
+void test_rejected_block_is_split()
+{
+    TianBMS tianBMS;
+    uint32_t now = 1001;
+    plan->onSend(1, SLOW_BLOCK, now);
+    plan->onError(1, SLOW_BLOCK, true);
+    TEST_ASSERT_TRUE(plan->isSplit(1, SLOW_BLOCK));
+    TEST_ASSERT_FALSE(plan->isSplit(2, SLOW_BLOCK));
+
+    // one split block per poll, one field each, applied at its own offset
+    const uint16_t expectedAddress[3] = {4105, 4106, 4107};
+    for (size_t i = 0; i < 3; i++)
+    {
+        now += 500;
+        int16_t block = plan->nextExtra(1, now);
+        TEST_ASSERT_EQUAL(TianBMSPollPlan::MAX_BLOCK + i, block);
+        const TianBMSRegister::Block& part = plan->getBlock(block);
+        TEST_ASSERT_EQUAL_UINT16(expectedAddress[i], part.address);
+        TEST_ASSERT_EQUAL_UINT16(1, part.count);
+        plan->onSend(1, block, now);
+        uint8_t payload[2] = {0x01, (uint8_t)(0x10 + i)};
+        TEST_ASSERT_TRUE(tianBMS.updateFromPayload(1, tianBMS.getToken(1, (TianBMSUtils::RequestType)part.request,
+            part.offset, block), payload, sizeof(payload), now));
+    }
+    TEST_ASSERT_EQUAL(-1, plan->nextExtra(1, now + 500));
+    TianBMSData record;
+    TEST_ASSERT_TRUE(tianBMS.getSnapshot(1, record));
+    TEST_ASSERT_EQUAL_UINT16(0x0110, record.soh);
+    TEST_ASSERT_EQUAL_UINT16(0x0111, record.fullChargedCap);
+    TEST_ASSERT_EQUAL_UINT16(0x0112, record.cycleCount);
+    TEST_ASSERT_EQUAL_UINT32(4, plan->getRequestCount(SLOW_BLOCK));
+
+    // next period starts again from the first field, still split
+    TEST_ASSERT_EQUAL(TianBMSPollPlan::MAX_BLOCK, plan->nextExtra(1, now + SLOW_PERIOD));
+
+    // another pack answered on the id, the whole block is tried again
+    plan->resetSlave(1);
+    TEST_ASSERT_FALSE(plan->isSplit(1, SLOW_BLOCK));
+    TEST_ASSERT_EQUAL(SLOW_BLOCK, plan->nextExtra(1, now));
+}
+
+void test_failed_split_block_waits_for_next_period()
+{
+    uint32_t now = 1001;
+    plan->onError(1, SLOW_BLOCK, true);
+    int16_t block = plan->nextExtra(1, now);
+    plan->onSend(1, block, now);
+    // failed split block (index from MAX_BLOCK) is counted with its block, it is not split again nor retried
+    plan->onError(1, block, true);
+    TEST_ASSERT_TRUE(plan->isSplit(1, SLOW_BLOCK));
+    TEST_ASSERT_EQUAL_UINT32(2, plan->getErrorCount(SLOW_BLOCK));
+    TEST_ASSERT_EQUAL(block + 1, plan->nextExtra(1, now + 500));
+    plan->onSend(1, block + 1, now + 500);
+
+    // failed last split block ends the period as its send did, the first field is read on the next period
+    plan->onSend(1, block + 2, now + 1000);
+    plan->onError(1, block + 2);
+    TEST_ASSERT_EQUAL_UINT32(3, plan->getErrorCount(SLOW_BLOCK));
+    TEST_ASSERT_EQUAL(-1, plan->nextExtra(1, now + 1500));
+    TEST_ASSERT_EQUAL(block, plan->nextExtra(1, now + 1000 + SLOW_PERIOD));
+
+    // split index past the split block of the plan is ignored
+    plan->onError(1, TianBMSPollPlan::MAX_BLOCK + TianBMSPollPlan::MAX_SPLIT_BLOCK - 1, true);
+    TEST_ASSERT_EQUAL_UINT32(3, plan->getErrorCount(SLOW_BLOCK));
+}
+
+void test_reset()
+{
+    plan->onSend(1, SLOW_BLOCK, 1000);
+    plan->onError(2, SLOW_BLOCK, true);
+    plan->reset();
+    TEST_ASSERT_EQUAL(SLOW_BLOCK, plan->nextExtra(1, 1001));
+    TEST_ASSERT_FALSE(plan->isSplit(2, SLOW_BLOCK));
+    TEST_ASSERT_EQUAL_UINT32(0, plan->getRequestCount(SLOW_BLOCK));
+    TEST_ASSERT_EQUAL_UINT32(0, plan->getRegisterCount());
+}
+
+static const uint32_t FAST_PERIOD = 2000;      // one sweep of every slave, as the poll window gives with 16 slave
+static const uint8_t SLAVE_COUNT = 16;
+
+/**
+ * Bus time of one transaction on the simulated rtu gateway : request and response frame overhead plus 2 character
+ * per register at 11 bit per character, then the gateway turnaround
+*/
+static double getBusTime(uint16_t count, uint32_t baud, uint32_t turnaround)
+{
+    return (20 + 2 * count) * 11 * 1000.0 / baud + turnaround;
+}
+
+/**
+ * Sweeps SLAVE_COUNT slave every FAST_PERIOD for 10 minute as pollNext() in main.cpp does : every fast block, then
+ * the extra block nextExtra() gives. The session block is left out, it is read once per slave and not by sweep. When
+ * isRejected every slave answers the whole slow block with a modbus exception, as handleError() reports it
+ *
+ * @return      bus time per sweep in ms, transactions and registers per sweep through the pointers
+*/
+static double simulateSweep(uint32_t baud, uint32_t turnaround, double* transactions, double* registers,
+    bool isRejected = false)
+{
+    TianBMSPollPlan sweepPlan(SLOW_PERIOD, TianBMSPollPlan::getBridgeLimit(baud, turnaround));
+    const int sweepCount = 600000 / FAST_PERIOD;
+    double busTime = 0;
+    uint32_t transactionCount = 0;
+    uint32_t registerCount = 0;
+    for (int sweep = 0; sweep < sweepCount; sweep++)
+    {
+        uint32_t now = 1001 + sweep * FAST_PERIOD;
+        for (uint8_t id = 1; id <= SLAVE_COUNT; id++)
+        {
+            for (size_t block = TianBMSPollPlan::FAST_BLOCK; block < sweepPlan.getFastBlockCount(); block++)
+            {
+                busTime += getBusTime(sweepPlan.getBlock(block).count, baud, turnaround);
+                transactionCount++;
+                registerCount += sweepPlan.getBlock(block).count;
+            }
+            int16_t extra = sweepPlan.nextExtra(id, now);
+            if (extra >= 0)
+            {
+                busTime += getBusTime(sweepPlan.getBlock(extra).count, baud, turnaround);
+                transactionCount++;
+                registerCount += sweepPlan.getBlock(extra).count;
+                sweepPlan.onSend(id, extra, now);
+                if (isRejected && extra < TianBMSPollPlan::MAX_BLOCK)
+                {
+                    sweepPlan.onError(id, extra, true);
+                }
+            }
+        }
+    }
+    *transactions = (double)transactionCount / sweepCount;
+    *registers = (double)registerCount / sweepCount;
+    return busTime / sweepCount;
+}
+
+void test_measure_bus_time_per_sweep()
+{
+    const uint32_t bauds[] = {9600, 19200};
+    const uint32_t turnarounds[] = {0, 10};
+    for (uint32_t baud : bauds)
+    {
+        for (uint32_t turnaround : turnarounds)
+        {
+            double transactions;
+            double registers;
+            double split = simulateSweep(baud, turnaround, &transactions, &registers);
+            // one read of the whole fast span, the slow counter included, read every sweep
+            uint16_t span = plan->getBlock(1).address + plan->getBlock(1).count - plan->getBlock(0).address;
+            double single = SLAVE_COUNT * getBusTime(span, baud, turnaround);
+            // the slow counter is off the fast read, one fast read more per slave and the slow block per period
+            TEST_ASSERT_TRUE(transactions > 2 * SLAVE_COUNT && transactions < 2 * SLAVE_COUNT + 2);
+            TEST_ASSERT_TRUE(registers < SLAVE_COUNT * span);
+            char message[160];
+            snprintf(message, sizeof(message), "%5u baud %2u ms turnaround : one read %7.1f ms %u transaction, split "
+                "%7.1f ms %5.2f transaction %6.1f register, %+7.1f ms per sweep", baud, turnaround, single,
+                SLAVE_COUNT, split, transactions, registers, split - single);
+            TEST_MESSAGE(message);
+        }
+    }
+}
+
+void test_measure_transactions_per_sweep()
+{
+    double transactions;
+    double registers;
+    simulateSweep(9600, 10, &transactions, &registers);
+    double wholeTransactions = transactions;
+    double split = simulateSweep(9600, 10, &transactions, &registers, true);
+    // 2 fast read per slave and the slow block once per 15 sweep. Rejected, its 3 field are read one per poll and
+    // the period starts again from the last one, 3 split block per 17 sweep
+    uint32_t sweepCount = SLOW_PERIOD / FAST_PERIOD;
+    TEST_ASSERT_FLOAT_WITHIN(0.1, 2 * SLAVE_COUNT + (double)SLAVE_COUNT / sweepCount, wholeTransactions);
+    TEST_ASSERT_FLOAT_WITHIN(0.15, 2 * SLAVE_COUNT + 3.0 * SLAVE_COUNT / (sweepCount + 2), transactions);
+    char message[160];
+    snprintf(message, sizeof(message), "%u slave, 9600 baud 10 ms turnaround : whole slow block %5.2f transaction per "
+        "sweep, rejected and split %5.2f transaction %7.1f ms per sweep", SLAVE_COUNT, wholeTransactions,
+        transactions, split);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_bridge_limit);
+    RUN_TEST(test_block_plan);
+    RUN_TEST(test_every_enabled_field_is_read);
+    RUN_TEST(test_fast_range);
+    RUN_TEST(test_slow_block_once_per_period);
+    RUN_TEST(test_rejected_block_is_split);
+    RUN_TEST(test_failed_split_block_waits_for_next_period);
+    RUN_TEST(test_reset);
+    RUN_TEST(test_measure_bus_time_per_sweep);
+    RUN_TEST(test_measure_transactions_per_sweep);
+    return UNITY_END();
+}
@@ -0,0 +1,315 @@
+#include <unity.h>
+#include <TianBMSPollWindow.h>
+#include <deque>
+#include <random>
+
+static const uint32_t CLIENT_INTERVAL = 2;     // POLL_INTERVAL in main.cpp
+static const uint32_t OLD_CLIENT_INTERVAL = 200;
+
+static TianBMSPollWindow* window;
+
+void setUp()
+{
+    window = new TianBMSPollWindow();
+}
+
+void tearDown()
+{
+    delete window;
+}
+
+/**
+ * Send to the slave and get its response after rtt, return the time of the response
+*/
+static uint32_t roundTrip(uint8_t id, uint32_t now, uint32_t rtt)
+{
+    window->onSend(id, now);
+    window->onResponse(id, now + rtt);
+    return now + rtt;
+}
+
+void test_one_request_per_slave()
+{
+    TEST_ASSERT_TRUE(window->canSend(1000));
+    window->onSend(3, 1000);
+    window->onSend(3, 1001);
+    TEST_ASSERT_TRUE(window->isInFlight(3));
+    TEST_ASSERT_FALSE(window->isInFlight(4));
+    TEST_ASSERT_EQUAL_UINT8(1, window->getInFlight());
+    TEST_ASSERT_FALSE(window->canSend(1002));
+
+    // response of a slave not in flight is ignored
+    window->onResponse(4, 1010);
+    TEST_ASSERT_EQUAL_UINT8(1, window->getInFlight());
+    window->onResponse(3, 1020);
+    TEST_ASSERT_EQUAL_UINT8(0, window->getInFlight());
+    TEST_ASSERT_EQUAL_UINT32(20, window->getSmoothedRtt());
+    TEST_ASSERT_TRUE(window->canSend(1020));
+}
+
+void test_window_grows_without_queue()
+{
+    uint32_t now = 1000;
+    for (int i = 0; i < 50; i++)
+    {
+        now = roundTrip(1, now, 20);
+    }
+    TEST_ASSERT_EQUAL_UINT8(TianBMSPollWindow::MAX_WINDOW, window->getWindow());
+    TEST_ASSERT_EQUAL_UINT32(20, window->getBaseRtt());
+    for (uint8_t id = 1; id <= TianBMSPollWindow::MAX_WINDOW; id++)
+    {
+        TEST_ASSERT_TRUE(window->canSend(now));
+        window->onSend(id, now);
+    }
+    TEST_ASSERT_FALSE(window->canSend(now));
+}
+
+void test_window_shrinks_with_queue_down_to_minimum()
+{
+    uint32_t now = roundTrip(1, 1000, 20);
+    TEST_ASSERT_EQUAL_UINT8(2, window->getWindow());
+    // every request waits behind others, round trip far above the base
+    for (int i = 0; i < 20; i++)
+    {
+        now = roundTrip(1, now, 400);
+    }
+    // the window stays open at MIN_WINDOW, a window truncated to 0 would stop the poll for good
+    TEST_ASSERT_EQUAL_UINT8(TianBMSPollWindow::MIN_WINDOW, window->getWindow());
+    TEST_ASSERT_TRUE(window->canSend(now));
+}
+
+void test_base_rtt_is_measured_again()
+{
+    uint32_t now = roundTrip(1, 1000, 20);
+    for (uint32_t i = 0; i < TianBMSPollWindow::BASE_RTT_SAMPLES * 2; i++)
+    {
+        now = roundTrip(1, now, 60);
+    }
+    TEST_ASSERT_EQUAL_UINT32(60, window->getBaseRtt());
+}
+
+void test_timeout_backs_off_once_per_round_trip()
+{
+    uint32_t now = roundTrip(1, 1000, 40);
+    TEST_ASSERT_EQUAL_UINT8(2, window->getWindow());
+    window->onSend(2, now);
+    window->onSend(3, now);
+    now += 2000;
+    window->onTimeout(2, now);
+    window->onTimeout(3, now + 1);
+    TEST_ASSERT_EQUAL_UINT8(1, window->getWindow());
+    TEST_ASSERT_EQUAL_UINT32(40, window->getGap());
+    TEST_ASSERT_EQUAL_UINT32(2, window->getTimeoutCount());
+    TEST_ASSERT_GREATER_THAN(0, window->getTimeoutRate());
+
+    window->onSend(4, now);
+    TEST_ASSERT_FALSE(window->canSend(now + 39));
+    window->onTimeout(4, now + 40);
+    TEST_ASSERT_TRUE(window->canSend(now + 40 + 80));
+    TEST_ASSERT_FALSE(window->canSend(now + 79));
+    TEST_ASSERT_EQUAL_UINT32(80, window->getGap());
+
+    for (int i = 0; i < 10; i++)
+    {
+        now += 1000;
+        window->onSend(5, now);
+        window->onTimeout(5, now + 1);
+    }
+    TEST_ASSERT_EQUAL_UINT32(TianBMSPollWindow::MAX_GAP, window->getGap());
+    TEST_ASSERT_EQUAL_UINT8(TianBMSPollWindow::MIN_WINDOW, window->getWindow());
+}
+
+void test_gap_is_cleared_after_success()
+{
+    uint32_t now = roundTrip(1, 1000, 40);
+    for (int i = 0; i < 10; i++)
+    {
+        now += 1000;
+        window->onSend(2, now);
+        window->onTimeout(2, now + 1);
+    }
+    TEST_ASSERT_EQUAL_UINT32(TianBMSPollWindow::MAX_GAP, window->getGap());
+    int responses = 0;
+    while (window->getGap() > 0 && responses < 100)
+    {
+        now = roundTrip(1, now + window->getGap(), 40);
+        responses++;
+    }
+    // the quarter decrease alone stalls at 3 ms
+    TEST_ASSERT_EQUAL_UINT32(0, window->getGap());
+    TEST_ASSERT_LESS_THAN(30, responses);
+}
+
+void test_lost_request_does_not_back_off()
+{
+    uint32_t now = roundTrip(1, 1000, 40);
+    window->onSend(2, now);
+    window->onLost(2, now + 2000);
+    TEST_ASSERT_FALSE(window->isInFlight(2));
+    TEST_ASSERT_EQUAL_UINT32(1, window->getTimeoutCount());
+    TEST_ASSERT_EQUAL_UINT8(2, window->getWindow());
+    TEST_ASSERT_EQUAL_UINT32(0, window->getGap());
+}
+
+void test_reset()
+{
+    uint32_t now = roundTrip(1, 1000, 40);
+    window->onSend(2, now);
+    window->onTimeout(2, now + 2000);
+    window->onSend(3, now + 2100);
+    window->reset();
+    TEST_ASSERT_FALSE(window->isInFlight(3));
+    TEST_ASSERT_EQUAL_UINT8(0, window->getInFlight());
+    TEST_ASSERT_EQUAL_UINT8(TianBMSPollWindow::MIN_WINDOW, window->getWindow());
+    TEST_ASSERT_EQUAL_UINT32(0, window->getGap());
+    TEST_ASSERT_EQUAL_UINT32(0, window->getSmoothedRtt());
+
+    // the first timeout after reset backs off, even within a round trip of the last decrease before reset (3040)
+    now = roundTrip(1, 3000, 40);
+    window->onSend(4, now);
+    window->onTimeout(4, now + 20);
+    TEST_ASSERT_EQUAL_UINT32(40, window->getGap());
+}
+
+/**
+ * Poll simulation on a gateway serving one request at a time in 1 ms step : response after latency to 1.5 latency,
+ * lost request answered by timeout after 2 s. The modbus client sends the next queued request interval after the end
+ * of the previous one (eModbus setTimeout() interval). Poll of every slave in turn either with one request every
+ * 500 ms (the fixed interval before the window) or through the window, for 10 simulated minutes
+ * 
+ * @return      number of sweep of every slave per minute
+*/
+static double simulate(uint8_t slaveCount, uint32_t latency, double loss, bool isAdaptive, uint32_t interval,
+    double& averageQueue)
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    window->reset();
+    std::deque<uint8_t> queue;
+    bool isBusy = false;
+    bool isLost = false;
+    uint8_t current = 0;
+    uint32_t doneAt = 0;
+    uint32_t idleUntil = 0;
+    uint32_t lastSend = 0;
+    uint8_t next = 1;
+    uint32_t polledCount = 0;
+    double queueSum = 0;
+    uint32_t queueSamples = 0;
+    const uint32_t duration = 600000;
+    for (uint32_t now = 1; now < duration; now++)
+    {
+        if (isBusy && now >= doneAt)
+        {
+            isBusy = false;
+            idleUntil = now + interval;
+            if (isLost)
+            {
+                window->onTimeout(current, now);
+            }
+            else
+            {
+                window->onResponse(current, now);
+            }
+            polledCount++;
+        }
+        if (!isBusy && !queue.empty() && now >= idleUntil)
+        {
+            current = queue.front();
+            queue.pop_front();
+            isBusy = true;
+            isLost = uniform(random) < loss;
+            doneAt = now + (isLost ? 2000 : latency + (uint32_t)(uniform(random) * latency / 2));
+        }
+        if (now % 10 != 0)
+        {
+            continue;
+        }
+        if (isAdaptive)
+        {
+            while (window->canSend(now) && !window->isInFlight(next))
+            {
+                queue.push_back(next);
+                window->onSend(next, now);
+                next = next % slaveCount + 1;
+            }
+        }
+        else if (now - lastSend >= 500)
+        {
+            queue.push_back(next);
+            next = next % slaveCount + 1;
+            lastSend = now;
+        }
+        queueSum += queue.size();
+        queueSamples++;
+    }
+    averageQueue = queueSum / queueSamples;
+    return polledCount / (double)slaveCount / (duration / 60000.0);
+}
+
+void test_measure_sweep_rate()
+{
+    const uint8_t slaveCounts[] = {16, 247};
+    const uint32_t latencies[] = {20, 80};
+    const double losses[] = {0, 0.05};
+    for (uint8_t slaveCount : slaveCounts)
+    {
+        for (uint32_t latency : latencies)
+        {
+            for (double loss : losses)
+            {
+                double fixedQueue = 0;
+                double averageQueue = 0;
+                double fixed = simulate(slaveCount, latency, loss, false, CLIENT_INTERVAL, fixedQueue);
+                double adaptive = simulate(slaveCount, latency, loss, true, CLIENT_INTERVAL, averageQueue);
+                TEST_ASSERT_GREATER_THAN(fixed, adaptive);
+                TEST_ASSERT_LESS_THAN(TianBMSPollWindow::MAX_WINDOW, averageQueue);
+                char message[128];
+                snprintf(message, sizeof(message), "%3u slave, %2u ms, %2.0f %% lost : fixed 500 ms %6.2f sweep/min, "
+                    "window %6.2f sweep/min, queue %.2f", slaveCount, latency, loss * 100, fixed, adaptive,
+                    averageQueue);
+                TEST_MESSAGE(message);
+            }
+        }
+    }
+}
+
+void test_measure_client_pacing()
+{
+    const uint8_t slaveCounts[] = {16, 247};
+    const uint32_t latencies[] = {20, 80};
+    for (uint8_t slaveCount : slaveCounts)
+    {
+        for (uint32_t latency : latencies)
+        {
+            double averageQueue = 0;
+            double old = simulate(slaveCount, latency, 0, true, OLD_CLIENT_INTERVAL, averageQueue);
+            double paced = simulate(slaveCount, latency, 0, true, CLIENT_INTERVAL, averageQueue);
+            double unpaced = simulate(slaveCount, latency, 0, true, 0, averageQueue);
+            // the client interval is paid once per request, with 200 ms it, not the bus, sets the sweep rate
+            TEST_ASSERT_TRUE(paced > old * 2);
+            TEST_ASSERT_TRUE(paced > unpaced * 0.85);
+            char message[128];
+            snprintf(message, sizeof(message), "%3u slave, %2u ms : interval %3u ms %6.2f sweep/min, %u ms %6.2f "
+                "sweep/min, 0 ms %6.2f sweep/min", slaveCount, latency, OLD_CLIENT_INTERVAL, old, CLIENT_INTERVAL,
+                paced, unpaced);
+            TEST_MESSAGE(message);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_one_request_per_slave);
+    RUN_TEST(test_window_grows_without_queue);
+    RUN_TEST(test_window_shrinks_with_queue_down_to_minimum);
+    RUN_TEST(test_base_rtt_is_measured_again);
+    RUN_TEST(test_timeout_backs_off_once_per_round_trip);
+    RUN_TEST(test_gap_is_cleared_after_success);
+    RUN_TEST(test_lost_request_does_not_back_off);
+    RUN_TEST(test_reset);
+    RUN_TEST(test_measure_sweep_rate);
+    RUN_TEST(test_measure_client_pacing);
+    return UNITY_END();
+}
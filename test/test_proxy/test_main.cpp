@@ -0,0 +1,280 @@
+#include <unity.h>
+#include <TianBMS.h>
+#include <TianBMSInflightTable.h>
+#include <TianBMSModbusMap.h>
+#include <TianBMSPollPlan.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const uint8_t READ_INPUT_REGISTER = 0x04;
+
+static TianBMSInflightTable* inflight;
+
+void setUp()
+{
+    inflight = new TianBMSInflightTable();
+}
+
+void tearDown()
+{
+    delete inflight;
+}
+
+void test_follower_gets_the_leader_response()
+{
+    TianBMSInflightTable::Key key = {3, READ_INPUT_REGISTER, 4096, 28};
+    bool isLeader = false;
+    int16_t leader = inflight->join(key, isLeader);
+    TEST_ASSERT_TRUE(isLeader);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, leader);
+
+    std::atomic<size_t> length(0);
+    std::vector<uint8_t> message(TianBMSInflightTable::MESSAGE_SIZE);
+    std::thread follower([&]()
+    {
+        bool isFollowerLeader = true;
+        int16_t entry = inflight->join(key, isFollowerLeader);
+        TEST_ASSERT_FALSE(isFollowerLeader);
+        TEST_ASSERT_EQUAL(leader, entry);
+        length.store(inflight->wait(entry, message.data(), message.size(), 2000));
+        inflight->leave(entry);
+    });
+    while (inflight->getCoalescedCount() == 0)
+    {
+        std::this_thread::yield();
+    }
+    const uint8_t response[5] = {3, READ_INPUT_REGISTER, 2, 0x14, 0xC9};
+    inflight->complete(leader, response, sizeof(response));
+    inflight->leave(leader);
+    follower.join();
+    TEST_ASSERT_EQUAL(sizeof(response), length.load());
+    TEST_ASSERT_EQUAL_MEMORY(response, message.data(), sizeof(response));
+
+    // entry is free once both left, the next identical request is forwarded again
+    TEST_ASSERT_EQUAL(leader, inflight->join(key, isLeader));
+    TEST_ASSERT_TRUE(isLeader);
+}
+
+void test_different_request_is_not_coalesced()
+{
+    const TianBMSInflightTable::Key keys[] = {
+        {3, READ_INPUT_REGISTER, 4096, 28}, {4, READ_INPUT_REGISTER, 4096, 28}, {3, 0x03, 4096, 28},
+        {3, READ_INPUT_REGISTER, 4097, 28}, {3, READ_INPUT_REGISTER, 4096, 27}
+    };
+    for (const TianBMSInflightTable::Key& key : keys)
+    {
+        bool isLeader = false;
+        TEST_ASSERT_GREATER_OR_EQUAL(0, inflight->join(key, isLeader));
+        TEST_ASSERT_TRUE(isLeader);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, inflight->getCoalescedCount());
+}
+
+void test_full_table_forwards_without_coalescing()
+{
+    bool isLeader = false;
+    for (size_t i = 0; i < TianBMSInflightTable::CAPACITY; i++)
+    {
+        TianBMSInflightTable::Key key = {(uint8_t)(i + 1), READ_INPUT_REGISTER, 4096, 28};
+        TEST_ASSERT_EQUAL(i, inflight->join(key, isLeader));
+    }
+    TianBMSInflightTable::Key key = {100, READ_INPUT_REGISTER, 4096, 28};
+    TEST_ASSERT_EQUAL(-1, inflight->join(key, isLeader));
+    TEST_ASSERT_TRUE(isLeader);
+    // calls with the entry of the full table are ignored
+    inflight->complete(-1, nullptr, 0);
+    TEST_ASSERT_EQUAL(0, inflight->wait(-1, nullptr, 0, 0));
+    inflight->leave(-1);
+}
+
+void test_failed_or_late_leader()
+{
+    TianBMSInflightTable::Key key = {3, READ_INPUT_REGISTER, 4096, 28};
+    bool isLeader = false;
+    int16_t leader = inflight->join(key, isLeader);
+    int16_t follower = inflight->join(key, isLeader);
+    uint8_t message[8];
+    TEST_ASSERT_EQUAL(0, inflight->wait(follower, message, sizeof(message), 20));
+
+    // no response from the gateway, the follower answers with an error too
+    inflight->complete(leader, nullptr, 0);
+    TEST_ASSERT_EQUAL(0, inflight->wait(follower, message, sizeof(message), 20));
+
+    // response longer than the follower buffer is not copied
+    const uint8_t response[12] = {3, READ_INPUT_REGISTER, 8};
+    inflight->complete(leader, response, sizeof(response));
+    TEST_ASSERT_EQUAL(0, inflight->wait(follower, message, sizeof(message), 20));
+}
+
+/**
+ * Gateway simulation, time scaled down 4 times from the setup of the measurement : the serial bus takes 10 ms per
+ * request and serves one at a time, 16 slaves, the collector polls one slave every 125 ms and 3 clients read the pack
+ * and cell voltage register (4096 - 4123) of each slave in turn every 37 ms, for 5 s
+*/
+class GatewaySimulation
+{
+public:
+    static const uint32_t BUS_TIME = 10;
+    static const uint32_t POLL_INTERVAL = 125;
+    static const uint32_t CLIENT_INTERVAL = 37;
+    static const uint32_t DURATION = 5000;
+    static const uint8_t SLAVE_COUNT = 16;
+    static const size_t CLIENT_COUNT = 3;
+    static const uint16_t CLIENT_ADDRESS = 4096;
+    static const uint16_t CLIENT_WORDS = 28;
+
+    std::atomic<uint32_t> busCount{0};
+    std::atomic<uint32_t> requestCount{0};
+    std::atomic<uint32_t> hitCount{0};
+
+    uint32_t getCoalescedCount() const
+    {
+        return _inflight.getCoalescedCount();
+    }
+
+    GatewaySimulation(bool isProxy, uint32_t ttl) : _isProxy(isProxy), _ttl(ttl), _modbusMap(_tianBMS) {}
+
+    void run()
+    {
+        _start = std::chrono::steady_clock::now();
+        std::atomic<bool> isRunning(true);
+        std::thread collector([&]()
+        {
+            uint8_t id = 1;
+            while (isRunning.load())
+            {
+                sendOnBus();
+                uint8_t payload[TianBMSPollPlan::MAX_BLOCK_SIZE * 2] = {0};
+                payload[1] = now() % 100;
+                const TianBMSRegister::Block& block = _pollPlan.getBlock(TianBMSPollPlan::FAST_BLOCK);
+                _tianBMS.updateFromPayload(id, _tianBMS.getToken(id, TianBMSUtils::REQUEST_DATA), payload,
+                    block.count * 2, now() | 1);
+                id = id % SLAVE_COUNT + 1;
+                std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL - BUS_TIME));
+            }
+        });
+        std::vector<std::thread> clients;
+        for (size_t i = 0; i < CLIENT_COUNT; i++)
+        {
+            clients.emplace_back([&]()
+            {
+                uint8_t id = 1;
+                while (isRunning.load())
+                {
+                    read(id);
+                    id = id % SLAVE_COUNT + 1;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(CLIENT_INTERVAL));
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(DURATION));
+        isRunning.store(false);
+        collector.join();
+        for (std::thread& thread : clients)
+        {
+            thread.join();
+        }
+    }
+
+private:
+    bool _isProxy;
+    uint32_t _ttl;
+    TianBMS _tianBMS;
+    TianBMSModbusMap _modbusMap;
+    TianBMSPollPlan _pollPlan;
+    TianBMSInflightTable _inflight;
+    std::mutex _bus;
+    std::chrono::steady_clock::time_point _start;
+
+    uint32_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _start).count();
+    }
+
+    void sendOnBus()
+    {
+        std::lock_guard<std::mutex> lock(_bus);
+        busCount++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(BUS_TIME));
+    }
+
+    /**
+     * Client read, same decision as proxyModbusRead() in main.cpp
+    */
+    void read(uint8_t id)
+    {
+        requestCount++;
+        if (!_isProxy)
+        {
+            sendOnBus();
+            return;
+        }
+        uint16_t registers[125];
+        uint32_t timestamp = _tianBMS.getDataTimestamp(id);
+        if (timestamp != 0 && now() - timestamp <= _ttl && _pollPlan.isFastRange(CLIENT_ADDRESS, CLIENT_WORDS) &&
+            _modbusMap.readNative(id, CLIENT_ADDRESS, CLIENT_WORDS, registers))
+        {
+            hitCount++;
+            return;
+        }
+        TianBMSInflightTable::Key key = {id, READ_INPUT_REGISTER, CLIENT_ADDRESS, CLIENT_WORDS};
+        bool isLeader = true;
+        int16_t entry = _inflight.join(key, isLeader);
+        if (!isLeader)
+        {
+            uint8_t message[TianBMSInflightTable::MESSAGE_SIZE];
+            _inflight.wait(entry, message, sizeof(message), 1000);
+            _inflight.leave(entry);
+            return;
+        }
+        sendOnBus();
+        uint8_t message[3 + 2 * CLIENT_WORDS] = {id, READ_INPUT_REGISTER, 2 * CLIENT_WORDS};
+        _inflight.complete(entry, message, sizeof(message));
+        _inflight.leave(entry);
+    }
+};
+
+void test_gateway_simulation()
+{
+    const uint32_t ttl = 5000 / 4;
+    const struct
+    {
+        bool isProxy;
+        uint32_t ttl;
+        const char* name;
+    } modes[] = {{false, 0, "direct"}, {true, ttl, "proxy, ttl 5 s"}, {true, ttl * 2, "proxy, ttl 10 s"}};
+    uint32_t busCount[3];
+    for (size_t mode = 0; mode < 3; mode++)
+    {
+        GatewaySimulation* simulation = new GatewaySimulation(modes[mode].isProxy, modes[mode].ttl);
+        simulation->run();
+        busCount[mode] = simulation->busCount.load();
+        char message[128];
+        snprintf(message, sizeof(message), "%-15s : %u client read, %u bus request, %u from the snapshot, %u coalesced",
+            modes[mode].name, simulation->requestCount.load(), busCount[mode], simulation->hitCount.load(),
+            simulation->getCoalescedCount());
+        TEST_MESSAGE(message);
+        if (modes[mode].isProxy)
+        {
+            TEST_ASSERT_GREATER_THAN(0, simulation->hitCount.load());
+        }
+        delete simulation;
+    }
+    // a longer ttl never sends more on the bus
+    TEST_ASSERT_LESS_THAN(busCount[0] / 2, busCount[1]);
+    TEST_ASSERT_LESS_OR_EQUAL(busCount[1], busCount[2]);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_follower_gets_the_leader_response);
+    RUN_TEST(test_different_request_is_not_coalesced);
+    RUN_TEST(test_full_table_forwards_without_coalescing);
+    RUN_TEST(test_failed_or_late_leader);
+    RUN_TEST(test_gateway_simulation);
+    return UNITY_END();
+}
@@ -0,0 +1,213 @@
+#include <unity.h>
+#include <TianBMS.h>
+#include <TianBMSJsonStream.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+ * Library side of the web socket push : the changes collected between two push, the fallback when they are lost and
+ * the size of the frame. The client list and its locking live in main.cpp on top of AsyncWebSocket and need the
+ * target to run
+*/
+
+static const size_t FRAME_SIZE = TianBMSJsonStream::RECORD_SIZE + 64;  // pushFrame in main.cpp
+static const uint32_t UPDATE_COUNT = 20000;
+
+static TianBMS* tianBMS;
+static std::array<uint8_t, TianBMSSlotTable::MAX_ID + 1> changed;
+
+void setUp()
+{
+    tianBMS = new TianBMS();
+    changed.fill(0);
+}
+
+void tearDown()
+{
+    delete tianBMS;
+}
+
+static void updateSlave(uint8_t id, uint16_t packVoltage)
+{
+    uint16_t registers[32] = {0};
+    registers[0] = packVoltage;
+    tianBMS->update(id, tianBMS->getToken(id, TianBMSUtils::REQUEST_DATA), registers, 32);
+}
+
+void test_changes_between_two_push()
+{
+    updateSlave(3, 5000);
+    updateSlave(7, 5000);
+    uint32_t pushVersion = tianBMS->getVersion();
+
+    updateSlave(7, 5001);
+    updateSlave(7, 5001);   // nothing changed, not pushed again
+    updateSlave(9, 5000);
+    uint32_t version = tianBMS->getVersion();
+    TEST_ASSERT_TRUE(tianBMS->getChanges(pushVersion, version, changed.data(), changed.size()));
+    TEST_ASSERT_EQUAL_HEX8(0, changed[3]);
+    TEST_ASSERT_EQUAL_HEX8(1 << TianBMSRegister::GROUP_ELECTRICAL, changed[7]);
+    TEST_ASSERT_EQUAL_HEX8(TianBMSChangeLog::GROUP_ALL, changed[9]);
+}
+
+void test_removed_slave_is_pushed()
+{
+    updateSlave(3, 5000);
+    uint32_t pushVersion = tianBMS->getVersion();
+    tianBMS->setMaxErrorCount(0);
+    tianBMS->updateOnError(tianBMS->getToken(3, TianBMSUtils::REQUEST_DATA));
+    tianBMS->cleanUp();
+    TEST_ASSERT_TRUE(tianBMS->getChanges(pushVersion, tianBMS->getVersion(), changed.data(), changed.size()));
+    TEST_ASSERT_TRUE((changed[3] & TianBMSChangeLog::GROUP_REMOVED) != 0);
+    TianBMSData record;
+    TEST_ASSERT_FALSE(tianBMS->getSnapshot(3, record));
+}
+
+void test_lost_changes_fall_back_to_every_slave()
+{
+    updateSlave(3, 5000);
+    uint32_t pushVersion = tianBMS->getVersion();
+    for (size_t i = 0; i <= TianBMSChangeLog::CAPACITY; i++)
+    {
+        updateSlave(4, 5000 + i);
+    }
+    TEST_ASSERT_FALSE(tianBMS->getChanges(pushVersion, tianBMS->getVersion(), changed.data(), changed.size()));
+
+    pushVersion = tianBMS->getVersion();
+    tianBMS->clearData();
+    TEST_ASSERT_FALSE(tianBMS->getChanges(pushVersion, tianBMS->getVersion(), changed.data(), changed.size()));
+}
+
+void test_largest_frame_fits()
+{
+    TianBMSData record;
+    record.id = TianBMSSlotTable::MAX_ID;
+    record.msgCount = UINT32_MAX;
+    record.packCurrent = INT16_MIN;
+    record.avgCellTemperature = INT16_MIN;
+    record.envTemperature = INT16_MIN;
+    record.warningFlag.value = 0xFFFF;
+    record.protectionFlag.value = 0xFFFF;
+    record.faultStatusFlag.value = 0xFFFF;
+    record.cellVoltage.fill(UINT16_MAX);
+    record.cellTemperature.fill(UINT16_MAX);
+    record.remainChgTime = UINT32_MAX;
+    record.remainDsgTime = UINT32_MAX;
+    // every character escaped as \u00XX
+    std::array<char, 33>* strings[3] = {&record.pcbBarcode, &record.snCode1, &record.snCode2};
+    for (std::array<char, 33>* value : strings)
+    {
+        value->fill(0x01);
+        value->back() = 0;
+    }
+    for (size_t i = 0; i < TianBMSRegister::FIELD_COUNT; i++)
+    {
+        const TianBMSRegister::Descriptor& field = TianBMSRegister::FIELDS[i];
+        if (field.type == TianBMSRegister::TYPE_UINT16)
+        {
+            *reinterpret_cast<uint16_t*>(reinterpret_cast<uint8_t*>(&record) + field.dataOffset) = UINT16_MAX;
+        }
+    }
+
+    std::vector<char> frame(FRAME_SIZE);
+    TianBMSJsonWriter writer(frame.data(), frame.size());
+    writer.append("{\"version\":");
+    writer.appendUInt(UINT32_MAX);
+    writer.append(",\"data\":");
+    TianBMSJsonStream::renderRecord(writer, record);
+    writer.append('}');
+    TEST_ASSERT_FALSE(writer.isOverflow());
+    char message[64];
+    snprintf(message, sizeof(message), "largest frame %zu of %zu bytes", writer.length(), FRAME_SIZE);
+    TEST_MESSAGE(message);
+}
+
+void test_no_change_is_missed_while_updating()
+{
+    // version -> slave changed at that version, written by the modbus side only
+    std::vector<uint8_t> changedAt(UPDATE_COUNT + 2, 0);
+    std::atomic<bool> isDone(false);
+    std::thread writer([&]()
+    {
+        for (uint32_t n = 1; n <= UPDATE_COUNT; n++)
+        {
+            uint8_t id = 1 + (n * 37) % 40;
+            updateSlave(id, n);
+            changedAt[tianBMS->getVersion()] = id;
+            if (n % 8 == 0)
+            {
+                std::this_thread::yield();  // responses are applied in batch of 8 (drain of the loop)
+            }
+        }
+        isDone.store(true);
+    });
+
+    struct Push
+    {
+        uint32_t since;
+        uint32_t until;
+        std::array<uint8_t, TianBMSSlotTable::MAX_ID + 1> changed;
+    };
+    std::vector<Push> pushes;
+    uint32_t pushVersion = 0;
+    uint32_t lostCount = 0;
+    while (!isDone.load() || pushVersion != tianBMS->getVersion())
+    {
+        uint32_t version = tianBMS->getVersion();
+        if (version == pushVersion)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        Push push;
+        push.since = pushVersion;
+        push.until = version;
+        push.changed.fill(0);
+        if (tianBMS->getChanges(pushVersion, version, push.changed.data(), push.changed.size()))
+        {
+            pushes.push_back(push);
+        }
+        else
+        {
+            lostCount++;
+        }
+        pushVersion = version;
+    }
+    writer.join();
+
+    uint32_t missed = 0;
+    uint32_t spurious = 0;
+    for (const Push& push : pushes)
+    {
+        std::array<uint8_t, TianBMSSlotTable::MAX_ID + 1> expected;
+        expected.fill(0);
+        for (uint32_t version = push.since + 1; version <= push.until; version++)
+        {
+            expected[changedAt[version]] = 1;
+        }
+        for (size_t id = TianBMSSlotTable::MIN_ID; id <= TianBMSSlotTable::MAX_ID; id++)
+        {
+            missed += expected[id] && push.changed[id] == 0;
+            spurious += !expected[id] && push.changed[id] != 0;
+        }
+    }
+    TEST_ASSERT_GREATER_THAN(0, pushes.size());
+    TEST_ASSERT_EQUAL_UINT32(0, missed);
+    TEST_ASSERT_EQUAL_UINT32(0, spurious);
+    char message[96];
+    snprintf(message, sizeof(message), "%u update, %zu push, %u fell back to every slave", UPDATE_COUNT, pushes.size(),
+        lostCount);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_changes_between_two_push);
+    RUN_TEST(test_removed_slave_is_pushed);
+    RUN_TEST(test_lost_changes_fall_back_to_every_slave);
+    RUN_TEST(test_largest_frame_fits);
+    RUN_TEST(test_no_change_is_missed_while_updating);
+    return UNITY_END();
+}
@@ -0,0 +1,238 @@
+#include <unity.h>
+#include <TianBMS.h>
+#include <TianBMSRegister.h>
+
+static const uint8_t ID = 3;
+static const uint16_t DATA_ADDRESS = 4096;
+static const size_t DATA_COUNT = 32;    // fast block
+
+static TianBMS* tianBMS;
+static uint16_t registers[64];
+static uint8_t payload[128];
+
+void setUp()
+{
+    tianBMS = new TianBMS();
+    memset(registers, 0, sizeof(registers));
+    memset(payload, 0, sizeof(payload));
+}
+
+void tearDown()
+{
+    delete tianBMS;
+}
+
+static void setRegister(uint16_t startAddress, uint16_t address, uint16_t value)
+{
+    registers[address - startAddress] = value;
+}
+
+/**
+ * Serialize the registers as modbus response payload, big endian
+*/
+static size_t toPayload(size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        payload[i * 2] = registers[i] >> 8;
+        payload[i * 2 + 1] = registers[i] & 0xFF;
+    }
+    return count * 2;
+}
+
+static void fillDataBlock()
+{
+    setRegister(DATA_ADDRESS, 4096, 5321);          // pack voltage, 53.21 V
+    setRegister(DATA_ADDRESS, 4097, (uint16_t)-1250); // pack current, -12.50 A
+    setRegister(DATA_ADDRESS, 4098, 87);
+    setRegister(DATA_ADDRESS, 4099, (uint16_t)-45); // average cell temperature, -4.5 C
+    setRegister(DATA_ADDRESS, 4101, 0x0801);        // warning, cell_ov_alm and low_capacity
+    setRegister(DATA_ADDRESS, 4102, 0x0010);        // protection, short_prot
+    setRegister(DATA_ADDRESS, 4103, 0x0C00);        // fault status, chg_mos and dchg_mos
+    setRegister(DATA_ADDRESS, 4104, 9550);
+    setRegister(DATA_ADDRESS, 4107, 321);
+    for (uint16_t cell = 0; cell < 16; cell++)
+    {
+        setRegister(DATA_ADDRESS, 4108 + cell, 3300 + cell);
+    }
+    setRegister(DATA_ADDRESS, 4124, 250);           // balance temperature, disabled field
+    setRegister(DATA_ADDRESS, 4125, 3315);
+    setRegister(DATA_ADDRESS, 4126, 3300);
+    setRegister(DATA_ADDRESS, 4127, 15);
+}
+
+void test_decode_fast_block_from_payload()
+{
+    fillDataBlock();
+    size_t size = toPayload(DATA_COUNT);
+    uint32_t token = tianBMS->getToken(ID, TianBMSUtils::REQUEST_DATA);
+    TEST_ASSERT_TRUE(tianBMS->updateFromPayload(ID, token, payload, size, 1000));
+
+    TianBMSData record;
+    TEST_ASSERT_TRUE(tianBMS->getSnapshot(ID, record));
+    TEST_ASSERT_EQUAL_UINT16(5321, record.packVoltage);
+    TEST_ASSERT_EQUAL_INT16(-1250, record.packCurrent);
+    TEST_ASSERT_EQUAL_UINT16(87, record.remainingCapacity);
+    TEST_ASSERT_EQUAL_INT16(-45, record.avgCellTemperature);
+    TEST_ASSERT_EQUAL_UINT16(1, record.warningFlag.bits.cell_ov_alarm);
+    TEST_ASSERT_EQUAL_UINT16(1, record.warningFlag.bits.low_capacity);
+    TEST_ASSERT_EQUAL_UINT16(1, record.protectionFlag.bits.short_prot);
+    TEST_ASSERT_EQUAL_UINT16(1, record.faultStatusFlag.bits.chg_mos);
+    TEST_ASSERT_EQUAL_UINT16(1, record.faultStatusFlag.bits.dchg_mos);
+    TEST_ASSERT_EQUAL_UINT16(9550, record.soc);
+    TEST_ASSERT_EQUAL_UINT16(321, record.cycleCount);
+    for (uint16_t cell = 0; cell < 16; cell++)
+    {
+        TEST_ASSERT_EQUAL_UINT16(3300 + cell, record.cellVoltage[cell]);
+    }
+    TEST_ASSERT_EQUAL_UINT16(3315, record.maxCellVoltage);
+    TEST_ASSERT_EQUAL_UINT16(3300, record.minCellVoltage);
+    TEST_ASSERT_EQUAL_UINT16(15, record.cellVoltageDiff);
+    // disabled field is never decoded, also when its register is inside the block
+    TEST_ASSERT_EQUAL_UINT16(0, record.balanceTemperature);
+    TEST_ASSERT_EQUAL_UINT32(1, record.msgCount);
+    TEST_ASSERT_EQUAL_UINT32(1000, tianBMS->getDataTimestamp(ID));
+}
+
+void test_payload_and_register_source_agree()
+{
+    fillDataBlock();
+    size_t size = toPayload(DATA_COUNT);
+    TianBMSData fromPayload;
+    TianBMSData fromRegister;
+    TianBMSPayloadSource payloadSource(payload, size / 2);
+    TianBMSRegisterSource registerSource(registers, DATA_COUNT);
+    size_t payloadCount = TianBMSRegister::decode(&fromPayload, DATA_ADDRESS, payloadSource, true);
+    size_t registerCount = TianBMSRegister::decode(&fromRegister, DATA_ADDRESS, registerSource, true);
+    TEST_ASSERT_EQUAL(registerCount, payloadCount);
+    TEST_ASSERT_GREATER_THAN(0, payloadCount);
+    for (size_t i = 0; i < TianBMSRegister::FIELD_COUNT; i++)
+    {
+        const TianBMSRegister::Descriptor& field = TianBMSRegister::FIELDS[i];
+        size_t elementCount = field.type == TianBMSRegister::TYPE_UINT16_ARRAY ? field.count : 1;
+        for (size_t element = 0; element < elementCount; element++)
+        {
+            TEST_ASSERT_EQUAL(TianBMSRegister::fieldValue(fromRegister, field, element),
+                TianBMSRegister::fieldValue(fromPayload, field, element));
+        }
+        TEST_ASSERT_EQUAL_STRING(TianBMSRegister::fieldString(fromRegister, field),
+            TianBMSRegister::fieldString(fromPayload, field));
+    }
+}
+
+void test_field_outside_block_keeps_its_value()
+{
+    fillDataBlock();
+    uint32_t token = tianBMS->getToken(ID, TianBMSUtils::REQUEST_DATA);
+    tianBMS->updateFromPayload(ID, token, payload, toPayload(DATA_COUNT), 1000);
+
+    // later block (max / min cell temperature, fet temperature) carried by the token offset
+    memset(registers, 0, sizeof(registers));
+    setRegister(4128, 4128, 301);
+    setRegister(4128, 4129, 280);
+    setRegister(4128, 4130, 355);
+    token = tianBMS->getToken(ID, TianBMSUtils::REQUEST_DATA, 4128 - DATA_ADDRESS, 1);
+    TEST_ASSERT_TRUE(tianBMS->updateFromPayload(ID, token, payload, toPayload(3), 2000));
+
+    TianBMSData record;
+    tianBMS->getSnapshot(ID, record);
+    TEST_ASSERT_EQUAL_UINT16(301, record.maxCellTemp);
+    TEST_ASSERT_EQUAL_UINT16(280, record.minCellTemp);
+    TEST_ASSERT_EQUAL_UINT16(355, record.fetTemp);
+    TEST_ASSERT_EQUAL_UINT16(5321, record.packVoltage);
+    // only the fast block refresh the data timestamp
+    TEST_ASSERT_EQUAL_UINT32(1000, tianBMS->getDataTimestamp(ID));
+}
+
+void test_decode_string_with_swap()
+{
+    const char* barcode = "PCB-0123456789AB";
+    for (size_t i = 0; i < 8; i++)
+    {
+        // little endian pack, the first character is in the low byte of the register
+        registers[i] = (uint8_t)barcode[i * 2] | ((uint8_t)barcode[i * 2 + 1] << 8);
+    }
+    uint32_t token = tianBMS->getToken(ID, TianBMSUtils::REQUEST_PCB_CODE);
+    TEST_ASSERT_TRUE(tianBMS->updateFromPayload(ID, token, payload, toPayload(16), 3000));
+    TEST_ASSERT_EQUAL_STRING(barcode, tianBMS->getPcbBarcode(ID).c_str());
+    TEST_ASSERT_EQUAL_UINT32(3000 | 0x01, tianBMS->getIdentityTimestamp(ID));
+    TEST_ASSERT_EQUAL_UINT32(0, tianBMS->getDataTimestamp(ID));
+
+    TianBMS bigEndian(TianBMSUtils::ENDIAN_BIG);
+    for (size_t i = 0; i < 8; i++)
+    {
+        registers[i] = ((uint8_t)barcode[i * 2] << 8) | (uint8_t)barcode[i * 2 + 1];
+    }
+    token = bigEndian.getToken(ID, TianBMSUtils::REQUEST_PCB_CODE);
+    TEST_ASSERT_TRUE(bigEndian.updateFromPayload(ID, token, payload, toPayload(16), 3000));
+    TEST_ASSERT_EQUAL_STRING(barcode, bigEndian.getPcbBarcode(ID).c_str());
+}
+
+void test_changed_group()
+{
+    fillDataBlock();
+    TianBMSData record;
+    TianBMSPayloadSource source(payload, toPayload(DATA_COUNT) / 2);
+    uint8_t changedGroups = 0;
+    TianBMSRegister::decode(&record, DATA_ADDRESS, source, true, &changedGroups);
+    uint8_t expected = (1 << TianBMSRegister::GROUP_ELECTRICAL) | (1 << TianBMSRegister::GROUP_CAPACITY) |
+        (1 << TianBMSRegister::GROUP_TEMPERATURE) | (1 << TianBMSRegister::GROUP_STATUS) |
+        (1 << TianBMSRegister::GROUP_CELL_VOLTAGE);
+    TEST_ASSERT_EQUAL_HEX8(expected, changedGroups);
+
+    // same registers again, nothing changed
+    changedGroups = 0;
+    TianBMSRegister::decode(&record, DATA_ADDRESS, source, true, &changedGroups);
+    TEST_ASSERT_EQUAL_HEX8(0, changedGroups);
+
+    payload[1]++;
+    TianBMSRegister::decode(&record, DATA_ADDRESS, source, true, &changedGroups);
+    TEST_ASSERT_EQUAL_HEX8(1 << TianBMSRegister::GROUP_ELECTRICAL, changedGroups);
+}
+
+void test_invalid_payload_is_ignored()
+{
+    fillDataBlock();
+    uint32_t token = tianBMS->getToken(ID, TianBMSUtils::REQUEST_DATA);
+    TEST_ASSERT_FALSE(tianBMS->updateFromPayload(ID, token, payload, 63, 1000));
+    TEST_ASSERT_FALSE(tianBMS->updateFromPayload(ID, token, nullptr, 64, 1000));
+    TEST_ASSERT_FALSE(tianBMS->updateFromPayload(0, token, payload, 64, 1000));
+    TianBMSData record;
+    TEST_ASSERT_TRUE(tianBMS->getSnapshot(ID, record));
+    TEST_ASSERT_EQUAL_UINT32(0, record.msgCount);
+    TEST_ASSERT_EQUAL_UINT16(0, record.packVoltage);
+}
+
+void test_scan_response()
+{
+    registers[0] = 5210;
+    uint32_t token = tianBMS->getToken(ID, TianBMSUtils::REQUEST_SCAN);
+    TEST_ASSERT_TRUE(tianBMS->updateFromPayload(ID, token, payload, toPayload(1), 0));
+    TEST_ASSERT_EQUAL_UINT16(5210, tianBMS->getPackVoltage(ID));
+    TEST_ASSERT_FALSE(tianBMS->updateFromPayload(ID, token, payload, toPayload(2), 0));
+}
+
+void test_token_round_trip()
+{
+    uint32_t token = tianBMS->getToken(247, TianBMSUtils::REQUEST_SN2_CODE, 200, 127, true);
+    TokenInfo info = tianBMS->parseToken(token);
+    TEST_ASSERT_EQUAL_UINT8(247, info.id);
+    TEST_ASSERT_EQUAL_UINT8(TianBMSUtils::REQUEST_SN2_CODE, info.requestType);
+    TEST_ASSERT_EQUAL_UINT8(200, info.offset);
+    TEST_ASSERT_EQUAL_UINT8(127, info.block);
+    TEST_ASSERT_TRUE(info.isContinued);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_decode_fast_block_from_payload);
+    RUN_TEST(test_payload_and_register_source_agree);
+    RUN_TEST(test_field_outside_block_keeps_its_value);
+    RUN_TEST(test_decode_string_with_swap);
+    RUN_TEST(test_changed_group);
+    RUN_TEST(test_invalid_payload_is_ignored);
+    RUN_TEST(test_scan_response);
+    RUN_TEST(test_token_round_trip);
+    return UNITY_END();
+}
@@ -0,0 +1,155 @@
+#include <unity.h>
+#include <TianBMS.h>
+#include <TianBMSResponseQueue.h>
+#include <atomic>
+#include <thread>
+
+static const uint32_t RESPONSE_COUNT = 100000;
+static const uint8_t ID = 9;
+static const size_t FAST_SIZE = 64;     // fast block, 32 register from 4096
+
+static TianBMS* tianBMS;
+static TianBMSResponseQueue* queue;
+
+void setUp()
+{
+    tianBMS = new TianBMS();
+    queue = new TianBMSResponseQueue();
+}
+
+void tearDown()
+{
+    delete queue;
+    delete tianBMS;
+}
+
+/**
+ * Enqueue the fast block of the slave, the pack voltage register carries the value
+*/
+static bool pushData(uint8_t id, uint16_t packVoltage, uint8_t block = 0, bool isContinued = false)
+{
+    TianBMSResponse* slot = queue->reserve();
+    if (slot == nullptr)
+    {
+        return false;
+    }
+    slot->token = tianBMS->getToken(id, TianBMSUtils::REQUEST_DATA, 0, block, isContinued);
+    slot->timestamp = millis();
+    slot->id = id;
+    slot->payloadSize = FAST_SIZE;
+    slot->payload.fill(0);
+    slot->payload[0] = packVoltage >> 8;
+    slot->payload[1] = packVoltage & 0xFF;
+    queue->commit();
+    return true;
+}
+
+void test_overflow_and_invalid_are_counted()
+{
+    for (size_t i = 0; i < TianBMSResponseQueue::CAPACITY; i++)
+    {
+        TEST_ASSERT_TRUE(pushData(ID, i));
+    }
+    TEST_ASSERT_FALSE(pushData(ID, 0));
+    TEST_ASSERT_FALSE(queue->pushError(tianBMS->getToken(ID, TianBMSUtils::REQUEST_DATA), 0xE0, 0));
+    queue->reject();
+    TEST_ASSERT_EQUAL_UINT32(TianBMSResponseQueue::CAPACITY, queue->getEnqueuedCount());
+    TEST_ASSERT_EQUAL_UINT32(2, queue->getOverflowCount());
+    TEST_ASSERT_EQUAL_UINT32(1, queue->getInvalidCount());
+    TEST_ASSERT_EQUAL_UINT32(3, queue->getDroppedCount());
+
+    TEST_ASSERT_EQUAL(TianBMSResponseQueue::CAPACITY, queue->drain(*tianBMS, 64));
+    TEST_ASSERT_EQUAL(0, queue->size());
+    TEST_ASSERT_EQUAL_UINT32(TianBMSResponseQueue::CAPACITY, queue->getAppliedCount());
+    TEST_ASSERT_EQUAL_UINT16(TianBMSResponseQueue::CAPACITY - 1, tianBMS->getPackVoltage(ID));
+}
+
+void test_error_is_applied_in_order()
+{
+    pushData(ID, 5000);
+    queue->pushError(tianBMS->getToken(ID, TianBMSUtils::REQUEST_DATA), 0xE0, 0);
+    TEST_ASSERT_EQUAL(2, queue->drain(*tianBMS, 8));
+    TianBMSData copy;
+    TEST_ASSERT_TRUE(tianBMS->getSnapshot(ID, copy));
+    TEST_ASSERT_EQUAL_UINT8(1, copy.errorCount);
+    TEST_ASSERT_EQUAL_UINT32(1, copy.msgCount);
+}
+
+void test_continued_block_is_merged()
+{
+    pushData(ID, 5100, 0, true);
+    // the next block of the poll is not queued yet, the first one is held
+    TEST_ASSERT_EQUAL(0, queue->drain(*tianBMS, 8));
+    pushData(ID, 5200, 1, false);
+    TEST_ASSERT_EQUAL(2, queue->drain(*tianBMS, 8));
+    TEST_ASSERT_EQUAL_UINT32(1, queue->getMergedCount());
+    TEST_ASSERT_EQUAL_UINT32(1, tianBMS->getVersion());
+}
+
+void test_continued_block_is_released_after_max_hold()
+{
+    delete queue;
+    queue = new TianBMSResponseQueue(0);
+    pushData(ID, 5100, 0, true);
+    TEST_ASSERT_EQUAL(1, queue->drain(*tianBMS, 8));
+    TEST_ASSERT_EQUAL_UINT32(0, queue->getMergedCount());
+}
+
+void test_producer_consumer_stress()
+{
+    std::atomic<bool> isDone(false);
+    std::atomic<uint32_t> overflowRetry(0);
+    std::thread producer([&]()
+    {
+        for (uint32_t n = 1; n <= RESPONSE_COUNT; n++)
+        {
+            while (!pushData(ID, (uint16_t)n))
+            {
+                overflowRetry++;
+                std::this_thread::yield();
+            }
+        }
+        isDone.store(true);
+    });
+
+    uint32_t applied = 0;
+    uint32_t backwardCount = 0;
+    uint16_t last = 0;
+    while (!isDone.load() || queue->size() > 0)
+    {
+        size_t count = queue->drain(*tianBMS, 8);
+        if (count == 0)
+        {
+            std::this_thread::yield();
+        }
+        applied += count;
+        uint16_t packVoltage = tianBMS->getPackVoltage(ID);
+        backwardCount += (uint16_t)(packVoltage - last) > 0x8000;
+        last = packVoltage;
+    }
+    producer.join();
+
+    TianBMSData copy;
+    TEST_ASSERT_TRUE(tianBMS->getSnapshot(ID, copy));
+    TEST_ASSERT_EQUAL_UINT32(RESPONSE_COUNT, applied);
+    TEST_ASSERT_EQUAL_UINT32(RESPONSE_COUNT, copy.msgCount);
+    TEST_ASSERT_EQUAL_UINT16((uint16_t)RESPONSE_COUNT, copy.packVoltage);
+    TEST_ASSERT_EQUAL_UINT32(0, backwardCount);
+    TEST_ASSERT_EQUAL_UINT32(RESPONSE_COUNT, queue->getEnqueuedCount());
+    TEST_ASSERT_EQUAL_UINT32(queue->getEnqueuedCount(), queue->getAppliedCount());
+    TEST_ASSERT_EQUAL_UINT32(overflowRetry.load(), queue->getOverflowCount());
+    char message[96];
+    snprintf(message, sizeof(message), "%u response, %u overflow retried", RESPONSE_COUNT, overflowRetry.load());
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_overflow_and_invalid_are_counted);
+    RUN_TEST(test_error_is_applied_in_order);
+    RUN_TEST(test_continued_block_is_merged);
+    RUN_TEST(test_continued_block_is_released_after_max_hold);
+    RUN_TEST(test_producer_consumer_stress);
+    return UNITY_END();
+}
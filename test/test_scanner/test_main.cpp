@@ -0,0 +1,176 @@
+#include <unity.h>
+#include <TianBMSScanner.h>
+#include <deque>
+
+static const uint32_t CLIENT_INTERVAL = 2;     // POLL_INTERVAL in main.cpp
+static const uint32_t OLD_CLIENT_INTERVAL = 200;
+static const uint32_t SCAN_TIMEOUT = 300;      // SCAN_TIMEOUT in main.cpp
+static const uint8_t SCAN_PARALLEL = 2;        // SCAN_PARALLEL in main.cpp
+static const uint32_t PRESENT_LATENCY = 20;
+static const uint8_t PRESENT_COUNT = 16;
+
+static TianBMSScanner* scanner;
+static uint8_t addresses[TianBMSSlotTable::MAX_ID];
+
+void setUp()
+{
+    scanner = new TianBMSScanner();
+    for (uint8_t i = 0; i < TianBMSSlotTable::MAX_ID; i++)
+    {
+        addresses[i] = TianBMSSlotTable::MIN_ID + i;
+    }
+}
+
+void tearDown()
+{
+    delete scanner;
+}
+
+void test_every_address_is_settled()
+{
+    scanner->begin(addresses, 4, 2, 1000);
+    TEST_ASSERT_EQUAL(1, scanner->nextProbe());
+    // one probe in flight until the first answer
+    TEST_ASSERT_EQUAL(-1, scanner->nextProbe());
+    scanner->onResponse(1, 1020);
+    TEST_ASSERT_EQUAL(2, scanner->nextProbe());
+    TEST_ASSERT_EQUAL(3, scanner->nextProbe());
+    scanner->onAbsent(2, 1100);
+    scanner->onTimeout(3, 1300);
+    TEST_ASSERT_EQUAL(4, scanner->nextProbe());
+    scanner->onAbsent(4, 1400);
+    TEST_ASSERT_FALSE(scanner->isFinished());
+
+    // the ambiguous address is probed again after the first pass, then taken as absent
+    TEST_ASSERT_EQUAL(3, scanner->nextProbe());
+    TEST_ASSERT_EQUAL(-1, scanner->nextProbe());
+    scanner->onTimeout(3, 1700);
+    TEST_ASSERT_TRUE(scanner->isFinished());
+    TEST_ASSERT_TRUE(scanner->isPresent(1));
+    TEST_ASSERT_FALSE(scanner->isPresent(3));
+    TEST_ASSERT_EQUAL(1, scanner->getPresentCount());
+    TEST_ASSERT_EQUAL_UINT32(5, scanner->getProbeCount());
+    TEST_ASSERT_EQUAL_UINT32(1, scanner->getRetryCount());
+    TEST_ASSERT_EQUAL_UINT32(700, scanner->getDuration());
+}
+
+void test_timeout_halves_the_probe_in_flight()
+{
+    scanner->begin(addresses, 8, 4, 0);
+    for (uint8_t id = 1; id <= 3; id++)
+    {
+        TEST_ASSERT_EQUAL(id, scanner->nextProbe());
+        scanner->onResponse(id, id * 10);
+    }
+    TEST_ASSERT_EQUAL(4, scanner->nextProbe());
+    TEST_ASSERT_EQUAL(5, scanner->nextProbe());
+    TEST_ASSERT_EQUAL(6, scanner->nextProbe());
+    TEST_ASSERT_EQUAL(7, scanner->nextProbe());
+    TEST_ASSERT_EQUAL(-1, scanner->nextProbe());
+    scanner->onTimeout(4, 400);
+    scanner->onTimeout(5, 400);
+    scanner->onTimeout(6, 400);
+    // window 4 -> 2 -> 1, address 7 still in flight
+    TEST_ASSERT_EQUAL(-1, scanner->nextProbe());
+    scanner->onResponse(7, 410);
+    TEST_ASSERT_EQUAL(8, scanner->nextProbe());
+    TEST_ASSERT_EQUAL(-1, scanner->nextProbe());
+}
+
+/**
+ * Scan simulation of address 1 to 247 in 1 ms step, PRESENT_COUNT slave present from address 1. The gateway serves
+ * one request at a time : present slave answers after PRESENT_LATENCY, a missing one holds the bus for gatewayTimeout
+ * then the gateway replies "target failed to respond", or stays silent until the client times out after SCAN_TIMEOUT
+ * when isSilent. The modbus client sends the next queued probe interval after the end of the previous one (eModbus
+ * setTimeout() interval), the poll task queues probe every 10 ms as nextProbe() allows
+ *
+ * @return      scan duration in ms
+*/
+static uint32_t simulate(uint32_t gatewayTimeout, bool isSilent, uint32_t interval)
+{
+    scanner->begin(addresses, TianBMSSlotTable::MAX_ID, SCAN_PARALLEL, 0);
+    std::deque<uint8_t> queue;
+    bool isBusy = false;
+    uint8_t current = 0;
+    uint32_t doneAt = 0;
+    uint32_t idleUntil = 0;
+    uint32_t now = 0;
+    while (!scanner->isFinished())
+    {
+        now++;
+        if (isBusy && now >= doneAt)
+        {
+            isBusy = false;
+            idleUntil = now + interval;
+            if (current <= PRESENT_COUNT)
+            {
+                scanner->onResponse(current, now);
+            }
+            else if (isSilent)
+            {
+                scanner->onTimeout(current, now);
+            }
+            else
+            {
+                scanner->onAbsent(current, now);
+            }
+        }
+        if (!isBusy && !queue.empty() && now >= idleUntil)
+        {
+            current = queue.front();
+            queue.pop_front();
+            isBusy = true;
+            doneAt = now + (current <= PRESENT_COUNT ? PRESENT_LATENCY : isSilent ? SCAN_TIMEOUT : gatewayTimeout);
+        }
+        if (now % 10 == 0)
+        {
+            int16_t id;
+            while ((id = scanner->nextProbe()) >= 0)
+            {
+                queue.push_back(id);
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL(PRESENT_COUNT, scanner->getPresentCount());
+    return scanner->getDuration();
+}
+
+void test_measure_scan_time()
+{
+    const uint32_t gatewayTimeouts[] = {100, 250};
+    for (uint32_t gatewayTimeout : gatewayTimeouts)
+    {
+        uint32_t old = simulate(gatewayTimeout, false, OLD_CLIENT_INTERVAL);
+        uint32_t paced = simulate(gatewayTimeout, false, CLIENT_INTERVAL);
+        uint32_t unpaced = simulate(gatewayTimeout, false, 0);
+        // 247 * 200 ms of client rest alone is 49 s, nearly all of it is saved
+        uint32_t probeCount = scanner->getProbeCount();
+        TEST_ASSERT_GREATER_THAN(49400, old);
+        TEST_ASSERT_GREATER_THAN(probeCount * (OLD_CLIENT_INTERVAL - CLIENT_INTERVAL) * 9 / 10, old - paced);
+        TEST_ASSERT_LESS_THAN(unpaced + unpaced / 20, paced);
+        char message[128];
+        snprintf(message, sizeof(message), "gateway replies after %u ms : interval %u ms %6.1f s, %u ms %6.1f s, "
+            "0 ms %6.1f s, %u probe", gatewayTimeout, OLD_CLIENT_INTERVAL, old / 1000.0, CLIENT_INTERVAL,
+            paced / 1000.0, unpaced / 1000.0, probeCount);
+        TEST_MESSAGE(message);
+    }
+    uint32_t old = simulate(0, true, OLD_CLIENT_INTERVAL);
+    uint32_t paced = simulate(0, true, CLIENT_INTERVAL);
+    uint32_t unpaced = simulate(0, true, 0);
+    uint32_t probeCount = scanner->getProbeCount();
+    TEST_ASSERT_GREATER_THAN(probeCount * (OLD_CLIENT_INTERVAL - CLIENT_INTERVAL) * 9 / 10, old - paced);
+    char message[128];
+    snprintf(message, sizeof(message), "gateway silent, %u ms timeout : interval %u ms %6.1f s, %u ms %6.1f s, "
+        "0 ms %6.1f s, %u probe", SCAN_TIMEOUT, OLD_CLIENT_INTERVAL, old / 1000.0, CLIENT_INTERVAL, paced / 1000.0,
+        unpaced / 1000.0, probeCount);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_every_address_is_settled);
+    RUN_TEST(test_timeout_halves_the_probe_in_flight);
+    RUN_TEST(test_measure_scan_time);
+    return UNITY_END();
+}
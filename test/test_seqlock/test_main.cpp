@@ -0,0 +1,179 @@
+#include <unity.h>
+#include <TianBMS.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static const uint32_t WRITE_COUNT = 200000;
+static const size_t READER_COUNT = 3;
+static const uint8_t ID = 42;
+static const double MIN_READ_RATE = 100000;    // read/s of every reader together, while the writer never stops
+
+static TianBMSSlotTable* table;
+
+void setUp()
+{
+    table = new TianBMSSlotTable();
+}
+
+void tearDown()
+{
+    delete table;
+}
+
+/**
+ * Every field of the record written from the same counter, a copy mixing two writes has fields that disagree
+*/
+static void fill(TianBMSData& record, uint32_t n)
+{
+    record.msgCount = n;
+    record.packVoltage = (uint16_t)n;
+    record.soc = (uint16_t)(n >> 1);
+    record.cellVoltage.fill((uint16_t)n);
+    record.cellTemperature.fill((uint16_t)(n + 1));
+    record.remainChgTime = n * 3;
+    snprintf(record.pcbBarcode.data(), record.pcbBarcode.size(), "PCB%010u", n);
+}
+
+static bool isConsistent(const TianBMSData& record)
+{
+    uint32_t n = record.msgCount;
+    char barcode[33];
+    snprintf(barcode, sizeof(barcode), "PCB%010u", n);
+    bool isCellConsistent = true;
+    for (size_t i = 0; i < record.cellVoltage.size(); i++)
+    {
+        isCellConsistent = isCellConsistent && record.cellVoltage[i] == (uint16_t)n;
+    }
+    for (size_t i = 0; i < record.cellTemperature.size(); i++)
+    {
+        isCellConsistent = isCellConsistent && record.cellTemperature[i] == (uint16_t)(n + 1);
+    }
+    return isCellConsistent && record.packVoltage == (uint16_t)n && record.soc == (uint16_t)(n >> 1) &&
+        record.remainChgTime == n * 3 && strcmp(record.pcbBarcode.data(), barcode) == 0;
+}
+
+void test_reader_never_sees_torn_record()
+{
+    TianBMSData* record = table->beginWrite(ID);
+    fill(*record, 0);
+    table->endWrite(ID);
+
+    std::atomic<bool> isDone(false);
+    std::atomic<uint32_t> tornCount(0);
+    std::atomic<uint32_t> readCount(0);
+    std::atomic<uint32_t> backwardCount(0);
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < READER_COUNT; i++)
+    {
+        readers.emplace_back([&]()
+        {
+            TianBMSData copy;
+            uint32_t lastVersion = 0;
+            while (!isDone.load())
+            {
+                uint32_t version = 0;
+                if (!table->read(ID, copy, &version))
+                {
+                    // starved, the writer is preempted in its write section. A caller skips the slave for this
+                    // read, here the reader lets the writer run and reads again
+                    std::this_thread::yield();
+                    continue;
+                }
+                tornCount += !isConsistent(copy) || (version & 0x01) != 0;
+                backwardCount += version < lastVersion;
+                lastVersion = version;
+                readCount++;
+            }
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 1; n <= WRITE_COUNT; n++)
+    {
+        record = table->beginWrite(ID);
+        fill(*record, n);
+        table->endWrite(ID);
+    }
+    isDone.store(true);
+    for (std::thread& reader : readers)
+    {
+        reader.join();
+    }
+    double readRate = readCount.load() / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    TianBMSData copy;
+    uint32_t version = 0;
+    TEST_ASSERT_TRUE(table->read(ID, copy, &version));
+    TEST_ASSERT_EQUAL_UINT32(WRITE_COUNT, copy.msgCount);
+    TEST_ASSERT_EQUAL_UINT32((WRITE_COUNT + 1) * 2, version);
+    TEST_ASSERT_EQUAL_UINT32(0, tornCount.load());
+    TEST_ASSERT_EQUAL_UINT32(0, backwardCount.load());
+    char message[128];
+    snprintf(message, sizeof(message), "%u write, %u read, %.0f read/s, %u retry, %u starved", WRITE_COUNT,
+        readCount.load(), readRate, table->getReadRetryCount(), table->getReadStarvedCount());
+    TEST_MESSAGE(message);
+    TEST_ASSERT_GREATER_OR_EQUAL(MIN_READ_RATE, readRate);
+}
+
+void test_reader_of_slot_in_write_gives_up()
+{
+    TianBMSData* record = table->beginWrite(ID);
+    fill(*record, 1);
+    table->endWrite(ID);
+
+    // writer preempted in its write section, as by a reader of higher priority on the same core
+    record = table->beginWrite(ID);
+    TianBMSData copy;
+    auto start = std::chrono::steady_clock::now();
+    TEST_ASSERT_FALSE(table->read(ID, copy));
+    double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    TEST_ASSERT_EQUAL_UINT32(TianBMSSlotTable::MAX_READ_ATTEMPT, table->getReadRetryCount());
+    TEST_ASSERT_EQUAL_UINT32(1, table->getReadStarvedCount());
+    // bounded by the attempts, the reader never sleeps
+    TEST_ASSERT_LESS_THAN(1000, elapsed);
+
+    // once the writer runs again the next read succeeds
+    fill(*record, 2);
+    table->endWrite(ID);
+    TEST_ASSERT_TRUE(table->read(ID, copy));
+    TEST_ASSERT_EQUAL_UINT32(2, copy.msgCount);
+    TEST_ASSERT_EQUAL_UINT32(1, table->getReadStarvedCount());
+}
+
+void test_reader_of_erased_slave_gives_up()
+{
+    TianBMSData* record = table->beginWrite(ID);
+    fill(*record, 1);
+    table->endWrite(ID);
+    table->erase(ID);
+
+    TianBMSData copy;
+    TEST_ASSERT_FALSE(table->read(ID, copy));
+}
+
+void test_snapshot_through_tianbms()
+{
+    TianBMS tianBMS;
+    TianBMSData copy;
+    TEST_ASSERT_FALSE(tianBMS.getSnapshot(ID, copy));
+
+    TianBMSData* record = tianBMS.getTianBMSData().beginWrite(ID);
+    fill(*record, 7);
+    tianBMS.getTianBMSData().endWrite(ID);
+    uint32_t version = 0;
+    TEST_ASSERT_TRUE(tianBMS.getSnapshot(ID, copy, &version));
+    TEST_ASSERT_TRUE(isConsistent(copy));
+    TEST_ASSERT_EQUAL_UINT32(7, copy.msgCount);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_reader_never_sees_torn_record);
+    RUN_TEST(test_reader_of_slot_in_write_gives_up);
+    RUN_TEST(test_reader_of_erased_slave_gives_up);
+    RUN_TEST(test_snapshot_through_tianbms);
+    return UNITY_END();
+}
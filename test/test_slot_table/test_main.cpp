@@ -0,0 +1,249 @@
+#include <unity.h>
+#include <TianBMS.h>
+#include <chrono>
+#include <map>
+
+static TianBMSSlotTable* table;
+
+void setUp()
+{
+    table = new TianBMSSlotTable();
+}
+
+void tearDown()
+{
+    delete table;
+}
+
+static void insert(uint8_t id, uint16_t packVoltage)
+{
+    TianBMSData* record = table->beginWrite(id);
+    TEST_ASSERT_NOT_NULL(record);
+    record->packVoltage = packVoltage;
+    table->endWrite(id);
+}
+
+void test_empty_table()
+{
+    TEST_ASSERT_TRUE(table->empty());
+    TEST_ASSERT_EQUAL(0, table->size());
+    TEST_ASSERT_EQUAL(0, table->next(0));
+    TEST_ASSERT_TRUE(table->begin() == table->end());
+    TEST_ASSERT_NULL(table->find(1));
+}
+
+void test_id_out_of_range()
+{
+    TEST_ASSERT_NULL(table->beginWrite(0));
+    TEST_ASSERT_NULL(table->beginWrite(TianBMSSlotTable::MAX_ID + 1));
+    TEST_ASSERT_FALSE(table->contains(0));
+    TEST_ASSERT_FALSE(table->contains(255));
+    TEST_ASSERT_TRUE(table->empty());
+}
+
+void test_insert_and_find()
+{
+    insert(TianBMSSlotTable::MIN_ID, 5200);
+    insert(TianBMSSlotTable::MAX_ID, 5300);
+    TEST_ASSERT_EQUAL(2, table->size());
+    TEST_ASSERT_TRUE(table->contains(TianBMSSlotTable::MIN_ID));
+    TEST_ASSERT_TRUE(table->contains(TianBMSSlotTable::MAX_ID));
+    TEST_ASSERT_EQUAL(5300, table->find(TianBMSSlotTable::MAX_ID)->packVoltage);
+    TEST_ASSERT_EQUAL(TianBMSSlotTable::MAX_ID, table->find(TianBMSSlotTable::MAX_ID)->id);
+
+    // writing a present slave keeps its record
+    insert(TianBMSSlotTable::MIN_ID, 5210);
+    TEST_ASSERT_EQUAL(2, table->size());
+    TEST_ASSERT_EQUAL(5210, table->find(TianBMSSlotTable::MIN_ID)->packVoltage);
+}
+
+void test_iterate_in_id_order()
+{
+    const uint8_t ids[] = {200, 3, 31, 32, 64, 247};
+    for (uint8_t id : ids)
+    {
+        insert(id, id);
+    }
+    const uint8_t expected[] = {3, 31, 32, 64, 200, 247};
+    size_t index = 0;
+    for (TianBMSData& record : *table)
+    {
+        TEST_ASSERT_EQUAL(expected[index], record.id);
+        index++;
+    }
+    TEST_ASSERT_EQUAL(6, index);
+
+    index = 0;
+    for (uint8_t id = table->next(0); id != 0; id = table->next(id))
+    {
+        TEST_ASSERT_EQUAL(expected[index], id);
+        index++;
+    }
+    TEST_ASSERT_EQUAL(6, index);
+}
+
+void test_erase_keeps_iterator_valid()
+{
+    insert(10, 1);
+    insert(20, 2);
+    insert(30, 3);
+    TianBMSSlotTable::iterator it = table->begin();
+    TEST_ASSERT_EQUAL(10, it->id);
+    TEST_ASSERT_TRUE(table->erase(20));
+    TEST_ASSERT_FALSE(table->erase(20));
+    TEST_ASSERT_EQUAL(10, it->id);
+    ++it;
+    TEST_ASSERT_EQUAL(30, it->id);
+    ++it;
+    TEST_ASSERT_TRUE(it == table->end());
+    TEST_ASSERT_EQUAL(2, table->size());
+}
+
+void test_insert_after_erase_starts_clean()
+{
+    insert(5, 5200);
+    table->find(5)->cycleCount = 12;
+    table->erase(5);
+    TEST_ASSERT_NULL(table->find(5));
+
+    TianBMSData* record = table->beginWrite(5);
+    TEST_ASSERT_EQUAL(0, record->cycleCount);
+    TEST_ASSERT_EQUAL(5, record->id);
+    table->endWrite(5);
+}
+
+void test_clear()
+{
+    for (uint8_t id = TianBMSSlotTable::MIN_ID; id <= TianBMSSlotTable::MAX_ID; id++)
+    {
+        insert(id, id);
+    }
+    TEST_ASSERT_EQUAL(TianBMSSlotTable::MAX_ID, table->size());
+    table->clear();
+    TEST_ASSERT_TRUE(table->empty());
+    TEST_ASSERT_EQUAL(0, table->next(0));
+}
+
+void test_read_version()
+{
+    TianBMSData copy;
+    uint32_t version = 0;
+    TEST_ASSERT_FALSE(table->read(7, copy, &version));
+
+    insert(7, 5100);
+    TEST_ASSERT_TRUE(table->read(7, copy, &version));
+    TEST_ASSERT_EQUAL(5100, copy.packVoltage);
+    uint32_t first = version;
+    TEST_ASSERT_EQUAL(0, first & 0x01);
+
+    // version is never reset, also when the slave is removed and found again
+    table->erase(7);
+    insert(7, 5101);
+    TEST_ASSERT_TRUE(table->read(7, copy, &version));
+    TEST_ASSERT_EQUAL(first + 2, version);
+    TEST_ASSERT_EQUAL(0, table->getReadRetryCount());
+}
+
+static size_t mapHeapSize = 0;
+
+/**
+ * Allocator of the std::map the slot table replaced, counts the heap it holds in mapHeapSize. The map rebinds it to
+ * its node type, so the count includes the node overhead
+*/
+template <typename T>
+struct CountingAllocator
+{
+    using value_type = T;
+
+    CountingAllocator() = default;
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>&) {}
+    T* allocate(size_t count)
+    {
+        mapHeapSize += count * sizeof(T);
+        return static_cast<T*>(::operator new(count * sizeof(T)));
+    }
+    void deallocate(T* pointer, size_t count)
+    {
+        mapHeapSize -= count * sizeof(T);
+        ::operator delete(pointer);
+    }
+    template <typename U>
+    bool operator==(const CountingAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const CountingAllocator<U>&) const { return false; }
+};
+
+using DataMap = std::map<uint8_t, TianBMSData, std::less<uint8_t>,
+    CountingAllocator<std::pair<const uint8_t, TianBMSData>>>;
+
+/**
+ * Lookup order of the benchmark, every present id in a scattered order as the web server and the modbus server ask
+*/
+static std::vector<uint8_t> lookupOrder(size_t slaveCount)
+{
+    std::vector<uint8_t> order;
+    for (size_t i = 0; i < slaveCount; i++)
+    {
+        order.push_back(TianBMSSlotTable::MIN_ID + (i * 97) % slaveCount);
+    }
+    return order;
+}
+
+void test_measure_against_map()
+{
+    const size_t slaveCounts[] = {16, 64, TianBMSSlotTable::MAX_ID};
+    const int rounds = 2000000;
+    for (size_t slaveCount : slaveCounts)
+    {
+        table->clear();
+        DataMap map;
+        for (uint8_t id = TianBMSSlotTable::MIN_ID; id < TianBMSSlotTable::MIN_ID + slaveCount; id++)
+        {
+            insert(id, 5000 + id);
+            map[id].packVoltage = 5000 + id;
+        }
+        std::vector<uint8_t> order = lookupOrder(slaveCount);
+
+        uint32_t mapSum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++)
+        {
+            DataMap::iterator it = map.find(order[i % slaveCount]);
+            mapSum += it->second.packVoltage;
+        }
+        double mapRate = rounds / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint32_t tableSum = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++)
+        {
+            tableSum += table->find(order[i % slaveCount])->packVoltage;
+        }
+        double tableRate = rounds / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        TEST_ASSERT_EQUAL_UINT32(mapSum, tableSum);
+
+        // the slot table is allocated once for every id, the map allocate one node per slave
+        char message[128];
+        snprintf(message, sizeof(message), "%3zu slave : map %6.1f M lookup/s %6zu B heap, slot table %6.1f M lookup/s "
+            "%6zu B fixed", slaveCount, mapRate / 1e6, mapHeapSize, tableRate / 1e6,
+            sizeof(TianBMSSlotTable));
+        TEST_MESSAGE(message);
+    }
+    TEST_ASSERT_EQUAL(0, mapHeapSize);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_table);
+    RUN_TEST(test_id_out_of_range);
+    RUN_TEST(test_insert_and_find);
+    RUN_TEST(test_iterate_in_id_order);
+    RUN_TEST(test_erase_keeps_iterator_valid);
+    RUN_TEST(test_insert_after_erase_starts_clean);
+    RUN_TEST(test_clear);
+    RUN_TEST(test_read_version);
+    RUN_TEST(test_measure_against_map);
+    return UNITY_END();
+}
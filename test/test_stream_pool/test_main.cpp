@@ -0,0 +1,146 @@
+#include <unity.h>
+#include <TianBMS.h>
+#include <TianBMSJsonStream.h>
+#include <string>
+#include <vector>
+
+static TianBMS* tianBMS;
+static TianBMSJsonStreamPool* pool;
+
+void setUp()
+{
+    tianBMS = new TianBMS();
+    pool = new TianBMSJsonStreamPool();
+    for (uint8_t id = 1; id <= 30; id++)
+    {
+        uint16_t registers[32] = {0};
+        registers[0] = 5000 + id;
+        tianBMS->update(id, tianBMS->getToken(id, TianBMSUtils::REQUEST_DATA), registers, 32);
+    }
+}
+
+void tearDown()
+{
+    delete pool;
+    delete tianBMS;
+}
+
+static std::string readAll(TianBMSJsonStream* stream)
+{
+    std::string document;
+    uint8_t buffer[1436];
+    size_t length;
+    while ((length = stream->read(buffer, sizeof(buffer))) > 0)
+    {
+        document.append(reinterpret_cast<const char*>(buffer), length);
+    }
+    return document;
+}
+
+void test_acquire_until_exhausted()
+{
+    std::vector<TianBMSJsonStreamHandle> handles;
+    for (size_t i = 0; i < TianBMSJsonStreamPool::CAPACITY; i++)
+    {
+        handles.push_back(pool->acquire());
+        TEST_ASSERT_TRUE(handles.back().isValid());
+    }
+    TEST_ASSERT_EQUAL(0, pool->available());
+    TianBMSJsonStreamHandle extra = pool->acquire();
+    TEST_ASSERT_FALSE(extra.isValid());
+    TEST_ASSERT_NULL(extra.get());
+    TEST_ASSERT_EQUAL_UINT32(1, pool->getExhaustedCount());
+
+    handles.pop_back();
+    TEST_ASSERT_EQUAL(1, pool->available());
+    TEST_ASSERT_TRUE(pool->acquire().isValid());
+    TEST_ASSERT_EQUAL(1, pool->available());
+}
+
+void test_copy_keeps_the_stream()
+{
+    TianBMSJsonStreamHandle copy;
+    {
+        TianBMSJsonStreamHandle handle = pool->acquire();
+        handle->begin(*tianBMS);
+        copy = handle;
+        TianBMSJsonStreamHandle second(handle);
+        TEST_ASSERT_TRUE(second.get() == handle.get());
+    }
+    // the response callback still holds its copy after the request handler returned
+    TEST_ASSERT_EQUAL(TianBMSJsonStreamPool::CAPACITY - 1, pool->available());
+    TEST_ASSERT_FALSE(copy->isFinished());
+    readAll(copy.get());
+    TEST_ASSERT_TRUE(copy->isFinished());
+    copy = TianBMSJsonStreamHandle();
+    TEST_ASSERT_EQUAL(TianBMSJsonStreamPool::CAPACITY, pool->available());
+}
+
+void test_released_stream_is_ended()
+{
+    TianBMSJsonStream* stream;
+    {
+        TianBMSJsonStreamHandle handle = pool->acquire();
+        stream = handle.get();
+        handle->begin(*tianBMS);
+        uint8_t buffer[16];
+        handle->read(buffer, sizeof(buffer));
+    }
+    // client disconnected in the middle of the document
+    TEST_ASSERT_TRUE(stream->isFinished());
+}
+
+void test_interleaved_clients_get_whole_documents()
+{
+    TianBMSJsonStreamHandle single = pool->acquire();
+    single->begin(*tianBMS);
+    std::string reference = readAll(single.get());
+    single = TianBMSJsonStreamHandle();
+
+    const TianBMSJsonStream::Format formats[TianBMSJsonStreamPool::CAPACITY] = {
+        TianBMSJsonStream::FORMAT_FULL, TianBMSJsonStream::FORMAT_COMPACT, TianBMSJsonStream::FORMAT_FULL,
+        TianBMSJsonStream::FORMAT_FULL
+    };
+    std::vector<TianBMSJsonStreamHandle> handles;
+    std::vector<std::string> documents(TianBMSJsonStreamPool::CAPACITY);
+    for (size_t i = 0; i < TianBMSJsonStreamPool::CAPACITY; i++)
+    {
+        handles.push_back(pool->acquire());
+        handles[i]->begin(*tianBMS, formats[i]);
+    }
+    // every client reads a few bytes in turn, like the chunked responses served by the web server task
+    bool isReading = true;
+    while (isReading)
+    {
+        isReading = false;
+        for (size_t i = 0; i < handles.size(); i++)
+        {
+            uint8_t buffer[97];
+            size_t length = handles[i]->read(buffer, 13 + i * 29);
+            documents[i].append(reinterpret_cast<const char*>(buffer), length);
+            isReading = isReading || length > 0;
+        }
+    }
+    for (size_t i = 0; i < handles.size(); i++)
+    {
+        if (formats[i] == TianBMSJsonStream::FORMAT_FULL)
+        {
+            TEST_ASSERT_TRUE(reference == documents[i]);
+        }
+        else
+        {
+            TEST_ASSERT_EQUAL_STRING("{\"data\":[[", documents[i].substr(0, 10).c_str());
+            TEST_ASSERT_EQUAL_STRING("]]}", documents[i].substr(documents[i].length() - 3).c_str());
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_acquire_until_exhausted);
+    RUN_TEST(test_copy_keeps_the_stream);
+    RUN_TEST(test_released_stream_is_ended);
+    RUN_TEST(test_interleaved_clients_get_whole_documents);
+    return UNITY_END();
+}